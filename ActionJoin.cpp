@@ -0,0 +1,96 @@
+#include "ActionJoin.h"
+
+#include "LatencyTrace.h"
+
+using mocap_netop::latency_now_ns;
+
+Action_Join_Table::Action_Join_Table(std::chrono::milliseconds ttl /*= 500 ms*/)
+{
+    SetTTL(ttl);
+}
+
+void Action_Join_Table::SetTTL(std::chrono::milliseconds ttl)
+{
+    _nTTL = (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(ttl).count();
+}
+
+std::chrono::milliseconds Action_Join_Table::GetTTL() const
+{
+    return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::nanoseconds(_nTTL));
+}
+
+unsigned Action_Join_Table::Absorb(mocap_netop::Data_Repos<Data_MoCap_Send, Data_MoCap_Recv> &dataReposForServer)
+{
+    _results.clear();
+    unsigned nResult = dataReposForServer.PopAllData_RecvQueue(_results);
+
+    // in the order they came, so the last one of a frame wins
+    for(const auto &result : _results) Update(*result);
+
+    _results.clear(); // the results go back to the pool of the repos
+    return nResult;
+}
+
+void Action_Join_Table::Update(const Data_MoCap_Recv &result)
+{
+    uint64_t now = latency_now_ns();
+    Expire(now);
+
+    for(const auto &poseAction : result.actions){
+        auto ret = _actions.insert(std::make_pair(poseAction.poseID, Entry{poseAction.action, result.timestamp, now}));
+        if(ret.second) continue; // the first action of the pose
+
+        Entry &entry = ret.first->second;
+        if(result.timestamp < entry.sourceTimestamp && !IsExpired(entry, now)){ // a recognizer behind the others
+            _nStale ++;
+            continue;
+        }
+        entry = Entry{poseAction.action, result.timestamp, now};
+    }
+}
+
+unsigned Action_Join_Table::Join(Data_MoCap_Send &frame)
+{
+    uint64_t now = latency_now_ns();
+    Expire(now);
+
+    frame.actions.resize(0);
+    for(const auto &pose : frame.poses){
+        auto it = _actions.find(pose.ID);
+        if(it == _actions.end() || IsExpired(it->second, now)) continue;
+
+        Data_MoCap_Send::PoseAction poseAction;
+        poseAction.poseID = pose.ID;
+        poseAction.action = it->second.action;
+        frame.actions.push_back(poseAction);
+    }
+
+    return (unsigned)frame.actions.size();
+}
+
+bool Action_Join_Table::Find(unsigned long long poseID, int &action, uint64_t *pSourceTimestamp /*= 0*/) const
+{
+    auto it = _actions.find(poseID);
+    if(it == _actions.end() || IsExpired(it->second, latency_now_ns())) return false;
+
+    action = it->second.action;
+    if(pSourceTimestamp) *pSourceTimestamp = it->second.sourceTimestamp;
+    return true;
+}
+
+void Action_Join_Table::Clear()
+{
+    _actions.clear();
+    _nStale = 0;
+}
+
+void Action_Join_Table::Expire(uint64_t now)
+{
+    if(now - _tLastExpire < _nTTL) return;
+    _tLastExpire = now;
+
+    for(auto it = _actions.begin(); it != _actions.end(); ){
+        if(IsExpired(it->second, now)) it = _actions.erase(it);
+        else ++ it;
+    }
+}
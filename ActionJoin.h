@@ -0,0 +1,88 @@
+/*******************************************************************
+* Author	: wwyang
+* Date		: 2026.10.17
+* Copyright : Zhejiang Gongshang University
+* Head File :
+* Version   : 1.0
+*********************************************************************/
+// .NAME Action_Join_Table
+
+// .SECTION Description
+// It keeps the latest action recognized for each pose, by pose ID, for a server to join into the frames it sends.
+// The results of the recognizers (Data_MoCap_Recv) are all taken out of the receive queue of the server at once, so
+// the queue does not grow however fast they come. An action replaces the one of its pose unless it is recognized
+// from an older frame (by the timestamp of the result), and it is forgotten when no newer one has come for the TTL.
+// Joining a frame looks up each of its poses, so it takes O(poses) whatever the number of the results.
+// The table is not thread-safe: it is used by the thread producing the frames.
+
+// .SECTION See also
+// Data_MoCap_Send, Data_MoCap_Recv
+
+#ifndef ACTIONJOIN_H
+#define ACTIONJOIN_H
+
+#include <vector>
+#include <memory>
+#include <chrono>
+#include <unordered_map>
+#include <stdint.h>
+
+#include "MoCap_Data.h"
+
+class Action_Join_Table{
+public:
+    explicit Action_Join_Table(std::chrono::milliseconds ttl = std::chrono::milliseconds(500));
+
+    // Description:
+    // How long an action is kept without a newer one for its pose
+    void SetTTL(std::chrono::milliseconds ttl);
+    std::chrono::milliseconds GetTTL() const;
+
+    // Description:
+    // Take all the results out of the receive queue of a server into the table. Return the number of the results.
+    unsigned Absorb(mocap_netop::Data_Repos<Data_MoCap_Send, Data_MoCap_Recv> &dataReposForServer);
+
+    // Description:
+    // Put the actions of a result into the table. Those recognized from a frame older than the one of their pose in
+    // the table are ignored (see GetStaleCount()).
+    void Update(const Data_MoCap_Recv &result);
+
+    // Description:
+    // Fill the actions of a frame with the latest action of each of its poses, if any. Return the number of the actions.
+    unsigned Join(Data_MoCap_Send &frame);
+
+    // Description:
+    // The latest action of a pose and the timestamp of the frame it is recognized from. Return false if there is none.
+    bool Find(unsigned long long poseID, int &action, uint64_t *pSourceTimestamp = 0) const;
+
+    // Description:
+    // Number of the poses with an action, some of which may have expired since the last Absorb(), Update() or Join()
+    size_t Size() const { return _actions.size(); }
+
+    // Description:
+    // Number of the actions ignored as older than those in the table
+    uint64_t GetStaleCount() const { return _nStale; }
+
+    void Clear();
+
+private:
+    struct Entry{
+        int action;
+        uint64_t sourceTimestamp; // timestamp of the frame it is recognized from
+        uint64_t tUpdate; // when it came, on the monotonic clock in nanoseconds
+    };
+
+    bool IsExpired(const Entry &entry, uint64_t now) const { return now - entry.tUpdate > _nTTL; }
+
+    // Forget the expired actions, at most once in a TTL so the cost is spread over the calls
+    void Expire(uint64_t now);
+
+private:
+    std::unordered_map<unsigned long long, Entry> _actions; // latest action of each pose
+    std::vector< std::shared_ptr<Data_MoCap_Recv> > _results; // reused by Absorb()
+    uint64_t _nTTL; // in nanoseconds
+    uint64_t _tLastExpire = 0;
+    uint64_t _nStale = 0;
+};
+
+#endif // ACTIONJOIN_H
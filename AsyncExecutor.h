@@ -0,0 +1,316 @@
+/*******************************************************************
+* Author	: wwyang
+* Date		: 2026.10.17
+* Copyright : Zhejiang Gongshang University
+* Head File :
+* Version   : 1.0
+*********************************************************************/
+// .NAME Async_Executor/Async_Reader
+
+// .SECTION Description
+// Here provides the asynchronous reading of the data repos, so that many consumers of the data (e.g., the pipelines of
+// recognizers or renderers, each on its own client) run on one thread instead of a thread blocked on each repos.
+// An Async_Executor runs the tasks posted to it, at once or after a delay, on the threads calling Run() (or Poll()
+// from another loop). An Async_Reader hands the data of the receive queue of a repos to the handlers given to Next(),
+// on the executor, as they arrive: a consumer asks for the next data in the handler of the last one, and nothing runs
+// for it until a data is there. The reader is woken by the notifier of the receive queue, so it does not poll.
+// Sending needs no waiting: the send queue of a repos takes the data at once (PushData_SendQueue), from the handlers
+// as well.
+// For a client:
+//     Async_Reader<Data_MoCap_Recv, Data_MoCap_Send> reader(client.GetClientDataRepos(), executor,
+//                                                          [&client]{ return client.IsWorking(); });
+//     reader.Next(onFrame); // onFrame(frame) handles the frame and calls reader.Next(onFrame) again
+//     executor.Run();
+// The frame is an empty pointer once the client stops working (or Cancel() is called), and the consumer finishes then.
+
+// .SECTION See also
+// Data_Repos, CMoCapTCPClient
+
+#ifndef ASYNCEXECUTOR_H
+#define ASYNCEXECUTOR_H
+
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <algorithm>
+#include <chrono>
+#include <stdint.h>
+
+#include "NetOp.h"
+
+namespace mocap_netop {
+
+    class Async_Executor{
+    public:
+        typedef std::function<void()> Task;
+
+        Async_Executor() = default;
+        Async_Executor(const Async_Executor&) = delete;
+        Async_Executor& operator=(const Async_Executor&) = delete;
+
+        // Description:
+        // Run a task on the executor, after those posted before it. It may be called by any threads.
+        void Post(const Task &task)
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+
+            _tasks.push(task);
+
+            lock.unlock();
+
+            _cv.notify_one();
+        }
+
+        // Description:
+        // Run a task on the executor once the delay has passed, e.g., for a timeout or a periodic job
+        void PostAfter(std::chrono::milliseconds delay, const Task &task)
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+
+            _timers.push_back(Timer{std::chrono::steady_clock::now() + delay, _nTimer ++, task});
+            std::push_heap(_timers.begin(), _timers.end(), Timer_Later());
+
+            lock.unlock();
+
+            _cv.notify_one(); // it may be due before the one waited for
+        }
+
+        // Description:
+        // Run the tasks on the calling thread until Stop() is called, sleeping when there is none. Return the number
+        // of the tasks run.
+        uint64_t Run()
+        {
+            uint64_t nTask = 0;
+            Task task;
+            while(Take(task, true)){
+                task();
+                task = nullptr; // what it holds goes before the executor sleeps
+                nTask ++;
+            }
+            return nTask;
+        }
+
+        // Description:
+        // Run the tasks that are ready, without sleeping, e.g., from the loop of a thread that has other work.
+        // Return the number of the tasks run.
+        uint64_t Poll()
+        {
+            uint64_t nTask = 0;
+            Task task;
+            while(Take(task, false)){
+                task();
+                task = nullptr;
+                nTask ++;
+            }
+            return nTask;
+        }
+
+        // Description:
+        // Make Run() return after the task it is running, on all the threads. The tasks left wait for Restart().
+        void Stop()
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+
+            _bStopped = true;
+
+            lock.unlock();
+
+            _cv.notify_all();
+        }
+        void Restart()
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+
+            _bStopped = false;
+        }
+        bool IsStopped()
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+
+            return _bStopped;
+        }
+
+        // Description:
+        // Number of the tasks waiting to run, with the delayed ones
+        size_t GetPendingCount()
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+
+            return _tasks.size() + _timers.size();
+        }
+
+    private:
+        struct Timer{
+            std::chrono::steady_clock::time_point tDue;
+            uint64_t nOrder; // of the timers due at the same time, the one posted first runs first
+            Task task;
+        };
+        struct Timer_Later{ // the heap keeps the earliest timer at the front
+            bool operator()(const Timer &a, const Timer &b) const
+            {
+                return a.tDue != b.tDue ? a.tDue > b.tDue : a.nOrder > b.nOrder;
+            }
+        };
+
+        // The next task to run: the timers that are due go after the tasks already posted. Return false if stopped, or
+        // if there is no task and it should not wait.
+        bool Take(Task &task, bool bWait)
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+
+            for(;;){
+                if(_bStopped) return false;
+
+                auto now = std::chrono::steady_clock::now();
+                while(!_timers.empty() && _timers.front().tDue <= now){
+                    std::pop_heap(_timers.begin(), _timers.end(), Timer_Later());
+                    _tasks.push(_timers.back().task);
+                    _timers.pop_back();
+                }
+
+                if(!_tasks.empty()){
+                    task = _tasks.front();
+                    _tasks.pop();
+                    return true;
+                }
+
+                if(!bWait) return false;
+
+                if(_timers.empty()) _cv.wait(lock);
+                else _cv.wait_until(lock, _timers.front().tDue);
+            }
+        }
+
+    private:
+        std::mutex _mutex;
+        std::condition_variable _cv; // signaled when a task is posted or the executor is stopped
+        Ring_Queue<Task> _tasks; // ready to run, in order
+        std::vector<Timer> _timers; // the delayed tasks, in a heap by the time they are due
+        uint64_t _nTimer = 0;
+        bool _bStopped = false;
+    };
+
+    template<class DataType_Send, class DataType_Recv>
+    class Async_Reader{
+    public:
+        typedef std::function<void(const std::shared_ptr<DataType_Recv>&)> Handler;
+
+        // Description:
+        // Read the receive queue of the repos on the executor. The source is closed when isOpen returns false (e.g.,
+        // the client is not working any more); it is checked when the repos wakes up its waiters. A repos has one
+        // reader at most, for its notifier is taken by the reader.
+        Async_Reader(Data_Repos<DataType_Send, DataType_Recv> &repos, Async_Executor &executor,
+                     const std::function<bool()> &isOpen = nullptr)
+            : _state(std::make_shared<State>(repos, executor, isOpen))
+        {
+            std::shared_ptr<State> state = _state;
+            repos.SetNotifier_RecvQueue([state]{ state->Schedule(); });
+        }
+        Async_Reader(const Async_Reader&) = delete;
+        Async_Reader& operator=(const Async_Reader&) = delete;
+
+        // The handlers not called yet are dropped. The repos should live until the executor has run the tasks of the
+        // reader posted before.
+        ~Async_Reader()
+        {
+            _state->repos.SetNotifier_RecvQueue(nullptr);
+
+            Ring_Queue<Handler> handlers;
+            std::unique_lock<std::mutex> lock(_state->mutex);
+            std::swap(handlers, _state->handlers);
+        }
+
+        // Description:
+        // Call the handler on the executor with the next data of the receive queue, once there is one, or with an
+        // empty pointer if the source is closed. The handlers are called in the order they are given, a data each.
+        // It may be called by any threads, and by a handler for the data after its own.
+        void Next(const Handler &handler)
+        {
+            {
+                std::unique_lock<std::mutex> lock(_state->mutex);
+                _state->handlers.push(handler);
+            }
+            _state->Schedule();
+        }
+
+        // Description:
+        // Call the handlers waiting for data with an empty pointer, e.g., to finish the consumers before the
+        // executor stops. The data in the queue are left for the next handlers.
+        void Cancel()
+        {
+            Ring_Queue<Handler> handlers;
+            {
+                std::unique_lock<std::mutex> lock(_state->mutex);
+                std::swap(handlers, _state->handlers);
+            }
+
+            for(; !handlers.empty(); handlers.pop()){
+                Handler handler = handlers.front();
+                _state->executor.Post([handler]{ handler(std::shared_ptr<DataType_Recv>()); });
+            }
+        }
+
+        // Description:
+        // Number of the handlers waiting for data
+        size_t GetWaitingCount()
+        {
+            std::unique_lock<std::mutex> lock(_state->mutex);
+            return _state->handlers.size();
+        }
+
+    private:
+        // Shared with the notifier and the tasks posted, which may outlive the reader
+        struct State : std::enable_shared_from_this<State>{
+            State(Data_Repos<DataType_Send, DataType_Recv> &repos, Async_Executor &executor, const std::function<bool()> &isOpen)
+                : repos(repos), executor(executor), isOpen(isOpen) {}
+
+            // Post a Drain() unless one is waiting to run: a burst of data costs one task
+            void Schedule()
+            {
+                if(bScheduled.exchange(true)) return;
+
+                std::shared_ptr<State> self = this->shared_from_this();
+                executor.Post([self]{ self->Drain(); });
+            }
+
+            // Give the data to the handlers, as many as there are of both
+            void Drain()
+            {
+                bScheduled = false; // a data pushed from now on schedules the next one
+
+                for(;;){
+                    Handler handler;
+                    std::shared_ptr<DataType_Recv> data;
+                    {
+                        std::unique_lock<std::mutex> lock(mutex);
+                        if(handlers.empty()) return;
+
+                        data = repos.PopData_RecvQueue();
+                        if(!data && (!isOpen || isOpen())) return; // until the next data
+
+                        handler = handlers.front();
+                        handlers.pop();
+                    }
+                    handler(data); // empty if the source is closed
+                }
+            }
+
+            Data_Repos<DataType_Send, DataType_Recv> &repos;
+            Async_Executor &executor;
+            const std::function<bool()> isOpen;
+
+            std::mutex mutex;
+            Ring_Queue<Handler> handlers; // waiting for data, in order
+            std::atomic_bool bScheduled{false};
+        };
+
+    private:
+        std::shared_ptr<State> _state;
+    };
+
+} // namespace: mocap_netop
+
+#endif // ASYNCEXECUTOR_H
@@ -0,0 +1,249 @@
+/*******************************************************************
+* Author	: wwyang
+* Date		: 2026.10.17
+* Copyright : Zhejiang Gongshang University
+* Head File :
+* Version   : 1.0
+*********************************************************************/
+// .NAME Clock_Estimate/Clock_Offset_Estimator/Clock_Ping/Clock_Pong
+
+// .SECTION Description
+// Here provides the estimation of the monotonic clock of the other side of a connection, so that a time stamped
+// there (e.g., the sendTime of a frame) is turned into the local clock, and the one-way latency is measured across
+// hosts. A client sends a "ping" with its send time t0; the server answers with a "pong" holding t0, the time t1 it
+// got the ping and the time t2 it sent the pong; the client gets it at t3. As in NTP, the exchange tells the offset of
+// the clock of the server, ((t1 - t0) + (t2 - t3)) / 2, off by half of the round trip (t3 - t0) - (t2 - t1) at most,
+// which is why the offset is taken from the exchange with the shortest round trip of the last few. The drift of the
+// clocks (the rates differ by some ppm) is the slope of those offsets over time, by least squares, and the offset in
+// between is extrapolated with it.
+// A ping also holds the estimate of its sender, so the other side knows it as well without pinging.
+
+// .SECTION See also
+// CMoCapTCPClient, CMoCapTCPServer, Latency_Tracer
+
+#ifndef CLOCKSYNC_H
+#define CLOCKSYNC_H
+
+#include <vector>
+#include <mutex>
+#include <string.h>
+#include <stdint.h>
+
+namespace mocap_netop {
+
+    // The clock of the other side relative to the local one, both in nanoseconds
+    struct Clock_Estimate{
+        bool bValid = false;
+        int64_t offset = 0; // the remote clock minus the local one, at tLocal
+        uint64_t tLocal = 0; // on the local clock
+        double drift = 0; // change of the offset per nanosecond of the local clock, e.g. 1e-6 for 1 ppm
+        uint64_t delay = 0; // round trip of the exchange the offset is from; the offset is off by half of it at most
+        unsigned nSample = 0; // exchanges taken
+
+        int64_t OffsetAt(uint64_t tLocalNow) const
+        {
+            return offset + (int64_t)(drift * ((double)tLocalNow - (double)tLocal));
+        }
+
+        // Description:
+        // A time of the remote clock on the local one, e.g., when a message was sent from there
+        uint64_t ToLocal(uint64_t tRemote) const
+        {
+            if(!bValid) return tRemote;
+            return tRemote - OffsetAt(tRemote - offset);
+        }
+        uint64_t ToRemote(uint64_t tLocalNow) const
+        {
+            if(!bValid) return tLocalNow;
+            return tLocalNow + OffsetAt(tLocalNow);
+        }
+
+        // Description:
+        // The same estimate seen from the other side: the local clock relative to the remote one
+        Clock_Estimate Inverse() const
+        {
+            Clock_Estimate inverse = *this;
+            inverse.offset = -offset;
+            inverse.tLocal = tLocal + offset;
+            inverse.drift = -drift / (1 + drift);
+            return inverse;
+        }
+    };
+
+    // The entity of a "ping": (time it is sent: ulong long, 8 bytes); the estimate of the sender: (valid: uint, 4 bytes);
+    // (samples: uint, 4 bytes); (offset: long long, 8 bytes); (its local time: ulong long, 8 bytes); (drift: double,
+    // 8 bytes); (delay: ulong long, 8 bytes)
+    struct Clock_Ping{
+        static const size_t WIRE_SIZE = 48;
+
+        uint64_t tSend = 0;
+        Clock_Estimate estimate;
+
+        void Encode(char *pDst) const
+        {
+            uint32_t nValid = estimate.bValid ? 1 : 0, nSample = estimate.nSample;
+            memcpy(pDst, &tSend, 8);
+            memcpy(pDst + 8, &nValid, 4);
+            memcpy(pDst + 12, &nSample, 4);
+            memcpy(pDst + 16, &estimate.offset, 8);
+            memcpy(pDst + 24, &estimate.tLocal, 8);
+            memcpy(pDst + 32, &estimate.drift, 8);
+            memcpy(pDst + 40, &estimate.delay, 8);
+        }
+
+        // Description:
+        // Return false if the entity is not a ping
+        bool Decode(const char *pSrc, size_t nSize)
+        {
+            if(nSize != WIRE_SIZE) return false;
+
+            uint32_t nValid, nSample;
+            memcpy(&tSend, pSrc, 8);
+            memcpy(&nValid, pSrc + 8, 4);
+            memcpy(&nSample, pSrc + 12, 4);
+            memcpy(&estimate.offset, pSrc + 16, 8);
+            memcpy(&estimate.tLocal, pSrc + 24, 8);
+            memcpy(&estimate.drift, pSrc + 32, 8);
+            memcpy(&estimate.delay, pSrc + 40, 8);
+            estimate.bValid = nValid != 0;
+            estimate.nSample = nSample;
+            return true;
+        }
+    };
+
+    // The entity of a "pong": (tSend of the ping: ulong long, 8 bytes); (time the ping is received: ulong long, 8 bytes);
+    // (time the pong is sent: ulong long, 8 bytes)
+    struct Clock_Pong{
+        static const size_t WIRE_SIZE = 24;
+
+        uint64_t tPing = 0, tReceive = 0, tSend = 0;
+
+        void Encode(char *pDst) const
+        {
+            memcpy(pDst, &tPing, 8);
+            memcpy(pDst + 8, &tReceive, 8);
+            memcpy(pDst + 16, &tSend, 8);
+        }
+
+        bool Decode(const char *pSrc, size_t nSize)
+        {
+            if(nSize != WIRE_SIZE) return false;
+
+            memcpy(&tPing, pSrc, 8);
+            memcpy(&tReceive, pSrc + 8, 8);
+            memcpy(&tSend, pSrc + 16, 8);
+            return true;
+        }
+    };
+
+    class Clock_Offset_Estimator{
+    public:
+        // Description:
+        // The offset is taken from the shortest round trip of the last nFilter exchanges, and the drift is fitted to
+        // the last nDriftPoint offsets taken
+        explicit Clock_Offset_Estimator(unsigned nFilter = 8, unsigned nDriftPoint = 16)
+            : _nFilter(nFilter > 0 ? nFilter : 1), _nDriftPoint(nDriftPoint > 1 ? nDriftPoint : 2) {}
+
+        // Description:
+        // Take an exchange: t0 and t3 on the local clock, t1 and t2 on the remote one. Return false if it makes no sense
+        // (e.g., a reply that took less time than the other side held it). It may be called by any threads.
+        bool AddSample(uint64_t t0, uint64_t t1, uint64_t t2, uint64_t t3)
+        {
+            if(t3 < t0 || t2 < t1 || t3 - t0 < t2 - t1) return false;
+
+            Sample sample;
+            sample.offset = ((int64_t)(t1 - t0) + (int64_t)(t2 - t3)) / 2;
+            sample.delay = (t3 - t0) - (t2 - t1);
+            sample.tLocal = t0 + (t3 - t0) / 2;
+
+            std::unique_lock<std::mutex> lock(_mutex);
+
+            if(_samples.size() < _nFilter) _samples.push_back(sample);
+            else _samples[_nSample % _nFilter] = sample;
+            _nSample ++;
+
+            // the clock filter: the shortest round trip is the least off, unless it is so old that the clocks may have
+            // drifted apart more since (by 15 ppm at most, as NTP takes it)
+            const double maxDrift = 15e-6;
+            const Sample *pBest = 0;
+            double bestScore = 0;
+            for(const Sample &s : _samples){
+                double score = s.delay / 2.0 + maxDrift * (double)(sample.tLocal - s.tLocal);
+                if(pBest == 0 || score < bestScore){
+                    pBest = &s;
+                    bestScore = score;
+                }
+            }
+
+            if(_points.empty() || _points[(_nPoint - 1) % _nDriftPoint].tLocal != pBest->tLocal){
+                if(_points.size() < _nDriftPoint) _points.push_back(*pBest);
+                else _points[_nPoint % _nDriftPoint] = *pBest;
+                _nPoint ++;
+            }
+
+            _estimate.bValid = true;
+            _estimate.offset = pBest->offset;
+            _estimate.tLocal = pBest->tLocal;
+            _estimate.delay = pBest->delay;
+            _estimate.drift = FitDrift();
+            _estimate.nSample = (unsigned)_nSample;
+            return true;
+        }
+
+        Clock_Estimate GetEstimate() const
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+
+            return _estimate;
+        }
+
+        void Reset()
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+
+            _samples.clear();
+            _points.clear();
+            _nSample = _nPoint = 0;
+            _estimate = Clock_Estimate();
+        }
+
+    private:
+        struct Sample{
+            int64_t offset;
+            uint64_t delay;
+            uint64_t tLocal; // the middle of the exchange
+        };
+
+        // The slope of the offsets over the local time, 0 until they span a while. It is called under the lock.
+        double FitDrift() const
+        {
+            if(_points.size() < 3) return 0;
+
+            // relative to a point, so the numbers stay small for the doubles
+            const Sample &origin = _points[0];
+            double sumT = 0, sumO = 0, sumTT = 0, sumTO = 0, tMin = 0, tMax = 0;
+            for(const Sample &p : _points){
+                double t = (double)(int64_t)(p.tLocal - origin.tLocal), o = (double)(p.offset - origin.offset);
+                sumT += t; sumO += o; sumTT += t * t; sumTO += t * o;
+                if(t < tMin) tMin = t;
+                if(t > tMax) tMax = t;
+            }
+            if(tMax - tMin < 1e9) return 0; // a second at least, or the jitter is taken for the drift
+
+            double n = (double)_points.size(), det = n * sumTT - sumT * sumT;
+            return det > 0 ? (n * sumTO - sumT * sumO) / det : 0;
+        }
+
+    private:
+        const unsigned _nFilter, _nDriftPoint;
+
+        mutable std::mutex _mutex;
+        std::vector<Sample> _samples; // the last exchanges, in a ring
+        std::vector<Sample> _points; // the last offsets taken by the filter, in a ring
+        uint64_t _nSample = 0, _nPoint = 0;
+        Clock_Estimate _estimate;
+    };
+
+} // namespace: mocap_netop
+
+#endif // CLOCKSYNC_H
@@ -0,0 +1,224 @@
+/*******************************************************************
+* Author	: wwyang
+* Date		: 2026.10.17
+* Copyright : Zhejiang Gongshang University
+* Head File :
+* Version   : 1.0
+*********************************************************************/
+// .NAME Connection_Handle/Connection_Table/Snapshot_Publisher
+
+// .SECTION Description
+// Here provides the registry of the client connections of a server. A connection lives in a slot of the table and is
+// known by a handle: the index of its slot and the generation of the slot, which goes up each time the slot is freed.
+// A handle kept after its connection is gone (e.g., by an event that comes late, or a socket number reused by the
+// system) does not find the next connection in the slot. The free slots are kept in a list, so adding and removing
+// a connection take a constant time, and the slots are only created as the number of the connections grows.
+// The capacity limits the connections in the table and may be changed at any time; lowering it does not remove any
+// connection, the new ones are refused until there are fewer than the capacity. The table is not thread-safe.
+// A Snapshot_Publisher hands a read-only copy of the connections to the threads that use them on every message
+// (RCU style): the writers build a new copy under their own lock when a connection comes or goes and swap it in,
+// and a reader keeps the copy it has until it sees a newer version, so it takes no lock. An old copy, and the
+// connections it holds, live on until the last reader lets it go.
+
+// .SECTION See also
+// CMoCapTCPServer
+
+#ifndef CONNECTIONTABLE_H
+#define CONNECTIONTABLE_H
+
+#include <deque>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <utility>
+#include <stdint.h>
+
+namespace mocap_netop {
+
+    struct Connection_Handle{
+        uint32_t iSlot = 0;
+        uint32_t nGeneration = 0; // 0 for no connection; a slot in use has an odd generation
+
+        bool IsValid() const { return nGeneration != 0; }
+
+        // Description:
+        // The handle as a number, e.g., for the data of an epoll event; 0 for no connection
+        uint64_t ToId() const { return ((uint64_t)nGeneration << 32) | iSlot; }
+        static Connection_Handle FromId(uint64_t id)
+        {
+            Connection_Handle handle;
+            handle.iSlot = (uint32_t)id;
+            handle.nGeneration = (uint32_t)(id >> 32);
+            return handle;
+        }
+
+        bool operator==(const Connection_Handle &other) const { return iSlot == other.iSlot && nGeneration == other.nGeneration; }
+        bool operator!=(const Connection_Handle &other) const { return !(*this == other); }
+    };
+
+    template<class Entry>
+    class Connection_Table{
+    public:
+        explicit Connection_Table(unsigned nCapacity = 5) : _nCapacity(nCapacity) {}
+
+        // Description:
+        // Put a connection into a free slot. Return an invalid handle if the table is at its capacity.
+        // The entry stays at the same address until it is removed.
+        Connection_Handle Add(Entry &&entry)
+        {
+            if(_nSize >= _nCapacity) return Connection_Handle();
+
+            uint32_t iSlot;
+            if(!_freeSlots.empty()){
+                iSlot = _freeSlots.back();
+                _freeSlots.pop_back();
+            }
+            else{
+                iSlot = (uint32_t)_slots.size();
+                _slots.emplace_back();
+            }
+
+            Slot &slot = _slots[iSlot];
+            slot.nGeneration ++; // odd: in use
+            slot.entry = std::move(entry);
+            _nSize ++;
+
+            Connection_Handle handle;
+            handle.iSlot = iSlot;
+            handle.nGeneration = slot.nGeneration;
+            return handle;
+        }
+
+        // Description:
+        // Free the slot of a connection. Return false if the handle is stale.
+        bool Remove(Connection_Handle handle)
+        {
+            Entry *pEntry = Get(handle);
+            if(pEntry == 0) return false;
+
+            Slot &slot = _slots[handle.iSlot];
+            slot.entry = Entry();
+            slot.nGeneration ++; // even: free, and the handles of the last connection are stale
+            if(slot.nGeneration == 0) slot.nGeneration = 2; // after wrapping around, 0 still means no connection
+            _freeSlots.push_back(handle.iSlot);
+            _nSize --;
+            return true;
+        }
+
+        // Description:
+        // The connection of a handle, or 0 if it is gone
+        Entry* Get(Connection_Handle handle)
+        {
+            if(handle.iSlot >= _slots.size() || (handle.nGeneration & 1) == 0) return 0;
+
+            Slot &slot = _slots[handle.iSlot];
+            return slot.nGeneration == handle.nGeneration ? &slot.entry : 0;
+        }
+
+        // Description:
+        // The handle of the connection in a slot, invalid if the slot is free
+        Connection_Handle GetHandle(uint32_t iSlot) const
+        {
+            Connection_Handle handle;
+            if(iSlot < _slots.size() && (_slots[iSlot].nGeneration & 1) != 0){
+                handle.iSlot = iSlot;
+                handle.nGeneration = _slots[iSlot].nGeneration;
+            }
+            return handle;
+        }
+
+        // Description:
+        // Call fn(handle, entry) for each connection. fn should not add or remove connections.
+        template<class Fn>
+        void ForEach(Fn fn)
+        {
+            for(uint32_t i = 0; i < _slots.size(); i ++){
+                if((_slots[i].nGeneration & 1) == 0) continue;
+
+                Connection_Handle handle;
+                handle.iSlot = i;
+                handle.nGeneration = _slots[i].nGeneration;
+                fn(handle, _slots[i].entry);
+            }
+        }
+
+        // Description:
+        // The handles of all the connections, e.g., to remove them
+        std::vector<Connection_Handle> GetHandles() const
+        {
+            std::vector<Connection_Handle> handles;
+            for(uint32_t i = 0; i < _slots.size(); i ++){
+                Connection_Handle handle = GetHandle(i);
+                if(handle.IsValid()) handles.push_back(handle);
+            }
+            return handles;
+        }
+
+        void SetCapacity(unsigned nCapacity) { _nCapacity = nCapacity; }
+        unsigned GetCapacity() const { return _nCapacity; }
+        bool IsFull() const { return _nSize >= _nCapacity; }
+
+        // Description:
+        // Number of the connections, and of the slots created for them so far
+        unsigned Size() const { return _nSize; }
+        unsigned GetSlotCount() const { return (unsigned)_slots.size(); }
+
+        // Description:
+        // Remove all the connections. The slots are kept, so the old handles stay stale.
+        void Clear()
+        {
+            for(Connection_Handle handle : GetHandles()) Remove(handle);
+        }
+
+    private:
+        struct Slot{
+            uint32_t nGeneration = 0;
+            Entry entry;
+        };
+
+        std::deque<Slot> _slots; // a deque keeps the entries in place as it grows
+        std::vector<uint32_t> _freeSlots; // free slots, the last freed on the back
+        unsigned _nSize = 0;
+        unsigned _nCapacity;
+    };
+
+    template<class Snapshot>
+    class Snapshot_Publisher{
+    public:
+        Snapshot_Publisher() : _pSnapshot(std::make_shared<Snapshot>()), _nVersion(1) {}
+        Snapshot_Publisher(const Snapshot_Publisher&) = delete;
+        Snapshot_Publisher& operator=(const Snapshot_Publisher&) = delete;
+
+        // Description:
+        // Swap in a new snapshot. The writers should take turns, e.g., under a mutex.
+        void Publish(std::shared_ptr<const Snapshot> pSnapshot)
+        {
+            std::atomic_store(&_pSnapshot, pSnapshot);
+            _nVersion.fetch_add(1, std::memory_order_release); // after the store, so a reader seeing it gets the new one
+        }
+
+        // Description:
+        // The latest snapshot
+        std::shared_ptr<const Snapshot> Get() const { return std::atomic_load(&_pSnapshot); }
+
+        // Description:
+        // Bring the copy of a reader up to date, with the version it was taken at (0 for none). Unless a new snapshot has
+        // been published since, it only reads the version. Return true if the copy changed.
+        bool Refresh(std::shared_ptr<const Snapshot> &pSnapshot, uint64_t &nVersion) const
+        {
+            uint64_t nLatest = _nVersion.load(std::memory_order_acquire);
+            if(pSnapshot && nLatest == nVersion) return false;
+
+            pSnapshot = Get();
+            nVersion = nLatest;
+            return true;
+        }
+
+    private:
+        std::shared_ptr<const Snapshot> _pSnapshot; // only accessed by the atomic functions of shared_ptr
+        std::atomic<uint64_t> _nVersion;
+    };
+
+} // namespace: mocap_netop
+
+#endif // CONNECTIONTABLE_H
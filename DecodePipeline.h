@@ -0,0 +1,223 @@
+/*******************************************************************
+* Author	: wwyang
+* Date		: 2026.10.17
+* Copyright : Zhejiang Gongshang University
+* Head File :
+* Version   : 1.0
+*********************************************************************/
+// .NAME Decode_Pipeline
+
+// .SECTION Description
+// Here provides the decoding of the messages received by a client on a few worker threads, so that the thread reading
+// the socket only assembles the messages and goes back to the socket at once, however long a frame takes to decode.
+// A message is copied into a job (recycled by a pool) with a sequence number, and a worker runs the receive callback
+// of the client on it into a repos of its own. The data decoded are then pushed into the repos of the client in the
+// order of the sequence numbers, by the worker finishing the next job in order, so the consumers see the frames in the
+// order they came. At most a number of jobs are in flight; the reading thread waits for the oldest one past that,
+// which holds the memory in the pipeline and leaves the rest to the socket buffer.
+// With several workers, the callback must not keep a state from a frame to the next (the compact codec does, by the
+// repos it is given), since the frames are decoded by different workers at the same time into different repos. Such
+// a callback takes a single worker, which decodes all the frames in order into the same repos.
+
+// .SECTION See also
+// CMoCapTCPClient, Data_Repos
+
+#ifndef DECODEPIPELINE_H
+#define DECODEPIPELINE_H
+
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <algorithm>
+#include <stdint.h>
+
+#include "NetOp.h"
+#include "LatencyTrace.h"
+
+namespace mocap_netop {
+
+    template<class DataType_Send, class DataType_Recv>
+    class Decode_Pipeline{
+    public:
+        typedef void (*Decode_Callback)(Data_Buffer*, Data_Repos<DataType_Send, DataType_Recv>&);
+
+        Decode_Pipeline() = default;
+        Decode_Pipeline(const Decode_Pipeline&) = delete;
+        Decode_Pipeline& operator=(const Decode_Pipeline&) = delete;
+
+        ~Decode_Pipeline() { Stop(); }
+
+        // Description:
+        // Start the workers decoding the messages with the callback into the repos, with at most maxInFlight messages
+        // submitted and not pushed into the repos yet (at least one for each worker). The Decode stage of the tracer,
+        // if given, is from the submission of a message to the end of its decoding.
+        bool Start(unsigned nThread, unsigned maxInFlight, Decode_Callback pCallback,
+                   Data_Repos<DataType_Send, DataType_Recv> &repos, Latency_Tracer *pTracer = 0)
+        {
+            Stop();
+            if(nThread == 0 || pCallback == 0) return false;
+
+            _pCallback = pCallback;
+            _pRepos = &repos;
+            _pTracer = pTracer;
+            _maxInFlight = std::max(maxInFlight, nThread);
+            _doneJobs.assign(_maxInFlight, std::shared_ptr<Decode_Job>());
+            _nSubmitted = _nDelivered = 0;
+            _bStopping = false;
+
+            for(unsigned i = 0; i < nThread; i ++)
+                _threads.push_back(std::thread(&Decode_Pipeline::DoDecode, this));
+            return true;
+        }
+
+        // Description:
+        // Stop the workers. The messages not decoded yet are dropped.
+        void Stop()
+        {
+            if(_threads.empty()) return;
+
+            {
+                std::unique_lock<std::mutex> lock(_mutex);
+                _bStopping = true;
+            }
+            _cvJob.notify_all();
+            _cvDelivered.notify_all();
+
+            for(auto &thread : _threads) thread.join();
+            _threads.clear();
+
+            while(!_jobs.empty()) _jobs.pop();
+            _doneJobs.clear();
+        }
+
+        bool IsRunning() const { return !_threads.empty(); }
+        unsigned GetThreadCount() const { return (unsigned)_threads.size(); }
+        unsigned GetMaxInFlight() const { return _maxInFlight; }
+
+        // Description:
+        // Copy a message to be decoded by a worker. It waits while maxInFlight messages are in flight.
+        // Return false if the pipeline is stopping.
+        bool Submit(const Data_Buffer &msg)
+        {
+            std::shared_ptr<Decode_Job> job = _jobPool.Acquire();
+            job->header = msg.dataHeader;
+            const char *pData = (const char*)msg.pData;
+            job->entity.assign(pData, pData + msg.dataHeader.nDataSize); // the capacity of a recycled job is kept
+            job->tSubmit = _pTracer ? _pTracer->Stamp() : 0;
+
+            std::unique_lock<std::mutex> lock(_mutex);
+
+            _cvDelivered.wait(lock, [this]{ return _bStopping || _nSubmitted - _nDelivered < _maxInFlight; });
+            if(_bStopping) return false;
+
+            job->nSequence = _nSubmitted ++;
+            _jobs.push(job);
+
+            lock.unlock();
+
+            _cvJob.notify_one();
+            return true;
+        }
+
+        // Description:
+        // Wait until all the messages submitted are decoded and pushed into the repos, e.g., before the consumers are
+        // told that no more will come
+        void Flush()
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+
+            _cvDelivered.wait(lock, [this]{ return _bStopping || _nDelivered == _nSubmitted; });
+        }
+
+        // Description:
+        // Number of the messages decoded and handed to the repos
+        uint64_t GetDeliveredCount()
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+
+            return _nDelivered;
+        }
+
+    private:
+        struct Decode_Job{
+            Data_Header header;
+            std::vector<char> entity;
+            uint64_t nSequence = 0;
+            uint64_t tSubmit = 0;
+            std::vector< std::shared_ptr<DataType_Recv> > results; // what the callback has pushed, in order
+        };
+
+        void DoDecode()
+        {
+            Data_Repos<DataType_Send, DataType_Recv> staging; // the callback pushes its data here; they may outlive it
+
+            for(;;){
+                std::shared_ptr<Decode_Job> job;
+                {
+                    std::unique_lock<std::mutex> lock(_mutex);
+
+                    _cvJob.wait(lock, [this]{ return _bStopping || !_jobs.empty(); });
+                    if(_bStopping) return;
+
+                    job = _jobs.front();
+                    _jobs.pop();
+                }
+
+                // 1. decode, at the same time as the other workers
+                Data_Buffer data;
+                data.dataHeader = job->header;
+                data.pData = job->entity.data();
+                _pCallback(&data, staging);
+
+                job->results.clear();
+                staging.PopAllData_RecvQueue(job->results);
+                if(_pTracer) _pTracer->Record(Latency_Stage::Decode, job->tSubmit, _pTracer->Stamp());
+
+                // 2. hand over the jobs done in order: this one, and the ones after it waiting for it
+                std::unique_lock<std::mutex> lock(_mutex);
+
+                _doneJobs[job->nSequence % _maxInFlight] = job; // the slot is free: fewer than maxInFlight are in flight
+                job.reset();
+
+                bool bDelivered = false;
+                for(;;){
+                    std::shared_ptr<Decode_Job> &next = _doneJobs[_nDelivered % _maxInFlight];
+                    if(!next || next->nSequence != _nDelivered) break;
+
+                    for(const auto &result : next->results) _pRepos->PushData_RecvQueue(result);
+                    next->results.clear();
+                    next.reset(); // back to the pool
+
+                    _nDelivered ++;
+                    bDelivered = true;
+                }
+
+                lock.unlock();
+
+                if(bDelivered) _cvDelivered.notify_all();
+            }
+        }
+
+    private:
+        Decode_Callback _pCallback = 0;
+        Data_Repos<DataType_Send, DataType_Recv> *_pRepos = 0;
+        Latency_Tracer *_pTracer = 0;
+        unsigned _maxInFlight = 0;
+
+        std::vector<std::thread> _threads;
+        Data_Pool<Decode_Job> _jobPool;
+
+        std::mutex _mutex;
+        std::condition_variable _cvJob; // signaled when a job is submitted or the pipeline is stopping
+        std::condition_variable _cvDelivered; // signaled when jobs are handed over or the pipeline is stopping
+        Ring_Queue< std::shared_ptr<Decode_Job> > _jobs; // waiting for a worker, in order
+        std::vector< std::shared_ptr<Decode_Job> > _doneJobs; // decoded and waiting for the ones before, by sequence
+        uint64_t _nSubmitted = 0, _nDelivered = 0; // sequence numbers of the next job submitted and handed over
+        bool _bStopping = false;
+    };
+
+} // namespace: mocap_netop
+
+#endif // DECODEPIPELINE_H
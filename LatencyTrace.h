@@ -0,0 +1,235 @@
+/*******************************************************************
+* Author	: wwyang
+* Date		: 2026.10.17
+* Copyright : Zhejiang Gongshang University
+* Head File :
+* Version   : 1.0
+*********************************************************************/
+// .NAME Latency_Histogram/Latency_Tracer
+
+// .SECTION Description
+// Here provides the tracing of where the latency of a message goes between the producer on one side and the consumer
+// on the other. The time is stamped with the monotonic clock at the boundaries of the stages, and each stage has a
+// histogram of its durations:
+//     SendQueue : PushData_SendQueue() -> PopData_SendQueue() in the send callback, waiting in the repos
+//     Serialize : the send callback is called -> the entity is sealed for the sockets
+//     Transport : sealed, when the time is put into the Data_Header -> recv() gets the message on the other side
+//     Decode    : the receive callback is called (or the message is handed to the decode workers) -> it returns
+//     RecvQueue : PushData_RecvQueue() -> PopData_RecvQueue() by the consumer
+// The first two are taken by the sender, the others by the receiver, so the frames of a server are traced by the
+// tracers of the server and the client together, and the actions of a client the other way round. Transport compares
+// the clocks of two processes, which are only the same on one host.
+// A histogram is HDR-like: the values are counted in buckets which are linear within each power of 2 (32 of them),
+// so a percentile is off by 3% at most whatever the range. The counting is lock-free.
+
+// .SECTION See also
+// CMoCapTCPServer, CMoCapTCPClient, Data_Repos
+
+#ifndef LATENCYTRACE_H
+#define LATENCYTRACE_H
+
+#include <string>
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+#include <stdio.h>
+#include <stdint.h>
+
+namespace mocap_netop {
+
+    // Description:
+    // Current time of the monotonic clock in nanoseconds
+    inline uint64_t latency_now_ns()
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    // Summary of a histogram, in nanoseconds
+    struct Latency_Summary{
+        uint64_t nCount = 0;
+        uint64_t nMin = 0, nMax = 0;
+        double mean = 0;
+        uint64_t nP50 = 0, nP99 = 0, nP999 = 0;
+    };
+
+    class Latency_Histogram{
+    public:
+        Latency_Histogram() { Reset(); }
+        Latency_Histogram(const Latency_Histogram&) = delete;
+        Latency_Histogram& operator=(const Latency_Histogram&) = delete;
+
+        // Description:
+        // Count a value. It may be called by any threads at the same time.
+        void Record(uint64_t value)
+        {
+            _buckets[BucketOf(value)].fetch_add(1, std::memory_order_relaxed);
+            _nCount.fetch_add(1, std::memory_order_relaxed);
+            _nSum.fetch_add(value, std::memory_order_relaxed);
+
+            uint64_t nMax = _nMax.load(std::memory_order_relaxed);
+            while(value > nMax && !_nMax.compare_exchange_weak(nMax, value, std::memory_order_relaxed));
+            uint64_t nMin = _nMin.load(std::memory_order_relaxed);
+            while(value < nMin && !_nMin.compare_exchange_weak(nMin, value, std::memory_order_relaxed));
+        }
+
+        // Description:
+        // The value below which the fraction p of the values are, e.g., 0.99. It is the middle of its bucket.
+        uint64_t Percentile(double p) const
+        {
+            uint64_t nCount = 0;
+            for(unsigned i = 0; i < N_BUCKET; i ++) nCount += _buckets[i].load(std::memory_order_relaxed);
+            if(nCount == 0) return 0;
+
+            uint64_t nRank = (uint64_t)(p * nCount);
+            if(nRank >= nCount) nRank = nCount - 1;
+
+            uint64_t nSeen = 0;
+            for(unsigned i = 0; i < N_BUCKET; i ++){
+                nSeen += _buckets[i].load(std::memory_order_relaxed);
+                if(nSeen > nRank)
+                    return std::min(BucketMiddle(i), _nMax.load(std::memory_order_relaxed));
+            }
+            return _nMax.load(std::memory_order_relaxed);
+        }
+
+        Latency_Summary GetSummary() const
+        {
+            Latency_Summary summary;
+            summary.nCount = _nCount.load(std::memory_order_relaxed);
+            if(summary.nCount == 0) return summary;
+
+            summary.nMin = _nMin.load(std::memory_order_relaxed);
+            summary.nMax = _nMax.load(std::memory_order_relaxed);
+            summary.mean = (double)_nSum.load(std::memory_order_relaxed) / summary.nCount;
+            summary.nP50 = Percentile(0.5);
+            summary.nP99 = Percentile(0.99);
+            summary.nP999 = Percentile(0.999);
+            return summary;
+        }
+
+        // Description:
+        // Forget all the values. Those recorded meanwhile may be partly kept.
+        void Reset()
+        {
+            for(unsigned i = 0; i < N_BUCKET; i ++) _buckets[i].store(0, std::memory_order_relaxed);
+            _nCount = 0;
+            _nSum = 0;
+            _nMax = 0;
+            _nMin = UINT64_MAX;
+        }
+
+    private:
+        // The values below 64 have a bucket each; above, each power of 2 is split into 32 buckets
+        static const unsigned N_SUB_BITS = 5, N_SUB = 1u << N_SUB_BITS;
+        static const unsigned N_MAX_BITS = 44; // about 4.9 hours in nanoseconds; the larger values go to the last bucket
+        static const unsigned N_BUCKET = 2 * N_SUB + (N_MAX_BITS - N_SUB_BITS - 1) * N_SUB;
+
+        static unsigned BucketOf(uint64_t value)
+        {
+            if(value < 2 * N_SUB) return (unsigned)value;
+
+            unsigned nBits = 63 - CountLeadingZeros(value); // position of the highest bit, >= N_SUB_BITS + 1
+            if(nBits >= N_MAX_BITS) return N_BUCKET - 1;
+
+            unsigned nShift = nBits - N_SUB_BITS;
+            return 2 * N_SUB + (nBits - N_SUB_BITS - 1) * N_SUB + (unsigned)((value >> nShift) & (N_SUB - 1));
+        }
+        static uint64_t BucketMiddle(unsigned iBucket)
+        {
+            if(iBucket < 2 * N_SUB) return iBucket;
+
+            unsigned nBits = (iBucket - 2 * N_SUB) / N_SUB + N_SUB_BITS + 1;
+            unsigned nShift = nBits - N_SUB_BITS;
+            uint64_t nLow = ((uint64_t)(N_SUB + (iBucket - 2 * N_SUB) % N_SUB)) << nShift;
+            return nLow + ((1ull << nShift) >> 1);
+        }
+        static unsigned CountLeadingZeros(uint64_t value)
+        {
+#if defined(__GNUC__)
+            return __builtin_clzll(value);
+#else
+            unsigned n = 0;
+            for(uint64_t bit = 1ull << 63; (value & bit) == 0; bit >>= 1) n ++;
+            return n;
+#endif
+        }
+
+    private:
+        std::atomic<uint64_t> _buckets[N_BUCKET];
+        std::atomic<uint64_t> _nCount, _nSum, _nMax, _nMin;
+    };
+
+    // Stages of a message, see the description above
+    enum class Latency_Stage {
+        SendQueue,
+        Serialize,
+        Transport,
+        Decode,
+        RecvQueue,
+        Count // number of the stages
+    };
+
+    inline const char* latency_stage_name(Latency_Stage stage)
+    {
+        static const char *names[] = {"send queue", "serialize", "transport", "decode", "recv queue"};
+        return stage < Latency_Stage::Count ? names[(int)stage] : "";
+    }
+
+    // The histograms of all the stages, owned by a server or client. Tracing is off until it is enabled.
+    class Latency_Tracer{
+    public:
+        Latency_Tracer() : _bEnabled(false) {}
+
+        void Enable(bool bEnabled) { _bEnabled = bEnabled; }
+        bool IsEnabled() const { return _bEnabled.load(std::memory_order_relaxed); }
+
+        // Description:
+        // The time to put at a stage boundary: now if tracing is enabled, otherwise 0 for "not traced"
+        uint64_t Stamp() const { return IsEnabled() ? latency_now_ns() : 0; }
+
+        // Description:
+        // Count a duration of the stage, from the stamp tStart to tEnd. Nothing is counted if either is not traced,
+        // or if tEnd is before tStart (the clocks of two hosts).
+        void Record(Latency_Stage stage, uint64_t tStart, uint64_t tEnd)
+        {
+            if(tStart == 0 || tEnd < tStart || !IsEnabled()) return;
+            _histograms[(int)stage].Record(tEnd - tStart);
+        }
+
+        const Latency_Histogram& GetHistogram(Latency_Stage stage) const { return _histograms[(int)stage]; }
+        Latency_Summary GetSummary(Latency_Stage stage) const { return _histograms[(int)stage].GetSummary(); }
+
+        void Reset()
+        {
+            for(auto &histogram : _histograms) histogram.Reset();
+        }
+
+        // Description:
+        // A table of the stages that have been traced, with the count and the percentiles in microseconds
+        std::string Report() const
+        {
+            std::string report;
+            char line[160];
+            snprintf(line, sizeof(line), "%-12s %10s %10s %10s %10s %10s\n", "stage", "count", "p50(us)", "p99(us)", "p999(us)", "max(us)");
+            report += line;
+
+            for(int i = 0; i < (int)Latency_Stage::Count; i ++){
+                Latency_Summary summary = _histograms[i].GetSummary();
+                if(summary.nCount == 0) continue;
+
+                snprintf(line, sizeof(line), "%-12s %10llu %10.1f %10.1f %10.1f %10.1f\n", latency_stage_name((Latency_Stage)i),
+                         (unsigned long long)summary.nCount, summary.nP50 / 1000.0, summary.nP99 / 1000.0,
+                         summary.nP999 / 1000.0, summary.nMax / 1000.0);
+                report += line;
+            }
+            return report;
+        }
+
+    private:
+        std::atomic_bool _bEnabled;
+        Latency_Histogram _histograms[(int)Latency_Stage::Count];
+    };
+
+} // namespace: mocap_netop
+
+#endif // LATENCYTRACE_H
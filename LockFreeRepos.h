@@ -0,0 +1,208 @@
+/*******************************************************************
+* Author	: wwyang
+* Date		: 2026.10.17
+* Copyright : Zhejiang Gongshang University
+* Head File :
+* Version   : 1.0
+*********************************************************************/
+// .NAME Bounded_Queue/Data_Repos_LockFree
+
+// .SECTION Description
+// Here provides a lock-free alternative of Data_Repos. Each direction has its own bounded ring buffer, so the
+// producers and consumers of the send queue never contend with those of the receive queue, and a push does not
+// allocate any memory of the queue. The ring buffer is safe for any number of producers and consumers (it is
+// typically used as SPSC or MPSC). Unlike Data_Repos, a push can fail when the queue is full, and the result
+// of each operation tells it explicitly.
+// It is a standalone class, not a policy of CMoCapTCPServer/CMoCapTCPClient: they and their callbacks take a
+// Data_Repos, whose pools, waits and notifiers it does not have. It is for queues of the application, e.g., between
+// the capture and the thread that pushes the frames into the repos of the server.
+
+// .SECTION See also
+// Data_Repos
+
+#ifndef _LOCKFREEREPOS_H_
+#define _LOCKFREEREPOS_H_
+
+#include <atomic>
+#include <memory>
+#include <stddef.h>
+#include <stdint.h>
+
+namespace mocap_netop {
+
+    // Result of an operation on a bounded queue
+    enum class Queue_Result {
+        Ok,
+        Full,  // nothing is pushed as the queue is full
+        Empty  // nothing is popped as the queue is empty
+    };
+
+    // A bounded ring buffer in which each cell carries a sequence number telling whether it is ready to be
+    // written or read. Producers and consumers claim cells by advancing their own position with a CAS.
+    template<class T>
+    class Bounded_Queue{
+    public:
+        // Description:
+        // The capacity is rounded up to a power of 2
+        explicit Bounded_Queue(size_t capacity)
+        {
+            size_t nCell = 2;
+            while(nCell < capacity) nCell <<= 1;
+
+            _mask = nCell - 1;
+            _cells.reset(new Cell[nCell]);
+            for(size_t i = 0; i < nCell; i ++){
+                _cells[i].sequence.store(i, std::memory_order_relaxed);
+            }
+
+            _enqueuePos.store(0, std::memory_order_relaxed);
+            _dequeuePos.store(0, std::memory_order_relaxed);
+        }
+        Bounded_Queue(const Bounded_Queue&) = delete;
+        Bounded_Queue& operator=(const Bounded_Queue&) = delete;
+
+        Queue_Result TryPush(const T &value)
+        {
+            size_t pos = _enqueuePos.load(std::memory_order_relaxed);
+            Cell *cell;
+
+            while(true){
+                cell = &_cells[pos & _mask];
+                size_t seq = cell->sequence.load(std::memory_order_acquire);
+                intptr_t dif = (intptr_t)seq - (intptr_t)pos;
+
+                if(dif == 0){ // the cell is free: claim it
+                    if(_enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                        break;
+                }
+                else if(dif < 0){ // the cell still holds a value of the previous round
+                    return Queue_Result::Full;
+                }
+                else{ // claimed by another producer
+                    pos = _enqueuePos.load(std::memory_order_relaxed);
+                }
+            }
+
+            cell->data = value;
+            cell->sequence.store(pos + 1, std::memory_order_release);
+
+            return Queue_Result::Ok;
+        }
+
+        Queue_Result TryPop(T &value)
+        {
+            size_t pos = _dequeuePos.load(std::memory_order_relaxed);
+            Cell *cell;
+
+            while(true){
+                cell = &_cells[pos & _mask];
+                size_t seq = cell->sequence.load(std::memory_order_acquire);
+                intptr_t dif = (intptr_t)seq - (intptr_t)(pos + 1);
+
+                if(dif == 0){ // the cell has been written: claim it
+                    if(_dequeuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                        break;
+                }
+                else if(dif < 0){ // the cell is not written yet
+                    return Queue_Result::Empty;
+                }
+                else{ // claimed by another consumer
+                    pos = _dequeuePos.load(std::memory_order_relaxed);
+                }
+            }
+
+            value = std::move(cell->data);
+            cell->data = T(); // do not keep a reference to the value in the cell
+            cell->sequence.store(pos + _mask + 1, std::memory_order_release);
+
+            return Queue_Result::Ok;
+        }
+
+        size_t Capacity() const { return _mask + 1; }
+
+        // Description:
+        // Number of values in the queue. It is only a snapshot when other threads are working on the queue.
+        size_t SizeApprox() const
+        {
+            size_t enqueuePos = _enqueuePos.load(std::memory_order_relaxed), dequeuePos = _dequeuePos.load(std::memory_order_relaxed);
+            return enqueuePos > dequeuePos ? enqueuePos - dequeuePos : 0;
+        }
+
+    private:
+        struct Cell{
+            std::atomic<size_t> sequence;
+            T data;
+        };
+
+        std::unique_ptr<Cell[]> _cells;
+        size_t _mask;
+
+        // The positions are on their own cache lines, so the producers and the consumers do not share a line
+        alignas(64) std::atomic<size_t> _enqueuePos;
+        alignas(64) std::atomic<size_t> _dequeuePos;
+    };
+
+    // Repos for the data to be sent or have been received by a server or client, backed by two lock-free queues.
+    // It offers the same push/pop calls as Data_Repos, but a push returns Queue_Result::Full if there is no room.
+    template<class DataType_Send, class DataType_Recv>
+    class Data_Repos_LockFree{
+    public:
+        explicit Data_Repos_LockFree(size_t capacitySend = 1024, size_t capacityRecv = 1024)
+            : _queueDataToSend(capacitySend), _queueDataReceived(capacityRecv)
+        {
+        }
+        ~Data_Repos_LockFree(){ DestroyRepos(); }
+
+        std::shared_ptr<DataType_Send> PopData_SendQueue()
+        {
+            std::shared_ptr<DataType_Send> data;
+            _queueDataToSend.TryPop(data);
+
+            return data; // empty pointer if the queue is empty
+        }
+        std::shared_ptr<DataType_Recv> PopData_RecvQueue()
+        {
+            std::shared_ptr<DataType_Recv> data;
+            _queueDataReceived.TryPop(data);
+
+            return data; // empty pointer if the queue is empty
+        }
+        Queue_Result PushData_SendQueue( const std::shared_ptr<DataType_Send> &data)
+        {
+            return _queueDataToSend.TryPush(data);
+        }
+        Queue_Result PushData_RecvQueue( const std::shared_ptr<DataType_Recv> &data)
+        {
+            return _queueDataReceived.TryPush(data);
+        }
+
+        // Description:
+        // Pop with an explicit result
+        Queue_Result TryPopData_SendQueue(std::shared_ptr<DataType_Send> &data)
+        {
+            return _queueDataToSend.TryPop(data);
+        }
+        Queue_Result TryPopData_RecvQueue(std::shared_ptr<DataType_Recv> &data)
+        {
+            return _queueDataReceived.TryPop(data);
+        }
+
+        size_t Capacity_SendQueue() const { return _queueDataToSend.Capacity(); }
+        size_t Capacity_RecvQueue() const { return _queueDataReceived.Capacity(); }
+
+        void DestroyRepos()
+        {
+            std::shared_ptr<DataType_Send> dataSend;
+            while(_queueDataToSend.TryPop(dataSend) == Queue_Result::Ok);
+
+            std::shared_ptr<DataType_Recv> dataRecv;
+            while(_queueDataReceived.TryPop(dataRecv) == Queue_Result::Ok);
+        }
+
+    private:
+        Bounded_Queue< std::shared_ptr<DataType_Send> > _queueDataToSend; // data to be sent to server/clients
+        Bounded_Queue< std::shared_ptr<DataType_Recv> > _queueDataReceived; // data received from the server/client
+    };
+}
+
+#endif // !_LOCKFREEREPOS_H_
@@ -0,0 +1,267 @@
+#include "MoCapTake.h"
+
+#include <string.h>
+#include <iostream>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+static_assert(sizeof(Take_File_Header) == 64, "the file header should be 64 bytes");
+static_assert(sizeof(Take_Frame_Entry) == 24, "an index entry should be 24 bytes");
+static_assert(sizeof(Data_MoCap_Send::Pose) % 8 == 0, "a pose record should keep the next one aligned");
+
+////////////////////////////////////////////////////////////////
+/// Reader
+///
+bool MoCap_Take_Reader::Open(const std::string &fileName)
+{
+    Close();
+
+    // 1. Map the whole file for reading
+#ifdef _WIN32
+    HANDLE hFile = CreateFileA(fileName.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if(hFile == INVALID_HANDLE_VALUE) return false;
+
+    LARGE_INTEGER fileSize;
+    if(!GetFileSizeEx(hFile, &fileSize) || fileSize.QuadPart < (LONGLONG)sizeof(Take_File_Header)){
+        CloseHandle(hFile);
+        return false;
+    }
+
+    HANDLE hMapping = CreateFileMappingA(hFile, NULL, PAGE_READONLY, 0, 0, NULL);
+    const char *pFile = hMapping ? (const char*)MapViewOfFile(hMapping, FILE_MAP_READ, 0, 0, 0) : 0;
+    if(pFile == 0){
+        if(hMapping) CloseHandle(hMapping);
+        CloseHandle(hFile);
+        return false;
+    }
+
+    _hFile = hFile;
+    _hMapping = hMapping;
+    _nFileSize = (size_t)fileSize.QuadPart;
+#else
+    int fd = open(fileName.c_str(), O_RDONLY);
+    if(fd < 0) return false;
+
+    struct stat st;
+    if(fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(Take_File_Header)){
+        close(fd);
+        return false;
+    }
+
+    void *pMap = mmap(0, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd); // the mapping keeps the file
+    if(pMap == MAP_FAILED) return false;
+
+    madvise(pMap, st.st_size, MADV_WILLNEED); // read ahead, so the playback does not wait for the disk
+
+    const char *pFile = (const char*)pMap;
+    _nFileSize = st.st_size;
+#endif
+    _pFile = pFile;
+
+    // 2. Check the header and the index
+    const Take_File_Header *pHeader = (const Take_File_Header*)_pFile;
+    bool bValid = memcmp(pHeader->magic, MOCAP_TAKE_MAGIC, sizeof(MOCAP_TAKE_MAGIC)) == 0
+            && pHeader->version == MOCAP_TAKE_VERSION
+            && pHeader->nJoint == JOINT_NUMBER
+            && pHeader->nPoseSize == sizeof(Data_MoCap_Send::Pose)
+            && pHeader->nIndexOffset % 8 == 0
+            && pHeader->nIndexOffset <= _nFileSize
+            && pHeader->nFrame <= (_nFileSize - pHeader->nIndexOffset) / sizeof(Take_Frame_Entry);
+
+    if(bValid){
+        _pIndex = (const Take_Frame_Entry*)(_pFile + pHeader->nIndexOffset);
+        _nFrame = pHeader->nFrame;
+
+        for(uint64_t i = 0; i < _nFrame && bValid; i ++){
+            const Take_Frame_Entry &entry = _pIndex[i];
+            bValid = entry.nOffset % 8 == 0
+                    && entry.nOffset <= pHeader->nIndexOffset
+                    && entry.nPose <= (pHeader->nIndexOffset - entry.nOffset) / sizeof(Data_MoCap_Send::Pose);
+        }
+    }
+
+    if(!bValid){
+        std::cout << "Not a valid take file: " << fileName << "\n";
+        Close();
+        return false;
+    }
+
+    return true;
+}
+
+void MoCap_Take_Reader::Close()
+{
+    if(_pFile == 0) return;
+
+#ifdef _WIN32
+    UnmapViewOfFile(_pFile);
+    CloseHandle((HANDLE)_hMapping);
+    CloseHandle((HANDLE)_hFile);
+    _hFile = _hMapping = 0;
+#else
+    munmap((void*)_pFile, _nFileSize);
+#endif
+
+    _pFile = 0;
+    _nFileSize = 0;
+    _pIndex = 0;
+    _nFrame = 0;
+}
+
+bool MoCap_Take_Reader::GetFrame(uint64_t iFrame, Take_Frame_View &view) const
+{
+    if(iFrame >= _nFrame) return false;
+
+    const Take_Frame_Entry &entry = _pIndex[iFrame];
+    view.timestamp = entry.timestamp;
+    view.nPose = entry.nPose;
+    view.pPoses = (const Data_MoCap_Send::Pose*)(_pFile + entry.nOffset);
+
+    return true;
+}
+
+bool MoCap_Take_Reader::CopyFrame(uint64_t iFrame, Data_MoCap_Send &data) const
+{
+    Take_Frame_View view;
+    if(!GetFrame(iFrame, view)) return false;
+
+    data.timestamp = view.timestamp;
+    data.poses.assign(view.pPoses, view.pPoses + view.nPose); // keeps the capacity of a recycled data
+
+    return true;
+}
+
+////////////////////////////////////////////////////////////////
+/// Writer
+///
+bool MoCap_Take_Writer::Open(const std::string &fileName)
+{
+    Close();
+
+    _fp = fopen(fileName.c_str(), "wb");
+    if(_fp == NULL) return false;
+
+    // a placeholder of the header, which is rewritten on closing
+    Take_File_Header header;
+    memset(&header, 0, sizeof(header));
+
+    _bOk = fwrite(&header, sizeof(header), 1, _fp) == 1;
+    _nOffset = sizeof(header);
+    _index.clear();
+
+    return _bOk;
+}
+
+bool MoCap_Take_Writer::WriteFrame(uint64_t timestamp, const std::vector<Data_MoCap_Send::Pose> &poses)
+{
+    if(_fp == NULL || !_bOk) return false;
+
+    Take_Frame_Entry entry;
+    memset(&entry, 0, sizeof(entry));
+    entry.nOffset = _nOffset;
+    entry.timestamp = timestamp;
+    entry.nPose = poses.size();
+
+    if(!poses.empty())
+        _bOk = fwrite(poses.data(), sizeof(Data_MoCap_Send::Pose), poses.size(), _fp) == poses.size();
+
+    _nOffset += poses.size() * sizeof(Data_MoCap_Send::Pose);
+    _index.push_back(entry);
+
+    return _bOk;
+}
+
+bool MoCap_Take_Writer::Close()
+{
+    if(_fp == NULL) return false;
+
+    // the index after the last frame, then the header pointing at it
+    Take_File_Header header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, MOCAP_TAKE_MAGIC, sizeof(MOCAP_TAKE_MAGIC));
+    header.version = MOCAP_TAKE_VERSION;
+    header.nJoint = JOINT_NUMBER;
+    header.nPoseSize = sizeof(Data_MoCap_Send::Pose);
+    header.nFrame = _index.size();
+    header.nIndexOffset = _nOffset;
+
+    if(_bOk && !_index.empty())
+        _bOk = fwrite(_index.data(), sizeof(Take_Frame_Entry), _index.size(), _fp) == _index.size();
+    if(_bOk)
+        _bOk = fseek(_fp, 0, SEEK_SET) == 0 && fwrite(&header, sizeof(header), 1, _fp) == 1;
+
+    bool bOk = (fclose(_fp) == 0) && _bOk;
+    _fp = NULL;
+    _index.clear();
+
+    return bOk;
+}
+
+////////////////////////////////////////////////////////////////
+/// Conversion from the text format
+///
+long long mocap_take_convert_text(const std::string &textFileName, const std::string &takeFileName, unsigned nFrameIntervalMs)
+{
+    FILE *fp = fopen(textFileName.c_str(), "r");
+    if(fp == NULL){
+        std::cout << "Cannot open " << textFileName << "\n";
+        return -1;
+    }
+
+    MoCap_Take_Writer writer;
+    if(!writer.Open(takeFileName)){
+        std::cout << "Cannot create " << takeFileName << "\n";
+        fclose(fp);
+        return -1;
+    }
+
+    std::vector<Data_MoCap_Send::Pose> poses;
+    unsigned nPose, nJoint;
+    char line[128];
+    long long nFrame = 0;
+    bool bOk = true;
+
+    // number of poses and joints of each frame, then one pose per line
+    while(bOk && fscanf(fp, "%u%u", &nPose, &nJoint) == 2){
+        if(nJoint != JOINT_NUMBER){
+            std::cout << "Frame " << nFrame << " has " << nJoint << " joints instead of " << JOINT_NUMBER << "\n";
+            bOk = false;
+            break;
+        }
+        fgets(line, 128, fp); // eat out the line
+
+        poses.resize(nPose);
+        for(unsigned j = 0; j < nPose && bOk; j ++){
+            Data_MoCap_Send::Pose &pose = poses[j];
+            pose.ID = j+1;
+            for(unsigned k = 0; k < JOINT_NUMBER && bOk; k ++){
+                Data_MoCap_Send::Joint &joint = pose.joints[k];
+                bOk = fscanf(fp, "%f%f%f", &joint.x, &joint.y, &joint.z) == 3;
+            }
+
+            // eat out the line: one pose one line
+            fgets(line, 128, fp);
+        }
+
+        if(!bOk){
+            std::cout << "Frame " << nFrame << " is truncated\n";
+            break;
+        }
+
+        bOk = writer.WriteFrame(nFrame * nFrameIntervalMs, poses);
+        nFrame ++;
+    }
+
+    fclose(fp);
+    bOk = writer.Close() && bOk;
+
+    return bOk ? nFrame : -1;
+}
@@ -0,0 +1,127 @@
+/*******************************************************************
+* Author	: wwyang
+* Date		: 2026.10.17
+* Copyright : Zhejiang Gongshang University
+* Head File :
+* Version   : 1.0
+*********************************************************************/
+// .NAME MoCap_Take_Reader/MoCap_Take_Writer
+
+// .SECTION Description
+// Here provides a binary format of a recorded take of 3D poses, so that a playback server does not parse any text
+// while it is streaming. A take file is laid out as:
+//     (file header: Take_File_Header, 64 bytes);
+//     (frame blocks: the poses of each frame as Data_MoCap_Send::Pose records, 8-byte aligned);
+//     (frame index: a Take_Frame_Entry for each frame, telling the offset of its block, its timestamp and its poses)
+// The reader maps the whole file into memory: a frame is reached in O(1) through the index, and its view points
+// straight at the poses in the mapped file without copying them. The data is in the byte order of the machine.
+
+// .SECTION See also
+// Data_MoCap_Send
+
+#ifndef MOCAPTAKE_H
+#define MOCAPTAKE_H
+
+#include <string>
+#include <vector>
+#include <stdio.h>
+#include <stdint.h>
+
+#include "MoCap_Data.h"
+
+#define MOCAP_TAKE_MAGIC "MOCAPTK"
+#define MOCAP_TAKE_VERSION 1
+
+struct Take_File_Header{
+    char magic[8]; // MOCAP_TAKE_MAGIC
+    uint32_t version; // MOCAP_TAKE_VERSION
+    uint32_t nJoint; // joints of a pose: JOINT_NUMBER
+    uint32_t nPoseSize; // bytes of a pose record: sizeof(Data_MoCap_Send::Pose)
+    uint32_t reserved0;
+    uint64_t nFrame; // number of frames
+    uint64_t nIndexOffset; // position of the frame index in the file
+    char reserved[24];
+};
+
+struct Take_Frame_Entry{
+    uint64_t nOffset; // position of the poses of the frame in the file
+    uint64_t timestamp; // in milliseconds from the beginning of the take
+    uint32_t nPose; // number of poses
+    uint32_t reserved;
+};
+
+// A frame of the take, pointing into the mapped file
+struct Take_Frame_View{
+    uint64_t timestamp;
+    unsigned nPose;
+    const Data_MoCap_Send::Pose *pPoses;
+};
+
+// Reader of a take file through a memory mapping
+class MoCap_Take_Reader{
+public:
+    MoCap_Take_Reader() {}
+    MoCap_Take_Reader(const MoCap_Take_Reader&) = delete;
+    MoCap_Take_Reader& operator=(const MoCap_Take_Reader&) = delete;
+
+    ~MoCap_Take_Reader() { Close(); }
+
+    // Description:
+    // Map a take file. The header and the whole index are checked here, so no frame can point out of the file.
+    bool Open(const std::string &fileName);
+    void Close();
+
+    bool IsOpen() const { return _pFile != 0; }
+
+    uint64_t GetFrameCount() const { return _nFrame; }
+
+    // Description:
+    // View of a frame, valid until the reader is closed. Return false if the frame number is out of range.
+    bool GetFrame(uint64_t iFrame, Take_Frame_View &view) const;
+
+    // Description:
+    // Copy the timestamp and the poses of a frame into a data (its actions are left unchanged)
+    bool CopyFrame(uint64_t iFrame, Data_MoCap_Send &data) const;
+
+private:
+    const char *_pFile = 0; // the mapped file
+    size_t _nFileSize = 0;
+    const Take_Frame_Entry *_pIndex = 0;
+    uint64_t _nFrame = 0;
+
+#ifdef _WIN32
+    void *_hFile = 0, *_hMapping = 0;
+#endif
+};
+
+// Writer of a take file: the frames are appended one by one, and the index is written on closing
+class MoCap_Take_Writer{
+public:
+    MoCap_Take_Writer() {}
+    MoCap_Take_Writer(const MoCap_Take_Writer&) = delete;
+    MoCap_Take_Writer& operator=(const MoCap_Take_Writer&) = delete;
+
+    ~MoCap_Take_Writer() { Close(); }
+
+    bool Open(const std::string &fileName);
+
+    bool WriteFrame(uint64_t timestamp, const std::vector<Data_MoCap_Send::Pose> &poses);
+
+    // Description:
+    // Write the index and the final header. The file is not a valid take until it is closed.
+    bool Close();
+
+private:
+    FILE *_fp = 0;
+    uint64_t _nOffset = 0; // where the next frame goes
+    std::vector<Take_Frame_Entry> _index;
+    bool _bOk = true;
+};
+
+// Description:
+// Convert a text file of poses into a take file. The text has, for each frame, a line "nPose nJoint" followed by
+// one pose per line (the x y z of each joint). The frames are timestamped every nFrameIntervalMs, and the poses
+// of a frame get the IDs 1, 2, ... Return the number of frames converted, or -1 on error.
+long long mocap_take_convert_text(const std::string &textFileName, const std::string &takeFileName, unsigned nFrameIntervalMs = 20);
+
+#endif // MOCAPTAKE_H
@@ -0,0 +1,772 @@
+/*******************************************************************
+* Author	: wwyang
+* Date		: 2026.10.17
+* Copyright : Zhejiang Gongshang University
+* Head File :
+* Version   : 1.0
+*********************************************************************/
+// .NAME MoCap_Wire_Layout
+
+// .SECTION Description
+// Here provides the callbacks of MoCap_Data.h for the frames of any skeleton (Data_MoCap_Frame<Skeleton>), as
+// templates of the same names, e.g. sendmsg_callback_mocap_server<Skeleton_Body25>. A server or a client of a skeleton
+// takes them as its callbacks, and the skeleton is deduced from its repos:
+//     CMoCapTCPServer<Data_MoCap_Frame<Skeleton_Body25>, Data_MoCap_Recv> server(...);
+//     server.Start(sendmsg_callback_mocap_server, recvmsg_callback_mocap_server);
+// but the projection callback is named with its skeleton. The callbacks of Data_MoCap_Send are those for
+// Skeleton_Coco17, built once in MoCap_Data.cpp.
+// The formats are those of MoCap_Data.h with the joints of the skeleton. The sizes and offsets of a frame are known at
+// compile time (MoCap_Wire_Layout), so the copies of the joints are of a constant size and the loops over them have a
+// constant trip count, which the compiler unrolls. A frame of another skeleton does not match the sizes, and the
+// recv callbacks drop it.
+
+// .SECTION See also
+// Data_MoCap_Frame, Skeleton_Coco17
+
+#ifndef MOCAP_CODEC_H
+#define MOCAP_CODEC_H
+
+#include <string.h>
+#include <assert.h>
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <iostream>
+
+#include "NetOp.h"
+#include "Subscription.h"
+#include "MoCap_Data.h"
+
+////////////////////////////////////////////////////////////////
+/// The sizes and offsets of the formats of a skeleton, in bytes
+///
+template<class Skeleton>
+struct MoCap_Wire_Layout{
+    static_assert(Skeleton::JOINT_COUNT >= 1 && Skeleton::JOINT_COUNT <= 32, "A skeleton has 1 to 32 joints");
+
+    static constexpr unsigned JOINT_COUNT = Skeleton::JOINT_COUNT;
+    static constexpr unsigned JOINT_BYTES = 12;
+    static constexpr unsigned POSE_BYTES = 8 + JOINT_BYTES * JOINT_COUNT; // ID and joints
+    static constexpr unsigned ACTION_BYTES = 12;
+    static constexpr uint32_t ALL_JOINTS = JOINT_COUNT >= 32 ? 0xFFFFFFFFu : (1u << (JOINT_COUNT % 32)) - 1; // mask of a subscription
+    static constexpr unsigned COMPACT_MAX_POSE_BYTES = 1 + 10 + 3 * JOINT_COUNT * 5; // a delta pose with the largest varints
+
+    // Description:
+    // Offset of a joint in a pose of the plain format
+    static constexpr unsigned JointOffset(unsigned k) { return 8 + JOINT_BYTES * k; }
+
+    // Description:
+    // Size of a frame of the plain format
+    static constexpr unsigned long long FrameBytes(unsigned long long nPose, unsigned long long nAction)
+    {
+        return 4 + nPose * POSE_BYTES + 4 + nAction * ACTION_BYTES;
+    }
+};
+
+template<class Skeleton> constexpr unsigned MoCap_Wire_Layout<Skeleton>::JOINT_COUNT;
+template<class Skeleton> constexpr unsigned MoCap_Wire_Layout<Skeleton>::JOINT_BYTES;
+template<class Skeleton> constexpr unsigned MoCap_Wire_Layout<Skeleton>::POSE_BYTES;
+template<class Skeleton> constexpr unsigned MoCap_Wire_Layout<Skeleton>::ACTION_BYTES;
+template<class Skeleton> constexpr uint32_t MoCap_Wire_Layout<Skeleton>::ALL_JOINTS;
+template<class Skeleton> constexpr unsigned MoCap_Wire_Layout<Skeleton>::COMPACT_MAX_POSE_BYTES;
+
+namespace mocap_codec {
+
+    // A pose of the plain format is its ID and joints as they are in memory
+    template<class Skeleton>
+    struct Pose_Layout_Check{
+        typedef typename Data_MoCap_Frame<Skeleton>::Pose Pose;
+        static_assert(sizeof(typename Data_MoCap_Frame<Skeleton>::Joint) == 12, "A joint is 3 floats");
+        static_assert(offsetof(Pose, joints) == 8 && sizeof(Pose::joints) + 8 == MoCap_Wire_Layout<Skeleton>::POSE_BYTES,
+                      "A pose is its ID and joints");
+    };
+
+    // Description:
+    // Read the numbers of the poses and actions of a frame of the plain format. Return false if the size of the frame
+    // does not match them, e.g., a frame of another skeleton.
+    template<class Skeleton>
+    bool read_plain_counts(const char *pSrc, unsigned nDataSize, unsigned &nPose, unsigned &nAction)
+    {
+        typedef MoCap_Wire_Layout<Skeleton> Layout;
+
+        if(nDataSize < 8) return false;
+        memcpy(&nPose, pSrc, 4);
+        if((unsigned long long)nPose * Layout::POSE_BYTES + 8 > nDataSize) return false;
+        memcpy(&nAction, pSrc + 4 + nPose * Layout::POSE_BYTES, 4);
+        return Layout::FrameBytes(nPose, nAction) == nDataSize;
+    }
+
+    // Description:
+    // Read out a frame projected by project_callback_mocap_server. The joints that are not in it are 0. Return false
+    // if it does not match the skeleton.
+    template<class Skeleton>
+    bool read_projected_frame(const mocap_netop::Data_Buffer *pDataBuffer, Data_MoCap_Frame<Skeleton> &data, bool bActions)
+    {
+        typedef MoCap_Wire_Layout<Skeleton> Layout;
+
+        const char *pSrc = (const char *)pDataBuffer->pData;
+        unsigned nDataSize = pDataBuffer->dataHeader.nDataSize, nCurDataSize = 8;
+        if(nDataSize < 12) return false;
+
+        uint32_t jointMask;
+        unsigned nPose, nAction;
+        memcpy(&jointMask, pSrc, 4);
+        memcpy(&nPose, pSrc + 4, 4);
+        if((jointMask & ~Layout::ALL_JOINTS) != 0) return false;
+
+        unsigned nJoint = 0;
+        for(unsigned k = 0; k < Layout::JOINT_COUNT; k ++) nJoint += (jointMask >> k) & 1;
+        const unsigned nPoseSize = 8 + nJoint * Layout::JOINT_BYTES;
+        if(12 + (unsigned long long)nPose * nPoseSize > nDataSize) return false;
+        memcpy(&nAction, pSrc + 8 + nPose * nPoseSize, 4);
+        if(12 + nPose * nPoseSize + (unsigned long long)nAction * Layout::ACTION_BYTES != nDataSize) return false;
+
+        data.timestamp = pDataBuffer->dataHeader.timestamp;
+        data.poses.resize(nPose);
+        for(auto &pose : data.poses){
+            if(jointMask == Layout::ALL_JOINTS){
+                memcpy(&pose, pSrc + nCurDataSize, Layout::POSE_BYTES);
+                nCurDataSize += Layout::POSE_BYTES;
+                continue;
+            }
+
+            memcpy(&(pose.ID), pSrc + nCurDataSize, 8);
+            nCurDataSize += 8;
+            for(unsigned k = 0; k < Layout::JOINT_COUNT; k ++){
+                if((jointMask >> k) & 1){
+                    memcpy(&pose.joints[k], pSrc + nCurDataSize, Layout::JOINT_BYTES);
+                    nCurDataSize += Layout::JOINT_BYTES;
+                }
+                else{
+                    pose.joints[k].x = pose.joints[k].y = pose.joints[k].z = 0;
+                }
+            }
+        }
+        nCurDataSize += 4;
+
+        data.actions.resize(bActions ? nAction : 0);
+        for(auto &action : data.actions){
+            memcpy(&(action.poseID), pSrc + nCurDataSize, 8);
+            memcpy(&(action.action), pSrc + nCurDataSize + 8, 4);
+            nCurDataSize += Layout::ACTION_BYTES;
+        }
+
+        return true;
+    }
+
+    // Description:
+    // Read out a frame of the plain format, with the actions or not. Return false if it does not match the skeleton.
+    template<class Skeleton>
+    bool read_plain_frame(const mocap_netop::Data_Buffer *pDataBuffer, Data_MoCap_Frame<Skeleton> &data, bool bActions)
+    {
+        typedef MoCap_Wire_Layout<Skeleton> Layout;
+        (void)sizeof(Pose_Layout_Check<Skeleton>);
+
+        // data format: (number of poses: uint, 4 bytes); (pose1, pose2, ...); (number of action: uint, 4 bytes); (action1, action2, ..)
+        // format of pose: (poseID: ulong long, 8 bytes); (joint1, joint2,..,jointN)
+        // format of joint: (x: float, 4 bytes), (y: float, 4 bytes), (z: float, 4 bytes)
+        // format of action: (poseID: ulong long, 8 bytes); (action type: int, 4 bytes)
+        const char *pSrc = (const char *)pDataBuffer->pData;
+        unsigned nPose, nAction;
+        if(!read_plain_counts<Skeleton>(pSrc, pDataBuffer->dataHeader.nDataSize, nPose, nAction)) return false;
+
+        data.timestamp = pDataBuffer->dataHeader.timestamp;
+
+        // 1. data of 3D poses: the ID and joints of a pose at once
+        data.poses.resize(nPose);
+        const char *pPose = pSrc + 4;
+        for(auto &pose : data.poses){
+            memcpy(&pose, pPose, Layout::POSE_BYTES);
+            pPose += Layout::POSE_BYTES;
+        }
+
+        // 2. data of Pose actions
+        data.actions.resize(bActions ? nAction : 0);
+        const char *pAction = pPose + 4;
+        for(auto &action : data.actions){
+            memcpy(&(action.poseID), pAction, 8);
+            memcpy(&(action.action), pAction + 8, 4);
+            pAction += Layout::ACTION_BYTES;
+        }
+
+        return true;
+    }
+
+    template<class Skeleton>
+    void recvmsg_plain(mocap_netop::Data_Buffer* pDataBuffer, mocap_netop::Data_Repos<Data_MoCap_Recv, Data_MoCap_Frame<Skeleton> > &dataReposForClient, bool bWithActions)
+    {
+        assert(pDataBuffer->pData != 0);
+
+        // Create a data from the buffer
+        std::shared_ptr< Data_MoCap_Frame<Skeleton> > data = dataReposForClient.AcquireData_RecvQueue();
+
+        // A frame projected for the subscription of the client, or the whole one
+        // The transport has gathered the chunks of a large data, so a buffer contains a mocap data
+        bool bOk;
+        if(strncmp(pDataBuffer->dataHeader.data_name, "mocap_p", sizeof(pDataBuffer->dataHeader.data_name)) == 0)
+            bOk = read_projected_frame<Skeleton>(pDataBuffer, *data, bWithActions);
+        else
+            bOk = read_plain_frame<Skeleton>(pDataBuffer, *data, bWithActions);
+
+        if(!bOk){
+            std::cout << "A mocap data that is not of the skeleton " << Skeleton::Name() << " is dropped\n";
+            return;
+        }
+
+        dataReposForClient.PushData_RecvQueue( data );
+    }
+
+    ////////////////////////////////////////////////////////////////
+    /// The compact codec
+    ///
+
+    // A pose quantized to millimetres: the root (joint 0) in absolute and the other joints relative to the root
+    template<class Skeleton>
+    struct Quantized_Pose{
+        int32_t root[3];
+        int32_t joints[Skeleton::JOINT_COUNT > 1 ? Skeleton::JOINT_COUNT-1 : 1][3]; // in the range of int16
+    };
+
+    // State of a coded stream: the last frame, which the next delta frame refers to
+    template<class Skeleton>
+    struct Codec_Stream{
+        typedef std::vector< std::pair<unsigned long long, Quantized_Pose<Skeleton> > > Quantized_Frame; // poses by ID, in the order of the frame
+
+        uint32_t nSequence = 0; // sequence of the last frame
+        bool bValid = false; // whether the last frame is known (always true for the encoder after its first frame)
+        Quantized_Frame poses, posesNext; // poses of the last frame, and the memory for the next one
+    };
+
+    const uint8_t FRAME_KEY = 'K', FRAME_DELTA = 'D'; // type of a frame
+    const uint8_t POSE_INTRA = 0, POSE_DELTA = 1; // how a pose is coded in a delta frame
+
+    // Description:
+    // The stream of a repos of the server/clients, which lives as long as the repos
+    template<class Skeleton, class Repos>
+    Codec_Stream<Skeleton>& codec_stream(Repos &repos)
+    {
+        return repos.template GetCodecState< Codec_Stream<Skeleton> >();
+    }
+
+    // Find a pose of the last frame. The poses mostly keep their order between frames, so try the same index first.
+    template<class Skeleton>
+    const Quantized_Pose<Skeleton>* find_pose(const typename Codec_Stream<Skeleton>::Quantized_Frame &poses, unsigned long long ID, size_t iHint)
+    {
+        if(iHint < poses.size() && poses[iHint].first == ID) return &poses[iHint].second;
+
+        for(const auto &pose : poses)
+            if(pose.first == ID) return &pose.second;
+        return 0;
+    }
+
+    template<class Skeleton>
+    void quantize_pose(const typename Data_MoCap_Frame<Skeleton>::Pose &pose, Quantized_Pose<Skeleton> &q)
+    {
+        const typename Data_MoCap_Frame<Skeleton>::Joint &root = pose.joints[0];
+        q.root[0] = (int32_t)lrintf(root.x * 1000.f);
+        q.root[1] = (int32_t)lrintf(root.y * 1000.f);
+        q.root[2] = (int32_t)lrintf(root.z * 1000.f);
+
+        for(unsigned k = 1; k < Skeleton::JOINT_COUNT; k ++){
+            const float *v = &pose.joints[k].x;
+            for(unsigned c = 0; c < 3; c ++){
+                int32_t rel = (int32_t)lrintf(v[c] * 1000.f) - q.root[c];
+                q.joints[k-1][c] = rel < -32768 ? -32768 : (rel > 32767 ? 32767 : rel);
+            }
+        }
+    }
+
+    template<class Skeleton>
+    void dequantize_pose(const Quantized_Pose<Skeleton> &q, typename Data_MoCap_Frame<Skeleton>::Pose &pose)
+    {
+        pose.joints[0].x = q.root[0] * 0.001f;
+        pose.joints[0].y = q.root[1] * 0.001f;
+        pose.joints[0].z = q.root[2] * 0.001f;
+
+        for(unsigned k = 1; k < Skeleton::JOINT_COUNT; k ++){
+            pose.joints[k].x = (q.root[0] + q.joints[k-1][0]) * 0.001f;
+            pose.joints[k].y = (q.root[1] + q.joints[k-1][1]) * 0.001f;
+            pose.joints[k].z = (q.root[2] + q.joints[k-1][2]) * 0.001f;
+        }
+    }
+
+    // Writer/reader of the bytes of a frame. The reader fails (and stays failed) instead of reading past the end.
+    struct Byte_Writer{
+        char *p;
+
+        void Put(const void *pData, unsigned nSize) { memcpy(p, pData, nSize); p += nSize; }
+        void PutVarint(uint64_t v)
+        {
+            while(v >= 0x80){ *p++ = (char)(v | 0x80); v >>= 7; }
+            *p++ = (char)v;
+        }
+        void PutSigned(int64_t v) { PutVarint(((uint64_t)v << 1) ^ (uint64_t)(v >> 63)); } // zigzag
+    };
+
+    struct Byte_Reader{
+        const char *p, *pEnd;
+        bool bOk = true;
+
+        bool Get(void *pData, unsigned nSize)
+        {
+            if(!bOk || pEnd - p < (long)nSize) return bOk = false;
+            memcpy(pData, p, nSize); p += nSize;
+            return true;
+        }
+        uint64_t GetVarint()
+        {
+            uint64_t v = 0;
+            for(unsigned shift = 0; bOk && shift < 64; shift += 7){
+                if(p >= pEnd){ bOk = false; break; }
+                uint8_t b = (uint8_t)*p++;
+                v |= (uint64_t)(b & 0x7f) << shift;
+                if((b & 0x80) == 0) return v;
+            }
+            bOk = false;
+            return 0;
+        }
+        int64_t GetSigned()
+        {
+            uint64_t v = GetVarint();
+            return (int64_t)(v >> 1) ^ -(int64_t)(v & 1);
+        }
+    };
+
+    // data format: (frame type: 'K' or 'D', 1 byte); (sequence: uint, 4 bytes); (number of poses: varint); (pose1, pose2, ...);
+    //              (number of action: uint, 4 bytes); (action1, action2, ..)
+    // format of pose in a keyframe: (poseID: varint); (root: 3 int, 12 bytes); (joint2, ..,jointN: 3 short each, 6 bytes)
+    // format of pose in a delta frame: (coding: 1 byte), then as in a keyframe if it is coded intra (a new pose), or
+    //              (poseID: varint); (differences to the pose in the last frame of the root and other joints: 3*N zigzag varints)
+    // format of action: (poseID: ulong long, 8 bytes); (action type: int, 4 bytes)
+    template<class Skeleton>
+    bool decode_compact(mocap_netop::Data_Buffer* pDataBuffer, Codec_Stream<Skeleton> &stream, Data_MoCap_Frame<Skeleton> &data, bool bWithActions)
+    {
+        const unsigned N = Skeleton::JOINT_COUNT;
+
+        Byte_Reader reader;
+        reader.p = (const char*)pDataBuffer->pData;
+        reader.pEnd = reader.p + pDataBuffer->dataHeader.nDataSize;
+
+        uint8_t frameType;
+        uint32_t nSequence;
+        reader.Get(&frameType, 1);
+        reader.Get(&nSequence, 4);
+
+        // A delta frame can only be decoded right after the frame it refers to
+        if(!reader.bOk || (frameType == FRAME_DELTA && (!stream.bValid || nSequence != stream.nSequence + 1))){
+            stream.bValid = false;
+            return false;
+        }
+
+        typename Codec_Stream<Skeleton>::Quantized_Frame &poses = stream.posesNext;
+        poses.clear();
+
+        uint64_t nPose = reader.GetVarint();
+        if(nPose > pDataBuffer->dataHeader.nDataSize) reader.bOk = false; // a pose takes at least a byte
+        data.poses.resize(reader.bOk ? nPose : 0);
+
+        for(size_t j = 0; j < data.poses.size(); j ++){
+            typename Data_MoCap_Frame<Skeleton>::Pose &pose = data.poses[j];
+            uint8_t coding = POSE_INTRA;
+            if(frameType == FRAME_DELTA) reader.Get(&coding, 1);
+
+            pose.ID = reader.GetVarint();
+
+            Quantized_Pose<Skeleton> q;
+            if(coding == POSE_INTRA){
+                reader.Get(q.root, 12);
+                for(unsigned k = 0; k < N-1; k ++){
+                    int16_t rel[3];
+                    reader.Get(rel, 6);
+                    for(unsigned c = 0; c < 3; c ++) q.joints[k][c] = rel[c];
+                }
+            }
+            else{
+                const Quantized_Pose<Skeleton> *pRef = find_pose<Skeleton>(stream.poses, pose.ID, j);
+                if(pRef == 0){ reader.bOk = false; break; }
+
+                q = *pRef;
+                for(unsigned c = 0; c < 3; c ++) q.root[c] += (int32_t)reader.GetSigned();
+                for(unsigned k = 0; k < N-1; k ++)
+                    for(unsigned c = 0; c < 3; c ++) q.joints[k][c] += (int32_t)reader.GetSigned();
+            }
+
+            if(!reader.bOk) break;
+
+            dequantize_pose<Skeleton>(q, pose);
+            poses.push_back(std::make_pair(pose.ID, q));
+        }
+
+        if(bWithActions){
+            unsigned nAction = 0;
+            reader.Get(&nAction, 4);
+            if(nAction > pDataBuffer->dataHeader.nDataSize) reader.bOk = false;
+            data.actions.resize(reader.bOk ? nAction : 0);
+
+            for(auto &action : data.actions){
+                reader.Get(&(action.poseID), 8);
+                reader.Get(&(action.action), 4);
+            }
+            if(reader.p != reader.pEnd) reader.bOk = false; // a frame of another skeleton
+        }
+
+        if(!reader.bOk){
+            std::cout << "Error on decoding a compact mocap data of the skeleton " << Skeleton::Name() << "\n";
+            stream.bValid = false;
+            return false;
+        }
+
+        stream.poses.swap(poses);
+        stream.nSequence = nSequence;
+        stream.bValid = true;
+
+        return true;
+    }
+
+    template<class Skeleton>
+    void recvmsg_compact(mocap_netop::Data_Buffer* pDataBuffer, mocap_netop::Data_Repos<Data_MoCap_Recv, Data_MoCap_Frame<Skeleton> > &dataReposForClient, bool bWithActions)
+    {
+        assert(pDataBuffer->pData != 0);
+
+        std::shared_ptr< Data_MoCap_Frame<Skeleton> > data = dataReposForClient.AcquireData_RecvQueue();
+        data->timestamp = pDataBuffer->dataHeader.timestamp;
+
+        if(decode_compact<Skeleton>(pDataBuffer, codec_stream<Skeleton>(dataReposForClient), *data, bWithActions)){
+            dataReposForClient.PushData_RecvQueue( data );
+        }
+    }
+
+} // namespace: mocap_codec
+
+// callback for the server
+template<class Skeleton>
+void sendmsg_callback_mocap_server(mocap_netop::Data_Buffer* pDataBuffer, mocap_netop::Data_Repos<Data_MoCap_Frame<Skeleton>, Data_MoCap_Recv> &dataReposForServerClient)
+{
+    typedef MoCap_Wire_Layout<Skeleton> Layout;
+    (void)sizeof(mocap_codec::Pose_Layout_Check<Skeleton>);
+
+    // try to grab a mocap data that is to be sent from the server's repos
+    std::shared_ptr< Data_MoCap_Frame<Skeleton> > data = dataReposForServerClient.PopData_SendQueue();
+
+    if(data){ // not empty
+        Data_MoCap_Frame<Skeleton> *pData = data.get();
+
+        strcpy(pDataBuffer->dataHeader.data_name, "mocap");
+        pDataBuffer->dataHeader.timestamp = pData->timestamp;
+
+        // Pack the mocap data into a packet
+        // A data larger than the buffer is split into chunks by the transport
+
+        // data format: (number of poses: uint, 4 bytes); (pose1, pose2, ...); (number of action: uint, 4 bytes); (action1, action2, ..)
+        // format of pose: (poseID: ulong long, 8 bytes); (joint1, joint2,..,jointN)
+        // format of joint: (x: float, 4 bytes), (y: float, 4 bytes), (z: float, 4 bytes)
+        // format of action: (poseID: ulong long, 8 bytes); (action type: int, 4 bytes)
+
+        // 0. make sure the buffer can hold the data
+        unsigned nTotDataSize = (unsigned)Layout::FrameBytes(pData->poses.size(), pData->actions.size());
+        if(!pDataBuffer->Reserve(nTotDataSize)){
+            std::cout << "The buffer is too small for the mocap data: " << nTotDataSize << "\n";
+            return;
+        }
+        char *pDst = (char *)pDataBuffer->pData;
+
+        // 1. data of 3D poses
+        // (a) number of poses
+        unsigned nPose = pData->poses.size();
+        memcpy(pDst, &nPose, 4);
+        pDst += 4;
+
+        // (b) the ID and joints of each pose at once
+        for(const auto &pose : pData->poses){
+            memcpy(pDst, &pose, Layout::POSE_BYTES);
+            pDst += Layout::POSE_BYTES;
+        }
+
+        // 2. data of Pose actions
+        // (a) number of actions
+        unsigned nAction = pData->actions.size();
+        memcpy(pDst, &nAction, 4);
+        pDst += 4;
+
+        // (b) information of each action
+        for(auto &action : pData->actions){
+            memcpy(pDst, &(action.poseID), 8);
+            memcpy(pDst + 8, &(action.action), 4);
+            pDst += Layout::ACTION_BYTES;
+        }
+
+        assert(pDst - (char *)pDataBuffer->pData == (long)nTotDataSize);
+        pDataBuffer->dataHeader.nDataSize = nTotDataSize;
+    }
+}
+
+// The actions from the clients, which do not depend on the skeleton
+template<class Skeleton>
+void recvmsg_callback_mocap_server(mocap_netop::Data_Buffer* pDataBuffer, mocap_netop::Data_Repos<Data_MoCap_Frame<Skeleton>, Data_MoCap_Recv> &dataReposForServerClient)
+{
+    // try to recieve a mocap data and save it to the client's repos
+    assert(pDataBuffer->pData != 0);
+
+    // Read out the mocap data from a packet
+    // The transport has gathered the chunks of a large data, so a buffer contains a mocap data
+
+    // data format: (number of action: int, 4 bytes); (action1, action2, ..)
+    // format of action: (poseID: ulong long, 8 bytes); (action type: int, 4 bytes)
+    const char *pSrc = (const char *)pDataBuffer->pData;
+    unsigned nDataSize = pDataBuffer->dataHeader.nDataSize, nAction;
+    if(nDataSize < 4) return;
+    memcpy(&nAction, pSrc, 4);
+    if(4 + (unsigned long long)nAction * MoCap_Wire_Layout<Skeleton>::ACTION_BYTES != nDataSize){
+        std::cout << "A wrong size of the action data: " << nDataSize << "\n";
+        return;
+    }
+
+    // Create a data from the buffer
+    std::shared_ptr<Data_MoCap_Recv> data = dataReposForServerClient.AcquireData_RecvQueue();
+    data->timestamp = pDataBuffer->dataHeader.timestamp;
+    data->actions.resize(nAction);
+
+    const char *pAction = pSrc + 4;
+    for(auto &action : data->actions){
+        memcpy(&(action.poseID), pAction, 8);
+        memcpy(&(action.action), pAction + 8, 4);
+        pAction += MoCap_Wire_Layout<Skeleton>::ACTION_BYTES;
+    }
+
+    dataReposForServerClient.PushData_RecvQueue( data );
+}
+
+// callback for projecting a frame of the server for a subscription
+template<class Skeleton>
+void project_callback_mocap_server(const mocap_netop::Data_Buffer &frameData, const mocap_netop::Stream_Subscription &subscription, mocap_netop::Data_Buffer *pProjected)
+{
+    typedef MoCap_Wire_Layout<Skeleton> Layout;
+
+    // Only the frames of sendmsg_callback_mocap_server are projected; their size tells them from the compact ones
+    const char *pSrc = (const char *)frameData.pData;
+    unsigned nPose, nAction;
+    if(!mocap_codec::read_plain_counts<Skeleton>(pSrc, frameData.dataHeader.nDataSize, nPose, nAction)) return;
+
+    // data format: (joint mask: uint, 4 bytes); (number of poses: uint, 4 bytes); (pose1, pose2, ...); (number of action: uint, 4 bytes); (action1, action2, ..)
+    // format of pose: (poseID: ulong long, 8 bytes); (the joints in the mask, in their order)
+    // format of action: (poseID: ulong long, 8 bytes); (action type: int, 4 bytes)
+    uint32_t jointMask = subscription.jointMask & Layout::ALL_JOINTS;
+    unsigned nJoint = 0;
+    for(unsigned k = 0; k < Layout::JOINT_COUNT; k ++) nJoint += (jointMask >> k) & 1;
+
+    // 0. make sure the buffer can hold the data if all the poses are wanted
+    if(!pProjected->Reserve(12 + nPose * (8 + nJoint * Layout::JOINT_BYTES) + nAction * Layout::ACTION_BYTES)){
+        std::cout << "The buffer is too small for the projected mocap data\n";
+        return;
+    }
+    char *pDst = (char *)pProjected->pData;
+    unsigned nProjectedSize = 8;
+
+    // 1. the poses wanted, with the joints wanted
+    unsigned nPoseWanted = 0;
+    for(unsigned i = 0; i < nPose; i ++){
+        const char *pPose = pSrc + 4 + i * Layout::POSE_BYTES;
+        unsigned long long poseID;
+        memcpy(&poseID, pPose, 8);
+        if(!subscription.HasPose(poseID)) continue;
+
+        if(jointMask == Layout::ALL_JOINTS){
+            memcpy(pDst + nProjectedSize, pPose, Layout::POSE_BYTES);
+            nProjectedSize += Layout::POSE_BYTES;
+        }
+        else{
+            memcpy(pDst + nProjectedSize, pPose, 8);
+            nProjectedSize += 8;
+            for(unsigned k = 0; k < Layout::JOINT_COUNT; k ++){
+                if(((jointMask >> k) & 1) == 0) continue;
+                memcpy(pDst + nProjectedSize, pPose + Layout::JointOffset(k), Layout::JOINT_BYTES);
+                nProjectedSize += Layout::JOINT_BYTES;
+            }
+        }
+        nPoseWanted ++;
+    }
+    memcpy(pDst, &jointMask, 4);
+    memcpy(pDst + 4, &nPoseWanted, 4);
+
+    // 2. the actions of the poses wanted
+    unsigned nActionWanted = 0, nActionPos = nProjectedSize;
+    nProjectedSize += 4;
+    if(subscription.bActions){
+        const char *pActions = pSrc + 8 + nPose * Layout::POSE_BYTES;
+        for(unsigned j = 0; j < nAction; j ++){
+            unsigned long long poseID;
+            memcpy(&poseID, pActions + j * Layout::ACTION_BYTES, 8);
+            if(!subscription.HasPose(poseID)) continue;
+
+            memcpy(pDst + nProjectedSize, pActions + j * Layout::ACTION_BYTES, Layout::ACTION_BYTES);
+            nProjectedSize += Layout::ACTION_BYTES;
+            nActionWanted ++;
+        }
+    }
+    memcpy(pDst + nActionPos, &nActionWanted, 4);
+
+    strcpy(pProjected->dataHeader.data_name, "mocap_p");
+    pProjected->dataHeader.nDataSize = nProjectedSize;
+}
+
+// callback for the client 1
+template<class Skeleton>
+void sendmsg_callback_mocap_client_actionRecog(mocap_netop::Data_Buffer* pDataBuffer, mocap_netop::Data_Repos<Data_MoCap_Recv, Data_MoCap_Frame<Skeleton> > &dataReposForClient)
+{
+    // Send the action recognition result to the server, which does not depend on the skeleton
+
+    // try to grab a mocap data that is to be sent from the client's repos
+    std::shared_ptr<Data_MoCap_Recv> data = dataReposForClient.PopData_SendQueue();
+
+    if(data){ // not empty
+        Data_MoCap_Recv *pData = data.get();
+
+        strcpy(pDataBuffer->dataHeader.data_name, "mocap");
+        pDataBuffer->dataHeader.timestamp = pData->timestamp; // the frame the actions are recognized from
+
+        // data format: (number of action: int, 4 bytes); (action1, action2, ..)
+        // format of action: (poseID: ulong long, 8 bytes); (action type: int, 4 bytes)
+
+        // 0. make sure the buffer can hold the data
+        unsigned nTotDataSize = 4 + pData->actions.size() * MoCap_Wire_Layout<Skeleton>::ACTION_BYTES;
+        if(!pDataBuffer->Reserve(nTotDataSize)){
+            std::cout << "The buffer is too small for the action data: " << nTotDataSize << "\n";
+            return;
+        }
+        char *pDst = (char *)pDataBuffer->pData;
+
+        // 1. data of Pose actions
+        unsigned nAction = pData->actions.size();
+        memcpy(pDst, &nAction, 4);
+        pDst += 4;
+
+        for(auto &action : pData->actions){
+            memcpy(pDst, &(action.poseID), 8);
+            memcpy(pDst + 8, &(action.action), 4);
+            pDst += MoCap_Wire_Layout<Skeleton>::ACTION_BYTES;
+        }
+
+        pDataBuffer->dataHeader.nDataSize = nTotDataSize;
+    }
+}
+
+template<class Skeleton>
+void recvmsg_callback_mocap_client_actionRecog(mocap_netop::Data_Buffer* pDataBuffer, mocap_netop::Data_Repos<Data_MoCap_Recv, Data_MoCap_Frame<Skeleton> > &dataReposForClient)
+{
+    // Only receive the mocap data of 3d poses from the server
+    mocap_codec::recvmsg_plain<Skeleton>(pDataBuffer, dataReposForClient, false);
+}
+
+template<class Skeleton>
+void recvmsg_callback_mocap_client_contentRender(mocap_netop::Data_Buffer* pDataBuffer, mocap_netop::Data_Repos<Data_MoCap_Recv, Data_MoCap_Frame<Skeleton> > &dataReposForClient)
+{
+    // Receive all of the mocap data (3d poses + pose action) from the server
+    mocap_codec::recvmsg_plain<Skeleton>(pDataBuffer, dataReposForClient, true);
+}
+
+template<class Skeleton>
+void sendmsg_callback_mocap_server_compact(mocap_netop::Data_Buffer* pDataBuffer, mocap_netop::Data_Repos<Data_MoCap_Frame<Skeleton>, Data_MoCap_Recv> &dataReposForServerClient)
+{
+    using namespace mocap_codec;
+    typedef MoCap_Wire_Layout<Skeleton> Layout;
+    const unsigned N = Skeleton::JOINT_COUNT;
+
+    // try to grab a mocap data that is to be sent from the server's repos
+    std::shared_ptr< Data_MoCap_Frame<Skeleton> > data = dataReposForServerClient.PopData_SendQueue();
+
+    if(!data) return; // empty
+
+    Data_MoCap_Frame<Skeleton> *pData = data.get();
+    Codec_Stream<Skeleton> &stream = codec_stream<Skeleton>(dataReposForServerClient);
+
+    unsigned nKeyframeInterval = mocap_codec_get_keyframe_interval();
+    uint32_t nSequence = stream.bValid ? stream.nSequence + 1 : 0;
+    bool bKeyframe = !stream.bValid || nSequence % nKeyframeInterval == 0;
+
+    // 0. make sure the buffer can hold the data in the worst case
+    unsigned nMaxDataSize = 1 + 4 + 10 + pData->poses.size() * Layout::COMPACT_MAX_POSE_BYTES + 4 + pData->actions.size() * Layout::ACTION_BYTES;
+    if(!pDataBuffer->Reserve(nMaxDataSize)){
+        std::cout << "The buffer is too small for the mocap data: " << nMaxDataSize << "\n";
+        return;
+    }
+
+    strcpy(pDataBuffer->dataHeader.data_name, "mocap");
+    pDataBuffer->dataHeader.timestamp = pData->timestamp;
+
+    Byte_Writer writer;
+    writer.p = (char*)pDataBuffer->pData;
+
+    uint8_t frameType = bKeyframe ? FRAME_KEY : FRAME_DELTA;
+    writer.Put(&frameType, 1);
+    writer.Put(&nSequence, 4);
+
+    // 1. data of 3D poses
+    typename Codec_Stream<Skeleton>::Quantized_Frame &poses = stream.posesNext;
+    poses.clear();
+
+    writer.PutVarint(pData->poses.size());
+    for(size_t j = 0; j < pData->poses.size(); j ++){
+        const typename Data_MoCap_Frame<Skeleton>::Pose &pose = pData->poses[j];
+        Quantized_Pose<Skeleton> q;
+        quantize_pose<Skeleton>(pose, q);
+
+        const Quantized_Pose<Skeleton> *pRef = bKeyframe ? 0 : find_pose<Skeleton>(stream.poses, pose.ID, j);
+        if(pRef == 0){ // keyframe or a new pose
+            if(!bKeyframe){
+                uint8_t coding = POSE_INTRA;
+                writer.Put(&coding, 1);
+            }
+            writer.PutVarint(pose.ID);
+            writer.Put(q.root, 12);
+            for(unsigned k = 0; k < N-1; k ++){
+                int16_t rel[3] = {(int16_t)q.joints[k][0], (int16_t)q.joints[k][1], (int16_t)q.joints[k][2]};
+                writer.Put(rel, 6);
+            }
+        }
+        else{
+            const Quantized_Pose<Skeleton> &ref = *pRef;
+
+            uint8_t coding = POSE_DELTA;
+            writer.Put(&coding, 1);
+            writer.PutVarint(pose.ID);
+            for(unsigned c = 0; c < 3; c ++) writer.PutSigned((int64_t)q.root[c] - ref.root[c]);
+            for(unsigned k = 0; k < N-1; k ++)
+                for(unsigned c = 0; c < 3; c ++) writer.PutSigned((int64_t)q.joints[k][c] - ref.joints[k][c]);
+        }
+
+        poses.push_back(std::make_pair(pose.ID, q));
+    }
+
+    // 2. data of Pose actions
+    unsigned nAction = pData->actions.size();
+    writer.Put(&nAction, 4);
+    for(auto &action : pData->actions){
+        writer.Put(&(action.poseID), 8);
+        writer.Put(&(action.action), 4);
+    }
+
+    unsigned nDataSize = writer.p - (char *)pDataBuffer->pData;
+    assert(nDataSize <= pDataBuffer->dataHeader.nMaxDataSize);
+    pDataBuffer->dataHeader.nDataSize = nDataSize;
+
+    // the next delta frame refers to the quantized poses
+    stream.poses.swap(poses);
+    stream.nSequence = nSequence;
+    stream.bValid = true;
+}
+
+template<class Skeleton>
+void recvmsg_callback_mocap_client_actionRecog_compact(mocap_netop::Data_Buffer* pDataBuffer, mocap_netop::Data_Repos<Data_MoCap_Recv, Data_MoCap_Frame<Skeleton> > &dataReposForClient)
+{
+    // Only receive the mocap data of 3d poses from the server
+    mocap_codec::recvmsg_compact<Skeleton>(pDataBuffer, dataReposForClient, false);
+}
+
+template<class Skeleton>
+void recvmsg_callback_mocap_client_contentRender_compact(mocap_netop::Data_Buffer* pDataBuffer, mocap_netop::Data_Repos<Data_MoCap_Recv, Data_MoCap_Frame<Skeleton> > &dataReposForClient)
+{
+    // Receive all of the mocap data (3d poses + pose action) from the server
+    mocap_codec::recvmsg_compact<Skeleton>(pDataBuffer, dataReposForClient, true);
+}
+
+#endif // MOCAP_CODEC_H
@@ -11,9 +11,11 @@
 // It is a class that implements a data type which will be transmitted between the server and the clients. 
 // Meanwhile, the corresponding callback functions are created for the server and clients to tell them how to
 // transform between the data type and the format of the network packet.  
+// The frames of 3D poses are of a skeleton (Data_MoCap_Frame<Skeleton>, see Skeleton.h), and Data_MoCap_Send is that
+// of the 17 COCO keypoints. The callbacks for the other skeletons are the templates of MoCap_Codec.h.
 
 // .SECTION See also
-// CMoCapTCPServer CMoCapTCPClient
+// CMoCapTCPServer CMoCapTCPClient Skeleton_Coco17 MoCap_Wire_Layout
 
 #ifndef MOCAP_DATA_H
 #define MOCAP_DATA_H
@@ -25,13 +27,18 @@
 #include <queue>
 
 #include "NetOp.h"
+#include "Subscription.h"
+#include "Skeleton.h"
 
-#define JOINT_NUMBER 17
+#define JOINT_NUMBER 17 // joints of a pose of Data_MoCap_Send
 
 ////////////////////////////////////////////////////////////////
-/// The data type of Data_MoCap: represents a frame of 3D poses
+/// The data type of Data_MoCap: represents a frame of 3D poses of a skeleton
 ///
-struct Data_MoCap_Send{
+template<class Skeleton>
+struct Data_MoCap_Frame{
+    typedef Skeleton Skeleton_Type;
+
     uint64_t timestamp;
     
     // data of skeletons at one frame
@@ -41,7 +48,7 @@ struct Data_MoCap_Send{
 
     struct Pose{
         unsigned long long ID;
-        Joint joints[JOINT_NUMBER];
+        Joint joints[Skeleton::JOINT_COUNT];
     };
     
     struct PoseAction{
@@ -53,7 +60,12 @@ struct Data_MoCap_Send{
     std::vector<PoseAction> actions; // recognized action type of each pose  
 };
 
+typedef Data_MoCap_Frame<Skeleton_Coco17> Data_MoCap_Send;
+static_assert(JOINT_NUMBER == Skeleton_Coco17::JOINT_COUNT, "JOINT_NUMBER is the joints of Data_MoCap_Send");
+
 struct Data_MoCap_Recv{
+    uint64_t timestamp = 0; // timestamp of the frame the actions are recognized from
+
     struct PoseAction{
         unsigned long long poseID;
         int action;
@@ -68,11 +80,32 @@ struct Data_MoCap_Recv{
 void sendmsg_callback_mocap_server(mocap_netop::Data_Buffer* pDataBuffer, mocap_netop::Data_Repos<Data_MoCap_Send, Data_MoCap_Recv> &dataReposForServer);
 void recvmsg_callback_mocap_server(mocap_netop::Data_Buffer* pDataBuffer, mocap_netop::Data_Repos<Data_MoCap_Send, Data_MoCap_Recv> &dataReposForServer);
 
+// The projection of a frame of sendmsg_callback_mocap_server for a subscription (see CMoCapTCPServer::SetProjectionCallback):
+// the poses wanted with the joints wanted, and their actions if wanted, as a "mocap_p" message. The recv callbacks of the
+// clients above read it as well, with the joints not wanted as 0. The frames of the compact codec are not projected.
+void project_callback_mocap_server(const mocap_netop::Data_Buffer &frameData, const mocap_netop::Stream_Subscription &subscription, mocap_netop::Data_Buffer *pProjected);
+
 // -- for client
 void sendmsg_callback_mocap_client_actionRecog(mocap_netop::Data_Buffer* pDataBuffer, mocap_netop::Data_Repos<Data_MoCap_Recv, Data_MoCap_Send> &dataReposForClient);
 void recvmsg_callback_mocap_client_actionRecog(mocap_netop::Data_Buffer* pDataBuffer, mocap_netop::Data_Repos<Data_MoCap_Recv, Data_MoCap_Send> &dataReposForClient);
 void recvmsg_callback_mocap_client_contentRender(mocap_netop::Data_Buffer* pDataBuffer, mocap_netop::Data_Repos<Data_MoCap_Recv, Data_MoCap_Send> &dataReposForClient);
 
+// The compact variants of the callbacks above. The joints are quantized to millimetres (the root of a pose in int32 and the
+// other joints in int16 relative to the root), and are coded as varint differences to the same pose (by ID) in the previous
+// frame. Every few frames a keyframe is coded without reference, so a new or resynced client can start decoding from it;
+// the frames before that are dropped by the client. A server with a compact send callback needs clients with a compact recv callback.
+// -- for server
+void sendmsg_callback_mocap_server_compact(mocap_netop::Data_Buffer* pDataBuffer, mocap_netop::Data_Repos<Data_MoCap_Send, Data_MoCap_Recv> &dataReposForServer);
+
+// -- for client
+void recvmsg_callback_mocap_client_actionRecog_compact(mocap_netop::Data_Buffer* pDataBuffer, mocap_netop::Data_Repos<Data_MoCap_Recv, Data_MoCap_Send> &dataReposForClient);
+void recvmsg_callback_mocap_client_contentRender_compact(mocap_netop::Data_Buffer* pDataBuffer, mocap_netop::Data_Repos<Data_MoCap_Recv, Data_MoCap_Send> &dataReposForClient);
+
+// Set how often (in frames) the compact codec sends a keyframe. 1 means all frames are keyframes. It is for the frames of all
+// the skeletons.
+void mocap_codec_set_keyframe_interval(unsigned nInterval);
+unsigned mocap_codec_get_keyframe_interval();
+
 ////////////////////////////////////////////////////////////////
 /// Other data types.... 
 /// Note that one type should be associated with a sendmsg callback and a recvmsg callback.
@@ -0,0 +1,366 @@
+/*******************************************************************
+* Author	: wwyang
+* Date		: 2026.10.17
+* Copyright : Zhejiang Gongshang University
+* Head File :
+* Version   : 1.0
+*********************************************************************/
+// .NAME Multicast_Sender/Multicast_Receiver
+
+// .SECTION Description
+// Here provides a UDP multicast channel for the frames of a server, so the server sends a frame once to a group
+// however many clients render it, instead of writing it to each of their connections. A frame goes as the message
+// a socket would carry, (Data_Header of the whole entity); (entity), split into datagrams that fit in a packet:
+//     format of datagram : (Multicast_Datagram_Header, 24 bytes); (bytes nOffset ~ nOffset+n of the message)
+// The frames are numbered in the order they are sent. UDP may lose or reorder the datagrams, and nothing is resent:
+// a receiver only completes the newest frame it has seen. Once a datagram of a newer frame comes, the frame in
+// progress is given up, so a gap costs the frames in it and never stalls the stream. The channel is one-way; the
+// clients still talk to the server over TCP.
+
+// .SECTION See also
+// CMoCapTCPServer, CMoCapTCPClient, Frame_Assembler
+
+#ifndef MULTICASTCHANNEL_H
+#define MULTICASTCHANNEL_H
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <chrono>
+#include <string.h>
+#include <stdint.h>
+
+#include "NetPlatform.h"
+#include "NetOp.h"
+
+namespace mocap_netop {
+
+    #define MULTICAST_MAGIC "MCF1"
+
+    struct Multicast_Datagram_Header{
+        char magic[4]; // MULTICAST_MAGIC
+        uint32_t nStream; // random number of the sender, changed when it is opened again
+        uint32_t nSequence; // number of the frame
+        uint32_t nFrameSize; // bytes of the message: the Data_Header and the entity
+        uint32_t nOffset; // position of the datagram's bytes in the message
+        uint16_t iFragment, nFragment; // number of the datagram in the frame and the datagrams of the frame
+    };
+
+    const unsigned MULTICAST_DATAGRAM_SIZE = 1472; // a datagram in an Ethernet packet without IP fragmentation
+
+    // Description:
+    // Parse "ip:port" into an address. Return false if it is not in this format.
+    inline bool multicast_parse_address(const std::string &addressPort, struct sockaddr_in &addr)
+    {
+        auto index = addressPort.find_last_of(':');
+        if(index == addressPort.npos) return false;
+
+        memset((char *) &addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = inet_addr(addressPort.substr(0, index).c_str());
+        addr.sin_port = htons(std::stoi(addressPort.substr(index + 1)));
+        return true;
+    }
+
+    // Sender of the frames to a multicast group, owned by the server. It should only be used by one thread.
+    class Multicast_Sender{
+    public:
+        Multicast_Sender() {}
+        Multicast_Sender(const Multicast_Sender&) = delete;
+        Multicast_Sender& operator=(const Multicast_Sender&) = delete;
+        ~Multicast_Sender() { Close(); }
+
+        // Description:
+        // Open a socket sending to the group "ip:port" (e.g., 239.255.0.1:5010) through the interface with the address
+        // interfaceIp (the default one if it is empty; 127.0.0.1 keeps the frames on the host). ttl bounds the routers passed.
+        bool Open(const std::string &groupAddressPort, const std::string &interfaceIp = "", unsigned ttl = 1)
+        {
+            Close();
+            socket_startup();
+
+            struct sockaddr_in group;
+            if(!multicast_parse_address(groupAddressPort, group)){
+                std::cout << "Error in the multicast address which should be in the format such as (239.255.0.1:5010)" << std::endl;
+                return false;
+            }
+
+            _sockfd = socket(AF_INET, SOCK_DGRAM, 0);
+            if(_sockfd < 0){
+                std::cout << "Error on opening socket" << std::endl;
+                return false;
+            }
+
+            unsigned char nTTL = (unsigned char)std::min(ttl, 255u), bLoop = 1;
+            int nBuffer = 1 << 20;
+            setsockopt(_sockfd, IPPROTO_IP, IP_MULTICAST_TTL, (const char*)&nTTL, sizeof(nTTL));
+            setsockopt(_sockfd, IPPROTO_IP, IP_MULTICAST_LOOP, (const char*)&bLoop, sizeof(bLoop)); // for the clients on the host
+            setsockopt(_sockfd, SOL_SOCKET, SO_SNDBUF, (const char*)&nBuffer, sizeof(nBuffer));
+            if(!interfaceIp.empty()){
+                struct in_addr iface;
+                iface.s_addr = inet_addr(interfaceIp.c_str());
+                setsockopt(_sockfd, IPPROTO_IP, IP_MULTICAST_IF, (const char*)&iface, sizeof(iface));
+            }
+
+            // connected to the group, so the datagrams are written with the gather writes of the sockets
+            if(connect(_sockfd, (struct sockaddr *) &group, sizeof(group)) < 0){
+                std::cout << "Error on the multicast group " << groupAddressPort << ": " << socket_last_error() << std::endl;
+                Close();
+                return false;
+            }
+
+            uint64_t nTime = std::chrono::high_resolution_clock::now().time_since_epoch().count();
+            _nStream = (uint32_t)(nTime ^ (nTime >> 32)) ^ (uint32_t)(uintptr_t)this;
+            _nSequence = 0;
+            return true;
+        }
+
+        void Close()
+        {
+            if(_sockfd == INVALID_SOCKET) return;
+
+            closesocket(_sockfd);
+            _sockfd = INVALID_SOCKET;
+        }
+
+        bool IsOpen() const { return _sockfd != INVALID_SOCKET; }
+
+        // Description:
+        // Send a sealed frame in datagrams. Return false if it is too large or the socket fails.
+        bool Send(const Wire_Frame &frame)
+        {
+            if(_sockfd == INVALID_SOCKET || frame.headers.empty()) return false;
+
+            // the frame goes as one message, however it is chunked for the sockets
+            Data_Header header = frame.headers[0];
+            if(header.nTotalSize > 0) header.nDataSize = header.nTotalSize;
+            header.nTotalSize = header.nOffset = 0;
+
+            const unsigned nHeadSize = sizeof(Data_Header);
+            const unsigned nPayload = MULTICAST_DATAGRAM_SIZE - sizeof(Multicast_Datagram_Header);
+            size_t nFrameSize = nHeadSize + (size_t)header.nDataSize;
+            size_t nFragment = (nFrameSize + nPayload - 1) / nPayload;
+            if(nFragment > 0xFFFF) return false;
+
+            Multicast_Datagram_Header datagram;
+            memcpy(datagram.magic, MULTICAST_MAGIC, sizeof(datagram.magic));
+            datagram.nStream = _nStream;
+            datagram.nSequence = _nSequence ++;
+            datagram.nFrameSize = (uint32_t)nFrameSize;
+            datagram.nFragment = (uint16_t)nFragment;
+
+            for(size_t i = 0; i < nFragment; i ++){
+                size_t nOffset = i * nPayload, nEnd = std::min(nFrameSize, nOffset + nPayload);
+                datagram.nOffset = (uint32_t)nOffset;
+                datagram.iFragment = (uint16_t)i;
+
+                // (datagram header); (piece of the Data_Header); (piece of the entity)
+                Wire_Segment segments[3];
+                unsigned nSegment = 0;
+                segments[nSegment++] = Wire_Segment{(const char*)&datagram, sizeof(datagram)};
+                if(nOffset < nHeadSize)
+                    segments[nSegment++] = Wire_Segment{(const char*)&header + nOffset, std::min<size_t>(nEnd, nHeadSize) - nOffset};
+                if(nEnd > nHeadSize){
+                    size_t nStart = std::max<size_t>(nOffset, nHeadSize) - nHeadSize;
+                    segments[nSegment++] = Wire_Segment{frame.entity.data() + nStart, nEnd - nHeadSize - nStart};
+                }
+
+                if(socket_send_gather(_sockfd, segments, nSegment) < 0){
+                    std::cout << "ERROR on writing to the multicast group: " << socket_last_error() << std::endl;
+                    return false;
+                }
+            }
+
+            return true;
+        }
+
+    private:
+        SOCKET _sockfd = INVALID_SOCKET;
+        uint32_t _nStream = 0;
+        uint32_t _nSequence = 0; // number of the next frame
+    };
+
+    // Receiver of the frames of a multicast group, owned by a client. It should only be used by one thread.
+    class Multicast_Receiver{
+    public:
+        // Description:
+        // nMaxFrameSize bounds the message of a frame: its Data_Header and entity
+        explicit Multicast_Receiver(unsigned nMaxFrameSize = 16u << 20) : _nMaxFrameSize(nMaxFrameSize) {}
+        Multicast_Receiver(const Multicast_Receiver&) = delete;
+        Multicast_Receiver& operator=(const Multicast_Receiver&) = delete;
+        ~Multicast_Receiver() { Close(); }
+
+        // Description:
+        // Join the group "ip:port" on the interface with the address interfaceIp (the default one if it is empty).
+        // Several receivers on a host may join the same group.
+        bool Open(const std::string &groupAddressPort, const std::string &interfaceIp = "")
+        {
+            Close();
+            socket_startup();
+
+            struct sockaddr_in group;
+            if(!multicast_parse_address(groupAddressPort, group)){
+                std::cout << "Error in the multicast address which should be in the format such as (239.255.0.1:5010)" << std::endl;
+                return false;
+            }
+
+            _sockfd = socket(AF_INET, SOCK_DGRAM, 0);
+            if(_sockfd < 0){
+                std::cout << "Error on opening socket" << std::endl;
+                return false;
+            }
+
+            int bReuse = 1, nBuffer = 4 << 20;
+            setsockopt(_sockfd, SOL_SOCKET, SO_REUSEADDR, (const char*)&bReuse, sizeof(bReuse));
+#ifdef SO_REUSEPORT
+            setsockopt(_sockfd, SOL_SOCKET, SO_REUSEPORT, (const char*)&bReuse, sizeof(bReuse));
+#endif
+            setsockopt(_sockfd, SOL_SOCKET, SO_RCVBUF, (const char*)&nBuffer, sizeof(nBuffer)); // ride out a burst of datagrams
+
+            struct sockaddr_in local = group;
+            local.sin_addr.s_addr = htonl(INADDR_ANY);
+            if(bind(_sockfd, (struct sockaddr *) &local, sizeof(local)) < 0){
+                std::cout << "Error on binding socket: " << socket_last_error() << std::endl;
+                Close();
+                return false;
+            }
+
+            struct ip_mreq membership;
+            membership.imr_multiaddr = group.sin_addr;
+            membership.imr_interface.s_addr = interfaceIp.empty() ? htonl(INADDR_ANY) : inet_addr(interfaceIp.c_str());
+            if(setsockopt(_sockfd, IPPROTO_IP, IP_ADD_MEMBERSHIP, (const char*)&membership, sizeof(membership)) < 0){
+                std::cout << "Error on joining the multicast group " << groupAddressPort << ": " << socket_last_error() << std::endl;
+                Close();
+                return false;
+            }
+
+            socket_set_nonblocking(_sockfd);
+
+            _datagram.resize(MULTICAST_DATAGRAM_SIZE);
+            _bInFrame = _bDelivered = false;
+            _nLost = _nDelivered = 0;
+            return true;
+        }
+
+        void Close()
+        {
+            if(_sockfd == INVALID_SOCKET) return;
+
+            closesocket(_sockfd);
+            _sockfd = INVALID_SOCKET;
+        }
+
+        bool IsOpen() const { return _sockfd != INVALID_SOCKET; }
+
+        // Description:
+        // Largest message of a frame, for the Frame_Assembler of the receiver
+        unsigned GetMaxFrameSize() const { return _nMaxFrameSize; }
+
+        // Description:
+        // Frames skipped for the datagrams lost or late, and frames completed
+        uint64_t GetLostCount() const { return _nLost; }
+        uint64_t GetDeliveredCount() const { return _nDelivered; }
+
+        // Description:
+        // Put the frames completed by the datagrams that arrived into the assembler, sleeping up to timeoutMs if none
+        // is there. Return the number of frames put, 0 on timeout, -1 on error of the socket.
+        int Read(Frame_Assembler &assembler, int timeoutMs)
+        {
+            if(_sockfd == INVALID_SOCKET) return -1;
+
+            if(socket_wait(_sockfd, false, timeoutMs) <= 0) return 0;
+
+            int nFrame = 0;
+            while(true){
+                auto n = recv(_sockfd, _datagram.data(), (int)_datagram.size(), 0);
+                if(n < 0){
+                    if(socket_would_block()) break;
+                    return -1;
+                }
+
+                if(Accept(_datagram.data(), (size_t)n)){
+                    assembler.Feed(_frame.data(), _frame.size());
+                    nFrame ++;
+                }
+            }
+
+            return nFrame;
+        }
+
+    private:
+        // Put a datagram into the frame in progress. Return true if it completes the frame.
+        bool Accept(const char *pData, size_t nSize)
+        {
+            const size_t nHeadSize = sizeof(Multicast_Datagram_Header);
+            if(nSize < nHeadSize) return false;
+
+            Multicast_Datagram_Header datagram;
+            memcpy(&datagram, pData, nHeadSize);
+            size_t nPayload = nSize - nHeadSize;
+
+            if(memcmp(datagram.magic, MULTICAST_MAGIC, sizeof(datagram.magic)) != 0
+                    || datagram.nFrameSize > _nMaxFrameSize || datagram.nFrameSize < sizeof(Data_Header)
+                    || datagram.iFragment >= datagram.nFragment || datagram.nOffset + (uint64_t)nPayload > datagram.nFrameSize)
+                return false; // not ours or broken
+
+            if(_bInFrame && datagram.nStream != _nStream){ // the server is restarted: start over
+                _bInFrame = _bDelivered = false;
+            }
+
+            if(!_bInFrame || (int32_t)(datagram.nSequence - _nSequence) > 0){
+                // a newer frame: the one in progress, if any, is given up
+                if(_bDelivered && (int32_t)(datagram.nSequence - _nLastDelivered) <= 0)
+                    return false; // late, older than what was delivered
+
+                _bInFrame = true;
+                _nStream = datagram.nStream;
+                _nSequence = datagram.nSequence;
+                _frame.resize(datagram.nFrameSize);
+                _received.assign(datagram.nFragment, false);
+                _nReceived = 0;
+            }
+            else if(datagram.nSequence != _nSequence){
+                return false; // late, older than the frame in progress
+            }
+
+            if(datagram.nFrameSize != _frame.size() || datagram.nFragment != _received.size()
+                    || _received[datagram.iFragment] || _nReceived == _received.size())
+                return false; // inconsistent, repeated or for a frame already delivered
+
+            memcpy(&_frame[datagram.nOffset], pData + nHeadSize, nPayload);
+            _received[datagram.iFragment] = true;
+            _nReceived ++;
+
+            if(_nReceived < _received.size()) return false;
+
+            // complete: the frames between it and the last one delivered are lost
+            if(_bDelivered) _nLost += (uint32_t)(_nSequence - _nLastDelivered - 1);
+            _bDelivered = true;
+            _nLastDelivered = _nSequence;
+            _nDelivered ++;
+
+            // the Data_Header must tell the entity that is there
+            Data_Header header;
+            memcpy(&header, _frame.data(), sizeof(header));
+            return header.nTotalSize == 0 && (size_t)header.nDataSize + sizeof(Data_Header) == _frame.size();
+        }
+
+    private:
+        SOCKET _sockfd = INVALID_SOCKET;
+        unsigned _nMaxFrameSize;
+        std::vector<char> _datagram; // memory of a datagram received
+
+        bool _bInFrame = false; // a frame is in progress (or just completed)
+        uint32_t _nStream = 0, _nSequence = 0; // the frame in progress
+        std::vector<char> _frame; // its message
+        std::vector<bool> _received; // its datagrams received
+        size_t _nReceived = 0;
+
+        bool _bDelivered = false;
+        uint32_t _nLastDelivered = 0; // number of the last frame completed
+        uint64_t _nLost = 0, _nDelivered = 0;
+    };
+
+} // namespace: mocap_netop
+
+#endif // MULTICASTCHANNEL_H
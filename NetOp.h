@@ -18,11 +18,17 @@
 #define _NETOP_H_
 
 #include <string>
+#include <string.h>
 #include <vector>
+#include <algorithm>
 #include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <functional>
 #include <memory>
-#include <queue>
-#include <iostream>;
+#include <iostream>
+
+#include "LatencyTrace.h"
 
 namespace mocap_netop {
 
@@ -38,6 +44,14 @@ namespace mocap_netop {
         
         // Data size
         unsigned nDataSize=0, nMaxDataSize=0;
+        
+        // An entity larger than the buffer of the transport is sent in several chunks, each with its own header.
+        // nTotalSize is the size of the whole entity (0 if it is not chunked) and nOffset the position of the chunk in it
+        unsigned nTotalSize=0, nOffset=0;
+        
+        // Monotonic time (nanoseconds) of the sender when the message was sealed for the sockets; 0 if it is not stamped.
+        // The receiver turns it into its own clock by the estimate of the clock of the sender (see Clock_Estimate).
+        uint64_t sendTime=0;
     };
 
 	struct Data_Buffer{
@@ -45,8 +59,512 @@ namespace mocap_netop {
 
 		// Pointer to the data entity
 		void* pData = 0;
+		
+		// Growable memory behind pData, set by the transport; 0 if the memory is fixed
+		std::vector<char> *pStorage = 0;
+		
+		// Description:
+		// Make sure that pData can hold nSize bytes, growing the memory if it is allowed.
+		// Return false if the memory is fixed and too small.
+		bool Reserve(unsigned nSize)
+		{
+		    if(nSize <= dataHeader.nMaxDataSize) return true;
+		    if(pStorage == 0) return false;
+		    
+		    pStorage->resize(nSize);
+		    pData = pStorage->data();
+		    dataHeader.nMaxDataSize = nSize;
+		    
+		    return true;
+		}
 	};
     
+    // A piece of memory on the wire
+    struct Wire_Segment{
+        const char *pData;
+        size_t nSize;
+    };
+    
+    // A message encoded once for all the connections: its entity and the headers of its chunks. An entity larger than
+    // the buffer of the transport is split into chunks, each of which is preceded by a header telling its position in
+    // the entity. Once sealed, a frame is not changed any more, so it is shared by the outbound queues of all the
+    // connections and written with gather I/O straight from its memory.
+    struct Wire_Frame{
+        std::vector<Data_Header> headers; // header of each chunk
+        std::vector<char> entity; // memory for the callback to put the entity, which may be larger than the entity
+        size_t nWireSize = 0; // bytes on the wire: the headers and the entity
+        
+        // Description:
+        // Build the headers of the chunks once the entity (header.nDataSize bytes) is filled
+        void Seal(const Data_Header &header, unsigned nMaxChunkSize)
+        {
+            headers.clear();
+            
+            if(header.nDataSize <= nMaxChunkSize){
+                headers.push_back(header);
+                headers.back().nTotalSize = 0;
+                headers.back().nOffset = 0;
+            }
+            else{
+                for(unsigned nOffset = 0; nOffset < header.nDataSize; nOffset += nMaxChunkSize){
+                    Data_Header chunkHeader = header;
+                    chunkHeader.nDataSize = std::min(nMaxChunkSize, header.nDataSize - nOffset);
+                    chunkHeader.nTotalSize = header.nDataSize;
+                    chunkHeader.nOffset = nOffset;
+                    
+                    headers.push_back(chunkHeader);
+                }
+            }
+            
+            nWireSize = headers.size() * sizeof(Data_Header) + header.nDataSize;
+        }
+        
+        // Description:
+        // Describe the bytes from nOffset on as segments, at most nMaxSegment of them. Return the number of segments.
+        unsigned GetSegments(size_t nOffset, Wire_Segment *pSegments, unsigned nMaxSegment) const
+        {
+            const size_t nHeadSize = sizeof(Data_Header);
+            unsigned nSegment = 0;
+            size_t nPos = 0; // position of the current piece on the wire
+            
+            for(const Data_Header &header : headers){
+                if(nSegment >= nMaxSegment) break;
+                
+                if(nOffset < nPos + nHeadSize){
+                    size_t nSkip = nOffset > nPos ? nOffset - nPos : 0;
+                    pSegments[nSegment++] = Wire_Segment{(const char*)&header + nSkip, nHeadSize - nSkip};
+                }
+                nPos += nHeadSize;
+                
+                if(nSegment >= nMaxSegment) break;
+                
+                if(header.nDataSize > 0 && nOffset < nPos + header.nDataSize){
+                    size_t nSkip = nOffset > nPos ? nOffset - nPos : 0;
+                    pSegments[nSegment++] = Wire_Segment{entity.data() + header.nOffset + nSkip, header.nDataSize - nSkip};
+                }
+                nPos += header.nDataSize;
+            }
+            
+            return nSegment;
+        }
+    };
+    
+    // Incremental framing of the byte stream of a connection. The received bytes are fed in whatever pieces the
+    // socket gives them, and whole messages come out once their header and entity (all of its chunks) are there.
+    class Frame_Assembler{
+    public:
+        // Description:
+        // nMaxChunkSize bounds the entity that follows a header, nMaxMessageSize the entity reassembled from chunks.
+        // A stream breaking them is taken as corrupted.
+        explicit Frame_Assembler(unsigned nMaxChunkSize, unsigned nMaxMessageSize = 64u << 20)
+            : _nMaxChunkSize(nMaxChunkSize), _nMaxMessageSize(nMaxMessageSize)
+        {
+        }
+        
+        // Description:
+        // Get the memory for the next nSize bytes, e.g., for recv() to write into, and then tell how many are written
+        char* PrepareWrite(size_t nSize)
+        {
+            Compact();
+            _stream.resize(_nWritePos + nSize);
+            
+            return &_stream[_nWritePos];
+        }
+        void CommitWrite(size_t nWritten)
+        {
+            _nWritePos += nWritten;
+        }
+        
+        // Description:
+        // Append received bytes
+        void Feed(const char *pData, size_t nSize)
+        {
+            memcpy(PrepareWrite(nSize), pData, nSize);
+            CommitWrite(nSize);
+        }
+        
+        // Description:
+        // Take out the next whole message. Return 1 if there is one, whose entity stays valid until the next call to
+        // any method; 0 if more bytes are needed; -1 if the stream is corrupted.
+        int Next(Data_Buffer &msg)
+        {
+            const unsigned nHeadSize = sizeof(Data_Header);
+            
+            while(_nWritePos - _nReadPos >= nHeadSize){
+                Data_Header header;
+                memcpy(&header, &_stream[_nReadPos], nHeadSize);
+                
+                bool bChunk = header.nTotalSize > 0;
+                if(header.nDataSize > _nMaxChunkSize
+                        || (bChunk && (header.nTotalSize > _nMaxMessageSize || header.nDataSize > header.nTotalSize - std::min(header.nOffset, header.nTotalSize))))
+                    return -1;
+                
+                if(_nWritePos - _nReadPos < nHeadSize + header.nDataSize)
+                    return 0; // wait for the rest of the entity
+                
+                char *pEntity = &_stream[_nReadPos + nHeadSize];
+                _nReadPos += nHeadSize + header.nDataSize;
+                
+                if(!bChunk){
+                    msg.dataHeader = header;
+                    msg.pData = pEntity;
+                    return 1;
+                }
+                
+                // gather the chunks of a large entity
+                if(header.nOffset == 0){
+                    _messageHeader = header;
+                    _message.resize(header.nTotalSize);
+                    _nMessageFilled = 0;
+                }
+                else if(header.nOffset != _nMessageFilled || header.nTotalSize != _messageHeader.nTotalSize){
+                    return -1; // a chunk is missing
+                }
+                
+                memcpy(&_message[header.nOffset], pEntity, header.nDataSize);
+                _nMessageFilled += header.nDataSize;
+                
+                if(_nMessageFilled == _messageHeader.nTotalSize){
+                    msg.dataHeader = _messageHeader;
+                    msg.dataHeader.nDataSize = _messageHeader.nTotalSize;
+                    msg.dataHeader.nTotalSize = 0;
+                    msg.dataHeader.nOffset = 0;
+                    msg.pData = _message.data();
+                    
+                    _nMessageFilled = 0;
+                    return 1;
+                }
+            }
+            
+            return 0;
+        }
+        
+        void Reset()
+        {
+            _nReadPos = _nWritePos = 0;
+            _nMessageFilled = 0;
+        }
+        
+    private:
+        // move the unread bytes to the front of the memory
+        void Compact()
+        {
+            if(_nReadPos == 0) return;
+            
+            if(_nWritePos > _nReadPos)
+                memmove(&_stream[0], &_stream[_nReadPos], _nWritePos - _nReadPos);
+            _nWritePos -= _nReadPos;
+            _nReadPos = 0;
+        }
+        
+    private:
+        std::vector<char> _stream; // received bytes: [_nReadPos, _nWritePos) are not framed yet
+        size_t _nReadPos = 0, _nWritePos = 0;
+        
+        Data_Header _messageHeader; // header of the entity being gathered from chunks
+        std::vector<char> _message;
+        unsigned _nMessageFilled = 0;
+        
+        unsigned _nMaxChunkSize, _nMaxMessageSize;
+    };
+    
+    // What to do when a message is queued for a connection whose outbound queue is full
+    enum class Overflow_Policy {
+        DropOldest, // drop the oldest message that has not been started to be written
+        KeepLatest, // only keep the newest message besides the one being written (conflation)
+        Disconnect  // the connection cannot keep up with the stream: drop it
+    };
+
+    // Queue of the messages waiting to be written to a connection.
+    // A message can be shared by the queues of all connections. It is not thread-safe.
+    class Outbound_Queue{
+    public:
+        typedef std::shared_ptr<const Wire_Frame> Message;
+
+        explicit Outbound_Queue(unsigned maxMessage = 8, Overflow_Policy policy = Overflow_Policy::DropOldest)
+            : _maxMessage(maxMessage > 0 ? maxMessage : 1), _policy(policy)
+        {
+            _messages.reserve(_maxMessage + 1); // the queue never holds more, so it does not allocate after this
+        }
+
+        // Description:
+        // Queue a message. Return false if the queue is full and the policy is to disconnect.
+        // The message being partially written is never dropped, otherwise the stream would be broken.
+        bool Push(const Message &msg)
+        {
+            unsigned nKept = (_nFrontOffset > 0) ? 1 : 0; // the message being written
+
+            if(_policy == Overflow_Policy::KeepLatest){
+                _nDropped += _messages.size() - nKept;
+                _messages.erase(_messages.begin() + nKept, _messages.end());
+            }
+            else if(_messages.size() >= _maxMessage){
+                if(_policy == Overflow_Policy::Disconnect)
+                    return false;
+
+                if(_messages.size() > nKept){
+                    _messages.erase(_messages.begin() + nKept);
+                    _nDropped ++;
+                }
+            }
+
+            _messages.push_back(msg);
+            return true;
+        }
+
+        bool Empty() const { return _messages.empty(); }
+
+        // Description:
+        // Describe the bytes that have not been written, from the front message on, as segments for a gather write.
+        // Return the number of segments, at most nMaxSegment.
+        unsigned GetSegments(Wire_Segment *pSegments, unsigned nMaxSegment) const
+        {
+            unsigned nSegment = 0;
+            size_t nOffset = _nFrontOffset;
+            
+            for(const Message &msg : _messages){
+                if(nSegment >= nMaxSegment) break;
+                
+                nSegment += msg->GetSegments(nOffset, pSegments + nSegment, nMaxSegment - nSegment);
+                nOffset = 0;
+            }
+            
+            return nSegment;
+        }
+
+        // Description:
+        // Tell that some bytes have been written, which may cover several messages
+        void Advance(size_t nWritten)
+        {
+            while(nWritten > 0 && !_messages.empty()){
+                size_t nRemain = _messages.front()->nWireSize - _nFrontOffset;
+                if(nWritten < nRemain){
+                    _nFrontOffset += nWritten;
+                    return;
+                }
+                
+                nWritten -= nRemain;
+                _messages.erase(_messages.begin());
+                _nFrontOffset = 0;
+            }
+        }
+
+        void Clear()
+        {
+            _messages.clear();
+            _nFrontOffset = 0;
+            _nDropped = 0;
+        }
+
+        unsigned Size() const { return _messages.size(); }
+        uint64_t GetDropCount() const { return _nDropped; }
+
+    private:
+        std::vector<Message> _messages; // a few messages at most, so erasing at the front is cheap
+        size_t _nFrontOffset = 0; // bytes of the front message that have been written
+        uint64_t _nDropped = 0; // number of messages dropped by the overflow policy
+
+        unsigned _maxMessage;
+        Overflow_Policy _policy;
+    };
+
+    // FIFO queue on a ring buffer, with the interface of std::queue. Unlike std::deque (behind std::queue), it keeps
+    // its memory when the data are popped, so a queue that has reached its working size no longer allocates.
+    template<class T>
+    class Ring_Queue{
+    public:
+        bool empty() const { return _nSize == 0; }
+        size_t size() const { return _nSize; }
+
+        T& front() { return _items[_nHead]; }
+        const T& front() const { return _items[_nHead]; }
+
+        void push(const T &item)
+        {
+            if(_nSize == _items.size()) Grow();
+
+            _items[(_nHead + _nSize) % _items.size()] = item;
+            _nSize ++;
+        }
+
+        void pop()
+        {
+            _items[_nHead] = T(); // do not keep a reference to the item
+            _nHead = (_nHead + 1) % _items.size();
+            _nSize --;
+        }
+
+    private:
+        void Grow()
+        {
+            std::vector<T> items(_items.empty() ? 16 : _items.size() * 2);
+            for(size_t i = 0; i < _nSize; i ++)
+                items[i] = std::move(_items[(_nHead + i) % _items.size()]);
+
+            _items.swap(items);
+            _nHead = 0;
+        }
+
+    private:
+        std::vector<T> _items;
+        size_t _nHead = 0, _nSize = 0;
+    };
+
+    // Counters of a Data_Pool
+    struct Pool_Stats{
+        uint64_t nAcquired = 0; // data handed out
+        uint64_t nCreated = 0; // data allocated on the heap; the others are recycled
+        uint64_t nBlockCreated = 0; // control blocks of the shared pointers allocated on the heap
+        unsigned nFree = 0; // data waiting in the pool
+    };
+
+    // Pool of data handed out as shared pointers. When the last owner drops a data, the deleter of the pointer puts it
+    // back into the pool instead of freeing it, and the memory of the control block of the pointer is kept for the next
+    // one as well. A recycled data keeps its content and the capacity of its members (e.g. vectors), so fill it over by
+    // resizing them. Once the pool has warmed up to the number of data in flight, acquiring a data does not allocate.
+    // It is thread-safe, and the data may outlive the pool.
+    template<class T>
+    class Data_Pool{
+    public:
+        explicit Data_Pool(unsigned maxFree = 256)
+            : _state(std::make_shared<Pool_State>(maxFree))
+        {
+        }
+        Data_Pool(const Data_Pool&) = delete;
+        Data_Pool& operator=(const Data_Pool&) = delete;
+
+        // Description:
+        // Get a recycled data, or a new one if the pool is empty
+        std::shared_ptr<T> Acquire()
+        {
+            T *pData = _state->Take();
+
+            return std::shared_ptr<T>(pData, Recycler{_state}, Block_Allocator<T>(_state));
+        }
+
+        Pool_Stats GetStats() const
+        {
+            std::unique_lock<std::mutex> lock(_state->mutex);
+
+            Pool_Stats stats = _state->stats;
+            stats.nFree = _state->freeData.size();
+            return stats;
+        }
+
+    private:
+        // Shared by the pool and the pointers handed out, so whichever is the last one frees the memory
+        struct Pool_State{
+            explicit Pool_State(unsigned maxFreeData) : maxFree(maxFreeData)
+            {
+                freeData.reserve(maxFree);
+                freeBlocks.reserve(maxFree);
+            }
+            ~Pool_State()
+            {
+                for(T *pData : freeData) delete pData;
+                for(void *pBlock : freeBlocks) ::operator delete(pBlock);
+            }
+
+            T* Take()
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+
+                stats.nAcquired ++;
+                if(!freeData.empty()){
+                    T *pData = freeData.back();
+                    freeData.pop_back();
+                    return pData;
+                }
+
+                stats.nCreated ++;
+                lock.unlock();
+
+                return new T();
+            }
+
+            void Give(T *pData)
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+
+                if(freeData.size() < maxFree){
+                    freeData.push_back(pData);
+                    return;
+                }
+
+                lock.unlock();
+                delete pData;
+            }
+
+            // The control blocks of the pointers all have the same size, which is learnt from the first one
+            void* TakeBlock(size_t nSize)
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+
+                if(nBlockSize == 0) nBlockSize = nSize;
+                if(nSize == nBlockSize && !freeBlocks.empty()){
+                    void *pBlock = freeBlocks.back();
+                    freeBlocks.pop_back();
+                    return pBlock;
+                }
+
+                stats.nBlockCreated ++;
+                lock.unlock();
+
+                return ::operator new(nSize);
+            }
+
+            void GiveBlock(void *pBlock, size_t nSize)
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+
+                if(nSize == nBlockSize && freeBlocks.size() < maxFree){
+                    freeBlocks.push_back(pBlock);
+                    return;
+                }
+
+                lock.unlock();
+                ::operator delete(pBlock);
+            }
+
+            std::mutex mutex;
+            std::vector<T*> freeData;
+            std::vector<void*> freeBlocks;
+            size_t nBlockSize = 0;
+            unsigned maxFree;
+            Pool_Stats stats;
+        };
+
+        // Deleter of the pointers: put the data back into the pool
+        struct Recycler{
+            std::shared_ptr<Pool_State> state;
+
+            void operator()(T *pData) const { state->Give(pData); }
+        };
+
+        // Allocator of the control blocks of the pointers
+        template<class U>
+        struct Block_Allocator{
+            typedef U value_type;
+
+            explicit Block_Allocator(const std::shared_ptr<Pool_State> &poolState) : state(poolState) {}
+            template<class V>
+            Block_Allocator(const Block_Allocator<V> &other) : state(other.state) {}
+
+            U* allocate(size_t n) { return (U*)state->TakeBlock(n * sizeof(U)); }
+            void deallocate(U *p, size_t n) { state->GiveBlock(p, n * sizeof(U)); }
+
+            template<class V>
+            bool operator==(const Block_Allocator<V> &other) const { return state == other.state; }
+            template<class V>
+            bool operator!=(const Block_Allocator<V> &other) const { return state != other.state; }
+
+            std::shared_ptr<Pool_State> state;
+        };
+
+    private:
+        std::shared_ptr<Pool_State> _state;
+    };
+
     // Repos for the data to be sent or have been received by a server or client
     template<class DataType_Send, class DataType_Recv>
     class Data_Repos{
@@ -66,6 +584,7 @@ namespace mocap_netop {
             
             std::shared_ptr<DataType_Send> data = _queueDataToSend.front();
             _queueDataToSend.pop();
+            PopStamp(_stampsToSend, _queueDataToSend.size(), Latency_Stage::SendQueue);
             
             return data;
         }
@@ -81,6 +600,7 @@ namespace mocap_netop {
             
             std::shared_ptr<DataType_Recv> data = _queueDataReceived.front();
             _queueDataReceived.pop();
+            PopStamp(_stampsReceived, _queueDataReceived.size(), Latency_Stage::RecvQueue);
             
             return data;
         }
@@ -89,12 +609,174 @@ namespace mocap_netop {
             std::unique_lock<std::mutex> lock(_forSafeDataOp);
             
             _queueDataToSend.push(data);
+            if(_pTracer) _stampsToSend.push(_pTracer->Stamp());
+            if(_notifierSendQueue) _notifierSendQueue();
+            
+            lock.unlock();
+            
+            _cvSendQueue.notify_one();
         }
         void PushData_RecvQueue( const std::shared_ptr<DataType_Recv> &data)
         {
             std::unique_lock<std::mutex> lock(_forSafeDataOp);
             
             _queueDataReceived.push(data);
+            if(_pTracer) _stampsReceived.push(_pTracer->Stamp());
+            if(_notifierRecvQueue) _notifierRecvQueue();
+            
+            lock.unlock();
+            
+            _cvRecvQueue.notify_one();
+        }
+        
+        // Description:
+        // Get a data from the pool of the repos, to be filled and pushed into its queue. It goes back to the pool when
+        // the last one drops it, so a steady stream of data does not allocate. The data keeps its former content.
+        std::shared_ptr<DataType_Send> AcquireData_SendQueue() { return _poolSend.Acquire(); }
+        std::shared_ptr<DataType_Recv> AcquireData_RecvQueue() { return _poolRecv.Acquire(); }
+        
+        Pool_Stats GetPoolStats_SendQueue() const { return _poolSend.GetStats(); }
+        Pool_Stats GetPoolStats_RecvQueue() const { return _poolRecv.GetStats(); }
+        
+        // Description:
+        // Wait-capable versions of the pop. They sleep until a data is pushed, the timeout expires or
+        // WakeUpWaiters() is called, and return an empty pointer in the latter two cases.
+        std::shared_ptr<DataType_Send> PopData_SendQueue(std::chrono::milliseconds timeout)
+        {
+            std::unique_lock<std::mutex> lock(_forSafeDataOp);
+            
+            if(!WaitQueue(lock, _cvSendQueue, _queueDataToSend, timeout)){
+                return std::shared_ptr<DataType_Send>(); // empty pointer
+            }
+            
+            std::shared_ptr<DataType_Send> data = _queueDataToSend.front();
+            _queueDataToSend.pop();
+            PopStamp(_stampsToSend, _queueDataToSend.size(), Latency_Stage::SendQueue);
+            
+            return data;
+        }
+        std::shared_ptr<DataType_Recv> PopData_RecvQueue(std::chrono::milliseconds timeout)
+        {
+            std::unique_lock<std::mutex> lock(_forSafeDataOp);
+            
+            if(!WaitQueue(lock, _cvRecvQueue, _queueDataReceived, timeout)){
+                return std::shared_ptr<DataType_Recv>(); // empty pointer
+            }
+            
+            std::shared_ptr<DataType_Recv> data = _queueDataReceived.front();
+            _queueDataReceived.pop();
+            PopStamp(_stampsReceived, _queueDataReceived.size(), Latency_Stage::RecvQueue);
+            
+            return data;
+        }
+        
+        // Description:
+        // Take out all the data in the queue at once (appended to the given vector) and return the number of them.
+        unsigned PopAllData_SendQueue(std::vector< std::shared_ptr<DataType_Send> > &data)
+        {
+            std::unique_lock<std::mutex> lock(_forSafeDataOp);
+            
+            unsigned nData = _queueDataToSend.size();
+            while(!_queueDataToSend.empty()){
+                data.push_back(_queueDataToSend.front());
+                _queueDataToSend.pop();
+                PopStamp(_stampsToSend, _queueDataToSend.size(), Latency_Stage::SendQueue);
+            }
+            
+            return nData;
+        }
+        unsigned PopAllData_RecvQueue(std::vector< std::shared_ptr<DataType_Recv> > &data)
+        {
+            std::unique_lock<std::mutex> lock(_forSafeDataOp);
+            
+            unsigned nData = _queueDataReceived.size();
+            while(!_queueDataReceived.empty()){
+                data.push_back(_queueDataReceived.front());
+                _queueDataReceived.pop();
+                PopStamp(_stampsReceived, _queueDataReceived.size(), Latency_Stage::RecvQueue);
+            }
+            
+            return nData;
+        }
+        
+        // Description:
+        // Sleep until the send queue has data (return true), the timeout expires or WakeUpWaiters() is called (return false).
+        // The data is left in the queue, e.g., for the send callback of a server/client to pick it out.
+        bool WaitData_SendQueue(std::chrono::milliseconds timeout)
+        {
+            std::unique_lock<std::mutex> lock(_forSafeDataOp);
+            
+            return WaitQueue(lock, _cvSendQueue, _queueDataToSend, timeout);
+        }
+        bool WaitData_RecvQueue(std::chrono::milliseconds timeout)
+        {
+            std::unique_lock<std::mutex> lock(_forSafeDataOp);
+            
+            return WaitQueue(lock, _cvRecvQueue, _queueDataReceived, timeout);
+        }
+        
+        // Description:
+        // Wake up all the threads that are waiting on the queues, e.g., when a server/client is stopping, and call the
+        // notifiers for the event loops
+        void WakeUpWaiters()
+        {
+            std::unique_lock<std::mutex> lock(_forSafeDataOp);
+            
+            _nWakeUp ++;
+            if(_notifierSendQueue) _notifierSendQueue();
+            if(_notifierRecvQueue) _notifierRecvQueue();
+            
+            lock.unlock();
+            
+            _cvSendQueue.notify_all();
+            _cvRecvQueue.notify_all();
+        }
+        
+        // Description:
+        // Set a function to be called whenever a data is pushed into the send (receive) queue or WakeUpWaiters() is called,
+        // e.g., to wake up an event loop that is not able to wait on the condition variable. It is called under the lock
+        // of the repos, so keep it short.
+        void SetNotifier_SendQueue(const std::function<void()> &notifier)
+        {
+            std::unique_lock<std::mutex> lock(_forSafeDataOp);
+            
+            _notifierSendQueue = notifier;
+        }
+        void SetNotifier_RecvQueue(const std::function<void()> &notifier)
+        {
+            std::unique_lock<std::mutex> lock(_forSafeDataOp);
+            
+            _notifierRecvQueue = notifier;
+        }
+        
+        // Description:
+        // Trace how long the data wait in the queues (the SendQueue and RecvQueue stages) with the tracer of the server or
+        // client that owns the repos, or stop tracing if it is null. The data already in the queues are not traced.
+        void SetTracer(Latency_Tracer *pTracer)
+        {
+            std::unique_lock<std::mutex> lock(_forSafeDataOp);
+            
+            _pTracer = pTracer;
+            while(!_stampsToSend.empty()) _stampsToSend.pop();
+            while(!_stampsReceived.empty()) _stampsReceived.pop();
+        }
+        
+        // Description:
+        // The state a codec keeps for the stream through this repos (e.g., the last frame the next delta frame refers
+        // to), created on the first call and destroyed with the repos. A repos carries the state of one codec; another
+        // type of state replaces it.
+        template<class State>
+        State& GetCodecState()
+        {
+            static const char stateType = 0; // one for each type of state
+            
+            std::unique_lock<std::mutex> lock(_mutexCodecState);
+            
+            if(!_pCodecState || _pCodecStateType != &stateType){
+                _pCodecState = std::make_shared<State>();
+                _pCodecStateType = &stateType;
+            }
+            return *static_cast<State*>(_pCodecState.get());
         }
         
         void DestroyRepos()
@@ -108,12 +790,48 @@ namespace mocap_netop {
             while(!_queueDataReceived.empty()){
                 _queueDataReceived.pop();
             }
+            
+            while(!_stampsToSend.empty()) _stampsToSend.pop();
+            while(!_stampsReceived.empty()) _stampsReceived.pop();
+        }
+        
+    private:
+        // The stamp of the data just popped, pushed along with it. The stamps are those of the last data pushed, so
+        // the data has one only if there are more stamps than the data left (nLeft) in the queue.
+        void PopStamp(Ring_Queue<uint64_t> &stamps, size_t nLeft, Latency_Stage stage)
+        {
+            if(stamps.size() <= nLeft || !_pTracer) return; // pushed before the tracer was set
+            
+            _pTracer->Record(stage, stamps.front(), _pTracer->Stamp());
+            stamps.pop();
+        }
+        
+
+        template<class Queue>
+        bool WaitQueue(std::unique_lock<std::mutex> &lock, std::condition_variable &cv, const Queue &queue, std::chrono::milliseconds timeout)
+        {
+            unsigned nWakeUp = _nWakeUp;
+            
+            cv.wait_for(lock, timeout, [&]{ return !queue.empty() || nWakeUp != _nWakeUp; });
+            
+            return !queue.empty();
         }
         
     private:
         std::mutex _forSafeDataOp; // manipulate the data in a thread-safe manner
-        std::queue< std::shared_ptr< DataType_Send > > _queueDataToSend; // data to be sent to server/clients
-        std::queue< std::shared_ptr<DataType_Recv> > _queueDataReceived; // data received from the server/client
+        std::condition_variable _cvSendQueue, _cvRecvQueue; // signaled when a data is pushed into the queue
+        unsigned _nWakeUp = 0; // increased to release all the waiting threads
+        std::function<void()> _notifierSendQueue; // called when a data is pushed into the send queue
+        std::function<void()> _notifierRecvQueue; // called when a data is pushed into the receive queue
+        Ring_Queue< std::shared_ptr< DataType_Send > > _queueDataToSend; // data to be sent to server/clients
+        Ring_Queue< std::shared_ptr<DataType_Recv> > _queueDataReceived; // data received from the server/client
+        Data_Pool<DataType_Send> _poolSend; // recycled data for the queues
+        Data_Pool<DataType_Recv> _poolRecv;
+        Latency_Tracer *_pTracer = 0; // if set, the time each data is pushed is kept in the stamps, one for each data in the queue
+        Ring_Queue<uint64_t> _stampsToSend, _stampsReceived;
+        std::mutex _mutexCodecState;
+        std::shared_ptr<void> _pCodecState; // see GetCodecState
+        const void *_pCodecStateType = 0;
     };
 }
 
@@ -0,0 +1,184 @@
+/*******************************************************************
+* Author	: wwyang
+* Date		: 2026.10.17
+* Copyright : Zhejiang Gongshang University
+* Head File :
+* Version   : 1.0
+*********************************************************************/
+// .NAME NetPlatform
+
+// .SECTION Description
+// Here provides a thin layer over the socket APIs of the platforms (Winsock on Windows, BSD sockets on Linux),
+// so that the server and client can be built on both of them. Only the few calls that differ are wrapped, the
+// rest of the socket functions (socket, bind, send, recv, ...) are used directly.
+
+// .SECTION See also
+// CMoCapTCPServer, CMoCapTCPClient
+
+#ifndef _NETPLATFORM_H_
+#define _NETPLATFORM_H_
+
+#include <iostream>
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <windows.h>
+#include <winsock.h>
+#include <ws2tcpip.h>
+
+#pragma comment(lib,"ws2_32.lib")
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0 // Winsock never raises SIGPIPE
+#endif
+
+#else
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/ioctl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <poll.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <string.h>
+
+typedef int SOCKET;
+
+#define INVALID_SOCKET (-1)
+#define SOCKET_ERROR (-1)
+
+inline int closesocket(SOCKET fd) { return close(fd); }
+inline int ioctlsocket(SOCKET fd, long cmd, unsigned long *argp) { return ioctl(fd, cmd, argp); }
+inline void Sleep(unsigned milliseconds) { usleep(milliseconds * 1000); }
+#endif
+
+namespace mocap_netop {
+
+    // Description:
+    // Initialize the socket library of the platform. Nothing is needed except on Windows.
+    inline bool socket_startup()
+    {
+#ifdef _WIN32
+        WORD w_req = MAKEWORD(2, 2); // Version number
+        WSADATA wsadata;
+        if (WSAStartup(w_req, &wsadata) != 0) {
+            std::cout << "ini socket fail" << std::endl;
+            return false;
+        }
+
+        // Check the Version number
+        if (LOBYTE(wsadata.wVersion) != 2 || HIBYTE(wsadata.wHighVersion) != 2) {
+            std::cout << "fail on socket version" << std::endl;
+            WSACleanup();
+            return false;
+        }
+#endif
+        return true;
+    }
+
+    // Description:
+    // The error code of the last socket operation
+    inline int socket_last_error()
+    {
+#ifdef _WIN32
+        return WSAGetLastError();
+#else
+        return errno;
+#endif
+    }
+
+    // Description:
+    // Whether the last failed operation on a non-blocking socket would have blocked, i.e., try it again later
+    inline bool socket_would_block()
+    {
+#ifdef _WIN32
+        return WSAGetLastError() == WSAEWOULDBLOCK;
+#else
+        return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+#endif
+    }
+
+    // Description:
+    // Wait until the socket is readable (or writable if bWrite), or the timeout expires.
+    // Return 1 if it is ready (including a hangup or an error to be picked by the next call on it), 0 on timeout, -1 on error.
+    inline int socket_wait(SOCKET fd, bool bWrite, int timeoutMs)
+    {
+        struct pollfd pfd;
+        pfd.fd = fd;
+        pfd.events = bWrite ? POLLOUT : POLLIN;
+        pfd.revents = 0;
+
+#ifdef _WIN32
+        int ret = WSAPoll(&pfd, 1, timeoutMs);
+#else
+        int ret = poll(&pfd, 1, timeoutMs);
+        if(ret < 0 && errno == EINTR) return 0;
+#endif
+        return ret > 0 ? 1 : ret;
+    }
+
+    // Description:
+    // Write the segments (pieces of memory with the members pData and nSize) to the socket in one call (writev-like)
+    // without gathering them into a continuous memory.
+    // Return the number of bytes written, which may stop in the middle of a segment, or -1 on error.
+    template<class Segment>
+    long long socket_send_gather(SOCKET fd, const Segment *pSegments, unsigned nSegment)
+    {
+        const unsigned nMaxSegment = 64;
+        if(nSegment > nMaxSegment) nSegment = nMaxSegment;
+
+#ifdef _WIN32
+        WSABUF buffers[nMaxSegment];
+        for(unsigned i = 0; i < nSegment; i ++){
+            buffers[i].buf = (char*)pSegments[i].pData;
+            buffers[i].len = (ULONG)pSegments[i].nSize;
+        }
+
+        DWORD nSent = 0;
+        if(WSASend(fd, buffers, nSegment, &nSent, 0, NULL, NULL) == SOCKET_ERROR)
+            return -1;
+        return nSent;
+#else
+        struct iovec iov[nMaxSegment];
+        for(unsigned i = 0; i < nSegment; i ++){
+            iov[i].iov_base = (void*)pSegments[i].pData;
+            iov[i].iov_len = pSegments[i].nSize;
+        }
+
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = iov;
+        msg.msg_iovlen = nSegment;
+
+        return sendmsg(fd, &msg, MSG_NOSIGNAL); // sendmsg instead of writev for not raising SIGPIPE
+#endif
+    }
+
+    // Description:
+    // Set the socket as non-blocking
+    inline int socket_set_nonblocking(SOCKET fd)
+    {
+        unsigned long ul = 1;
+        int ret = ioctlsocket(fd, FIONBIO, &ul);
+        if(ret == SOCKET_ERROR)
+            return -1;
+        else return 1;
+    }
+
+    // Description:
+    // Send the small messages at once instead of holding them for the ACK of the last ones (Nagle's algorithm). The
+    // messages are written whole, so nothing is gained by holding them, and a connection with messages on both ways
+    // (e.g., the pings of a client) would wait for the delayed ACKs.
+    inline int socket_set_nodelay(SOCKET fd)
+    {
+        int flag = 1;
+        return setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, (const char*)&flag, sizeof(flag)) == 0 ? 1 : -1;
+    }
+}
+
+#endif // !_NETPLATFORM_H_
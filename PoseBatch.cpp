@@ -0,0 +1,415 @@
+#include "PoseBatch.h"
+
+#include <string.h>
+#include <assert.h>
+#include <atomic>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define POSEBATCH_X86
+#include <immintrin.h>
+
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#define POSEBATCH_TARGET_SSE
+#define POSEBATCH_TARGET_AVX2
+#else
+// the kernels are compiled for their instruction set whatever the flags of the build, and only called if the CPU has it
+#define POSEBATCH_TARGET_SSE __attribute__((target("sse2")))
+#define POSEBATCH_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+
+namespace {
+    // The kernels work on the JOINT_NUMBER joints of a pose, except the scaling which works on a whole array
+    struct Pose_Kernels{
+        void (*interleave)(const float *x, const float *y, const float *z, char *pDst); // x[], y[], z[] -> (x, y, z)...
+        void (*deinterleave)(const char *pSrc, float *x, float *y, float *z); // (x, y, z)... -> x[], y[], z[]
+        void (*box)(const float *x, const float *y, const float *z, Pose_Box &box);
+        void (*scale)(float *p, size_t n, float factor);
+    };
+
+    ////////////////////////////////////////////////////////////////
+    /// Scalar kernels
+    ///
+    void interleave_scalar(const float *x, const float *y, const float *z, char *pDst)
+    {
+        for(unsigned k = 0; k < JOINT_NUMBER; k ++){
+            float joint[3] = {x[k], y[k], z[k]};
+            memcpy(pDst + k * 12, joint, 12); // the wire is not aligned
+        }
+    }
+
+    void deinterleave_scalar(const char *pSrc, float *x, float *y, float *z)
+    {
+        for(unsigned k = 0; k < JOINT_NUMBER; k ++){
+            float joint[3];
+            memcpy(joint, pSrc + k * 12, 12);
+            x[k] = joint[0]; y[k] = joint[1]; z[k] = joint[2];
+        }
+    }
+
+    void box_scalar(const float *x, const float *y, const float *z, Pose_Box &box)
+    {
+        box.minX = box.maxX = x[0];
+        box.minY = box.maxY = y[0];
+        box.minZ = box.maxZ = z[0];
+        for(unsigned k = 1; k < JOINT_NUMBER; k ++){
+            box.minX = x[k] < box.minX ? x[k] : box.minX; box.maxX = x[k] > box.maxX ? x[k] : box.maxX;
+            box.minY = y[k] < box.minY ? y[k] : box.minY; box.maxY = y[k] > box.maxY ? y[k] : box.maxY;
+            box.minZ = z[k] < box.minZ ? z[k] : box.minZ; box.maxZ = z[k] > box.maxZ ? z[k] : box.maxZ;
+        }
+    }
+
+    void scale_scalar(float *p, size_t n, float factor)
+    {
+        for(size_t i = 0; i < n; i ++) p[i] *= factor;
+    }
+
+    const Pose_Kernels g_kernelsScalar = {interleave_scalar, deinterleave_scalar, box_scalar, scale_scalar};
+
+#ifdef POSEBATCH_X86
+    ////////////////////////////////////////////////////////////////
+    /// SSE kernels: 4 joints at a time
+    ///
+    // x0..x3, y0..y3, z0..z3 -> x0 y0 z0 x1 | y1 z1 x2 y2 | z2 x3 y3 z3
+    POSEBATCH_TARGET_SSE inline void interleave4_sse(__m128 x, __m128 y, __m128 z, __m128 &out0, __m128 &out1, __m128 &out2)
+    {
+        __m128 xyLo = _mm_unpacklo_ps(x, y); // x0 y0 x1 y1
+        __m128 xyHi = _mm_unpackhi_ps(x, y); // x2 y2 x3 y3
+
+        out0 = _mm_shuffle_ps(xyLo, _mm_shuffle_ps(z, xyLo, _MM_SHUFFLE(2, 2, 0, 0)), _MM_SHUFFLE(2, 0, 1, 0));
+        out1 = _mm_shuffle_ps(_mm_shuffle_ps(xyLo, z, _MM_SHUFFLE(1, 1, 3, 3)), xyHi, _MM_SHUFFLE(1, 0, 2, 0));
+        out2 = _mm_shuffle_ps(_mm_shuffle_ps(z, xyHi, _MM_SHUFFLE(2, 2, 2, 2)), _mm_shuffle_ps(xyHi, z, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(2, 0, 2, 0));
+    }
+
+    // the inverse of interleave4_sse
+    POSEBATCH_TARGET_SSE inline void deinterleave4_sse(__m128 in0, __m128 in1, __m128 in2, __m128 &x, __m128 &y, __m128 &z)
+    {
+        x = _mm_shuffle_ps(in0, _mm_shuffle_ps(in1, in2, _MM_SHUFFLE(1, 1, 2, 2)), _MM_SHUFFLE(2, 0, 3, 0));
+        y = _mm_shuffle_ps(_mm_shuffle_ps(in0, in1, _MM_SHUFFLE(0, 0, 1, 1)), _mm_shuffle_ps(in1, in2, _MM_SHUFFLE(2, 2, 3, 3)), _MM_SHUFFLE(2, 0, 2, 0));
+        z = _mm_shuffle_ps(_mm_shuffle_ps(in0, in1, _MM_SHUFFLE(1, 1, 2, 2)), in2, _MM_SHUFFLE(3, 0, 2, 0));
+    }
+
+    POSEBATCH_TARGET_SSE void interleave_sse(const float *x, const float *y, const float *z, char *pDst)
+    {
+        unsigned k = 0;
+        for(; k + 4 <= JOINT_NUMBER; k += 4){
+            __m128 out0, out1, out2;
+            interleave4_sse(_mm_loadu_ps(x + k), _mm_loadu_ps(y + k), _mm_loadu_ps(z + k), out0, out1, out2);
+
+            float *pOut = (float*)(pDst + k * 12);
+            _mm_storeu_ps(pOut, out0);
+            _mm_storeu_ps(pOut + 4, out1);
+            _mm_storeu_ps(pOut + 8, out2);
+        }
+        for(; k < JOINT_NUMBER; k ++){
+            float joint[3] = {x[k], y[k], z[k]};
+            memcpy(pDst + k * 12, joint, 12);
+        }
+    }
+
+    POSEBATCH_TARGET_SSE void deinterleave_sse(const char *pSrc, float *x, float *y, float *z)
+    {
+        unsigned k = 0;
+        for(; k + 4 <= JOINT_NUMBER; k += 4){
+            const float *pIn = (const float*)(pSrc + k * 12);
+            __m128 vx, vy, vz;
+            deinterleave4_sse(_mm_loadu_ps(pIn), _mm_loadu_ps(pIn + 4), _mm_loadu_ps(pIn + 8), vx, vy, vz);
+
+            _mm_storeu_ps(x + k, vx);
+            _mm_storeu_ps(y + k, vy);
+            _mm_storeu_ps(z + k, vz);
+        }
+        for(; k < JOINT_NUMBER; k ++){
+            float joint[3];
+            memcpy(joint, pSrc + k * 12, 12);
+            x[k] = joint[0]; y[k] = joint[1]; z[k] = joint[2];
+        }
+    }
+
+    // min and max of the JOINT_NUMBER values
+    POSEBATCH_TARGET_SSE inline void range_sse(const float *p, float &minValue, float &maxValue)
+    {
+        __m128 vMin = _mm_loadu_ps(p), vMax = vMin;
+        unsigned k = 4;
+        for(; k + 4 <= JOINT_NUMBER; k += 4){
+            __m128 v = _mm_loadu_ps(p + k);
+            vMin = _mm_min_ps(vMin, v);
+            vMax = _mm_max_ps(vMax, v);
+        }
+        for(; k < JOINT_NUMBER; k ++){
+            __m128 v = _mm_set1_ps(p[k]);
+            vMin = _mm_min_ps(vMin, v);
+            vMax = _mm_max_ps(vMax, v);
+        }
+
+        vMin = _mm_min_ps(vMin, _mm_shuffle_ps(vMin, vMin, _MM_SHUFFLE(1, 0, 3, 2)));
+        vMin = _mm_min_ps(vMin, _mm_shuffle_ps(vMin, vMin, _MM_SHUFFLE(2, 3, 0, 1)));
+        vMax = _mm_max_ps(vMax, _mm_shuffle_ps(vMax, vMax, _MM_SHUFFLE(1, 0, 3, 2)));
+        vMax = _mm_max_ps(vMax, _mm_shuffle_ps(vMax, vMax, _MM_SHUFFLE(2, 3, 0, 1)));
+        minValue = _mm_cvtss_f32(vMin);
+        maxValue = _mm_cvtss_f32(vMax);
+    }
+
+    POSEBATCH_TARGET_SSE void box_sse(const float *x, const float *y, const float *z, Pose_Box &box)
+    {
+        range_sse(x, box.minX, box.maxX);
+        range_sse(y, box.minY, box.maxY);
+        range_sse(z, box.minZ, box.maxZ);
+    }
+
+    POSEBATCH_TARGET_SSE void scale_sse(float *p, size_t n, float factor)
+    {
+        __m128 vFactor = _mm_set1_ps(factor);
+        size_t i = 0;
+        for(; i + 4 <= n; i += 4)
+            _mm_storeu_ps(p + i, _mm_mul_ps(_mm_loadu_ps(p + i), vFactor));
+        for(; i < n; i ++) p[i] *= factor;
+    }
+
+    const Pose_Kernels g_kernelsSSE = {interleave_sse, deinterleave_sse, box_sse, scale_sse};
+
+    ////////////////////////////////////////////////////////////////
+    /// AVX2 kernels: 8 joints at a time
+    ///
+    POSEBATCH_TARGET_AVX2 void interleave_avx2(const float *x, const float *y, const float *z, char *pDst)
+    {
+        unsigned k = 0;
+        for(; k + 8 <= JOINT_NUMBER; k += 8){
+            __m256 vx = _mm256_loadu_ps(x + k), vy = _mm256_loadu_ps(y + k), vz = _mm256_loadu_ps(z + k);
+
+            // the same shuffles as SSE in each 128-bit lane: joints 0..3 in the low lanes, 4..7 in the high lanes
+            __m256 xyLo = _mm256_unpacklo_ps(vx, vy), xyHi = _mm256_unpackhi_ps(vx, vy);
+            __m256 out0 = _mm256_shuffle_ps(xyLo, _mm256_shuffle_ps(vz, xyLo, _MM_SHUFFLE(2, 2, 0, 0)), _MM_SHUFFLE(2, 0, 1, 0));
+            __m256 out1 = _mm256_shuffle_ps(_mm256_shuffle_ps(xyLo, vz, _MM_SHUFFLE(1, 1, 3, 3)), xyHi, _MM_SHUFFLE(1, 0, 2, 0));
+            __m256 out2 = _mm256_shuffle_ps(_mm256_shuffle_ps(vz, xyHi, _MM_SHUFFLE(2, 2, 2, 2)), _mm256_shuffle_ps(xyHi, vz, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(2, 0, 2, 0));
+
+            // put the low lanes before the high lanes
+            float *pOut = (float*)(pDst + k * 12);
+            _mm256_storeu_ps(pOut, _mm256_permute2f128_ps(out0, out1, 0x20));
+            _mm256_storeu_ps(pOut + 8, _mm256_permute2f128_ps(out2, out0, 0x30));
+            _mm256_storeu_ps(pOut + 16, _mm256_permute2f128_ps(out1, out2, 0x31));
+        }
+        for(; k < JOINT_NUMBER; k ++){
+            float joint[3] = {x[k], y[k], z[k]};
+            memcpy(pDst + k * 12, joint, 12);
+        }
+    }
+
+    POSEBATCH_TARGET_AVX2 void deinterleave_avx2(const char *pSrc, float *x, float *y, float *z)
+    {
+        unsigned k = 0;
+        for(; k + 8 <= JOINT_NUMBER; k += 8){
+            const float *pIn = (const float*)(pSrc + k * 12);
+            __m256 m0 = _mm256_loadu_ps(pIn), m1 = _mm256_loadu_ps(pIn + 8), m2 = _mm256_loadu_ps(pIn + 16);
+
+            // joints 0..3 to the low lanes and 4..7 to the high lanes, then the same shuffles as SSE in each lane
+            __m256 in0 = _mm256_permute2f128_ps(m0, m1, 0x30);
+            __m256 in1 = _mm256_permute2f128_ps(m0, m2, 0x21);
+            __m256 in2 = _mm256_permute2f128_ps(m1, m2, 0x30);
+
+            __m256 vx = _mm256_shuffle_ps(in0, _mm256_shuffle_ps(in1, in2, _MM_SHUFFLE(1, 1, 2, 2)), _MM_SHUFFLE(2, 0, 3, 0));
+            __m256 vy = _mm256_shuffle_ps(_mm256_shuffle_ps(in0, in1, _MM_SHUFFLE(0, 0, 1, 1)), _mm256_shuffle_ps(in1, in2, _MM_SHUFFLE(2, 2, 3, 3)), _MM_SHUFFLE(2, 0, 2, 0));
+            __m256 vz = _mm256_shuffle_ps(_mm256_shuffle_ps(in0, in1, _MM_SHUFFLE(1, 1, 2, 2)), in2, _MM_SHUFFLE(3, 0, 2, 0));
+
+            _mm256_storeu_ps(x + k, vx);
+            _mm256_storeu_ps(y + k, vy);
+            _mm256_storeu_ps(z + k, vz);
+        }
+        for(; k < JOINT_NUMBER; k ++){
+            float joint[3];
+            memcpy(joint, pSrc + k * 12, 12);
+            x[k] = joint[0]; y[k] = joint[1]; z[k] = joint[2];
+        }
+    }
+
+    POSEBATCH_TARGET_AVX2 inline void range_avx2(const float *p, float &minValue, float &maxValue)
+    {
+        __m256 vMin = _mm256_loadu_ps(p), vMax = vMin;
+        unsigned k = 8;
+        for(; k + 8 <= JOINT_NUMBER; k += 8){
+            __m256 v = _mm256_loadu_ps(p + k);
+            vMin = _mm256_min_ps(vMin, v);
+            vMax = _mm256_max_ps(vMax, v);
+        }
+
+        __m128 lMin = _mm_min_ps(_mm256_castps256_ps128(vMin), _mm256_extractf128_ps(vMin, 1));
+        __m128 lMax = _mm_max_ps(_mm256_castps256_ps128(vMax), _mm256_extractf128_ps(vMax, 1));
+        for(; k < JOINT_NUMBER; k ++){
+            __m128 v = _mm_set1_ps(p[k]);
+            lMin = _mm_min_ps(lMin, v);
+            lMax = _mm_max_ps(lMax, v);
+        }
+
+        lMin = _mm_min_ps(lMin, _mm_shuffle_ps(lMin, lMin, _MM_SHUFFLE(1, 0, 3, 2)));
+        lMin = _mm_min_ps(lMin, _mm_shuffle_ps(lMin, lMin, _MM_SHUFFLE(2, 3, 0, 1)));
+        lMax = _mm_max_ps(lMax, _mm_shuffle_ps(lMax, lMax, _MM_SHUFFLE(1, 0, 3, 2)));
+        lMax = _mm_max_ps(lMax, _mm_shuffle_ps(lMax, lMax, _MM_SHUFFLE(2, 3, 0, 1)));
+        minValue = _mm_cvtss_f32(lMin);
+        maxValue = _mm_cvtss_f32(lMax);
+    }
+
+    POSEBATCH_TARGET_AVX2 void box_avx2(const float *x, const float *y, const float *z, Pose_Box &box)
+    {
+        range_avx2(x, box.minX, box.maxX);
+        range_avx2(y, box.minY, box.maxY);
+        range_avx2(z, box.minZ, box.maxZ);
+    }
+
+    POSEBATCH_TARGET_AVX2 void scale_avx2(float *p, size_t n, float factor)
+    {
+        __m256 vFactor = _mm256_set1_ps(factor);
+        size_t i = 0;
+        for(; i + 8 <= n; i += 8)
+            _mm256_storeu_ps(p + i, _mm256_mul_ps(_mm256_loadu_ps(p + i), vFactor));
+        for(; i < n; i ++) p[i] *= factor;
+    }
+
+    const Pose_Kernels g_kernelsAVX2 = {interleave_avx2, deinterleave_avx2, box_avx2, scale_avx2};
+
+    bool cpu_has_avx2()
+    {
+#if defined(_MSC_VER) && !defined(__clang__)
+        int info[4];
+        __cpuid(info, 1);
+        bool bOSSaveYMM = (info[2] & (1 << 27)) && (_xgetbv(0) & 6) == 6; // the OS saves the AVX registers
+        __cpuidex(info, 7, 0);
+        return bOSSaveYMM && (info[1] & (1 << 5));
+#else
+        return __builtin_cpu_supports("avx2");
+#endif
+    }
+#endif
+
+    Simd_Level best_simd_level()
+    {
+#ifdef POSEBATCH_X86
+        return cpu_has_avx2() ? Simd_Level::AVX2 : Simd_Level::SSE;
+#else
+        return Simd_Level::Scalar;
+#endif
+    }
+
+    std::atomic<int> g_simdLevel(-1); // not detected yet
+
+    const Pose_Kernels& kernels()
+    {
+        int level = g_simdLevel.load(std::memory_order_relaxed);
+        if(level < 0){
+            level = (int)best_simd_level();
+            g_simdLevel.store(level, std::memory_order_relaxed);
+        }
+
+#ifdef POSEBATCH_X86
+        if(level == (int)Simd_Level::AVX2) return g_kernelsAVX2;
+        if(level == (int)Simd_Level::SSE) return g_kernelsSSE;
+#endif
+        return g_kernelsScalar;
+    }
+}
+
+Simd_Level posebatch_simd_level()
+{
+    kernels();
+    return (Simd_Level)g_simdLevel.load(std::memory_order_relaxed);
+}
+
+Simd_Level posebatch_set_simd_level(Simd_Level level)
+{
+    Simd_Level best = best_simd_level();
+    if((int)level > (int)best) level = best;
+
+    g_simdLevel.store((int)level, std::memory_order_relaxed);
+    return level;
+}
+
+void Pose_Batch::Resize(size_t nPose)
+{
+    ids.resize(nPose);
+    x.resize(nPose * JOINT_NUMBER);
+    y.resize(nPose * JOINT_NUMBER);
+    z.resize(nPose * JOINT_NUMBER);
+}
+
+void Pose_Batch::FromPoses(const std::vector<Data_MoCap_Send::Pose> &poses)
+{
+    static_assert(sizeof(Data_MoCap_Send::Joint) == 12, "a joint should be 3 packed floats");
+
+    const Pose_Kernels &k = kernels();
+
+    Resize(poses.size());
+    for(size_t i = 0; i < poses.size(); i ++){
+        ids[i] = poses[i].ID;
+        k.deinterleave((const char*)poses[i].joints, &x[i * JOINT_NUMBER], &y[i * JOINT_NUMBER], &z[i * JOINT_NUMBER]);
+    }
+}
+
+void Pose_Batch::ToPoses(std::vector<Data_MoCap_Send::Pose> &poses) const
+{
+    const Pose_Kernels &k = kernels();
+
+    poses.resize(Size());
+    for(size_t i = 0; i < poses.size(); i ++){
+        poses[i].ID = ids[i];
+        k.interleave(&x[i * JOINT_NUMBER], &y[i * JOINT_NUMBER], &z[i * JOINT_NUMBER], (char*)poses[i].joints);
+    }
+}
+
+size_t Pose_Batch::Pack(char *pDst) const
+{
+    const Pose_Kernels &k = kernels();
+
+    unsigned nPose = Size();
+    memcpy(pDst, &nPose, 4);
+
+    char *p = pDst + 4;
+    for(size_t i = 0; i < nPose; i ++){
+        memcpy(p, &ids[i], 8);
+        k.interleave(&x[i * JOINT_NUMBER], &y[i * JOINT_NUMBER], &z[i * JOINT_NUMBER], p + 8);
+        p += 8 + JOINT_NUMBER * 12;
+    }
+
+    assert((size_t)(p - pDst) == WireSize());
+    return p - pDst;
+}
+
+size_t Pose_Batch::Unpack(const char *pSrc, size_t nSize)
+{
+    if(nSize < 4) return 0;
+
+    unsigned nPose;
+    memcpy(&nPose, pSrc, 4);
+
+    const size_t nPoseSize = 8 + JOINT_NUMBER * 12;
+    if(nPose > (nSize - 4) / nPoseSize) return 0; // too short for the poses
+
+    const Pose_Kernels &k = kernels();
+
+    Resize(nPose);
+    const char *p = pSrc + 4;
+    for(size_t i = 0; i < nPose; i ++){
+        memcpy(&ids[i], p, 8);
+        k.deinterleave(p + 8, &x[i * JOINT_NUMBER], &y[i * JOINT_NUMBER], &z[i * JOINT_NUMBER]);
+        p += nPoseSize;
+    }
+
+    return p - pSrc;
+}
+
+void Pose_Batch::Scale(float factor)
+{
+    const Pose_Kernels &k = kernels();
+
+    k.scale(x.data(), x.size(), factor);
+    k.scale(y.data(), y.size(), factor);
+    k.scale(z.data(), z.size(), factor);
+}
+
+void Pose_Batch::ComputeBoxes(std::vector<Pose_Box> &boxes) const
+{
+    const Pose_Kernels &k = kernels();
+
+    boxes.resize(Size());
+    for(size_t i = 0; i < boxes.size(); i ++)
+        k.box(&x[i * JOINT_NUMBER], &y[i * JOINT_NUMBER], &z[i * JOINT_NUMBER], boxes[i]);
+}
@@ -0,0 +1,83 @@
+/*******************************************************************
+* Author	: wwyang
+* Date		: 2026.10.17
+* Copyright : Zhejiang Gongshang University
+* Head File :
+* Version   : 1.0
+*********************************************************************/
+// .NAME Pose_Batch
+
+// .SECTION Description
+// It is a structure-of-arrays form of the 3D poses of Data_MoCap_Send: the IDs and the x, y, z of all the joints are
+// kept in their own continuous arrays, so a loop over the joints of many poses runs on full SIMD registers. A batch
+// can be converted from/to the poses of Data_MoCap_Send, and packed/unpacked directly in the wire format of the poses
+// (see sendmsg_callback_mocap_server). The kernels are selected at runtime: AVX2 or SSE on x86, a scalar version otherwise.
+
+// .SECTION See also
+// Data_MoCap_Send
+
+#ifndef POSEBATCH_H
+#define POSEBATCH_H
+
+#include <vector>
+#include <stddef.h>
+
+#include "MoCap_Data.h"
+
+// Instruction set of the kernels of Pose_Batch
+enum class Simd_Level {
+    Scalar,
+    SSE,
+    AVX2
+};
+
+// Axis-aligned bounding box of a pose
+struct Pose_Box{
+    float minX, minY, minZ;
+    float maxX, maxY, maxZ;
+};
+
+class Pose_Batch{
+public:
+    std::vector<unsigned long long> ids; // ID of each pose
+    std::vector<float> x, y, z; // coordinates of the joints: joint k of pose i is at [i*JOINT_NUMBER + k]
+
+    size_t Size() const { return ids.size(); }
+
+    void Resize(size_t nPose);
+    void Clear() { Resize(0); }
+
+    // Description:
+    // Conversion from/to the array-of-structures poses
+    void FromPoses(const std::vector<Data_MoCap_Send::Pose> &poses);
+    void ToPoses(std::vector<Data_MoCap_Send::Pose> &poses) const;
+
+    // Description:
+    // Pack the poses in the wire format: (number of poses: uint, 4 bytes); (pose1, pose2, ...), where a pose is
+    // (poseID: ulong long, 8 bytes); (joint1, ..,joint17: x, y, z floats). WireSize() bytes are written to pDst.
+    size_t WireSize() const { return 4 + Size() * (8 + JOINT_NUMBER * 12); }
+    size_t Pack(char *pDst) const;
+
+    // Description:
+    // Unpack the poses from the wire format. Return the number of bytes read, or 0 if the data is too short.
+    size_t Unpack(const char *pSrc, size_t nSize);
+
+    // Description:
+    // Multiply all the coordinates by a factor, e.g. 1000 from metres to millimetres
+    void Scale(float factor);
+
+    // Description:
+    // Compute the bounding box of each pose
+    void ComputeBoxes(std::vector<Pose_Box> &boxes) const;
+};
+
+// Description:
+// The instruction set used by the kernels, which is the best one supported by the CPU unless it is set lower
+Simd_Level posebatch_simd_level();
+
+// Description:
+// Force the kernels to an instruction set (for testing or benchmarking). A level that the CPU does not support
+// falls back to the best supported one. Return the level in effect.
+Simd_Level posebatch_set_simd_level(Simd_Level level);
+
+#endif // POSEBATCH_H
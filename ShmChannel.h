@@ -0,0 +1,441 @@
+/*******************************************************************
+* Author	: wwyang
+* Date		: 2026.10.17
+* Copyright : Zhejiang Gongshang University
+* Head File :
+* Version   : 1.0
+*********************************************************************/
+// .NAME Shm_Ring_Writer/Shm_Ring_Reader
+
+// .SECTION Description
+// Here provides a shared-memory channel for the clients on the same host as the server. The server writes each
+// frame once into a ring of slots in a POSIX shared memory object, and any number of readers copy the frames out
+// of it without a system call per frame; they only sleep on a futex in the ring when there is nothing to read.
+// Memory layout of the object "/<name>":
+//     (Shm_Ring_Header, 192 bytes); (slot 0); (slot 1); ... (slot nSlot-1)
+//     format of slot : (sequence, 8 bytes); (Data_Header of a chunk); (entity of the chunk), padded to 64 bytes
+// A slot holds one chunk of a frame as it is sealed for the sockets (see Wire_Frame), so a reader puts the slots
+// into a Frame_Assembler as if they came from a socket. The chunks are numbered from 0 in the order they are
+// written; the chunk n is in the slot n % nSlot, whose sequence is 2n+1 while it is written and 2n+2 once it is done.
+// The writer never waits for the readers: a reader that falls more than nSlot chunks behind is lapped, it counts
+// the chunks it lost and resumes from the next whole frame. The channel is one-way; the clients still talk to the
+// server over TCP. Only Linux is supported, elsewhere Create() and Open() fail.
+// The object is only open to the user of the server (mode 0600), since the clients trust the frames in it: the clients
+// on the shared memory run as the same user. A frame of more than nSlot chunks, or a chunk larger than a slot, cannot be
+// written; it is dropped and counted (GetDropCount), and the clients on the shared memory do not get it at all.
+
+// .SECTION See also
+// CMoCapTCPServer, CMoCapTCPClient, Frame_Assembler
+
+#ifndef SHMCHANNEL_H
+#define SHMCHANNEL_H
+
+#include <iostream>
+#include <string>
+#include <atomic>
+#include <new>
+#include <algorithm>
+#include <string.h>
+#include <stdint.h>
+
+#include "NetOp.h"
+
+#ifdef __linux__
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <limits.h>
+#include <time.h>
+#include <errno.h>
+#endif
+
+namespace mocap_netop {
+
+    #define SHM_RING_MAGIC "MOCAPSH"
+    #define SHM_RING_VERSION 2
+
+    // The atomics are shared by processes, which only works if they are lock-free
+    static_assert(ATOMIC_LLONG_LOCK_FREE == 2 && ATOMIC_INT_LOCK_FREE == 2, "the shared-memory ring needs lock-free atomics");
+
+    struct Shm_Ring_Header{
+        char magic[8]; // SHM_RING_MAGIC
+        uint32_t version; // SHM_RING_VERSION
+        uint32_t nSlot; // number of slots, a power of 2
+        uint32_t nSlotSize; // bytes of a slot
+        uint32_t nMaxChunkSize; // largest entity of a chunk in a slot
+        char serverAddress[40]; // TCP address of the server (ip:port), for the upstream messages of the clients
+
+        alignas(64) std::atomic<uint64_t> nPublished; // chunks that are completely written, i.e., of whole frames
+
+        alignas(64) std::atomic<uint32_t> futexWord; // bumped on each frame and on closing; readers sleep on it
+        std::atomic<uint32_t> nWaiter; // readers sleeping on the futex
+        std::atomic<uint32_t> bClosed; // the writer is gone
+    };
+    static_assert(sizeof(Shm_Ring_Header) == 192, "the header is shared by the builds of the server and the clients");
+
+    struct Shm_Slot_Header{
+        std::atomic<uint64_t> seq; // 2n+1 while the chunk n is written, 2n+2 once it is done
+        Data_Header header; // header of the chunk
+    };
+
+    const unsigned SHM_SLOT_ENTITY_OFFSET = 64; // the entity of a chunk starts at this offset of its slot
+
+#ifdef __linux__
+    // Description:
+    // Wait on / wake up a futex which may be shared by processes
+    inline int shm_futex_wait(std::atomic<uint32_t> *pWord, uint32_t expected, int timeoutMs)
+    {
+        struct timespec ts;
+        ts.tv_sec = timeoutMs / 1000;
+        ts.tv_nsec = (timeoutMs % 1000) * 1000000L;
+        return (int)syscall(SYS_futex, (uint32_t*)pWord, FUTEX_WAIT, expected, timeoutMs < 0 ? 0 : &ts, 0, 0);
+    }
+    inline int shm_futex_wake(std::atomic<uint32_t> *pWord)
+    {
+        return (int)syscall(SYS_futex, (uint32_t*)pWord, FUTEX_WAKE, INT_MAX, 0, 0, 0);
+    }
+#endif
+
+    // Writer of the ring, owned by the server. It should only be used by one thread.
+    class Shm_Ring_Writer{
+    public:
+        Shm_Ring_Writer() {}
+        Shm_Ring_Writer(const Shm_Ring_Writer&) = delete;
+        Shm_Ring_Writer& operator=(const Shm_Ring_Writer&) = delete;
+        ~Shm_Ring_Writer() { Close(); }
+
+        // Description:
+        // Create the shared memory object "/<name>" (replacing a stale one) with nSlot slots (rounded up to a power of 2),
+        // each for a chunk up to nMaxChunkSize bytes. serverAddress is told to the readers for connecting the server.
+        bool Create(const std::string &name, unsigned nSlot, unsigned nMaxChunkSize, const std::string &serverAddress)
+        {
+            Close();
+
+#ifdef __linux__
+            unsigned n = 1;
+            while(n < nSlot) n <<= 1;
+
+            unsigned nSlotSize = (SHM_SLOT_ENTITY_OFFSET + nMaxChunkSize + 63) / 64 * 64;
+            size_t nMapSize = sizeof(Shm_Ring_Header) + (size_t)n * nSlotSize;
+
+            std::string path = "/" + name;
+            shm_unlink(path.c_str());
+
+            int fd = shm_open(path.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600); // no other user may write the frames
+            if(fd < 0){
+                std::cout << "Error on creating the shared memory " << path << ": " << errno << std::endl;
+                return false;
+            }
+
+            void *pMap = MAP_FAILED;
+            if(ftruncate(fd, nMapSize) == 0)
+                pMap = mmap(0, nMapSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+            close(fd);
+
+            if(pMap == MAP_FAILED){
+                std::cout << "Error on mapping the shared memory " << path << ": " << errno << std::endl;
+                shm_unlink(path.c_str());
+                return false;
+            }
+
+            // the object is zero-filled, so all the slots have the sequence 0: nothing written
+            _pHeader = new (pMap) Shm_Ring_Header;
+            _pHeader->version = SHM_RING_VERSION;
+            _pHeader->nSlot = n;
+            _pHeader->nSlotSize = nSlotSize;
+            _pHeader->nMaxChunkSize = nMaxChunkSize;
+            strncpy(_pHeader->serverAddress, serverAddress.c_str(), sizeof(_pHeader->serverAddress) - 1);
+            _pHeader->nPublished.store(0);
+            _pHeader->futexWord.store(0);
+            _pHeader->nWaiter.store(0);
+            _pHeader->bClosed.store(0);
+            _pSlots = (char*)pMap + sizeof(Shm_Ring_Header);
+            for(unsigned i = 0; i < n; i ++)
+                new (_pSlots + (size_t)i * nSlotSize) Shm_Slot_Header;
+
+            // readers check the magic last
+            std::atomic_thread_fence(std::memory_order_release);
+            memcpy(_pHeader->magic, SHM_RING_MAGIC, sizeof(_pHeader->magic));
+
+            _name = path;
+            _nMapSize = nMapSize;
+            _nNext = 0;
+            _nDropped = 0;
+            return true;
+#else
+            (void)name; (void)nSlot; (void)nMaxChunkSize; (void)serverAddress;
+            std::cout << "The shared-memory channel is only available on Linux" << std::endl;
+            return false;
+#endif
+        }
+
+        // Description:
+        // Mark the ring as closed, wake up the readers and remove the object. The readers keep their mapping.
+        void Close()
+        {
+#ifdef __linux__
+            if(_pHeader == 0) return;
+
+            _pHeader->bClosed.store(1);
+            _pHeader->futexWord.fetch_add(1);
+            shm_futex_wake(&_pHeader->futexWord);
+
+            munmap(_pHeader, _nMapSize);
+            shm_unlink(_name.c_str());
+
+            _pHeader = 0;
+            _pSlots = 0;
+#endif
+        }
+
+        bool IsOpen() const { return _pHeader != 0; }
+
+        // Description:
+        // Number of the frames that did not fit in the ring since it was created
+        uint64_t GetDropCount() const { return _nDropped; }
+
+        // Description:
+        // Write the chunks of a sealed frame into the ring and wake up the readers.
+        // Return false if a chunk does not fit in a slot or the frame does not fit in the ring, and the frame is dropped.
+        bool Publish(const Wire_Frame &frame)
+        {
+            if(_pHeader == 0) return false;
+
+            bool bFit = frame.headers.size() <= _pHeader->nSlot;
+            for(const Data_Header &header : frame.headers){
+                bFit = bFit && header.nDataSize <= _pHeader->nMaxChunkSize;
+            }
+            if(!bFit){
+                if(_nDropped.fetch_add(1) == 0){ // told once, and counted after
+                    std::cout << "A frame of " << frame.headers.size() << " chunks does not fit in the shared memory " << _name
+                              << " of " << _pHeader->nSlot << " slots, and is dropped" << std::endl;
+                }
+                return false;
+            }
+
+            const uint32_t nSlotSize = _pHeader->nSlotSize, nMask = _pHeader->nSlot - 1;
+            for(const Data_Header &header : frame.headers){
+                char *pSlot = _pSlots + (size_t)(_nNext & nMask) * nSlotSize;
+                Shm_Slot_Header *pSlotHeader = (Shm_Slot_Header*)pSlot;
+
+                // seqlock: odd while the slot is written, so a reader copying it meanwhile discards its copy
+                pSlotHeader->seq.store(2 * _nNext + 1, std::memory_order_relaxed);
+                std::atomic_thread_fence(std::memory_order_release);
+
+                pSlotHeader->header = header;
+                memcpy(pSlot + SHM_SLOT_ENTITY_OFFSET, frame.entity.data() + header.nOffset, header.nDataSize);
+
+                pSlotHeader->seq.store(2 * _nNext + 2, std::memory_order_release);
+                _nNext ++;
+            }
+
+            // the readers only see whole frames
+            _pHeader->nPublished.store(_nNext);
+            _pHeader->futexWord.fetch_add(1);
+#ifdef __linux__
+            if(_pHeader->nWaiter.load() > 0)
+                shm_futex_wake(&_pHeader->futexWord);
+#endif
+            return true;
+        }
+
+    private:
+        Shm_Ring_Header *_pHeader = 0;
+        char *_pSlots = 0;
+        size_t _nMapSize = 0;
+        std::string _name;
+        uint64_t _nNext = 0; // number of the next chunk to be written
+        std::atomic<uint64_t> _nDropped{0}; // frames that did not fit
+    };
+
+    // Reader of the ring, owned by a client. It should only be used by one thread.
+    class Shm_Ring_Reader{
+    public:
+        Shm_Ring_Reader() {}
+        Shm_Ring_Reader(const Shm_Ring_Reader&) = delete;
+        Shm_Ring_Reader& operator=(const Shm_Ring_Reader&) = delete;
+        ~Shm_Ring_Reader() { Close(); }
+
+        // Description:
+        // Map the ring "/<name>" created by a server. Reading starts from the next frame written.
+        bool Open(const std::string &name)
+        {
+            Close();
+
+#ifdef __linux__
+            std::string path = "/" + name;
+            int fd = shm_open(path.c_str(), O_RDWR, 0); // writable for the futex and the count of the waiters
+            if(fd < 0){
+                std::cout << "Error on opening the shared memory " << path << ": " << errno << std::endl;
+                return false;
+            }
+
+            struct stat st;
+            void *pMap = MAP_FAILED;
+            if(fstat(fd, &st) == 0 && (size_t)st.st_size >= sizeof(Shm_Ring_Header))
+                pMap = mmap(0, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+            close(fd);
+
+            if(pMap == MAP_FAILED){
+                std::cout << "Error on mapping the shared memory " << path << std::endl;
+                return false;
+            }
+
+            Shm_Ring_Header *pHeader = (Shm_Ring_Header*)pMap;
+            bool bValid = memcmp(pHeader->magic, SHM_RING_MAGIC, sizeof(pHeader->magic)) == 0;
+            std::atomic_thread_fence(std::memory_order_acquire);
+            bValid = bValid && pHeader->version == SHM_RING_VERSION
+                    && pHeader->nSlot > 0 && (pHeader->nSlot & (pHeader->nSlot - 1)) == 0
+                    && pHeader->nSlotSize >= SHM_SLOT_ENTITY_OFFSET + pHeader->nMaxChunkSize
+                    && sizeof(Shm_Ring_Header) + (uint64_t)pHeader->nSlot * pHeader->nSlotSize <= (uint64_t)st.st_size;
+            if(!bValid){
+                std::cout << "Not a ring of frames: " << path << std::endl;
+                munmap(pMap, st.st_size);
+                return false;
+            }
+
+            _pHeader = pHeader;
+            _pSlots = (char*)pMap + sizeof(Shm_Ring_Header);
+            _nMapSize = st.st_size;
+            _nNext = _pHeader->nPublished.load();
+            _nLost = 0;
+            _bResync = true;
+            return true;
+#else
+            (void)name;
+            std::cout << "The shared-memory channel is only available on Linux" << std::endl;
+            return false;
+#endif
+        }
+
+        void Close()
+        {
+#ifdef __linux__
+            if(_pHeader == 0) return;
+            munmap(_pHeader, _nMapSize);
+#endif
+            _pHeader = 0;
+            _pSlots = 0;
+        }
+
+        bool IsOpen() const { return _pHeader != 0; }
+
+        // Description:
+        // Size of the entity of a chunk, for the Frame_Assembler of the reader
+        unsigned GetMaxChunkSize() const { return _pHeader ? _pHeader->nMaxChunkSize : 0; }
+
+        // Description:
+        // TCP address (ip:port) of the server that writes the ring
+        std::string GetServerAddress() const
+        {
+            if(_pHeader == 0) return std::string();
+            return std::string(_pHeader->serverAddress, strnlen(_pHeader->serverAddress, sizeof(_pHeader->serverAddress)));
+        }
+
+        // Description:
+        // Chunks that were overwritten before they were read
+        uint64_t GetLostCount() const { return _nLost; }
+
+        // Description:
+        // Put the chunks that are written since the last call into the assembler, sleeping up to timeoutMs
+        // (-1 for ever) if there is none. Return the number of chunks put, 0 on timeout, -1 if the writer is closed.
+        int Read(Frame_Assembler &assembler, int timeoutMs)
+        {
+            if(_pHeader == 0) return -1;
+
+            int nRead = ReadAvailable(assembler);
+            if(nRead != 0) return nRead;
+
+#ifdef __linux__
+            // Announce the wait before checking again, so the writer either sees the waiter or we see its frame
+            uint32_t word = _pHeader->futexWord.load();
+            _pHeader->nWaiter.fetch_add(1);
+            if(_pHeader->nPublished.load() == _nNext && _pHeader->bClosed.load() == 0)
+                shm_futex_wait(&_pHeader->futexWord, word, timeoutMs);
+            _pHeader->nWaiter.fetch_sub(1);
+#endif
+
+            return ReadAvailable(assembler);
+        }
+
+    private:
+        int ReadAvailable(Frame_Assembler &assembler)
+        {
+            uint64_t nPublished = _pHeader->nPublished.load(std::memory_order_acquire);
+            if(nPublished == _nNext)
+                return _pHeader->bClosed.load() ? -1 : 0;
+
+            const uint32_t nSlot = _pHeader->nSlot, nSlotSize = _pHeader->nSlotSize;
+            if(nPublished - _nNext > nSlot) // lapped: the oldest chunks are gone
+                Skip(nPublished - nSlot);
+
+            int nRead = 0;
+            while(_nNext < nPublished){
+                const char *pSlot = _pSlots + (size_t)(_nNext & (nSlot - 1)) * nSlotSize;
+                const Shm_Slot_Header *pSlotHeader = (const Shm_Slot_Header*)pSlot;
+
+                uint64_t seq = pSlotHeader->seq.load(std::memory_order_acquire);
+                if(seq != 2 * _nNext + 2){ // being overwritten: lapped while reading
+                    Skip(std::max(_nNext + 1, _pHeader->nPublished.load() - nSlot + 1));
+                    continue;
+                }
+
+                Data_Header header = pSlotHeader->header;
+                if(header.nDataSize > _pHeader->nMaxChunkSize){
+                    Skip(_nNext + 1); // torn, checked again below
+                    continue;
+                }
+
+                if(_bResync && header.nOffset != 0){ // the tail of a frame whose head is lost
+                    _nNext ++;
+                    _nLost ++;
+                    continue;
+                }
+
+                size_t nSize = sizeof(Data_Header) + header.nDataSize;
+                char *pDest = assembler.PrepareWrite(nSize);
+                memcpy(pDest, &header, sizeof(Data_Header));
+                memcpy(pDest + sizeof(Data_Header), pSlot + SHM_SLOT_ENTITY_OFFSET, header.nDataSize);
+
+                // The copy counts only if the writer did not touch the slot meanwhile
+                std::atomic_thread_fence(std::memory_order_acquire);
+                if(pSlotHeader->seq.load(std::memory_order_relaxed) != seq){
+                    Skip(_nNext + 1);
+                    continue;
+                }
+
+                assembler.CommitWrite(nSize);
+                _bResync = false;
+                _nNext ++;
+                nRead ++;
+            }
+
+            return nRead;
+        }
+
+        // Jump to the chunk nNext, losing what is before it. The partial frame in the assembler is dropped
+        // when the next whole frame starts (its first chunk resets the assembler).
+        void Skip(uint64_t nNext)
+        {
+            if(nNext > _nNext){
+                _nLost += nNext - _nNext;
+                _nNext = nNext;
+            }
+            _bResync = true;
+        }
+
+    private:
+        Shm_Ring_Header *_pHeader = 0;
+        char *_pSlots = 0;
+        size_t _nMapSize = 0;
+        uint64_t _nNext = 0; // number of the next chunk to be read
+        uint64_t _nLost = 0;
+        bool _bResync = true; // skip the chunks up to the head of the next frame
+    };
+
+} // namespace: mocap_netop
+
+#endif // SHMCHANNEL_H
@@ -0,0 +1,128 @@
+/*******************************************************************
+* Author	: wwyang
+* Date		: 2026.10.17
+* Copyright : Zhejiang Gongshang University
+* Head File :
+* Version   : 1.0
+*********************************************************************/
+// .NAME Skeleton_Coco17/Skeleton_Body25/Skeleton_Kinect32
+
+// .SECTION Description
+// Here provides the topologies of the skeletons of the rigs, as traits types that the mocap data and its codecs are
+// templated on (see Data_MoCap_Frame): the number of the joints, known at compile time, the parent of each joint and
+// some flags of the joints. Joint 0 is the root of a skeleton, which the compact codec codes the other joints
+// relative to, and a parent comes before its children. A skeleton has 32 joints at most, one for each bit of the
+// joint mask of a subscription.
+// A new rig is supported by a new traits type with the same members.
+
+// .SECTION See also
+// Data_MoCap_Frame, Stream_Subscription
+
+#ifndef SKELETON_H
+#define SKELETON_H
+
+#include <stdint.h>
+
+// The flags of a joint
+const uint8_t SKELETON_JOINT_FACE = 1; // nose, eyes, ears
+const uint8_t SKELETON_JOINT_HAND = 2; // hands and fingers, past the wrists
+const uint8_t SKELETON_JOINT_FOOT = 4; // feet and toes, past the ankles
+
+////////////////////////////////////////////////////////////////
+/// COCO keypoints: nose, eyes, ears, shoulders, elbows, wrists, hips, knees and ankles (left before right)
+///
+struct Skeleton_Coco17{
+    static constexpr unsigned JOINT_COUNT = 17;
+
+    static const char* Name() { return "coco17"; }
+
+    static const int* Parents()
+    {
+        static const int parents[JOINT_COUNT] = {-1, 0, 0, 1, 2, 0, 0, 5, 6, 7, 8, 5, 6, 11, 12, 13, 14};
+        return parents;
+    }
+
+    static const uint8_t* Flags()
+    {
+        const uint8_t F = SKELETON_JOINT_FACE;
+        static const uint8_t flags[JOINT_COUNT] = {F, F, F, F, F, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0};
+        return flags;
+    }
+};
+
+////////////////////////////////////////////////////////////////
+/// OpenPose BODY_25: the COCO keypoints with the neck, the middle of the hips and the feet (right before left)
+///
+struct Skeleton_Body25{
+    static constexpr unsigned JOINT_COUNT = 25;
+
+    static const char* Name() { return "body25"; }
+
+    static const int* Parents()
+    {
+        static const int parents[JOINT_COUNT] = {-1, 0, 1, 2, 3, 1, 5, 6, 1, 8, 9, 10, 8, 12, 13, 0, 0, 15, 16,
+                                                 14, 19, 14, 11, 22, 11};
+        return parents;
+    }
+
+    static const uint8_t* Flags()
+    {
+        const uint8_t F = SKELETON_JOINT_FACE, T = SKELETON_JOINT_FOOT;
+        static const uint8_t flags[JOINT_COUNT] = {F, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, F, F, F, F,
+                                                   T, T, T, T, T, T};
+        return flags;
+    }
+};
+
+////////////////////////////////////////////////////////////////
+/// Azure Kinect body tracking: the spine from the pelvis, the clavicles, hands, feet and the face
+///
+struct Skeleton_Kinect32{
+    static constexpr unsigned JOINT_COUNT = 32;
+
+    static const char* Name() { return "kinect32"; }
+
+    static const int* Parents()
+    {
+        static const int parents[JOINT_COUNT] = {-1, 0, 1, 2, 2, 4, 5, 6, 7, 8, 7, 2, 11, 12, 13, 14, 15, 14,
+                                                 0, 18, 19, 20, 0, 22, 23, 24, 3, 26, 26, 26, 26, 26};
+        return parents;
+    }
+
+    static const uint8_t* Flags()
+    {
+        const uint8_t F = SKELETON_JOINT_FACE, H = SKELETON_JOINT_HAND, T = SKELETON_JOINT_FOOT;
+        static const uint8_t flags[JOINT_COUNT] = {0, 0, 0, 0, 0, 0, 0, 0, H, H, H, 0, 0, 0, 0, H, H, H,
+                                                   0, 0, 0, T, 0, 0, 0, T, 0, F, F, F, F, F};
+        return flags;
+    }
+};
+
+// Description:
+// The joint mask of a subscription (bit k for joint k) with the joints of a skeleton without any of the flags, e.g.
+// the body without the face and the hands
+template<class Skeleton>
+uint32_t skeleton_joint_mask(uint8_t excludedFlags)
+{
+    static_assert(Skeleton::JOINT_COUNT >= 1 && Skeleton::JOINT_COUNT <= 32, "A skeleton has 1 to 32 joints");
+
+    const uint8_t *flags = Skeleton::Flags();
+    uint32_t mask = 0;
+    for(unsigned k = 0; k < Skeleton::JOINT_COUNT; k ++)
+        if((flags[k] & excludedFlags) == 0) mask |= 1u << k;
+    return mask;
+}
+
+// Description:
+// Whether the parents of a skeleton make a tree rooted at joint 0, with each parent before its children
+template<class Skeleton>
+bool skeleton_is_valid()
+{
+    const int *parents = Skeleton::Parents();
+    if(parents[0] != -1) return false;
+    for(unsigned k = 1; k < Skeleton::JOINT_COUNT; k ++)
+        if(parents[k] < 0 || parents[k] >= (int)k) return false;
+    return true;
+}
+
+#endif // SKELETON_H
@@ -0,0 +1,291 @@
+#include "StreamRecorder.h"
+
+#include <string.h>
+#include <algorithm>
+#include <iostream>
+
+namespace mocap_netop {
+
+    static std::string segment_path(const std::string &basePath, uint32_t iSegment)
+    {
+        char name[32];
+        snprintf(name, sizeof(name), "_%06u.seg", iSegment);
+        return basePath + name;
+    }
+
+    static std::string index_path(const std::string &basePath)
+    {
+        return basePath + ".idx";
+    }
+
+    ////////////////////////////////////////////////////////////////
+    /// Recorder
+    ///
+    bool Stream_Recorder::Start(const std::string &basePath)
+    {
+        Stop();
+
+        _basePath = basePath;
+        _iSegment = 0;
+        _nSegmentSize = 0;
+        _lastIndexTimeUs = 0; // the times restart from the new start time
+        _fpIndex = fopen(index_path(basePath).c_str(), "wb");
+        if(_fpIndex == NULL){
+            std::cout << "Cannot create the log " << index_path(basePath) << "\n";
+            return false;
+        }
+
+        _startTime = std::chrono::steady_clock::now();
+        _startWallTime = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+
+        if(!OpenSegment()){
+            fclose(_fpIndex);
+            _fpIndex = 0;
+            return false;
+        }
+
+        _nRecorded = 0;
+        _nDropped = 0;
+        _bFailed = false;
+        _bInWork = true;
+        _threadWrite = std::thread(&Stream_Recorder::DoWrite, this);
+
+        return true;
+    }
+
+    void Stream_Recorder::Stop()
+    {
+        // the thread may have ended by itself on an error, and is still to be joined
+        if(!_threadWrite.joinable()) return;
+
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _bInWork = false;
+        }
+        _cvPending.notify_all();
+
+        _threadWrite.join();
+
+        while(!_pending.empty()) _pending.pop(); // queued after a failure
+        if(_fpSegment){ fclose(_fpSegment); _fpSegment = 0; }
+        if(_fpIndex){ fclose(_fpIndex); _fpIndex = 0; }
+    }
+
+    void Stream_Recorder::DoWrite()
+    {
+        std::vector<Pending_Frame> frames; // taken out at once, so the lock is not held while writing
+
+        std::unique_lock<std::mutex> lock(_mutex);
+        while(true){
+            _cvPending.wait(lock, [this]{ return !_pending.empty() || !_bInWork; });
+            if(_pending.empty()) break; // stopped and nothing left
+
+            while(!_pending.empty()){
+                frames.push_back(_pending.front());
+                _pending.pop();
+            }
+            lock.unlock();
+
+            bool bOk = true;
+            for(const Pending_Frame &pending : frames){
+                if(bOk) bOk = WriteFrame(pending);
+            }
+            frames.clear(); // the frames go back to the server
+
+            fflush(_fpSegment);
+            fflush(_fpIndex);
+
+            lock.lock();
+
+            if(!bOk){
+                std::cout << "Error on writing the log, the recording stops\n";
+                _bFailed = true;
+                while(!_pending.empty()) _pending.pop();
+                break;
+            }
+        }
+    }
+
+    bool Stream_Recorder::OpenSegment()
+    {
+        if(_fpSegment) fclose(_fpSegment);
+
+        _fpSegment = fopen(segment_path(_basePath, _iSegment).c_str(), "wb");
+        if(_fpSegment == NULL){
+            std::cout << "Cannot create the log " << segment_path(_basePath, _iSegment) << "\n";
+            return false;
+        }
+
+        Stream_Segment_Header header;
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, STREAM_LOG_MAGIC, sizeof(STREAM_LOG_MAGIC));
+        header.version = STREAM_LOG_VERSION;
+        header.iSegment = _iSegment;
+        header.startTime = _startWallTime;
+
+        _nSegmentSize = sizeof(header);
+        return fwrite(&header, sizeof(header), 1, _fpSegment) == 1;
+    }
+
+    bool Stream_Recorder::WriteFrame(const Pending_Frame &pending)
+    {
+        const Wire_Frame &frame = *pending.frame;
+        if(frame.headers.empty()) return true;
+
+        // the header of the whole entity, even if it is sent in chunks
+        Data_Header header = frame.headers[0];
+        if(header.nTotalSize != 0) header.nDataSize = header.nTotalSize;
+        header.nTotalSize = 0;
+        header.nOffset = 0;
+
+        Stream_Record_Header record;
+        memset(&record, 0, sizeof(record));
+        record.timeUs = pending.timeUs;
+        record.nSize = sizeof(Data_Header) + header.nDataSize;
+
+        // a new segment once the current one is full (a segment holds at least one record)
+        uint64_t nRecordSize = sizeof(record) + record.nSize;
+        if(_nSegmentSize > sizeof(Stream_Segment_Header) && _nSegmentSize + nRecordSize > _nMaxSegmentSize){
+            _iSegment ++;
+            if(!OpenSegment()) return false;
+        }
+        bool bNewSegment = (_nSegmentSize == sizeof(Stream_Segment_Header));
+
+        // a sparse index: the first record of a segment, then one every index interval
+        if(bNewSegment || pending.timeUs >= _lastIndexTimeUs + _nIndexIntervalUs){
+            Stream_Index_Entry entry;
+            memset(&entry, 0, sizeof(entry));
+            entry.timeUs = pending.timeUs;
+            entry.iSegment = _iSegment;
+            entry.nOffset = _nSegmentSize;
+
+            if(fwrite(&entry, sizeof(entry), 1, _fpIndex) != 1) return false;
+            _lastIndexTimeUs = pending.timeUs;
+        }
+
+        if(fwrite(&record, sizeof(record), 1, _fpSegment) != 1
+                || fwrite(&header, sizeof(header), 1, _fpSegment) != 1
+                || (header.nDataSize > 0 && fwrite(frame.entity.data(), header.nDataSize, 1, _fpSegment) != 1))
+            return false;
+
+        _nSegmentSize += nRecordSize;
+        _nRecorded ++;
+
+        return true;
+    }
+
+    ////////////////////////////////////////////////////////////////
+    /// Reader
+    ///
+    bool Stream_Log_Reader::Open(const std::string &basePath)
+    {
+        Close();
+
+        FILE *fp = fopen(index_path(basePath).c_str(), "rb");
+        if(fp == NULL) return false;
+
+        Stream_Index_Entry entry;
+        while(fread(&entry, sizeof(entry), 1, fp) == 1)
+            _index.push_back(entry);
+        fclose(fp);
+
+        _basePath = basePath;
+        return OpenSegment(0, sizeof(Stream_Segment_Header));
+    }
+
+    void Stream_Log_Reader::Close()
+    {
+        if(_fpSegment){ fclose(_fpSegment); _fpSegment = 0; }
+
+        _index.clear();
+        _bPeeked = false;
+    }
+
+    bool Stream_Log_Reader::OpenSegment(uint32_t iSegment, uint64_t nOffset)
+    {
+        if(_fpSegment){ fclose(_fpSegment); _fpSegment = 0; }
+
+        FILE *fp = fopen(segment_path(_basePath, iSegment).c_str(), "rb");
+        if(fp == NULL) return false;
+
+        Stream_Segment_Header header;
+        if(fread(&header, sizeof(header), 1, fp) != 1 || memcmp(header.magic, STREAM_LOG_MAGIC, sizeof(STREAM_LOG_MAGIC)) != 0
+                || header.version != STREAM_LOG_VERSION || fseek(fp, (long)nOffset, SEEK_SET) != 0){
+            std::cout << "Not a valid log segment: " << segment_path(_basePath, iSegment) << "\n";
+            fclose(fp);
+            return false;
+        }
+
+        _fpSegment = fp;
+        _iSegment = iSegment;
+        return true;
+    }
+
+    bool Stream_Log_Reader::ReadRecord(Stream_Record &record)
+    {
+        while(_fpSegment){
+            Stream_Record_Header recordHeader;
+            if(fread(&recordHeader, sizeof(recordHeader), 1, _fpSegment) == 1){
+                if(recordHeader.nSize < sizeof(Data_Header)) return false;
+
+                unsigned nDataSize = recordHeader.nSize - sizeof(Data_Header);
+                if(record.entity.size() < nDataSize) record.entity.resize(nDataSize);
+
+                if(fread(&record.header, sizeof(Data_Header), 1, _fpSegment) != 1
+                        || (nDataSize > 0 && fread(record.entity.data(), nDataSize, 1, _fpSegment) != 1)
+                        || record.header.nDataSize != nDataSize)
+                    return false; // cut short
+
+                record.timeUs = recordHeader.timeUs;
+                return true;
+            }
+
+            // the end of the segment: go on with the next one, if any
+            if(!OpenSegment(_iSegment + 1, sizeof(Stream_Segment_Header))) return false;
+        }
+
+        return false;
+    }
+
+    bool Stream_Log_Reader::Seek(uint64_t timeUs)
+    {
+        _bPeeked = false;
+
+        // start from the last indexed record before the time, and read on up to it
+        auto it = std::upper_bound(_index.begin(), _index.end(), timeUs,
+                                   [](uint64_t t, const Stream_Index_Entry &entry){ return t < entry.timeUs; });
+
+        bool bOk;
+        if(it == _index.begin())
+            bOk = OpenSegment(0, sizeof(Stream_Segment_Header));
+        else{
+            --it;
+            bOk = OpenSegment(it->iSegment, it->nOffset);
+        }
+        if(!bOk) return false;
+
+        while(ReadRecord(_peeked)){
+            if(_peeked.timeUs >= timeUs){
+                _bPeeked = true;
+                return true;
+            }
+        }
+
+        return false; // no record after the time
+    }
+
+    bool Stream_Log_Reader::Next(Stream_Record &record)
+    {
+        if(_bPeeked){
+            _bPeeked = false;
+
+            record.timeUs = _peeked.timeUs;
+            record.header = _peeked.header;
+            if(record.entity.size() < _peeked.entity.size()) record.entity.resize(_peeked.entity.size());
+            memcpy(record.entity.data(), _peeked.entity.data(), _peeked.header.nDataSize);
+            return true;
+        }
+
+        return ReadRecord(record);
+    }
+}
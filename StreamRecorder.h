@@ -0,0 +1,350 @@
+/*******************************************************************
+* Author	: wwyang
+* Date		: 2026.10.17
+* Copyright : Zhejiang Gongshang University
+* Head File :
+* Version   : 1.0
+*********************************************************************/
+// .NAME Stream_Recorder/Stream_Log_Reader/Stream_Replayer
+
+// .SECTION Description
+// Here provides the recording and the replay of the stream of a server. A recorder attached to a server (see
+// CMoCapTCPServer::SetRecorder) gets each frame once it is encoded for the clients, and only queues it: its own thread
+// writes the frames to the log, so recording adds no latency to the broadcast. The log is split into segments of a
+// bounded size, and a sparse index of the time of the records tells where to start reading for a seek:
+//     <base>.idx         : entries of (time, segment, offset), one at the beginning of each segment and then about
+//                          one every index interval
+//     <base>_000000.seg, <base>_000001.seg, ... : (segment header); (record1, record2, ...)
+//     format of record   : (Stream_Record_Header: time in microseconds since the recording started, 16 bytes);
+//                          (Data_Header of the whole entity); (entity)
+// A replayer reads a log, decodes the entities with the recv callback of a client and pushes the data into the
+// send queue of a server, in real time, N times faster or as fast as possible.
+
+// .SECTION See also
+// CMoCapTCPServer, Data_Repos
+
+#ifndef STREAMRECORDER_H
+#define STREAMRECORDER_H
+
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <stdio.h>
+#include <stdint.h>
+
+#include "NetOp.h"
+
+namespace mocap_netop {
+
+    #define STREAM_LOG_MAGIC "MOCAPLG"
+    #define STREAM_LOG_VERSION 2
+
+    struct Stream_Segment_Header{
+        char magic[8]; // STREAM_LOG_MAGIC
+        uint32_t version; // STREAM_LOG_VERSION
+        uint32_t iSegment; // number of the segment
+        uint64_t startTime; // wall-clock time when the recording started, in milliseconds since the epoch
+    };
+
+    struct Stream_Record_Header{
+        uint64_t timeUs; // when the frame was sent, in microseconds since the recording started
+        uint32_t nSize; // bytes following this header: the Data_Header and the entity
+        uint32_t reserved;
+    };
+
+    struct Stream_Index_Entry{
+        uint64_t timeUs; // time of the record
+        uint32_t iSegment; // segment of the record
+        uint32_t reserved;
+        uint64_t nOffset; // position of the record in the segment
+    };
+
+    // Recorder of the frames sent by a server
+    class Stream_Recorder{
+    public:
+        explicit Stream_Recorder(uint64_t nMaxSegmentSize = 64 << 20, unsigned nIndexIntervalMs = 1000, unsigned maxPending = 1024)
+            : _nMaxSegmentSize(nMaxSegmentSize), _nIndexIntervalUs((uint64_t)nIndexIntervalMs * 1000), _maxPending(maxPending)
+        {
+            _bInWork = false;
+        }
+        Stream_Recorder(const Stream_Recorder&) = delete;
+        Stream_Recorder& operator=(const Stream_Recorder&) = delete;
+
+        ~Stream_Recorder() { Stop(); }
+
+        // Description:
+        // Start a new log with the given base path, e.g. "records/session1", and the thread writing it
+        bool Start(const std::string &basePath);
+
+        // Description:
+        // Write the frames that are still queued, and close the log. It is also needed after the writing has failed.
+        void Stop();
+
+        // Description:
+        // Started, and the writing has not failed (e.g., on a full disk), after which the frames are not queued
+        bool IsWorking() const { return _bInWork && !_bFailed; }
+
+        // Description:
+        // Queue a frame to be written, which is called by the server for each frame it sends. It never blocks on
+        // the disk: if the writing thread is too far behind, the frame is dropped and counted.
+        void Record(const std::shared_ptr<const Wire_Frame> &frame)
+        {
+            if(!IsWorking()) return;
+
+            uint64_t timeUs = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - _startTime).count();
+
+            std::unique_lock<std::mutex> lock(_mutex);
+
+            if(_pending.size() >= _maxPending){
+                _nDropped ++;
+                return;
+            }
+            _pending.push(Pending_Frame{frame, timeUs});
+
+            lock.unlock();
+
+            _cvPending.notify_one();
+        }
+
+        uint64_t GetRecordedCount() const { return _nRecorded; }
+        uint64_t GetDropCount() const { return _nDropped; }
+
+    private:
+        struct Pending_Frame{
+            std::shared_ptr<const Wire_Frame> frame;
+            uint64_t timeUs;
+        };
+
+        // core of the thread writing the log
+        void DoWrite();
+
+        bool WriteFrame(const Pending_Frame &pending);
+        bool OpenSegment();
+
+    private:
+        std::atomic_bool _bInWork;
+        std::atomic_bool _bFailed{false}; // the writing has failed, and the thread has ended
+        std::thread _threadWrite;
+
+        std::mutex _mutex; // for the queue of the pending frames
+        std::condition_variable _cvPending;
+        Ring_Queue<Pending_Frame> _pending; // frames waiting to be written
+        std::atomic<uint64_t> _nRecorded{0}, _nDropped{0};
+
+        std::chrono::steady_clock::time_point _startTime;
+        uint64_t _startWallTime = 0;
+
+        // only used by the writing thread
+        std::string _basePath;
+        FILE *_fpSegment = 0, *_fpIndex = 0;
+        uint32_t _iSegment = 0;
+        uint64_t _nSegmentSize = 0;
+        uint64_t _lastIndexTimeUs = 0;
+
+        uint64_t _nMaxSegmentSize;
+        uint64_t _nIndexIntervalUs;
+        unsigned _maxPending;
+    };
+
+    // A record read from a log
+    struct Stream_Record{
+        uint64_t timeUs;
+        Data_Header header; // of the whole entity
+        std::vector<char> entity; // its size may be larger than header.nDataSize
+    };
+
+    // Sequential reader of a log, which can seek by time through the index
+    class Stream_Log_Reader{
+    public:
+        Stream_Log_Reader() {}
+        Stream_Log_Reader(const Stream_Log_Reader&) = delete;
+        Stream_Log_Reader& operator=(const Stream_Log_Reader&) = delete;
+
+        ~Stream_Log_Reader() { Close(); }
+
+        bool Open(const std::string &basePath);
+        void Close();
+
+        // Description:
+        // Move to the first record at or after the time (in microseconds since the recording started)
+        bool Seek(uint64_t timeUs);
+
+        // Description:
+        // Read the next record. Return false at the end of the log (or at a record cut short by a crash).
+        bool Next(Stream_Record &record);
+
+    private:
+        bool OpenSegment(uint32_t iSegment, uint64_t nOffset);
+        bool ReadRecord(Stream_Record &record);
+
+    private:
+        std::string _basePath;
+        std::vector<Stream_Index_Entry> _index;
+        FILE *_fpSegment = 0;
+        uint32_t _iSegment = 0;
+
+        Stream_Record _peeked; // a record read ahead by a seek
+        bool _bPeeked = false;
+    };
+
+    // Replay of a log into the send queue of a server
+    template<class DataType_Send, class DataType_Recv>
+    class Stream_Replayer{
+    public:
+        // The callback decoding an entity, i.e. the recv callback of a client receiving DataType_Send
+        typedef void (*Decode_Callback)(Data_Buffer*, Data_Repos<DataType_Recv, DataType_Send>&);
+
+        Stream_Replayer(Data_Repos<DataType_Send, DataType_Recv> &target, Decode_Callback decode)
+            : _target(target), _decode(decode)
+        {
+            _bInWork = false;
+        }
+        Stream_Replayer(const Stream_Replayer&) = delete;
+        Stream_Replayer& operator=(const Stream_Replayer&) = delete;
+
+        ~Stream_Replayer() { Stop(); }
+
+        bool Open(const std::string &basePath)
+        {
+            Stop();
+
+            std::unique_lock<std::mutex> lock(_mutex);
+
+            _bHasRecord = false; // nothing of the previous log is played
+            _bAnchor = false;
+            _bFinished = false;
+
+            return _reader.Open(basePath);
+        }
+
+        // Description:
+        // 1 for real time, N for N times faster, 0 for as fast as the log is read
+        void SetSpeed(double speed)
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+
+            _speed = speed > 0 ? speed : 0;
+            _bAnchor = false; // the pace restarts from the next frame
+            _cvWakeUp.notify_all();
+        }
+
+        // Description:
+        // The next frame to be played is the first one at or after the time (in milliseconds since the recording started)
+        bool Seek(uint64_t timeMs)
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+
+            _bHasRecord = false;
+            _bAnchor = false;
+            _cvWakeUp.notify_all();
+
+            return _reader.Seek(timeMs * 1000);
+        }
+
+        bool Start()
+        {
+            Stop();
+
+            _bInWork = true;
+            _bFinished = false;
+            _threadPlay = std::thread(&Stream_Replayer::DoPlay, this);
+            return true;
+        }
+
+        void Stop()
+        {
+            if(!_bInWork) return;
+
+            {
+                std::unique_lock<std::mutex> lock(_mutex);
+                _bInWork = false;
+                _cvWakeUp.notify_all();
+            }
+
+            if(_threadPlay.joinable())
+                _threadPlay.join();
+        }
+
+        // Description:
+        // Whether all the frames up to the end of the log have been played
+        bool IsFinished() const { return _bFinished; }
+
+        uint64_t GetPlayedCount() const { return _nPlayed; }
+
+    private:
+        // core of the thread of the replay
+        void DoPlay()
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+
+            while(_bInWork){
+                if(!_bHasRecord){
+                    if(!_reader.Next(_record)){ // the end of the log: wait for a seek or the stop
+                        _bFinished = true;
+                        _cvWakeUp.wait(lock);
+                        continue;
+                    }
+                    _bHasRecord = true;
+                    _bFinished = false;
+                }
+
+                // pace the frames on their recording time: the first one after a seek or a change of speed is the anchor
+                if(_speed > 0){
+                    auto now = std::chrono::steady_clock::now();
+                    if(!_bAnchor){
+                        _anchorTime = now;
+                        _anchorRecordUs = _record.timeUs;
+                        _bAnchor = true;
+                    }
+
+                    double delayUs = (double)(_record.timeUs - std::min(_record.timeUs, _anchorRecordUs)) / _speed;
+                    auto due = _anchorTime + std::chrono::microseconds((long long)delayUs);
+                    if(due > now){
+                        _cvWakeUp.wait_until(lock, due); // a seek, a change of speed or the stop comes in here
+                        continue;
+                    }
+                }
+
+                _bHasRecord = false;
+
+                // decode the entity into a data and hand it to the server
+                Data_Buffer buffer;
+                buffer.dataHeader = _record.header;
+                buffer.pData = _record.entity.data();
+
+                _decode(&buffer, _decoded);
+                while(std::shared_ptr<DataType_Send> data = _decoded.PopData_RecvQueue()){
+                    _target.PushData_SendQueue(data);
+                    _nPlayed ++;
+                }
+            }
+        }
+
+    private:
+        Data_Repos<DataType_Send, DataType_Recv> &_target;
+        Decode_Callback _decode;
+        Data_Repos<DataType_Recv, DataType_Send> _decoded; // where the decode callback puts the data
+
+        Stream_Log_Reader _reader;
+        std::thread _threadPlay;
+        std::mutex _mutex; // for the reader and the pace
+        std::condition_variable _cvWakeUp;
+        std::atomic_bool _bInWork;
+        std::atomic_bool _bFinished{false};
+        std::atomic<uint64_t> _nPlayed{0};
+
+        double _speed = 1;
+        Stream_Record _record; // the next record to be played
+        bool _bHasRecord = false;
+        bool _bAnchor = false;
+        std::chrono::steady_clock::time_point _anchorTime;
+        uint64_t _anchorRecordUs = 0;
+    };
+}
+
+#endif // STREAMRECORDER_H
@@ -0,0 +1,163 @@
+/*******************************************************************
+* Author	: wwyang
+* Date		: 2026.10.17
+* Copyright : Zhejiang Gongshang University
+* Head File :
+* Version   : 1.0
+*********************************************************************/
+// .NAME Stream_Subscription/Subscription_Projection/Subscription_Registry
+
+// .SECTION Description
+// Here provides the subscriptions of the clients to a part of the stream: the poses with some IDs (all of them if no
+// ID is listed), some of their joints (a mask with bit k for joint k) and the actions or not. A client sends its
+// subscription in a "sub" message (see CMoCapTCPClient::Subscribe), and the server sends it each frame projected by
+// the projection callback of the data type instead of the whole frame.
+// The connections with the same subscription share a Subscription_Projection of the registry, which keeps the last
+// frame projected for it, so a frame is projected once for all of them whatever the number of the clients.
+
+// .SECTION See also
+// CMoCapTCPServer, CMoCapTCPClient
+
+#ifndef SUBSCRIPTION_H
+#define SUBSCRIPTION_H
+
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <algorithm>
+#include <string.h>
+#include <stdint.h>
+
+#include "NetOp.h"
+
+namespace mocap_netop {
+
+    const uint32_t SUBSCRIPTION_ALL_JOINTS = 0xFFFFFFFF;
+
+    struct Stream_Subscription{
+        std::vector<unsigned long long> poseIDs; // the poses wanted, sorted; empty for all of them
+        uint32_t jointMask = SUBSCRIPTION_ALL_JOINTS; // bit k for joint k
+        bool bActions = true; // the actions of the poses wanted as well
+
+        // Description:
+        // The whole stream is wanted
+        bool IsFull() const { return poseIDs.empty() && jointMask == SUBSCRIPTION_ALL_JOINTS && bActions; }
+
+        bool HasPose(unsigned long long poseID) const
+        {
+            return poseIDs.empty() || std::binary_search(poseIDs.begin(), poseIDs.end(), poseID);
+        }
+
+        // Description:
+        // Sort the IDs and remove the duplicates, so equal subscriptions compare equal
+        void Normalize()
+        {
+            std::sort(poseIDs.begin(), poseIDs.end());
+            poseIDs.erase(std::unique(poseIDs.begin(), poseIDs.end()), poseIDs.end());
+        }
+
+        bool operator==(const Stream_Subscription &other) const
+        {
+            return jointMask == other.jointMask && bActions == other.bActions && poseIDs == other.poseIDs;
+        }
+
+        // Description:
+        // The entity of a "sub" message: (joint mask: uint, 4 bytes); (actions: uint, 4 bytes);
+        // (number of poses: uint, 4 bytes); (poseID1, poseID2, ...: ulong long, 8 bytes each)
+        size_t WireSize() const { return 12 + poseIDs.size() * 8; }
+        void Encode(char *pDst) const
+        {
+            uint32_t nActions = bActions ? 1 : 0, nPose = (uint32_t)poseIDs.size();
+            memcpy(pDst, &jointMask, 4);
+            memcpy(pDst + 4, &nActions, 4);
+            memcpy(pDst + 8, &nPose, 4);
+            if(nPose > 0) memcpy(pDst + 12, poseIDs.data(), nPose * 8);
+        }
+
+        // Description:
+        // Return false if the entity is not a subscription
+        bool Decode(const char *pSrc, size_t nSize)
+        {
+            uint32_t nActions, nPose;
+            if(nSize < 12) return false;
+
+            memcpy(&jointMask, pSrc, 4);
+            memcpy(&nActions, pSrc + 4, 4);
+            memcpy(&nPose, pSrc + 8, 4);
+            if(nSize != 12 + (size_t)nPose * 8) return false;
+
+            bActions = nActions != 0;
+            poseIDs.resize(nPose);
+            if(nPose > 0) memcpy(poseIDs.data(), pSrc + 12, nPose * 8);
+            Normalize();
+            return true;
+        }
+    };
+
+    // A subscription shared by the connections which have it, with the last frame projected for it
+    struct Subscription_Projection{
+        explicit Subscription_Projection(const Stream_Subscription &subscription = Stream_Subscription())
+            : subscription(subscription) {}
+
+        const Stream_Subscription subscription;
+
+        // The cache, only touched by the thread broadcasting the frames: the number of the last frame projected, and
+        // the message projected from it (0 if it cannot be projected, the whole frame is sent then)
+        mutable uint64_t nFrame = 0;
+        mutable Outbound_Queue::Message message;
+    };
+
+    class Subscription_Registry{
+    public:
+        Subscription_Registry() : _pFull(std::make_shared<Subscription_Projection>()) {}
+
+        // Description:
+        // The projection of a subscription, shared with the connections which have the same one. All the connections
+        // of the whole stream share one which is never projected. It may be called by any threads at the same time.
+        std::shared_ptr<const Subscription_Projection> Intern(Stream_Subscription subscription)
+        {
+            subscription.Normalize();
+            if(subscription.IsFull()) return _pFull;
+
+            std::unique_lock<std::mutex> lock(_mutex);
+
+            std::shared_ptr<const Subscription_Projection> pProjection;
+            for(size_t i = 0; i < _projections.size(); ){
+                std::shared_ptr<const Subscription_Projection> pKnown = _projections[i].lock();
+                if(!pKnown){ // no connection has it any more
+                    _projections[i] = _projections.back();
+                    _projections.pop_back();
+                    continue;
+                }
+                if(pKnown->subscription == subscription) pProjection = pKnown;
+                i ++;
+            }
+
+            if(!pProjection){
+                pProjection = std::make_shared<Subscription_Projection>(subscription);
+                _projections.push_back(pProjection);
+            }
+            return pProjection;
+        }
+
+        // Description:
+        // The projection of the whole stream
+        std::shared_ptr<const Subscription_Projection> GetFull() const { return _pFull; }
+
+        // Description:
+        // Number of the distinct subscriptions, some of which may not be used any more
+        size_t Size()
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            return _projections.size();
+        }
+
+    private:
+        const std::shared_ptr<const Subscription_Projection> _pFull;
+        std::mutex _mutex;
+        std::vector< std::weak_ptr<const Subscription_Projection> > _projections; // the subscriptions in use
+    };
+
+} // namespace: mocap_netop
+
+#endif // SUBSCRIPTION_H
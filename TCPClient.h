@@ -8,9 +8,20 @@
 // .NAME CMoCapTCPClient
 
 // .SECTION Description
-// It is a class that implements a client with TCP stream. In this implementation, we assume that a packet message contains
-// a full mocap data. 
+// It is a class that implements a client with TCP stream. The bytes from the server are assembled into messages
+// however the stream splits them, and a message larger than the buffer size is sent/received in chunks.
 // Note that a client can only send and receive a certain type of data which is specified through the template param.
+// A client on the same host as the server may connect with "shm://name" instead of "ip:port": it reads the frames
+// from the shared-memory ring of the server (see CMoCapTCPServer::EnableSharedMemory) and still sends its messages
+// to the server over TCP, at the address that the ring tells. Likewise a client may join the UDP multicast group of
+// the server (see EnableMulticast) for the frames, which skips the frames lost on the way instead of waiting for them.
+// A client may also subscribe to a part of the stream (see Subscribe), e.g. some of the poses or joints only.
+// The frames are decoded on the thread reading the socket, or on a few workers (see SetDecodeThreads) for a heavy
+// callback, in which case the thread only assembles them and they still reach the repos in order.
+// A client may ping the server now and then (see EnableClockSync) for an estimate of the clock of the server, which
+// turns the send time of the frames into the clock of the client for their one-way latency on another host.
+// With the heartbeats on (see SetHeartbeat), the client beats when it has sent nothing for a while, and takes the
+// server as gone when nothing has come from it for the idle timeout.
 
 // .SECTION See also
 // CMoCapTCPServer
@@ -19,7 +30,6 @@
 #define TCPCLIENT_H
 
 #include <iostream>
-#include <winsock2.h>
 #include <string>
 #include <vector>
 #include <thread>
@@ -27,14 +37,16 @@
 #include <memory>
 #include <map>
 #include <atomic>
-#include <windows.h>
-#include <winsock.h>
-#include <ws2tcpip.h>
 #include <assert.h>
 
+#include "NetPlatform.h"
 #include "NetOp.h"
-
-#pragma comment(lib,"ws2_32.lib")
+#include "ShmChannel.h"
+#include "MulticastChannel.h"
+#include "LatencyTrace.h"
+#include "Subscription.h"
+#include "DecodePipeline.h"
+#include "ClockSync.h"
 
 namespace mocap_netop {
 
@@ -50,7 +62,7 @@ public:
 	~CMoCapTCPClient() { Disconnect(); }
 
 	// Description:
-	// Connect the server for communication
+	// Connect the server for communication. The address is "ip:port", or "shm://name" for the shared-memory ring of a server.
 	// The callback functions are used to handle msgs that are received from or sent to the sever   
 	bool Connect(void (*send_msg_callback)(Data_Buffer*, Data_Repos<DataType_Send, DataType_Recv>& )=0, void (*recv_msg_callback)(Data_Buffer*, Data_Repos<DataType_Send, DataType_Recv>&)=0);
 	
@@ -70,27 +82,148 @@ public:
         return _dataReposForClient;
     }
     
+    // Description:
+    // Get the frames from the UDP multicast group "ip:port" of the server (see CMoCapTCPServer::EnableMulticast),
+    // joined on the interface interfaceIp, instead of over TCP. It should be called before Connect(). An empty group disables it.
+    bool EnableMulticast(const std::string &groupAddressPort, const std::string &interfaceIp = "")
+    {
+        if(_bInWork) return false;
+        
+        _multicastGroup = groupAddressPort;
+        _multicastInterface = interfaceIp;
+        return true;
+    }
+    
+    // Description:
+    // Decode the frames on nThread worker threads instead of the thread reading the socket, with at most maxInFlight
+    // of them waiting to be decoded and pushed (4 for each worker if 0); the repos gets them in the order they came.
+    // It is for a recv callback that takes long on a frame. A callback keeping a state from a frame to the next, as the
+    // compact ones do, must be told by bStateful: its frames are then decoded one after another on a single worker,
+    // whatever nThread is, instead of by several workers at the same time. It should be called before Connect();
+    // 0 threads decode on the reading thread.
+    bool SetDecodeThreads(unsigned nThread, unsigned maxInFlight = 0, bool bStateful = false)
+    {
+        if(_bInWork) return false;
+        
+        _nDecodeThread = (bStateful && nThread > 1) ? 1 : nThread;
+        _maxDecodeInFlight = maxInFlight > 0 ? maxInFlight : 4 * _nDecodeThread;
+        return true;
+    }
+    
+    // Description:
+    // Send a "beat" to the server when nothing has been sent to it for the interval, and drop the connection when nothing
+    // has come from the server for the idle timeout (over TCP, or the ring or the group), e.g., its host is down, which
+    // the socket does not tell for long. The server should beat at a shorter interval than the timeout (see
+    // CMoCapTCPServer::SetHeartbeat). Either is off if 0, which is the default. It should be called before Connect().
+    bool SetHeartbeat(std::chrono::milliseconds interval, std::chrono::milliseconds idleTimeout)
+    {
+        if(_bInWork) return false;
+        
+        _heartbeatInterval = interval;
+        _idleTimeout = idleTimeout;
+        return true;
+    }
+    
+    // Description:
+    // Ping the server every period for its clock (see Clock_Offset_Estimator); the first few go quicker, for an
+    // estimate soon. The server learns the clock of the client from the pings as well. It should be called before
+    // Connect(); a period of 0 disables it.
+    bool EnableClockSync(std::chrono::milliseconds period = std::chrono::milliseconds(1000))
+    {
+        if(_bInWork) return false;
+        
+        _clockSyncPeriod = period;
+        return true;
+    }
+    
+    // Description:
+    // The clock of the server relative to the client's, not valid until a pong has come back
+    Clock_Estimate GetServerClock() const
+    {
+        return _clockEstimator.GetEstimate();
+    }
+    
+    // Description:
+    // Trace the latency of the messages through the stages on the client (see Latency_Tracer): the frames on the way,
+    // in the receive callback and in the receive queue, the actions in the send queue and the send callback.
+    // It may be turned on and off at any time.
+    void EnableLatencyTracing(bool bEnabled = true) { _tracer.Enable(bEnabled); }
+    Latency_Tracer& GetLatencyTracer() { return _tracer; }
+    
+    // Description:
+    // Chunks of the frames lost by a slow client of the shared-memory ring
+    uint64_t GetSharedMemoryLostCount() const
+    {
+        return _shmReader.GetLostCount();
+    }
+    
+    // Description:
+    // Frames skipped by the client of a multicast group for the datagrams lost or reordered
+    uint64_t GetMulticastLostCount() const
+    {
+        return _multicastReceiver.GetLostCount();
+    }
+    
+    // Description:
+    // Why the server refused the connection, e.g., it is at its capacity; empty if it did not.
+    // The client stops working once it is refused.
+    std::string GetRejectReason()
+    {
+        std::unique_lock<std::mutex> lock(_mutexReason);
+        return _rejectReason;
+    }
+    
+    // Description:
+    // Ask the server for a part of the stream only: the poses with some IDs, some of their joints, with or without the
+    // actions (see Stream_Subscription). The frames then come projected (the "mocap_p" messages), which the recv callback
+    // decodes as well. It may be called before Connect() or at any time after, and it holds on reconnecting.
+    // Unsubscribe() gets the whole stream again. Return false if the subscription cannot be sent.
+    bool Subscribe(const Stream_Subscription &subscription);
+    bool Unsubscribe() { return Subscribe(Stream_Subscription()); }
+    
+    Stream_Subscription GetSubscription()
+    {
+        std::unique_lock<std::mutex> lock(_mutexSend);
+        return _subscription;
+    }
+    
 private:
+    // Open a TCP connection to the server at the address "ip:port"
+    bool ConnectServer(const std::string &serverAddressPort);
+    
     // core of the thread of message sending
 	void DoSendMessage();
+    
+    // Write a sealed message to the server, waiting while the socket cannot take it. It is called under _mutexSend.
+    // Return false if the connection is broken.
+    bool WriteMessage(const Wire_Frame &frame);
+    
+    // Send the subscription to the server. It is called under _mutexSend.
+    bool SendSubscription();
+    
+    // Send a ping stamped now, with the estimate of the clock of the server so far. It is called under _mutexSend.
+    bool SendPing();
+    
+    // Send a heartbeat. It is called under _mutexSend.
+    bool SendBeat();
 
 	// core of the thread of message receiving
 	void DoReceiveMessage();
     
+    // Hand the complete messages of the assembler to the callback, the frames only if bFrame.
+    // Return false if the server quits or the stream is corrupted.
+    bool DispatchMessages(Frame_Assembler &assembler, bool bFrame);
+    
     // set the socket as non-blocking
     int set_nonblocking(SOCKET fd)
     {
-        unsigned long long ul=1;
-        int ret=ioctlsocket(fd, FIONBIO, (unsigned long *)&ul);
-        if(ret == SOCKET_ERROR)
-            return -1;
-        else return 1;
+        return socket_set_nonblocking(fd);
     }
     
 private:
     std::atomic_bool _bInWork;
     
-    int _sockfd_client=-1; // handle to the client's socket
+    std::atomic_int _sockfd_client{-1}; // handle to the client's socket; closed by the receiving thread if the connection drops
     std::thread _threadRecvMsg; // thread for receiving messages from the server
 	std::thread _threadSendMsg; // thread for sending messages to the server
     
@@ -101,6 +234,21 @@ private:
     unsigned _maxDataSize;
     
     Data_Repos<DataType_Send, DataType_Recv> _dataReposForClient; // repos for the data have been received or to be sent by the client
+    Shm_Ring_Reader _shmReader; // the frames come from here if the client is connected with "shm://"
+    std::string _multicastGroup, _multicastInterface; // group of the multicast and the interface to it; empty if it is not used
+    Multicast_Receiver _multicastReceiver; // or from here if the client joins a multicast group
+    unsigned _nDecodeThread = 0, _maxDecodeInFlight = 0; // the workers decoding the frames, none for the reading thread
+    Decode_Pipeline<DataType_Send, DataType_Recv> _decodePipeline; // running if there are workers
+    Latency_Tracer _tracer; // histograms of the latency of the stages, if it is enabled
+    std::mutex _mutexReason;
+    std::string _rejectReason; // told by the server if it refuses the connection
+    std::mutex _mutexSend; // a message is written to the socket at a time: by the sending thread or Subscribe()
+    Stream_Subscription _subscription; // the part of the stream wanted, under _mutexSend
+    uint64_t _tLastSend = 0; // when a message was written last, under _mutexSend
+    std::chrono::milliseconds _heartbeatInterval{0}, _idleTimeout{0}; // of the heartbeats and the server, none if 0
+    std::chrono::milliseconds _clockSyncPeriod{0}; // of the pings, none if 0
+    Clock_Offset_Estimator _clockEstimator; // of the clock of the server, from the pongs
+    Clock_Estimate _serverClock; // the last estimate, for the thread receiving the frames
 };
 
 //////////////////////// Implementation of the template class ///////////////////////////////////////
@@ -111,6 +259,7 @@ CMoCapTCPClient<DataType_Send, DataType_Recv>::CMoCapTCPClient( const std::strin
     : _serverIPAddress(serverAddressPort), _maxDataSize(maxDataSize)
 {
     _bInWork = false;
+    _dataReposForClient.SetTracer(&_tracer);
 }
 
 template <class DataType_Send, class DataType_Recv>
@@ -121,31 +270,81 @@ bool CMoCapTCPClient<DataType_Send, DataType_Recv>::Connect(void (*send_msg_call
     
     _pSend_msg_callback = send_msg_callback;
     _pRecv_msg_callback = recv_msg_callback;
+    
+    {
+        std::unique_lock<std::mutex> lock(_mutexReason);
+        _rejectReason.clear();
+    }
 
 
-    WORD w_req = MAKEWORD(2, 2);//Version number
-        WSADATA wsadata;
-        int err;
-        err = WSAStartup(w_req, &wsadata);
-        if (err != 0) {
-            std::cout << "ini socket fail c" << std::endl;
-        }
-        else {
-            //std::cout << "ini socket success c" << std::endl;
-            Sleep(1);
-        }
-        //Check the Version number
-        if (LOBYTE(wsadata.wVersion) != 2 || HIBYTE(wsadata.wHighVersion) != 2) {
-            std::cout << "fail c" << std::endl;
-            WSACleanup();
-        }
-        else {
-            //std::cout << "right c" << std::endl;
-            Sleep(1);
-        }
+    socket_startup();
     
-    // Connect to the server
+    // Connect to the server: through the shared-memory ring for the frames if it is "shm://name"
+    _shmReader.Close();
+    _multicastReceiver.Close();
+    
+    std::string serverAddress = _serverIPAddress;
+    const std::string shmScheme = "shm://";
+    if(serverAddress.compare(0, shmScheme.size(), shmScheme) == 0){
+        if(!_shmReader.Open(serverAddress.substr(shmScheme.size())))
+            return false;
+        serverAddress = _shmReader.GetServerAddress();
+    }
+    
+    else if(!_multicastGroup.empty()){ // or through the multicast group
+        if(!_multicastReceiver.Open(_multicastGroup, _multicastInterface))
+            return false;
+    }
+    
+    if(!ConnectServer(serverAddress)){
+        _shmReader.Close();
+        _multicastReceiver.Close();
+        return false;
+    }
+    
+    if(_shmReader.IsOpen() || _multicastReceiver.IsOpen()){
+        // Tell the server not to send the frames over TCP
+        Data_Header data;
+        
+        strcpy(data.data_name, _shmReader.IsOpen() ? "shm" : "mcast");
+        data.nDataSize = 0;
+        
+        send(_sockfd_client, (char*)&data, sizeof(data), MSG_NOSIGNAL);
+    }
+    
+    // set the client socket as non-blocking mode
+    set_nonblocking(_sockfd_client);
+    socket_set_nodelay(_sockfd_client);
     
+    {
+        // Tell the server the part of the stream wanted, if not all of it
+        std::unique_lock<std::mutex> lock(_mutexSend);
+        _tLastSend = latency_now_ns();
+        if(!_subscription.IsFull()) SendSubscription();
+    }
+    
+    // A new connection may be to another server
+    _clockEstimator.Reset();
+    _serverClock = Clock_Estimate();
+    
+    // Decode the frames on the workers, if any
+    if(_nDecodeThread > 0 && _pRecv_msg_callback != 0)
+        _decodePipeline.Start(_nDecodeThread, _maxDecodeInFlight, _pRecv_msg_callback, _dataReposForClient, &_tracer);
+    
+    _bInWork = true;
+    
+    // 3. Create a new session for receving message from the server
+    _threadRecvMsg = std::thread(&CMoCapTCPClient::DoReceiveMessage, this);
+    
+    // 4. Create a new session for sending messages if available to the server
+    _threadSendMsg = std::thread(&CMoCapTCPClient::DoSendMessage, this);
+
+    return true;  
+}
+
+template <class DataType_Send, class DataType_Recv>
+bool CMoCapTCPClient<DataType_Send, DataType_Recv>::ConnectServer(const std::string &serverAddressPort)
+{
     // 1. Create a socket as a file: tcp stream
     _sockfd_client = socket(AF_INET, SOCK_STREAM, 0);
     
@@ -163,10 +362,10 @@ bool CMoCapTCPClient<DataType_Send, DataType_Recv>::Connect(void (*send_msg_call
     serv_addr.sin_family = AF_INET;  
     
     // decode the ip and port from _ipAddress (with the format such as: 192.0.1.1:20000)
-    auto index = _serverIPAddress.find_last_of(':');
-    if(index != _serverIPAddress.npos){ // found
-        std::string address = _serverIPAddress.substr(0, index).c_str();
-        int port = std::stoi(_serverIPAddress.substr(index+1, _serverIPAddress.length()-index-1 ));
+    auto index = serverAddressPort.find_last_of(':');
+    if(index != serverAddressPort.npos){ // found
+        std::string address = serverAddressPort.substr(0, index).c_str();
+        int port = std::stoi(serverAddressPort.substr(index+1, serverAddressPort.length()-index-1 ));
         
         struct hostent *server;
         server = gethostbyname(address.c_str());
@@ -198,18 +397,7 @@ bool CMoCapTCPClient<DataType_Send, DataType_Recv>::Connect(void (*send_msg_call
         return false;
     }
     
-    // set the client socket as non-blocking mode
-    set_nonblocking(_sockfd_client);
-    
-    _bInWork = true;
-    
-    // 3. Create a new session for receving message from the server
-    _threadRecvMsg = std::thread(&CMoCapTCPClient::DoReceiveMessage, this);
-    
-    // 4. Create a new session for sending messages if available to the server
-    _threadSendMsg = std::thread(&CMoCapTCPClient::DoSendMessage, this);
-
-    return true;  
+    return true;
 }
 
 template <class DataType_Send, class DataType_Recv>
@@ -219,11 +407,15 @@ void CMoCapTCPClient<DataType_Send, DataType_Recv>::Disconnect()
     
     _bInWork = false;
     
+    // Release the threads that are waiting for data to be sent
+    _dataReposForClient.WakeUpWaiters();
+    
     // Stop all threads
     if(_threadSendMsg.joinable())
         _threadSendMsg.join();
     if(_threadRecvMsg.joinable())
         _threadRecvMsg.join();
+    _decodePipeline.Stop();
     
     // Close the connection socket
     if(_sockfd_client >= 0){
@@ -233,7 +425,7 @@ void CMoCapTCPClient<DataType_Send, DataType_Recv>::Disconnect()
         strcpy(data.data_name, "quit");
         data.nDataSize = 0;
                    
-        send(_sockfd_client, (char*)&data, sizeof(data),0);
+        send(_sockfd_client, (char*)&data, sizeof(data), MSG_NOSIGNAL);
         
         shutdown(_sockfd_client, 2);
         closesocket(_sockfd_client);
@@ -241,34 +433,176 @@ void CMoCapTCPClient<DataType_Send, DataType_Recv>::Disconnect()
         _sockfd_client = -1;
     }
     
+    _shmReader.Close();
+    _multicastReceiver.Close();
+    
     std::cout << "Success on stopping client\n";
 }
 
+template <class DataType_Send, class DataType_Recv>
+bool CMoCapTCPClient<DataType_Send, DataType_Recv>::Subscribe(const Stream_Subscription &subscription)
+{
+    std::unique_lock<std::mutex> lock(_mutexSend);
+    
+    _subscription = subscription;
+    _subscription.Normalize();
+    
+    // otherwise it is sent on connecting
+    if(!_bInWork || _sockfd_client < 0) return true;
+    
+    return SendSubscription();
+}
+
+template <class DataType_Send, class DataType_Recv>
+bool CMoCapTCPClient<DataType_Send, DataType_Recv>::SendSubscription()
+{
+    Wire_Frame frame;
+    frame.entity.resize(_subscription.WireSize());
+    _subscription.Encode(frame.entity.data());
+    
+    Data_Header header;
+    strcpy(header.data_name, "sub");
+    header.timestamp = 0;
+    header.nDataSize = (unsigned)frame.entity.size();
+    frame.Seal(header, _maxDataSize);
+    
+    return WriteMessage(frame);
+}
+
+template <class DataType_Send, class DataType_Recv>
+bool CMoCapTCPClient<DataType_Send, DataType_Recv>::SendPing()
+{
+    Wire_Frame frame;
+    frame.entity.resize(Clock_Ping::WIRE_SIZE);
+    
+    Clock_Ping ping;
+    ping.estimate = _clockEstimator.GetEstimate();
+    ping.tSend = latency_now_ns();
+    ping.Encode(frame.entity.data());
+    
+    Data_Header header;
+    strcpy(header.data_name, "ping");
+    header.timestamp = 0;
+    header.nDataSize = Clock_Ping::WIRE_SIZE;
+    header.sendTime = ping.tSend;
+    frame.Seal(header, _maxDataSize);
+    
+    return WriteMessage(frame);
+}
+
+template <class DataType_Send, class DataType_Recv>
+bool CMoCapTCPClient<DataType_Send, DataType_Recv>::SendBeat()
+{
+    Wire_Frame frame;
+    
+    Data_Header header;
+    strcpy(header.data_name, "beat");
+    header.timestamp = 0;
+    header.nDataSize = 0;
+    header.sendTime = latency_now_ns();
+    frame.Seal(header, _maxDataSize);
+    
+    return WriteMessage(frame);
+}
+
+template <class DataType_Send, class DataType_Recv>
+bool CMoCapTCPClient<DataType_Send, DataType_Recv>::WriteMessage(const Wire_Frame &frame)
+{
+    if(_sockfd_client < 0) return false; // dropped
+    
+    const unsigned nMaxSegment = 64;
+    Wire_Segment segments[nMaxSegment];
+    
+    // send the headers and the entity to the server with gather writes
+    size_t nOffset = 0;
+    while(nOffset < frame.nWireSize){
+        unsigned nSegment = frame.GetSegments(nOffset, segments, nMaxSegment);
+        
+        auto n = socket_send_gather(_sockfd_client, segments, nSegment);
+        if(n > 0){
+            nOffset += n;
+        }
+        else if(n < 0 && socket_would_block()){
+            socket_wait(_sockfd_client, true, 100);
+        }
+        else{
+            std::cout << "ERROR on writing to socket\n";
+            return false;
+        }
+    }
+    
+    _tLastSend = latency_now_ns();
+    return true;
+}
+
 template <class DataType_Send, class DataType_Recv>
 void CMoCapTCPClient<DataType_Send, DataType_Recv>::DoSendMessage()
 {
-    static void *pDataBuffer = malloc(sizeof(Data_Header)+_maxDataSize); // reference to a memory for putting data's header and its entity together
+    Wire_Frame frame; // memory for the callback to put the data entity, growable for a large one
+    frame.entity.resize(_maxDataSize);
+    
+    if(_pSend_msg_callback == 0 && _clockSyncPeriod.count() == 0 && _heartbeatInterval.count() == 0) return; // nothing to be sent
+    
+    const uint64_t heartbeatInterval = std::chrono::duration_cast<std::chrono::nanoseconds>(_heartbeatInterval).count();
+    
+    const unsigned nQuickPing = 8; // as many as the estimator filters, before the period
+    const std::chrono::milliseconds quickPeriod = std::min(_clockSyncPeriod, std::chrono::milliseconds(100));
+    unsigned nPing = 0;
+    auto tNextPing = std::chrono::steady_clock::now();
     
     // Try to get a message from the callback of sending message
     while(_bInWork && _sockfd_client >= 0){
-        if(_pSend_msg_callback != 0){
+        std::chrono::milliseconds wait(100);
+        
+        // ping the server for its clock when it is time
+        if(_clockSyncPeriod.count() > 0){
+            auto now = std::chrono::steady_clock::now();
+            if(now >= tNextPing){
+                std::unique_lock<std::mutex> lock(_mutexSend);
+                SendPing();
+                
+                tNextPing = now + (++ nPing < nQuickPing ? quickPeriod : _clockSyncPeriod);
+            }
+            wait = std::min(wait, std::chrono::duration_cast<std::chrono::milliseconds>(tNextPing - now) + std::chrono::milliseconds(1));
+        }
+        
+        // beat when nothing has been sent for the interval
+        if(heartbeatInterval > 0){
+            std::unique_lock<std::mutex> lock(_mutexSend);
+            uint64_t now = latency_now_ns();
+            if(now - _tLastSend >= heartbeatInterval){
+                SendBeat();
+                now = _tLastSend;
+            }
+            wait = std::min(wait, std::chrono::milliseconds((_tLastSend + heartbeatInterval - now) / 1000000 + 1));
+        }
+        
+        if(_pSend_msg_callback == 0){ // only the pings
+            std::this_thread::sleep_for(wait);
+            continue;
+        }
+        
+        // sleep until a data is pushed into the repos or the client is disconnecting
+        if(_dataReposForClient.WaitData_SendQueue(wait)){
             Data_Buffer pickData;
             pickData.dataHeader.nMaxDataSize = _maxDataSize;
-            pickData.pData = (char*)pDataBuffer+sizeof(Data_Header);
+            pickData.pData = frame.entity.data();
+            pickData.pStorage = &frame.entity;
             
+            uint64_t tCallback = _tracer.Stamp();
             _pSend_msg_callback(&pickData, _dataReposForClient); // pick out a message for the server from somewhere
             
             // If a message available, then send it to the server
             if(pickData.dataHeader.nDataSize != 0){ // it has some message                
-                // 1. put the header and entity of the message into a continuous memory
-                unsigned nHeaderSize = sizeof (pickData.dataHeader), nTotSize = nHeaderSize + pickData.dataHeader.nDataSize;
+                pickData.dataHeader.sendTime = latency_now_ns(); // for the one-way latency on the server
+                _tracer.Record(Latency_Stage::Serialize, tCallback, pickData.dataHeader.sendTime);
                 
-                memcpy(pDataBuffer, &(pickData.dataHeader), nHeaderSize);
+                // 1. build the headers of the message, in chunks if it is large
+                frame.Seal(pickData.dataHeader, _maxDataSize);
                 
-                // 2. send the message to the server
-                int n = send(_sockfd_client, (char*)pDataBuffer, nTotSize,0);
-                if (n < 0) 
-                    std::cout << "ERROR on writing to socket\n";
+                // 2. send them with the entity, not in the middle of a subscription
+                std::unique_lock<std::mutex> lock(_mutexSend);
+                WriteMessage(frame);
             }
         }
     }
@@ -281,57 +615,127 @@ void CMoCapTCPClient<DataType_Send, DataType_Recv>::DoReceiveMessage()
 {
     // Try to receive a message from the client connection
     // Default to receive the skeleton data
-    unsigned nHeadSize = sizeof(Data_Header);
-    static void *pDataBuffer = malloc(nHeadSize+_maxDataSize);
+    // The bytes are assembled into messages however the stream splits them
+    Frame_Assembler assembler(_maxDataSize);
+    const size_t nMaxRead = 16384;
+    
+    // The frames of the shared-memory ring or the multicast group are assembled on their own: the chunks there are as
+    // large as the server's, or a frame is whole
+    bool bSharedMemory = _shmReader.IsOpen(), bMulticast = _multicastReceiver.IsOpen();
+    Frame_Assembler sideAssembler(bSharedMemory ? _shmReader.GetMaxChunkSize() : _multicastReceiver.GetMaxFrameSize());
+    
+    const uint64_t idleTimeout = std::chrono::duration_cast<std::chrono::nanoseconds>(_idleTimeout).count();
+    uint64_t tLastRecv = latency_now_ns(); // when something came from the server last
             
     while(_bInWork  && _sockfd_client >= 0){
+        bool bQuit = false, bReadable = true;
         
-        // First, read out the header
-        int n = recv(_sockfd_client, (char*)pDataBuffer, nHeadSize,0);
+        if(bSharedMemory || bMulticast){
+            // Sleep until some frames are written into the ring or arrive at the group, and take all of them
+            int nRead = bSharedMemory ? _shmReader.Read(sideAssembler, 100) : _multicastReceiver.Read(sideAssembler, 100);
+            if(nRead < 0){ // the server has closed the ring, or the socket is broken
+                bQuit = true;
+            }
+            else if(nRead > 0){
+                tLastRecv = latency_now_ns();
+                bQuit = !DispatchMessages(sideAssembler, true);
+            }
+        }
+        else{
+            // Sleep until some bytes arrive
+            bReadable = socket_wait(_sockfd_client, false, 100) > 0;
+        }
         
-        if(n == (int)nHeadSize){ // It's a data
-            Data_Header *pHeader = static_cast<Data_Header*>(pDataBuffer);
+        // Read what is there. With the ring or the group, the connection only brings the quit of the server.
+        if(!bQuit && bReadable){
+            auto n = recv(_sockfd_client, assembler.PrepareWrite(nMaxRead), nMaxRead, 0);
             
-            if(strcmp(pHeader->data_name, "quit") == 0){
-                // quit the connection
-                
-                shutdown(_sockfd_client, 2);
+            if(n > 0){
+                assembler.CommitWrite(n);
+                tLastRecv = latency_now_ns();
+            }
+            else if(n == 0 || !socket_would_block()) // closed by the server or broken
+                bQuit = true;
+            
+            if(!bQuit)
+                bQuit = !DispatchMessages(assembler, !bSharedMemory && !bMulticast);
+        }
+        
+        // A server silent for the idle timeout is taken as gone
+        if(!bQuit && idleTimeout > 0 && latency_now_ns() - tLastRecv > idleTimeout){
+            std::cout << "The server has been silent for too long\n";
+            bQuit = true;
+        }
+        
+        if(bQuit){
+            // quit the connection: a write in progress fails at once, and the socket is not closed under it
+            shutdown(_sockfd_client, 2);
+            {
+                std::unique_lock<std::mutex> lock(_mutexSend);
                 closesocket(_sockfd_client);
-                
                 _sockfd_client = -1;
-                
-                //std::cout << "Client: receive server quit command\n";
-            }
-            else{
-                assert(strcmp(pHeader->data_name, "mocap") == 0);
-                
-                if(pHeader->nDataSize > 0){
-                    // Second, read out the data entity
-                    int n = recv(_sockfd_client, (char *)pDataBuffer+nHeadSize, pHeader->nDataSize,0);
-    
-                    if(n == (int)pHeader->nDataSize){
-                        Data_Buffer data;
-                        
-                        data.dataHeader = *pHeader;
-                        data.pData = (char *)pDataBuffer + nHeadSize;
-    
-                        float f;
-                        memcpy(&f,data.pData,sizeof(float));
-                        
-                        if(_pRecv_msg_callback != 0){
-                            _pRecv_msg_callback(&data, _dataReposForClient);
-                        } 
-                        
-                        //std::cout << "recv: " << n << std::endl;
-                    } 
-                }
             }
+            
+            // the consumers waiting for the frames see the end at once, after the frames being decoded
+            _decodePipeline.Flush();
+            _dataReposForClient.WakeUpWaiters();
         }
     }
    
     return;
 }
 
+template <class DataType_Send, class DataType_Recv>
+bool CMoCapTCPClient<DataType_Send, DataType_Recv>::DispatchMessages(Frame_Assembler &assembler, bool bFrame)
+{
+    Data_Buffer data;
+    int ret;
+    while((ret = assembler.Next(data)) != 0){
+        if(ret < 0){
+            std::cout << "Error on the message from the server\n";
+            return false;
+        }
+        else if(strncmp(data.dataHeader.data_name, "quit", sizeof(data.dataHeader.data_name)) == 0){
+            //std::cout << "Client: receive server quit command\n";
+            return false;
+        }
+        else if(strncmp(data.dataHeader.data_name, "reject", sizeof(data.dataHeader.data_name)) == 0){
+            std::string reason((const char*)data.pData, data.dataHeader.nDataSize);
+            std::cout << "Refused by the server: " << reason << "\n";
+            
+            std::unique_lock<std::mutex> lock(_mutexReason);
+            _rejectReason = reason;
+            return false;
+        }
+        else if(strncmp(data.dataHeader.data_name, "pong", sizeof(data.dataHeader.data_name)) == 0){
+            uint64_t tReceive = latency_now_ns();
+            
+            Clock_Pong pong;
+            if(pong.Decode((const char*)data.pData, data.dataHeader.nDataSize)
+               && _clockEstimator.AddSample(pong.tPing, pong.tReceive, pong.tSend, tReceive))
+                _serverClock = _clockEstimator.GetEstimate();
+        }
+        else if(bFrame && (strncmp(data.dataHeader.data_name, "mocap", sizeof(data.dataHeader.data_name)) == 0
+                           || strncmp(data.dataHeader.data_name, "mocap_p", sizeof(data.dataHeader.data_name)) == 0)){ // whole or projected
+            if(data.dataHeader.nDataSize > 0 && _pRecv_msg_callback != 0){
+                uint64_t tDecode = _tracer.Stamp(), tSend = data.dataHeader.sendTime;
+                if(tDecode != 0 && tSend != 0) tSend = _serverClock.ToLocal(tSend); // on the clock of the client
+                _tracer.Record(Latency_Stage::Transport, tSend, tDecode);
+                
+                if(_decodePipeline.IsRunning()){ // copied for a worker, which traces the decoding
+                    _decodePipeline.Submit(data);
+                }
+                else{
+                    _pRecv_msg_callback(&data, _dataReposForClient);
+                    _tracer.Record(Latency_Stage::Decode, tDecode, _tracer.Stamp());
+                }
+            } 
+        }
+    }
+    
+    return true;
+}
+
 } // namespace: mocap_netop
 
 
@@ -8,9 +8,20 @@
 // .NAME CMoCapTCPSever
 
 // .SECTION Description
-// It is a class that implements a server with TCP stream. In this implementation, we assume that a mocap data
-// can be sent via a packet. The server will send a data if available to all of its connecting clients but does 
+// It is a class that implements a server with TCP stream. A mocap data larger than the buffer size is sent in
+// chunks and reassembled by the receiver. The server will send a data if available to all of its connecting clients but does 
 // not receive message from the clients except the "quit" msg.
+// The connections are kept in a Connection_Table and known by generation-tagged handles. A client that connects when
+// the server is at its capacity gets a "reject" message telling why, and is closed; the capacity may be changed at any time.
+// In the thread-per-client mode, the sending and receiving threads read the connections from a snapshot which is only
+// rebuilt when a client comes or goes, so a frame is sent to all the clients while they are being read from, with no lock.
+// A client may subscribe to a part of the stream (see Stream_Subscription); with a projection callback, each frame is then
+// projected once for each distinct subscription and the clients which have it get the projected frame instead.
+// The server answers the "ping" of a client with a "pong" holding its clock (see Clock_Offset_Estimator), and keeps the
+// clock of the client as the client has estimated it, for the one-way latency of the messages from there.
+// A client is taken as gone when its socket is closed or broken, which the receiving thread or the event loop sees,
+// or when nothing has come from it for the idle timeout (see SetHeartbeat); an idle client is sent a "beat" now and
+// then, so it knows the server is still there.
 // Note that a server can only send and receive a certain type of data which is specified through the template param.
 
 // .SECTION See also
@@ -20,25 +31,50 @@
 #define _TCPSERVER_H_
 
 #include <iostream>
-#include <winsock2.h>
 #include <string>
 #include <vector>
 #include <thread>
 #include <mutex>
 #include <memory>
-#include <map>
 #include <atomic>
-#include <windows.h>
-#include <winsock.h>
-#include <ws2tcpip.h>
 #include <assert.h>
 
+#include "NetPlatform.h"
 #include "NetOp.h"
-
-#pragma comment(lib,"ws2_32.lib")
+#include "StreamRecorder.h"
+#include "ShmChannel.h"
+#include "MulticastChannel.h"
+#include "LatencyTrace.h"
+#include "ConnectionTable.h"
+#include "Subscription.h"
+#include "ClockSync.h"
+
+#ifdef __linux__
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#endif
 
 namespace mocap_netop {
 
+// How the server drives its client connections
+enum class ServerIOMode {
+    ThreadPerClient, // a receiving thread for each slot of the connection table, created as the clients come (default)
+    Reactor          // a single event loop (edge-triggered epoll) handles all the connections, Linux only
+};
+
+// Statistics on the outbound queue of a client connection
+struct Client_SendStats {
+    Connection_Handle connection; // handle of the client connection
+    unsigned nQueuedMessage; // messages waiting to be written
+    uint64_t nDroppedMessage; // messages dropped by the overflow policy
+};
+
+// The clock of a client relative to the server, as estimated by the client (see CMoCapTCPClient::EnableClockSync)
+struct Client_Clock {
+    Connection_Handle connection; // handle of the client connection
+    Clock_Estimate clock; // not valid if the client does not ping the server
+};
+
 template<class DataType_Send, class DataType_Recv>
 class CMoCapTCPServer {
 public:
@@ -58,6 +94,80 @@ public:
 	// Description:
 	// Stop the server
 	void Stop();
+
+	// Description:
+	// Select how the server drives its connections. It should be called before Start().
+	// Return false if the server is working or the mode is not supported on the platform.
+	bool SetIOMode(ServerIOMode mode);
+	ServerIOMode GetIOMode() const { return _ioMode; }
+
+	// Description:
+	// Each client has its own queue of messages to be written. When a client cannot keep up and its queue
+	// already holds maxQueuedMessage messages, the policy decides what happens. It should be called before Start().
+	bool SetOverflowPolicy(Overflow_Policy policy, unsigned maxQueuedMessage = 8);
+
+	// Description:
+	// Send a "beat" to a client when nothing has been sent to it for the interval, and close a client when nothing has
+	// come from it for the idle timeout, e.g., its host is down or the network to it is cut, which the socket does not
+	// tell for long. The clients should beat at a shorter interval than the timeout (see CMoCapTCPClient::SetHeartbeat).
+	// Either is off if 0, which is the default. It should be called before Start().
+	bool SetHeartbeat(std::chrono::milliseconds interval, std::chrono::milliseconds idleTimeout);
+
+	// Description:
+	// Let the clients subscribe to a part of the stream: the callback projects the entity of a frame for a subscription,
+	// once for all the clients which have it, and leaves the size of the projected data 0 if it cannot. It should be
+	// called before Start(). Without it, the subscriptions are ignored and all the clients get the whole frames.
+	bool SetProjectionCallback(void (*project_msg_callback)(const Data_Buffer&, const Stream_Subscription&, Data_Buffer*));
+
+	// Description:
+	// Statistics on the outbound queue of each connected client
+	std::vector<Client_SendStats> GetClientSendStats();
+
+	// Description:
+	// The clock of each connected client, e.g., to turn a time stamped by a client into the clock of the server
+	std::vector<Client_Clock> GetClientClocks();
+
+	// Description:
+	// Change the maximum number of the client connections, at any time. Lowering it keeps the clients connected and
+	// refuses the new ones until there are fewer of them.
+	void SetMaxConnection(unsigned maxConnection);
+	unsigned GetMaxConnection() const { return _maxConnection; }
+
+	// Description:
+	// Number of the clients connected
+	unsigned GetConnectionCount();
+
+	// Description:
+	// Attach a recorder, which gets each frame as it is sent to the clients, or detach it with 0.
+	// The recorder only queues the frames on the send path; it should be detached before it is destroyed.
+	void SetRecorder(Stream_Recorder *pRecorder) { _pRecorder = pRecorder; }
+
+	// Description:
+	// Also write the frames into the shared-memory ring "name" (see Shm_Ring_Writer) with nSlot chunks, for the clients on
+	// the same host that connect with "shm://name". Such a client says "shm" after connecting and then gets no frames over TCP.
+	// It should be called before Start(), which fails if the ring cannot be created. An empty name disables it. Linux only.
+	// A frame goes into the ring in chunks of the max data size of the server, one for each slot, so a frame larger than
+	// nSlot times the max data size is not written; such frames are dropped for those clients and counted by
+	// GetShmDropCount(). The ring is only open to the user of the server, and its clients run as the same user.
+	bool EnableSharedMemory(const std::string &name, unsigned nSlot = 256);
+
+	// Description:
+	// Number of the frames that were too large for the shared-memory ring, since the server started
+	uint64_t GetShmDropCount() const { return _shmWriter.GetDropCount(); }
+
+	// Description:
+	// Also send the frames to the UDP multicast group "ip:port" (see Multicast_Sender) through the interface interfaceIp,
+	// for the clients that join it (see CMoCapTCPClient::EnableMulticast). Such a client says "mcast" after connecting and
+	// then gets no frames over TCP. It should be called before Start(), which fails if the socket cannot be opened.
+	// An empty group disables it.
+	bool EnableMulticast(const std::string &groupAddressPort, const std::string &interfaceIp = "", unsigned ttl = 1);
+    
+	// Description:
+	// Trace the latency of the messages through the stages on the server (see Latency_Tracer): the frames in the send
+	// queue and the send callback, the actions of the clients on the way, in the receive callback and in the receive queue.
+	// It may be turned on and off at any time. The frames are stamped for the clients to trace the rest of their way.
+	void EnableLatencyTracing(bool bEnabled = true) { _tracer.Enable(bEnabled); }
+	Latency_Tracer& GetLatencyTracer() { return _tracer; }
     
     bool IsWorking()
     {
@@ -81,41 +191,150 @@ private:
 	// core of the thread of message sending
 	void DoSendMessage();
 
-	// core of the thread of message receiving
-	void DoReceiveMessage(unsigned iClientThread);
+	// core of the thread of message receiving, for the connections in a slot of the table
+	void DoReceiveMessage(unsigned iSlot);
+
+    // Tell a client that the server is at its capacity, and close its connection
+    void RejectConnection(SOCKET fd, unsigned nCapacity);
     
     // set the socket as non-blocking
     int set_nonblocking(SOCKET fd)
     {
-        unsigned long long ul=1;
-        int ret=ioctlsocket(fd, FIONBIO, (unsigned long *)&ul);
-        if(ret == SOCKET_ERROR)
-            return -1;
-        else return 1;
+        return socket_set_nonblocking(fd);
     }
 
+    // write the queued messages to a non-blocking socket until it would block.
+    // Return false if the connection is broken.
+    bool FlushOutbound(SOCKET fd, Outbound_Queue &queue);
+
+    // The message of the frame nFrame for a subscription: projected for the first client which has it, and kept for
+    // the others. It is the whole frame for the whole stream, or if the frame cannot be projected.
+    Outbound_Queue::Message ProjectFrame(const Outbound_Queue::Message &msg, uint64_t nFrame, const Subscription_Projection &projection);
+
+    // The answer to a ping, stamped with the time it is sent now
+    Outbound_Queue::Message MakePong(Clock_Pong pong);
+
+    // A heartbeat, with no entity
+    Outbound_Queue::Message MakeBeat();
+
+    // Whether nothing has come from a client since tLastRecv for the idle timeout
+    bool IsIdle(uint64_t tLastRecv, uint64_t now) const
+    {
+        return _idleTimeout.count() > 0 && now > tLastRecv
+            && now - tLastRecv > (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(_idleTimeout).count();
+    }
+
+    // A client connection in the thread-per-client mode. It is shared by the snapshots and the table, and the socket is
+    // closed with the last of them, so its number is not reused while a thread may still be using it.
+    struct ThreadConnection{
+        ThreadConnection(SOCKET fd, unsigned maxQueuedMessage, Overflow_Policy policy)
+            : sockfd(fd), sendQueue(maxQueuedMessage, policy), bSideChannel(false), bClosed(false), nQueuedMessage(0), nDroppedMessage(0),
+              bPong(false), tLastRecv(latency_now_ns()), tLastSend(tLastRecv) {}
+        ThreadConnection(const ThreadConnection&) = delete;
+        ThreadConnection& operator=(const ThreadConnection&) = delete;
+        ~ThreadConnection() { closesocket(sockfd); }
+
+        Connection_Handle handle;
+        SOCKET sockfd;
+        Outbound_Queue sendQueue; // messages waiting to be written to the connection, only touched by the sending thread
+        std::atomic_bool bSideChannel; // the client gets the frames from the shared-memory ring or the multicast group
+        std::atomic_bool bClosed; // it is shut down and removed from the table, but may still be in an old snapshot
+        std::atomic_uint nQueuedMessage; // statistics of the queue, updated by the sending thread
+        std::atomic<uint64_t> nDroppedMessage;
+        Snapshot_Publisher<Subscription_Projection> subscription; // set by the receiving thread, the whole stream at first
+        std::shared_ptr<const Subscription_Projection> pSendSubscription; // the copy of the sending thread
+        uint64_t nSendSubscription = 0;
+        Snapshot_Publisher<Clock_Estimate> clock; // of the client, from its last ping
+        std::mutex mutexPong;
+        std::vector<Clock_Pong> pongs; // the pings answered by the receiving thread, sent by the sending thread
+        std::atomic_bool bPong; // there are pongs
+        std::atomic<uint64_t> tLastRecv; // when some bytes came from the client last, set by the receiving thread
+        uint64_t tLastSend; // when a message was queued for the client last, by the sending thread
+    };
+    typedef std::vector< std::shared_ptr<ThreadConnection> > ThreadSnapshot; // the connections by slot, 0 for a free one
+
+    // Build a snapshot of the table of the thread-per-client mode and publish it. It is called under _mutex_forCriticalOps.
+    void PublishThreadConnections();
+
+    // Shut down a connection and publish the connections without it, unless it is gone already
+    void CloseThreadConnection(Connection_Handle handle);
+
+#ifdef __linux__
+    // A client connection driven by the event loop
+    struct ReactorConnection{
+        explicit ReactorConnection(unsigned maxDataSize = 0) : assembler(maxDataSize) {}
+
+        SOCKET sockfd = INVALID_SOCKET;
+        Frame_Assembler assembler; // bytes received but not yet assembled into a message
+        Outbound_Queue sendQueue; // messages waiting for the socket to be writable
+        bool bSideChannel = false; // the client gets the frames from the shared-memory ring or the multicast group
+        std::shared_ptr<const Subscription_Projection> pSubscription; // the part of the stream it wants
+        Clock_Estimate clock; // of the client, from its last ping
+        uint64_t tLastRecv = 0, tLastSend = 0; // when some bytes came from the client, and a message was queued for it, last
+    };
+
+    // Create the epoll instance and the thread of the event loop
+    bool InitializeReactor();
+
+    // core of the event loop thread: accepting, receiving and sending for all the connections
+    void DoEventLoop();
+
+    // handlers of the event loop. A handler returns false if the connection should be closed
+    void ReactorAccept();
+    bool ReactorRead(ReactorConnection &conn);
+    bool ReactorFlush(ReactorConnection &conn);
+    void ReactorBroadcast(const Outbound_Queue::Message &msg);
+    void ReactorHeartbeat(uint64_t now); // beat the idle clients and close the silent ones
+    void ReactorClose(Connection_Handle handle, bool bNotifyQuit);
+#endif
+
 private:
 	std::thread _threadListen; // thread for listening to the connection query
 	std::thread _threadSendMsg; // thread for sending messages to all clients
-	std::vector< std::shared_ptr<std::thread> > _threadClients; // thread pool for client connections: receiving messages from each client
+	std::vector< std::shared_ptr<std::thread> > _threadClients; // thread pool for client connections: receiving messages from the client in each slot
 
     SOCKET _sockfd_server=-1; // handle to the server's socket
-    std::map<unsigned, int> _threadConnections; // the connection sockid associated to each thread; -1 if no connection assocition in the thread 
-    std::atomic_uint _nCurConnection; // number of current client connections
+    Connection_Table< std::shared_ptr<ThreadConnection> > _threadConnections; // connections of the thread-per-client mode, under _mutex_forCriticalOps
+    Snapshot_Publisher<ThreadSnapshot> _threadSnapshot; // the connections as read by the sending and receiving threads
     
     std::mutex _mutex_forCriticalOps; // for the thread-safe ops 
     
     std::atomic_bool _bInWork; 
+
+    ServerIOMode _ioMode = ServerIOMode::ThreadPerClient;
+
+#ifdef __linux__
+    std::thread _threadEventLoop; // thread of the event loop in the reactor mode
+    int _epollfd = -1; // epoll instance watching the server socket and all the client sockets
+    int _wakeupfd = -1; // eventfd to wake up the event loop, e.g., when stopping the server
+    Connection_Table<ReactorConnection> _reactorConnections; // connections of the event loop, only changed by its thread under _mutex_forCriticalOps
+    std::shared_ptr<Wire_Frame> _reactorFrame; // frame for the send callback to put the data entity
+    uint64_t _nReactorFrame = 0; // number of the frames broadcast by the event loop
+#endif
     
 private:
 	std::string _ipAddress; // address of the server: ip and port
 	void (*_pRecv_msg_callback)(Data_Buffer*, Data_Repos<DataType_Send, DataType_Recv>& )=0;  // callback for receiving a message
 	void (*_pSend_msg_callback)(Data_Buffer*, Data_Repos<DataType_Send, DataType_Recv>&) = 0;  // callback for sending a message. Note that it is sent to all clients 
-	unsigned _maxConnection = 1; // maximum number of the client connections allowed by the server
+	void (*_pProject_msg_callback)(const Data_Buffer&, const Stream_Subscription&, Data_Buffer*) = 0; // callback for projecting a frame for a subscription
+	std::atomic_uint _maxConnection; // maximum number of the client connections allowed by the server
     unsigned _maxDataSize;
+    Overflow_Policy _overflowPolicy = Overflow_Policy::DropOldest; // what to do when a client cannot keep up
+    unsigned _maxQueuedMessage = 8; // maximum of messages queued for a client
+    std::chrono::milliseconds _heartbeatInterval{0}, _idleTimeout{0}; // of the heartbeats and the clients, none if 0
     SOCKET testser = INVALID_SOCKET;
     
     Data_Repos<DataType_Send, DataType_Recv> _dataReposForServer; // repos for the data have been received or to be sent by the server
+    Data_Pool<Wire_Frame> _framePool; // frames go back here once all the clients have written them
+    std::atomic<Stream_Recorder*> _pRecorder; // recorder of the frames sent, if any
+    std::string _shmName; // name of the shared-memory ring; empty if it is not used
+    unsigned _nShmSlot = 256;
+    Shm_Ring_Writer _shmWriter; // writes the frames for the clients on the same host
+    std::string _multicastGroup, _multicastInterface; // group of the multicast and the interface to it; empty if it is not used
+    unsigned _multicastTTL = 1;
+    Multicast_Sender _multicastSender; // sends the frames once for all the clients in the group
+    Latency_Tracer _tracer; // histograms of the latency of the stages, if it is enabled
+    Subscription_Registry _subscriptions; // the distinct subscriptions of the clients, with their projected frames
 };
 
 //////////////////////// Implementation of the template class ///////////////////////////////////////
@@ -123,9 +342,12 @@ private:
 ///
 template<class DataType_Send, class DataType_Recv>
 CMoCapTCPServer<DataType_Send, DataType_Recv>::CMoCapTCPServer(const std::string& ipAddress, unsigned maxDataSize, unsigned maxConnection /*= 5*/)
-    : _ipAddress(ipAddress), _maxConnection(maxConnection), _maxDataSize(maxDataSize)
+    : _ipAddress(ipAddress), _maxDataSize(maxDataSize)
 {
+    _maxConnection = maxConnection;
     _bInWork = false;
+    _pRecorder = 0;
+    _dataReposForServer.SetTracer(&_tracer);
 }
 
 template<class DataType_Send, class DataType_Recv>
@@ -141,6 +363,277 @@ bool CMoCapTCPServer<DataType_Send, DataType_Recv>::Start(void (*send_msg_callba
     return InitializeServer();
 }
 
+template<class DataType_Send, class DataType_Recv>
+bool CMoCapTCPServer<DataType_Send, DataType_Recv>::SetIOMode(ServerIOMode mode)
+{
+    if(_bInWork)
+        return false;
+
+#ifndef __linux__
+    if(mode == ServerIOMode::Reactor){
+        std::cout << "The reactor mode is only available on Linux" << std::endl;
+        return false;
+    }
+#endif
+
+    _ioMode = mode;
+    return true;
+}
+
+template<class DataType_Send, class DataType_Recv>
+bool CMoCapTCPServer<DataType_Send, DataType_Recv>::SetOverflowPolicy(Overflow_Policy policy, unsigned maxQueuedMessage /*= 8*/)
+{
+    if(_bInWork)
+        return false;
+
+    _overflowPolicy = policy;
+    _maxQueuedMessage = maxQueuedMessage;
+    return true;
+}
+
+template<class DataType_Send, class DataType_Recv>
+bool CMoCapTCPServer<DataType_Send, DataType_Recv>::SetHeartbeat(std::chrono::milliseconds interval, std::chrono::milliseconds idleTimeout)
+{
+    if(_bInWork)
+        return false;
+
+    _heartbeatInterval = interval;
+    _idleTimeout = idleTimeout;
+    return true;
+}
+
+template<class DataType_Send, class DataType_Recv>
+bool CMoCapTCPServer<DataType_Send, DataType_Recv>::SetProjectionCallback(void (*project_msg_callback)(const Data_Buffer&, const Stream_Subscription&, Data_Buffer*))
+{
+    if(_bInWork)
+        return false;
+
+    _pProject_msg_callback = project_msg_callback;
+    return true;
+}
+
+template<class DataType_Send, class DataType_Recv>
+bool CMoCapTCPServer<DataType_Send, DataType_Recv>::EnableSharedMemory(const std::string &name, unsigned nSlot /*= 256*/)
+{
+    if(_bInWork)
+        return false;
+
+#ifndef __linux__
+    if(!name.empty()){
+        std::cout << "The shared-memory channel is only available on Linux" << std::endl;
+        return false;
+    }
+#endif
+
+    _shmName = name;
+    _nShmSlot = nSlot;
+    return true;
+}
+
+template<class DataType_Send, class DataType_Recv>
+bool CMoCapTCPServer<DataType_Send, DataType_Recv>::EnableMulticast(const std::string &groupAddressPort, const std::string &interfaceIp /*= ""*/, unsigned ttl /*= 1*/)
+{
+    if(_bInWork)
+        return false;
+
+    _multicastGroup = groupAddressPort;
+    _multicastInterface = interfaceIp;
+    _multicastTTL = ttl;
+    return true;
+}
+
+template<class DataType_Send, class DataType_Recv>
+std::vector<Client_SendStats> CMoCapTCPServer<DataType_Send, DataType_Recv>::GetClientSendStats()
+{
+    std::vector<Client_SendStats> stats;
+
+    std::shared_ptr<const ThreadSnapshot> pSnapshot = _threadSnapshot.Get();
+    for(const auto &pConn : *pSnapshot){
+        if(pConn && !pConn->bClosed)
+            stats.push_back(Client_SendStats{pConn->handle, pConn->nQueuedMessage, pConn->nDroppedMessage});
+    }
+
+#ifdef __linux__
+    std::unique_lock<std::mutex> lock(_mutex_forCriticalOps);
+
+    _reactorConnections.ForEach([&stats](Connection_Handle handle, ReactorConnection &conn){
+        stats.push_back(Client_SendStats{handle, conn.sendQueue.Size(), conn.sendQueue.GetDropCount()});
+    });
+#endif
+
+    return stats;
+}
+
+template<class DataType_Send, class DataType_Recv>
+std::vector<Client_Clock> CMoCapTCPServer<DataType_Send, DataType_Recv>::GetClientClocks()
+{
+    std::vector<Client_Clock> clocks;
+
+    std::shared_ptr<const ThreadSnapshot> pSnapshot = _threadSnapshot.Get();
+    for(const auto &pConn : *pSnapshot){
+        if(pConn && !pConn->bClosed)
+            clocks.push_back(Client_Clock{pConn->handle, *pConn->clock.Get()});
+    }
+
+#ifdef __linux__
+    std::unique_lock<std::mutex> lock(_mutex_forCriticalOps);
+
+    _reactorConnections.ForEach([&clocks](Connection_Handle handle, ReactorConnection &conn){
+        clocks.push_back(Client_Clock{handle, conn.clock});
+    });
+#endif
+
+    return clocks;
+}
+
+template<class DataType_Send, class DataType_Recv>
+void CMoCapTCPServer<DataType_Send, DataType_Recv>::SetMaxConnection(unsigned maxConnection)
+{
+    std::unique_lock<std::mutex> lock(_mutex_forCriticalOps);
+
+    _maxConnection = maxConnection;
+    _threadConnections.SetCapacity(maxConnection);
+#ifdef __linux__
+    _reactorConnections.SetCapacity(maxConnection);
+#endif
+}
+
+template<class DataType_Send, class DataType_Recv>
+unsigned CMoCapTCPServer<DataType_Send, DataType_Recv>::GetConnectionCount()
+{
+    std::unique_lock<std::mutex> lock(_mutex_forCriticalOps);
+
+    unsigned nConnection = _threadConnections.Size();
+#ifdef __linux__
+    nConnection += _reactorConnections.Size();
+#endif
+    return nConnection;
+}
+
+template<class DataType_Send, class DataType_Recv>
+bool CMoCapTCPServer<DataType_Send, DataType_Recv>::FlushOutbound(SOCKET fd, Outbound_Queue &queue)
+{
+    const unsigned nMaxSegment = 64;
+    Wire_Segment segments[nMaxSegment];
+
+    while(!queue.Empty()){
+        // the headers and entities of the queued messages are written straight from the shared frames
+        unsigned nSegment = queue.GetSegments(segments, nMaxSegment);
+
+        auto n = socket_send_gather(fd, segments, nSegment);
+        if(n > 0){
+            queue.Advance(n); // a partial write is resumed from here next time
+        }
+        else if(n < 0 && socket_would_block()){
+            return true;
+        }
+        else{
+            return false;
+        }
+    }
+
+    return true;
+}
+
+template<class DataType_Send, class DataType_Recv>
+Outbound_Queue::Message CMoCapTCPServer<DataType_Send, DataType_Recv>::ProjectFrame(const Outbound_Queue::Message &msg, uint64_t nFrame, const Subscription_Projection &projection)
+{
+    if(projection.subscription.IsFull() || _pProject_msg_callback == 0)
+        return msg;
+    if(projection.nFrame == nFrame) // done for another client
+        return projection.message ? projection.message : msg;
+
+    projection.nFrame = nFrame;
+    projection.message.reset();
+
+    // the whole entity of the frame, however it is chunked
+    Data_Buffer frameData;
+    frameData.dataHeader = msg->headers.front();
+    if(frameData.dataHeader.nTotalSize > 0) frameData.dataHeader.nDataSize = frameData.dataHeader.nTotalSize;
+    frameData.dataHeader.nTotalSize = frameData.dataHeader.nOffset = 0;
+    frameData.pData = (void*)msg->entity.data();
+
+    // the projected entity goes into a frame of the pool, like the whole one
+    std::shared_ptr<Wire_Frame> pFrame = _framePool.Acquire();
+    if(pFrame->entity.size() < _maxDataSize) pFrame->entity.resize(_maxDataSize);
+
+    Data_Buffer projected;
+    projected.dataHeader = frameData.dataHeader;
+    projected.dataHeader.nDataSize = 0;
+    projected.dataHeader.nMaxDataSize = (unsigned)pFrame->entity.size();
+    projected.pData = pFrame->entity.data();
+    projected.pStorage = &pFrame->entity;
+
+    _pProject_msg_callback(frameData, projection.subscription, &projected);
+    if(projected.dataHeader.nDataSize == 0)
+        return msg;
+
+    pFrame->Seal(projected.dataHeader, _maxDataSize);
+    projection.message = pFrame;
+    return projection.message;
+}
+
+template<class DataType_Send, class DataType_Recv>
+Outbound_Queue::Message CMoCapTCPServer<DataType_Send, DataType_Recv>::MakePong(Clock_Pong pong)
+{
+    std::shared_ptr<Wire_Frame> pFrame = _framePool.Acquire();
+    if(pFrame->entity.size() < Clock_Pong::WIRE_SIZE) pFrame->entity.resize(Clock_Pong::WIRE_SIZE);
+
+    // stamped as late as it can be: the time it is held here is not taken for the way on the network
+    pong.tSend = latency_now_ns();
+    pong.Encode(pFrame->entity.data());
+
+    Data_Header header;
+    strcpy(header.data_name, "pong");
+    header.timestamp = 0;
+    header.nDataSize = Clock_Pong::WIRE_SIZE;
+    header.sendTime = pong.tSend;
+    pFrame->Seal(header, _maxDataSize);
+    return pFrame;
+}
+
+template<class DataType_Send, class DataType_Recv>
+Outbound_Queue::Message CMoCapTCPServer<DataType_Send, DataType_Recv>::MakeBeat()
+{
+    std::shared_ptr<Wire_Frame> pFrame = _framePool.Acquire();
+
+    Data_Header header;
+    strcpy(header.data_name, "beat");
+    header.timestamp = 0;
+    header.nDataSize = 0;
+    header.sendTime = latency_now_ns();
+    pFrame->Seal(header, _maxDataSize);
+    return pFrame;
+}
+
+template<class DataType_Send, class DataType_Recv>
+void CMoCapTCPServer<DataType_Send, DataType_Recv>::PublishThreadConnections()
+{
+    // a new vector each time: the readers may still hold the last one
+    std::shared_ptr<ThreadSnapshot> pSnapshot = std::make_shared<ThreadSnapshot>(_threadConnections.GetSlotCount());
+    _threadConnections.ForEach([&pSnapshot](Connection_Handle handle, std::shared_ptr<ThreadConnection> &pConn){
+        (*pSnapshot)[handle.iSlot] = pConn;
+    });
+
+    _threadSnapshot.Publish(pSnapshot);
+}
+
+template<class DataType_Send, class DataType_Recv>
+void CMoCapTCPServer<DataType_Send, DataType_Recv>::CloseThreadConnection(Connection_Handle handle)
+{
+    std::unique_lock<std::mutex> lock(_mutex_forCriticalOps);
+
+    std::shared_ptr<ThreadConnection> *ppConn = _threadConnections.Get(handle);
+    if(ppConn == 0) return; // closed by the other thread
+
+    // the client sees the end at once; the socket is closed when no snapshot holds the connection any more
+    (*ppConn)->bClosed = true;
+    shutdown((*ppConn)->sockfd, 2);
+
+    _threadConnections.Remove(handle);
+    PublishThreadConnections();
+}
+
 template<class DataType_Send, class DataType_Recv>
 void CMoCapTCPServer<DataType_Send, DataType_Recv>::Stop()
 {
@@ -148,6 +641,26 @@ void CMoCapTCPServer<DataType_Send, DataType_Recv>::Stop()
 
     _bInWork = false;
 
+    // Release the threads that are waiting for data to be sent
+    _dataReposForServer.WakeUpWaiters();
+
+#ifdef __linux__
+    _dataReposForServer.SetNotifier_SendQueue(nullptr);
+
+    if(_threadEventLoop.joinable()){
+        // Wake up the event loop, which notifies and closes all the connections before it quits
+        uint64_t one = 1;
+        auto ret = write(_wakeupfd, &one, sizeof(one));
+        (void)ret;
+
+        _threadEventLoop.join();
+    }
+
+    if(_epollfd >= 0) close(_epollfd);
+    if(_wakeupfd >= 0) close(_wakeupfd);
+    _epollfd = _wakeupfd = -1;
+#endif
+
 
     //std::cout << "1\n";
 
@@ -199,21 +712,25 @@ void CMoCapTCPServer<DataType_Send, DataType_Recv>::Stop()
     std::cout << "222\n";
 
     // Close all connection sockets that are generated by the listening thread
-    for(unsigned i = 0; i < _threadConnections.size(); i ++){
-        int iConnection = _threadConnections[i];
-        if(iConnection >= 0){
-            // send a null message to the client to notify it
-            Data_Header data;
+    std::unique_lock<std::mutex> lock(_mutex_forCriticalOps);
 
-            strcpy(data.data_name, "quit") ;
-            data.nDataSize = 0;
+    _threadConnections.ForEach([](Connection_Handle, std::shared_ptr<ThreadConnection> &pConn){
+        // send a null message to the client to notify it
+        Data_Header data;
 
-            send(iConnection, (char*)&data, sizeof(data),0);
+        strcpy(data.data_name, "quit") ;
+        data.nDataSize = 0;
 
-            shutdown(iConnection, 2);
-            closesocket(iConnection);
-        }
-    }
+        send(pConn->sockfd, (char*)&data, sizeof(data), MSG_NOSIGNAL);
+
+        shutdown(pConn->sockfd, 2);
+    });
+
+    // the threads are gone, so the sockets are closed with the table and the snapshot
+    _threadConnections.Clear();
+    PublishThreadConnections();
+
+    lock.unlock();
 
     //std::cout << "3\n";
 
@@ -232,7 +749,10 @@ void CMoCapTCPServer<DataType_Send, DataType_Recv>::Stop()
 
     // Clear other resources
     _threadClients.clear();
-    _threadConnections.clear();
+
+    // the readers of the ring see it closed
+    _shmWriter.Close();
+    _multicastSender.Close();
 
     std::cout << "Success on stopping server\n";
 }
@@ -240,26 +760,7 @@ void CMoCapTCPServer<DataType_Send, DataType_Recv>::Stop()
 template<class DataType_Send, class DataType_Recv>
 bool CMoCapTCPServer<DataType_Send, DataType_Recv>::InitializeServer()
 {
-    WORD w_req = MAKEWORD(2, 2);//Version number
-        WSADATA wsadata;
-        int err;
-        err = WSAStartup(w_req, &wsadata);
-        if (err != 0) {
-            std::cout << "ini socket fail s" << std::endl;
-        }
-        else {
-            //std::cout << "ini socket success s" << std::endl;
-            Sleep(1);
-        }
-        //Check the Version number
-        if (LOBYTE(wsadata.wVersion) != 2 || HIBYTE(wsadata.wHighVersion) != 2) {
-            std::cout << "fail s" << std::endl;
-            WSACleanup();
-        }
-        else {
-            //std::cout << "right s" << std::endl;
-            Sleep(1);
-        }
+    socket_startup();
 
     // 1. Create a socket as a file: tcp stream
     _sockfd_server = socket(AF_INET, SOCK_STREAM, 0);
@@ -295,31 +796,45 @@ bool CMoCapTCPServer<DataType_Send, DataType_Recv>::InitializeServer()
     int ret = bind(_sockfd_server, (struct sockaddr *) &serv_addr, sizeof(serv_addr));
     if ( ret < 0){
         std::cout << "Error on binding socket" << std::endl;
-        wprintf(L"socket function failed with error: %u\n", WSAGetLastError());
+        std::cout << "socket function failed with error: " << socket_last_error() << std::endl;
         return false;
     }
 
+    // The ring of the clients on the same host holds a chunk of the frames in a slot
+    if(!_shmName.empty() && !_shmWriter.Create(_shmName, _nShmSlot, _maxDataSize, _ipAddress)){
+        closesocket(_sockfd_server);
+        _sockfd_server = -1;
+        return false;
+    }
+    if(!_multicastGroup.empty() && !_multicastSender.Open(_multicastGroup, _multicastInterface, _multicastTTL)){
+        _shmWriter.Close();
+        closesocket(_sockfd_server);
+        _sockfd_server = -1;
+        return false;
+    }
+
+#ifdef __linux__
+    if(_ioMode == ServerIOMode::Reactor)
+        return InitializeReactor();
+#endif
+
     _bInWork = true;
 
     _threadClients.clear();
-    _threadConnections.clear();
 
-    _nCurConnection = 0;
-    for(unsigned i = 0; i < _maxConnection; i ++){
-        _threadConnections.insert( std::pair<unsigned, int>(i, -1) );
-    }
+    std::unique_lock<std::mutex> lock(_mutex_forCriticalOps);
+    _threadConnections.Clear();
+    _threadConnections.SetCapacity(_maxConnection);
+    PublishThreadConnections();
+    lock.unlock();
 
-    // 3. Create a new thread for lisenting to the port
+    // 3. Create a new thread for lisenting to the port.
+    // The threads receiving from the clients are created by it as the slots of the connection table are.
     _threadListen = std::thread(&CMoCapTCPServer::DoListening, this);
 
     // 4. Create a new thread for sending messages if available to all connected clients
     _threadSendMsg = std::thread(&CMoCapTCPServer::DoSendMessage, this);
 
-    // 5. Pre-create a thread pool for client connections
-    for(unsigned i = 0; i < _maxConnection; i ++){
-        _threadClients.push_back( std::make_shared<std::thread>( &CMoCapTCPServer::DoReceiveMessage, this, i) );
-    }
-
     return true;
 }
 
@@ -329,15 +844,13 @@ void CMoCapTCPServer<DataType_Send, DataType_Recv>::DoListening()
     // This listen() call tells the socket to listen to the incoming connections.
     // The listen() function places all incoming connection into a backlog queue
     // until accept() call accepts the connection.
-    // Here, we set the maximum size for the backlog queue to 5.
-    listen(_sockfd_server, 5);
+    // Here, the backlog is as large as the system allows, for many clients connecting at once.
+    listen(_sockfd_server, SOMAXCONN);
     
     // Try to accept the incoming connections
     while(_bInWork){
         // The accept() call actually accepts an incoming connection
        
-        if(_nCurConnection == _maxConnection) continue; // no more connections are allowed
-       
         // This accept() function will write the connecting client's address info 
         // into the the address structure and the size of that structure is clilen.
         // The accept() returns a new socket file descriptor for the accepted connection.
@@ -354,163 +867,667 @@ void CMoCapTCPServer<DataType_Send, DataType_Recv>::DoListening()
         if(sockfd_client < 0){
             std::cout << "Error on accepting the connection from " << inet_ntoa(client_addr.sin_addr) 
                       << "port " << ntohs(client_addr.sin_port) << std::endl;
+            continue;
         }
-        else{            
-            // Associates this new connection to a free thread
-            _nCurConnection ++;
-            
-            std::unique_lock<std::mutex> lock(_mutex_forCriticalOps);
-
-            for(unsigned i = 0; i < _maxConnection; i ++){
-                if(_threadConnections[i] == -1){ // it's a free thread: no client socket is associated
-                    _threadConnections[i] = sockfd_client;
-                    break;
-                }
-            }
-
+        if(!_bInWork){ // the connection made by Stop() to wake up accept()
+            closesocket(sockfd_client);
+            break;
+        }
+        
+        std::unique_lock<std::mutex> lock(_mutex_forCriticalOps);
+        
+        if(_threadConnections.IsFull()){ // no more connections are allowed
+            unsigned nCapacity = _threadConnections.GetCapacity();
             lock.unlock();
             
-            // set the client socket as non-blocking mode
-            set_nonblocking(sockfd_client);
-        } 
+            RejectConnection(sockfd_client, nCapacity);
+            continue;
+        }
+        
+        // set the client socket as non-blocking mode, and put it into a free slot
+        set_nonblocking(sockfd_client);
+        socket_set_nodelay(sockfd_client);
+        
+        std::shared_ptr<ThreadConnection> pConn = std::make_shared<ThreadConnection>(sockfd_client, _maxQueuedMessage, _overflowPolicy);
+        Connection_Handle handle = _threadConnections.Add(std::move(pConn));
+        (*_threadConnections.Get(handle))->handle = handle;
+        
+        // the threads see the new client from their next round
+        PublishThreadConnections();
+        
+        lock.unlock();
+        
+        // a new slot gets its thread, which serves the clients of the slot from now on
+        if(handle.iSlot >= _threadClients.size())
+            _threadClients.push_back( std::make_shared<std::thread>( &CMoCapTCPServer::DoReceiveMessage, this, handle.iSlot) );
     }
     
 }
 
+template<class DataType_Send, class DataType_Recv>
+void CMoCapTCPServer<DataType_Send, DataType_Recv>::RejectConnection(SOCKET fd, unsigned nCapacity)
+{
+    // a "reject" message with the reason as its entity
+    char message[sizeof(Data_Header) + 96];
+    char *reason = message + sizeof(Data_Header);
+    int nReason = snprintf(reason, 96, "the server is at its capacity of %u connections", nCapacity);
+    
+    Data_Header header;
+    strcpy(header.data_name, "reject");
+    header.nDataSize = std::min(nReason, 95);
+    memcpy(message, &header, sizeof(header));
+    
+    send(fd, message, sizeof(Data_Header) + header.nDataSize, MSG_NOSIGNAL);
+    std::cout << "Reject a client: " << reason << std::endl;
+    
+    shutdown(fd, 2);
+    closesocket(fd);
+}
+
 template<class DataType_Send, class DataType_Recv>
 void CMoCapTCPServer<DataType_Send, DataType_Recv>::DoSendMessage()
 {
-    static void *pDataBuffer = malloc(sizeof(Data_Header)+_maxDataSize); // reference to a memory for putting data's header and its entity together
+    std::shared_ptr<Wire_Frame> pFrame; // frame for the callback to put the data entity, growable for a large one
+    
+    if(_pSend_msg_callback == 0 && _heartbeatInterval.count() == 0) return; // nothing to be sent
+    
+    const uint64_t heartbeatInterval = std::chrono::duration_cast<std::chrono::nanoseconds>(_heartbeatInterval).count();
+    std::chrono::milliseconds wait(100);
+    if(heartbeatInterval > 0) wait = std::min(wait, _heartbeatInterval);
+    
+    bool bPending = false; // some clients have messages that are not fully written
+    std::vector<Connection_Handle> lost; // connections closed in a round
+    std::shared_ptr<const ThreadSnapshot> pSnapshot; // the connections, refreshed when some come or go
+    uint64_t nSnapshotVersion = 0;
+    uint64_t nFrame = 0; // number of the frames sent, which the projections are cached by
     
     // Try to get a message from the callback of sending message
     while(_bInWork){
-        if(_pSend_msg_callback != 0){
+        Outbound_Queue::Message msg;
+        
+        // sleep until a data is pushed into the repos or the server is stopping, or it is time for the heartbeats.
+        // If some clients could not take all of their messages, come back soon to resume writing to them.
+        if(_pSend_msg_callback == 0){ // only the heartbeats
+            std::this_thread::sleep_for(bPending ? std::chrono::milliseconds(1) : wait);
+        }
+        else if(_dataReposForServer.WaitData_SendQueue(bPending ? std::chrono::milliseconds(1) : wait)){
             Data_Buffer pickData;
             pickData.dataHeader.nMaxDataSize = _maxDataSize;
-//            struct timeval tp; //get system time
-//            gettimeofday(&tp,NULL);
-//            pickData.dataHeader.timestamp = tp.tv_sec*1000+tp.tv_usec/1000;
 
-            pickData.pData = (char*)pDataBuffer+sizeof(Data_Header);
+            if(!pFrame){
+                pFrame = _framePool.Acquire(); // a recycled frame keeps the memory of its entity
+                if(pFrame->entity.size() < _maxDataSize) pFrame->entity.resize(_maxDataSize);
+            }
+            pickData.pData = pFrame->entity.data();
+            pickData.pStorage = &pFrame->entity;
             
+            uint64_t tCallback = _tracer.Stamp();
             _pSend_msg_callback(&pickData, _dataReposForServer); // pick out a message for the server from somewhere
             
             // If a message available, then send it to all the client connections
             if(pickData.dataHeader.nDataSize != 0){ // server has some message
-                // 1. put the header and entity of the message into a continuous memory
-                unsigned nHeaderSize = sizeof (pickData.dataHeader), nTotSize = nHeaderSize + pickData.dataHeader.nDataSize;
+                pickData.dataHeader.sendTime = latency_now_ns(); // for the one-way latency on the clients
+                _tracer.Record(Latency_Stage::Serialize, tCallback, pickData.dataHeader.sendTime);
                 
-                memcpy(pDataBuffer, &(pickData.dataHeader), nHeaderSize);
+                // 1. the entity is encoded once into a frame shared by all the clients. 
+                // An entity larger than the buffer size is split into chunks.
+                pFrame->Seal(pickData.dataHeader, _maxDataSize);
                 //std::cout<<"nDataSize:"<<pickData.dataHeader.nDataSize<<"\n";
-
-                //memcpy((void *)((char*) pDataBuffer + nHeaderSize), pickData.pData, pickData.dataHeader.nDataSize);
                 
-                // 2. send the message to all clients
-                std::unique_lock<std::mutex> lock(_mutex_forCriticalOps);
+                Stream_Recorder *pRecorder = _pRecorder;
+                if(pRecorder) pRecorder->Record(pFrame); // only queued, written by the thread of the recorder
+                
+                if(_shmWriter.IsOpen()) _shmWriter.Publish(*pFrame);
+                if(_multicastSender.IsOpen()) _multicastSender.Send(*pFrame);
                 
-                for(unsigned i = 0; i < _threadConnections.size(); i ++){
-                    if(_threadConnections[i] != -1){ // 
-                        char checkAlive;
-                        int nbyte = recv(_threadConnections[i], &checkAlive, 1, MSG_PEEK); // test if client connect is alive
-                        if(nbyte!=0){  //connection alive
-                            auto n = send(_threadConnections[i], (char*)pDataBuffer, nTotSize,0);
-                            if (n < 0)
-                                std::cout << "ERROR on writing to socket: " << i << std::endl;
-                        }
-                        else{  // connection failed
-                            std::cout << "connection lost\n";
-                            
-                            shutdown(_threadConnections[i], 2);
-                            closesocket(_threadConnections[i]);
-                            
-                            _nCurConnection--;
-                            _threadConnections[i] = -1;
-
-                        }
-                    }
+                msg = pFrame;
+                pFrame.reset();
+                nFrame ++;
+            }
+        }
+        
+        // 2. queue the message for all clients and write to each of them as much as it can take without blocking,
+        // so a slow client only delays itself. The connections are read from the snapshot, with no lock.
+        _threadSnapshot.Refresh(pSnapshot, nSnapshotVersion);
+        
+        bPending = false;
+        lost.clear();
+        Outbound_Queue::Message beat; // one for all the idle clients of the round
+        const uint64_t now = latency_now_ns();
+        for(const auto &pConn : *pSnapshot){
+            if(!pConn || pConn->bClosed) continue;
+            
+            ThreadConnection &conn = *pConn;
+            Connection_Handle handle = conn.handle;
+            Outbound_Queue &queue = conn.sendQueue;
+            bool bAlive = true;
+            
+            if(conn.bPong){ // the answers to the pings of the client, ahead of the frame
+                std::vector<Clock_Pong> pongs;
+                {
+                    std::unique_lock<std::mutex> lock(conn.mutexPong);
+                    pongs.swap(conn.pongs);
+                    conn.bPong = false;
                 }
-
-                lock.unlock();
+                for(const Clock_Pong &pong : pongs) queue.Push(MakePong(pong));
             }
+            
+            // a closed client is seen by its receiving thread, or by the writing below; nothing is probed here
+            if(msg && !conn.bSideChannel){ // a client of the ring or the group only gets what was queued before it said so
+                conn.subscription.Refresh(conn.pSendSubscription, conn.nSendSubscription);
+                
+                if(!queue.Push(ProjectFrame(msg, nFrame, *conn.pSendSubscription))){ // the part of the frame it wants
+                    std::cout << "client " << handle.iSlot << " cannot keep up with the stream\n";
+                    bAlive = false;
+                }
+            }
+            
+            if(!queue.Empty()){
+                conn.tLastSend = now;
+            }
+            else if(heartbeatInterval > 0 && now - conn.tLastSend >= heartbeatInterval){ // nothing sent to it for a while
+                if(!beat) beat = MakeBeat();
+                queue.Push(beat);
+                conn.tLastSend = now;
+            }
+            
+            if(bAlive && !queue.Empty()){
+                bAlive = FlushOutbound(conn.sockfd, queue);
+                if(!bAlive)
+                    std::cout << "ERROR on writing to socket: " << handle.iSlot << std::endl;
+            }
+            
+            if(!bAlive){  // connection failed
+                std::cout << "connection lost\n";
+                lost.push_back(handle);
+            }
+            else if(!queue.Empty()){
+                bPending = true;
+            }
+            
+            conn.nQueuedMessage.store(queue.Size(), std::memory_order_relaxed);
+            conn.nDroppedMessage.store(queue.GetDropCount(), std::memory_order_relaxed);
         }
+        
+        // the lock is only taken to take the lost ones out, which publishes a new snapshot
+        for(Connection_Handle handle : lost)
+            CloseThreadConnection(handle);
     }
 }
 
 template<class DataType_Send, class DataType_Recv>
-void CMoCapTCPServer<DataType_Send, DataType_Recv>::DoReceiveMessage(unsigned iClientThread)
+void CMoCapTCPServer<DataType_Send, DataType_Recv>::DoReceiveMessage(unsigned iSlot)
 {
     // Try to receive a message from the client connection 
-    static void *pDataBuffer = malloc(sizeof(Data_Header)+_maxDataSize);
+    // The bytes are assembled into messages however the stream splits them
+    Frame_Assembler assembler(_maxDataSize);
+    Connection_Handle lastHandle;
+    std::shared_ptr<const ThreadSnapshot> pSnapshot; // the connections, refreshed when some come or go
+    uint64_t nSnapshotVersion = 0;
     
     while(_bInWork){
-        std::unique_lock<std::mutex> lock(_mutex_forCriticalOps);
+        _threadSnapshot.Refresh(pSnapshot, nSnapshotVersion);
         
-        int iConnection = _threadConnections[iClientThread];
+        // the snapshot keeps the connection, and its socket, while it is used here
+        ThreadConnection *pConn = iSlot < pSnapshot->size() ? (*pSnapshot)[iSlot].get() : 0;
+        if(pConn == 0 || pConn->bClosed){ // no client is in the slot
+            Sleep(10);
+            continue;
+        }
         
-        lock.unlock();
+        Connection_Handle handle = pConn->handle;
+        SOCKET iConnection = pConn->sockfd;
         
-        if(iConnection < 0) continue;
+        if(handle != lastHandle){ // a new client
+            assembler.Reset();
+            lastHandle = handle;
+        }
         
-        //std::cout << "begin recv" << std::endl;
+        // Sleep until some bytes arrive, and read what is there. A client silent for the idle timeout is taken as gone.
+        if(socket_wait(iConnection, false, 100) <= 0){
+            if(IsIdle(pConn->tLastRecv, latency_now_ns())){
+                std::cout << "client " << iSlot << " timed out\n";
+                CloseThreadConnection(handle);
+            }
+            continue;
+        }
         
-        // First, read its head
-        unsigned nHeadSize = sizeof(Data_Header);
-        int n = recv(iConnection, (char*)pDataBuffer, nHeadSize,0);
-
-        //std::cout<<"recvsize:"<<n<<"\n";
-    
-        // If a message available, then send it to the callback of receiving  message
-        // do nothing, just handle the disconnect message
-        if (n == (int)nHeadSize){
-            
-            //std::cout << "recv1" << std::endl;
-            
-            Data_Header *pHeadInfo = static_cast<Data_Header*>(pDataBuffer);
-            //std::cout<<"RecvnDataSize:"<<pHeadInfo->nDataSize<<"\n";
-
-            if(strcmp(pHeadInfo->data_name, "quit") == 0){
-                // quit the connection and detach it from the thread
-                shutdown(iConnection, 2);
-                closesocket(iConnection);
-                
-                std::unique_lock<std::mutex> lock(_mutex_forCriticalOps);
-                
-                _threadConnections[iClientThread] = -1;
-                
-                lock.unlock();
-                
+        const size_t nMaxRead = 16384;
+        auto n = recv(iConnection, assembler.PrepareWrite(nMaxRead), nMaxRead, 0);
+        
+        bool bAlive = true;
+        if(n > 0){
+            assembler.CommitWrite(n);
+            pConn->tLastRecv.store(latency_now_ns(), std::memory_order_relaxed);
+        }
+        else if(n == 0 || !socket_would_block()) // closed by the client or broken
+            bAlive = false;
+        
+        // If messages are complete, then send them to the callback of receiving message
+        Data_Buffer data;
+        int ret;
+        while(bAlive && (ret = assembler.Next(data)) != 0){
+            if(ret < 0){
+                std::cout << "Error on the message from the client: " << iSlot << std::endl;
+                bAlive = false;
             }
-            else{
-                assert(strcmp(pHeadInfo->data_name, "mocap") == 0);
-                //std::cout << "recv2" << std::endl;
-                
-                // Second, read out the data entity
-                if(pHeadInfo->nDataSize > 0){
-                    int n = recv(iConnection, (char *)pDataBuffer+nHeadSize, pHeadInfo->nDataSize, 0);
-    
-                    //int move = -10;
-                    //memcpy(&move,(char *)pDataBuffer+nHeadSize,sizeof(int));
-                    //std::cout<<"actionReceived:"<<move<<"\n";
+            else if(strncmp(data.dataHeader.data_name, "quit", sizeof(data.dataHeader.data_name)) == 0){
+                bAlive = false;
+            }
+            else if(strncmp(data.dataHeader.data_name, "shm", sizeof(data.dataHeader.data_name)) == 0
+                    || strncmp(data.dataHeader.data_name, "mcast", sizeof(data.dataHeader.data_name)) == 0){
+                // the client gets the frames from the shared-memory ring or the multicast group
+                pConn->bSideChannel = true;
+            }
+            else if(strncmp(data.dataHeader.data_name, "sub", sizeof(data.dataHeader.data_name)) == 0){
+                // the client wants a part of the stream from the next frame on
+                Stream_Subscription subscription;
+                if(subscription.Decode((const char*)data.pData, data.dataHeader.nDataSize))
+                    pConn->subscription.Publish(_subscriptions.Intern(subscription));
+            }
+            else if(strncmp(data.dataHeader.data_name, "ping", sizeof(data.dataHeader.data_name)) == 0){
+                // the client asks for the clock of the server, and tells its own; the pong is sent by the sending thread
+                Clock_Ping ping;
+                if(ping.Decode((const char*)data.pData, data.dataHeader.nDataSize)){
+                    Clock_Pong pong;
+                    pong.tPing = ping.tSend;
+                    pong.tReceive = latency_now_ns();
+                    
+                    pConn->clock.Publish(std::make_shared<Clock_Estimate>(ping.estimate.Inverse()));
                     
-                    if(n == (int)pHeadInfo->nDataSize){
-                        Data_Buffer data;
-                        
-                        data.dataHeader = *pHeadInfo;
-                        data.pData = (char *)pDataBuffer + nHeadSize;
-                        
-                        if(_pRecv_msg_callback != 0){
-                            _pRecv_msg_callback(&data, _dataReposForServer);
-                        } 
-                    } 
+                    std::unique_lock<std::mutex> lock(pConn->mutexPong);
+                    pConn->pongs.push_back(pong);
+                    pConn->bPong = true;
                 }
             }
+            else if(strncmp(data.dataHeader.data_name, "mocap", sizeof(data.dataHeader.data_name)) == 0){
+                if(data.dataHeader.nDataSize > 0 && _pRecv_msg_callback != 0){
+                    uint64_t tDecode = _tracer.Stamp(), tSend = data.dataHeader.sendTime;
+                    if(tDecode != 0 && tSend != 0) tSend = pConn->clock.Get()->ToLocal(tSend); // on the clock of the server
+                    _tracer.Record(Latency_Stage::Transport, tSend, tDecode);
+                    
+                    _pRecv_msg_callback(&data, _dataReposForServer);
+                    _tracer.Record(Latency_Stage::Decode, tDecode, _tracer.Stamp());
+                } 
+            }
         }
         
-        //std::cout << "end recv" << std::endl;
-    
+        if(!bAlive){
+            // quit the connection and detach it from the thread, unless the sending thread has done it
+            CloseThreadConnection(handle);
+        }
     } 
 }
 
+#ifdef __linux__
+template<class DataType_Send, class DataType_Recv>
+bool CMoCapTCPServer<DataType_Send, DataType_Recv>::InitializeReactor()
+{
+    // The server socket is watched by the event loop instead of blocking in accept()
+    listen(_sockfd_server, SOMAXCONN);
+    set_nonblocking(_sockfd_server);
+
+    _epollfd = epoll_create1(EPOLL_CLOEXEC);
+    _wakeupfd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if(_epollfd < 0 || _wakeupfd < 0){
+        std::cout << "Error on creating the event loop: " << socket_last_error() << std::endl;
+
+        if(_epollfd >= 0) close(_epollfd);
+        if(_wakeupfd >= 0) close(_wakeupfd);
+        _epollfd = _wakeupfd = -1;
+        return false;
+    }
+
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    // The data of an event is the descriptor for these two, and the handle (Connection_Handle::ToId(), above 2^32) for a client
+    ev.events = EPOLLIN | EPOLLET;
+    ev.data.u64 = (uint64_t)_sockfd_server;
+    epoll_ctl(_epollfd, EPOLL_CTL_ADD, _sockfd_server, &ev);
+
+    ev.events = EPOLLIN | EPOLLET;
+    ev.data.u64 = (uint64_t)_wakeupfd;
+    epoll_ctl(_epollfd, EPOLL_CTL_ADD, _wakeupfd, &ev);
+
+    _reactorConnections.Clear();
+    _reactorConnections.SetCapacity(_maxConnection);
+    _reactorFrame.reset();
+
+    // A data pushed into the repos wakes up the event loop to send it
+    int wakeupfd = _wakeupfd;
+    _dataReposForServer.SetNotifier_SendQueue([wakeupfd]{
+        uint64_t one = 1;
+        auto ret = write(wakeupfd, &one, sizeof(one));
+        (void)ret;
+    });
+
+    _bInWork = true;
+
+    _threadEventLoop = std::thread(&CMoCapTCPServer::DoEventLoop, this);
+
+    return true;
+}
+
+template<class DataType_Send, class DataType_Recv>
+void CMoCapTCPServer<DataType_Send, DataType_Recv>::DoEventLoop()
+{
+    const int nMaxEvent = 64;
+    struct epoll_event events[nMaxEvent];
+
+    // the heartbeats are checked as often as the thread-per-client mode does
+    const bool bHeartbeat = _heartbeatInterval.count() > 0 || _idleTimeout.count() > 0;
+    std::chrono::milliseconds heartbeatPeriod(100);
+    if(_heartbeatInterval.count() > 0) heartbeatPeriod = std::min(heartbeatPeriod, _heartbeatInterval);
+    uint64_t tNextHeartbeat = latency_now_ns();
+
+    while(_bInWork){
+        int timeoutMs = -1;
+        if(bHeartbeat){
+            uint64_t now = latency_now_ns();
+            if(now >= tNextHeartbeat){
+                ReactorHeartbeat(now);
+                tNextHeartbeat = now + std::chrono::duration_cast<std::chrono::nanoseconds>(heartbeatPeriod).count();
+            }
+            timeoutMs = (int)((tNextHeartbeat - now) / 1000000) + 1;
+        }
+
+        // Sleep until an event comes, or it is time for the heartbeats. A data pushed into the repos is signaled through
+        // the eventfd.
+        int nEvent = epoll_wait(_epollfd, events, nMaxEvent, timeoutMs);
+
+        for(int i = 0; i < nEvent; i ++){
+            uint64_t id = events[i].data.u64;
+
+            if(id == (uint64_t)_sockfd_server){
+                ReactorAccept();
+            }
+            else if(id == (uint64_t)_wakeupfd){
+                uint64_t count;
+                while(read(_wakeupfd, &count, sizeof(count)) > 0);
+            }
+            else{
+                // an event of a connection closed meanwhile is stale
+                Connection_Handle handle = Connection_Handle::FromId(id);
+                ReactorConnection *pConn = _reactorConnections.Get(handle);
+                if(pConn == 0) continue;
+
+                bool bAlive = (events[i].events & (EPOLLERR | EPOLLHUP)) == 0;
+
+                if(bAlive && (events[i].events & (EPOLLIN | EPOLLRDHUP)))
+                    bAlive = ReactorRead(*pConn);
+                if(bAlive && (events[i].events & EPOLLOUT)){
+                    std::unique_lock<std::mutex> lock(_mutex_forCriticalOps);
+                    bAlive = ReactorFlush(*pConn);
+                }
+
+                if(!bAlive){
+                    std::cout << "connection lost\n";
+                    ReactorClose(handle, false);
+                }
+            }
+        }
+
+        // Pick out all the available messages and send them to all the clients
+        while(_bInWork && _pSend_msg_callback != 0){
+            Data_Buffer pickData;
+            pickData.dataHeader.nMaxDataSize = _maxDataSize;
+            if(!_reactorFrame){
+                _reactorFrame = _framePool.Acquire();
+                if(_reactorFrame->entity.size() < _maxDataSize) _reactorFrame->entity.resize(_maxDataSize);
+            }
+            pickData.pData = _reactorFrame->entity.data();
+            pickData.pStorage = &_reactorFrame->entity;
+
+            uint64_t tCallback = _tracer.Stamp();
+            _pSend_msg_callback(&pickData, _dataReposForServer);
+
+            if(pickData.dataHeader.nDataSize == 0) break; // no more message
+
+            pickData.dataHeader.sendTime = latency_now_ns(); // for the one-way latency on the clients
+            _tracer.Record(Latency_Stage::Serialize, tCallback, pickData.dataHeader.sendTime);
+
+            // the entity is encoded once into a frame shared by all the clients
+            _reactorFrame->Seal(pickData.dataHeader, _maxDataSize);
+
+            Stream_Recorder *pRecorder = _pRecorder;
+            if(pRecorder) pRecorder->Record(_reactorFrame); // only queued, written by the thread of the recorder
+
+            if(_shmWriter.IsOpen()) _shmWriter.Publish(*_reactorFrame);
+            if(_multicastSender.IsOpen()) _multicastSender.Send(*_reactorFrame);
+
+            ReactorBroadcast(_reactorFrame);
+            _reactorFrame.reset();
+        }
+    }
+
+    // Notify and close all the connections
+    for(Connection_Handle handle : _reactorConnections.GetHandles()){
+        ReactorClose(handle, true);
+    }
+}
+
+template<class DataType_Send, class DataType_Recv>
+void CMoCapTCPServer<DataType_Send, DataType_Recv>::ReactorAccept()
+{
+    // The server socket is edge-triggered: accept all the pending connections
+    while(true){
+        struct sockaddr_in client_addr;
+        socklen_t clilen = sizeof(client_addr);
+
+        int sockfd_client = accept(_sockfd_server, (struct sockaddr *) &client_addr, &clilen);
+        if(sockfd_client < 0){
+            if(!socket_would_block())
+                std::cout << "Error on accepting the connection: " << socket_last_error() << std::endl;
+            break;
+        }
+
+        std::unique_lock<std::mutex> lock(_mutex_forCriticalOps);
+
+        if(_reactorConnections.IsFull()){ // no more connections are allowed
+            unsigned nCapacity = _reactorConnections.GetCapacity();
+            lock.unlock();
+
+            RejectConnection(sockfd_client, nCapacity);
+            continue;
+        }
+
+        ReactorConnection conn(_maxDataSize);
+        conn.sockfd = sockfd_client;
+        conn.tLastRecv = conn.tLastSend = latency_now_ns();
+        conn.sendQueue = Outbound_Queue(_maxQueuedMessage, _overflowPolicy);
+        conn.pSubscription = _subscriptions.GetFull();
+        Connection_Handle handle = _reactorConnections.Add(std::move(conn));
+
+        lock.unlock();
+
+        set_nonblocking(sockfd_client);
+        socket_set_nodelay(sockfd_client);
+
+        struct epoll_event ev;
+        memset(&ev, 0, sizeof(ev));
+        ev.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+        ev.data.u64 = handle.ToId();
+        if(epoll_ctl(_epollfd, EPOLL_CTL_ADD, sockfd_client, &ev) < 0){
+            std::cout << "Error on watching the connection: " << socket_last_error() << std::endl;
+            closesocket(sockfd_client);
+
+            lock.lock();
+            _reactorConnections.Remove(handle);
+        }
+    }
+}
+
+template<class DataType_Send, class DataType_Recv>
+bool CMoCapTCPServer<DataType_Send, DataType_Recv>::ReactorRead(ReactorConnection &conn)
+{
+    // The socket is edge-triggered: read until it would block
+    const size_t nMaxRead = 16384;
+    while(true){
+        auto n = recv(conn.sockfd, conn.assembler.PrepareWrite(nMaxRead), nMaxRead, 0);
+        if(n > 0){
+            conn.assembler.CommitWrite(n);
+            conn.tLastRecv = latency_now_ns();
+        }
+        else if(n == 0){ // closed by the client
+            return false;
+        }
+        else if(socket_would_block()){
+            break;
+        }
+        else{
+            return false;
+        }
+    }
+
+    // Hand all the complete messages to the callback
+    Data_Buffer data;
+    int ret;
+    while((ret = conn.assembler.Next(data)) != 0){
+        if(ret < 0){
+            std::cout << "Error on the message from the client, drop the connection\n";
+            return false;
+        }
+
+        if(strncmp(data.dataHeader.data_name, "quit", sizeof(data.dataHeader.data_name)) == 0){
+            return false;
+        }
+        if(strncmp(data.dataHeader.data_name, "shm", sizeof(data.dataHeader.data_name)) == 0
+                || strncmp(data.dataHeader.data_name, "mcast", sizeof(data.dataHeader.data_name)) == 0){
+            // the client gets the frames from the shared-memory ring or the multicast group
+            std::unique_lock<std::mutex> lock(_mutex_forCriticalOps);
+            conn.bSideChannel = true;
+        }
+        if(strncmp(data.dataHeader.data_name, "sub", sizeof(data.dataHeader.data_name)) == 0){
+            // the client wants a part of the stream from the next frame on
+            Stream_Subscription subscription;
+            if(subscription.Decode((const char*)data.pData, data.dataHeader.nDataSize))
+                conn.pSubscription = _subscriptions.Intern(subscription);
+        }
+        if(strncmp(data.dataHeader.data_name, "ping", sizeof(data.dataHeader.data_name)) == 0){
+            // the client asks for the clock of the server, and tells its own
+            Clock_Ping ping;
+            if(ping.Decode((const char*)data.pData, data.dataHeader.nDataSize)){
+                Clock_Pong pong;
+                pong.tPing = ping.tSend;
+                pong.tReceive = latency_now_ns();
+
+                std::unique_lock<std::mutex> lock(_mutex_forCriticalOps);
+                conn.clock = ping.estimate.Inverse();
+                conn.sendQueue.Push(MakePong(pong));
+                if(!ReactorFlush(conn)) return false;
+            }
+        }
+        if(strncmp(data.dataHeader.data_name, "mocap", sizeof(data.dataHeader.data_name)) == 0){
+            if(data.dataHeader.nDataSize > 0 && _pRecv_msg_callback != 0){
+                uint64_t tDecode = _tracer.Stamp(), tSend = data.dataHeader.sendTime;
+                if(tDecode != 0 && tSend != 0) tSend = conn.clock.ToLocal(tSend); // on the clock of the server
+                _tracer.Record(Latency_Stage::Transport, tSend, tDecode);
+
+                _pRecv_msg_callback(&data, _dataReposForServer);
+                _tracer.Record(Latency_Stage::Decode, tDecode, _tracer.Stamp());
+            }
+        }
+    }
+
+    return true;
+}
+
+template<class DataType_Send, class DataType_Recv>
+bool CMoCapTCPServer<DataType_Send, DataType_Recv>::ReactorFlush(ReactorConnection &conn)
+{
+    // What is left is resumed on EPOLLOUT
+    return FlushOutbound(conn.sockfd, conn.sendQueue);
+}
+
+template<class DataType_Send, class DataType_Recv>
+void CMoCapTCPServer<DataType_Send, DataType_Recv>::ReactorBroadcast(const Outbound_Queue::Message &msg)
+{
+    std::vector<Connection_Handle> lost;
+    _nReactorFrame ++;
+
+    const uint64_t now = latency_now_ns();
+    std::unique_lock<std::mutex> lock(_mutex_forCriticalOps);
+
+    _reactorConnections.ForEach([&](Connection_Handle handle, ReactorConnection &conn){
+        if(conn.bSideChannel) return; // it only gets what was queued before it said so, written on EPOLLOUT
+
+        conn.tLastSend = now;
+        if(!conn.sendQueue.Push(ProjectFrame(msg, _nReactorFrame, *conn.pSubscription))){
+            std::cout << "client " << conn.sockfd << " cannot keep up with the stream\n";
+            lost.push_back(handle);
+        }
+        else if(!ReactorFlush(conn)){
+            lost.push_back(handle);
+        }
+    });
+
+    lock.unlock();
+
+    for(Connection_Handle handle : lost){
+        std::cout << "connection lost\n";
+        ReactorClose(handle, false);
+    }
+}
+
+template<class DataType_Send, class DataType_Recv>
+void CMoCapTCPServer<DataType_Send, DataType_Recv>::ReactorHeartbeat(uint64_t now)
+{
+    const uint64_t heartbeatInterval = std::chrono::duration_cast<std::chrono::nanoseconds>(_heartbeatInterval).count();
+    std::vector<Connection_Handle> lost;
+    Outbound_Queue::Message beat; // one for all the idle clients
+
+    std::unique_lock<std::mutex> lock(_mutex_forCriticalOps);
+
+    _reactorConnections.ForEach([&](Connection_Handle handle, ReactorConnection &conn){
+        if(IsIdle(conn.tLastRecv, now)){
+            std::cout << "client " << conn.sockfd << " timed out\n";
+            lost.push_back(handle);
+        }
+        else if(heartbeatInterval > 0 && now - conn.tLastSend >= heartbeatInterval && conn.sendQueue.Empty()){
+            if(!beat) beat = MakeBeat();
+            conn.sendQueue.Push(beat);
+            conn.tLastSend = now;
+            if(!ReactorFlush(conn)) lost.push_back(handle);
+        }
+    });
+
+    lock.unlock();
+
+    for(Connection_Handle handle : lost){
+        std::cout << "connection lost\n";
+        ReactorClose(handle, false);
+    }
+}
+
+template<class DataType_Send, class DataType_Recv>
+void CMoCapTCPServer<DataType_Send, DataType_Recv>::ReactorClose(Connection_Handle handle, bool bNotifyQuit)
+{
+    ReactorConnection *pConn = _reactorConnections.Get(handle);
+    if(pConn == 0) return;
+
+    SOCKET sockfd = pConn->sockfd;
+
+    if(bNotifyQuit){
+        // send a null message to the client to notify it
+        Data_Header data;
+
+        strcpy(data.data_name, "quit") ;
+        data.nDataSize = 0;
+
+        send(sockfd, (char*)&data, sizeof(data), MSG_NOSIGNAL);
+    }
+
+    epoll_ctl(_epollfd, EPOLL_CTL_DEL, sockfd, 0);
+
+    shutdown(sockfd, 2);
+    closesocket(sockfd);
+
+    std::unique_lock<std::mutex> lock(_mutex_forCriticalOps);
+
+    _reactorConnections.Remove(handle);
+}
+#endif
+
 } // namespace: mocap_netop
 
 
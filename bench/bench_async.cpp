@@ -0,0 +1,210 @@
+// Benchmark of the consumers of many clients run on one thread by an Async_Executor, against a thread for each
+// consumer blocked on its repos (as Client_Work in main.cpp). Each consumer takes the frames of its client and does a
+// little work on the joints. For both ways it reports the threads of the consumers, the frames taken, how late they
+// are from the time they are pushed into the server (p50, p99 and max) and the CPU time of the process per frame.
+// The threads of the clients themselves are the same in both.
+//
+// Usage: bench_async [consumers] [seconds] [frames per second] [port]
+
+#include <iostream>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#ifdef __linux__
+#include <sys/resource.h>
+#endif
+
+#include "TCPServer.h"
+#include "TCPClient.h"
+#include "MoCap_Data.h"
+#include "AsyncExecutor.h"
+
+using namespace mocap_netop;
+
+typedef CMoCapTCPServer<Data_MoCap_Send, Data_MoCap_Recv> Server;
+typedef CMoCapTCPClient<Data_MoCap_Recv, Data_MoCap_Send> Client;
+typedef Async_Reader<Data_MoCap_Recv, Data_MoCap_Send> Reader;
+
+static const unsigned N_PERSON = 8;
+
+// CPU time of the process in seconds, user and system
+static double cpu_seconds()
+{
+#ifdef __linux__
+    rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+#else
+    return 0;
+#endif
+}
+
+// The work of a consumer on a frame
+static float consume(const Data_MoCap_Send &frame, Latency_Histogram &latency)
+{
+    uint64_t now = latency_now_ns();
+    latency.Record(now > frame.timestamp ? now - frame.timestamp : 0);
+
+    float sum = 0;
+    for(const auto &pose : frame.poses){
+        for(unsigned k = 0; k < JOINT_NUMBER; k ++) sum += pose.joints[k].y;
+    }
+    return sum;
+}
+
+// A consumer on its own thread, sleeping on the repos
+static void consume_on_thread(Client &client, Latency_Histogram &latency, std::atomic<uint64_t> &nFrame)
+{
+    volatile float sum = 0;
+    while(client.IsWorking()){
+        std::shared_ptr<Data_MoCap_Send> frame = client.GetClientDataRepos().PopData_RecvQueue(std::chrono::milliseconds(100));
+        if(!frame) continue;
+
+        sum += consume(*frame, latency);
+        nFrame ++;
+    }
+}
+
+// A consumer on the executor: each frame asks for the next one, until the client stops
+struct Async_Consumer{
+    Async_Consumer(Client &client, Async_Executor &executor, Latency_Histogram &latency, std::atomic<uint64_t> &nFrame,
+                   std::atomic<unsigned> &nRunning)
+        : reader(client.GetClientDataRepos(), executor, [&client]{ return client.IsWorking(); }),
+          latency(latency), nFrame(nFrame), nRunning(nRunning) {}
+
+    void Start()
+    {
+        nRunning ++;
+        reader.Next([this](const std::shared_ptr<Data_MoCap_Send> &frame){ OnFrame(frame); });
+    }
+
+    void OnFrame(const std::shared_ptr<Data_MoCap_Send> &frame)
+    {
+        if(!frame){ // the client has stopped
+            nRunning --;
+            return;
+        }
+
+        sum += consume(*frame, latency);
+        nFrame ++;
+        reader.Next([this](const std::shared_ptr<Data_MoCap_Send> &frame){ OnFrame(frame); });
+    }
+
+    Reader reader;
+    Latency_Histogram &latency;
+    std::atomic<uint64_t> &nFrame;
+    std::atomic<unsigned> &nRunning;
+    float sum = 0;
+};
+
+// One run: the consumers on threads or on the executor. Return false if the server or a client cannot start.
+static bool run(bool bExecutor, unsigned nConsumer, double seconds, double fps, unsigned port)
+{
+    std::string address = "127.0.0.1:" + std::to_string(port);
+    Server server(address, 65536, nConsumer + 1);
+    if(!server.Start(sendmsg_callback_mocap_server, recvmsg_callback_mocap_server)) return false;
+    Sleep(100);
+
+    std::vector< std::unique_ptr<Client> > clients;
+    for(unsigned i = 0; i < nConsumer; i ++){
+        std::unique_ptr<Client> client(new Client(address, 65536));
+        if(!client->Connect(0, recvmsg_callback_mocap_client_contentRender)) return false;
+        clients.push_back(std::move(client));
+    }
+    Sleep(200); // let the server take all of them
+
+    Latency_Histogram latency;
+    std::atomic<uint64_t> nFrameTaken(0);
+    std::atomic<unsigned> nRunning(0);
+
+    Async_Executor executor;
+    std::vector< std::unique_ptr<Async_Consumer> > consumers;
+    std::vector<std::thread> threads;
+    if(bExecutor){
+        for(auto &client : clients){
+            consumers.push_back(std::unique_ptr<Async_Consumer>(new Async_Consumer(*client, executor, latency, nFrameTaken, nRunning)));
+            consumers.back()->Start();
+        }
+        threads.push_back(std::thread([&executor]{ executor.Run(); }));
+    }
+    else{
+        for(auto &client : clients)
+            threads.push_back(std::thread(consume_on_thread, std::ref(*client), std::ref(latency), std::ref(nFrameTaken)));
+    }
+    Sleep(100);
+
+    // the frames at the rate
+    auto &repos = server.GetSeverDataRepos();
+    const double periodNs = 1e9 / fps;
+    latency.Reset();
+    nFrameTaken = 0;
+    const double cpuStart = cpu_seconds();
+    const uint64_t tStart = latency_now_ns(), tEnd = tStart + (uint64_t)(seconds * 1e9);
+    for(uint64_t i = 0; ; i ++){
+        uint64_t tFrame = tStart + (uint64_t)(i * periodNs), now = latency_now_ns();
+        if(tFrame >= tEnd || now >= tEnd) break;
+        if(tFrame > now) std::this_thread::sleep_for(std::chrono::nanoseconds(tFrame - now));
+
+        std::shared_ptr<Data_MoCap_Send> frame = repos.AcquireData_SendQueue();
+        frame->poses.resize(N_PERSON);
+        for(unsigned j = 0; j < N_PERSON; j ++){
+            frame->poses[j].ID = j + 1;
+            for(unsigned k = 0; k < JOINT_NUMBER; k ++)
+                frame->poses[j].joints[k].x = frame->poses[j].joints[k].y = frame->poses[j].joints[k].z = (float)(i % 100) * 0.01f + k;
+        }
+        frame->actions.resize(0);
+        frame->timestamp = latency_now_ns();
+        repos.PushData_SendQueue(frame);
+    }
+    Sleep(200); // the frames on the way
+    const double cpu = cpu_seconds() - cpuStart;
+    const uint64_t nFrame = nFrameTaken;
+
+    // the consumers finish as their clients stop
+    for(auto &client : clients) client->Disconnect();
+    for(int i = 0; i < 100 && nRunning > 0; i ++) Sleep(10);
+    executor.Stop();
+    for(auto &thread : threads) thread.join();
+    consumers.clear();
+    server.Stop();
+
+    Latency_Summary summary = latency.GetSummary();
+    printf("%-9s %8u %10llu %9.1f %9.1f %9.1f %12.2f %10u\n", bExecutor ? "executor" : "threads",
+           bExecutor ? 1 : nConsumer, (unsigned long long)nFrame, summary.nP50 / 1e3, summary.nP99 / 1e3, summary.nMax / 1e3,
+           nFrame ? cpu * 1e6 / nFrame : 0., bExecutor ? nRunning.load() : 0);
+    return true;
+}
+
+int main(int argc, char *argv[])
+{
+    unsigned nConsumer = argc > 1 ? (unsigned)atoi(argv[1]) : 32;
+    double seconds = argc > 2 ? atof(argv[2]) : 3;
+    double fps = argc > 3 ? atof(argv[3]) : 120;
+    unsigned port = argc > 4 ? (unsigned)atoi(argv[4]) : 5025; // and the next one
+    if(nConsumer == 0 || seconds <= 0 || fps <= 0){
+        std::cout << "Usage: bench_async [consumers] [seconds] [frames per second] [port]\n";
+        return 1;
+    }
+
+    setbuf(stdout, NULL);
+
+    // the server and the clients tell of each connection on std::cout, which is kept quiet
+    std::cout.setstate(std::ios::failbit);
+
+    printf("%u consumers, %.0f frames/s of %u persons for %.1f s\n", nConsumer, fps, N_PERSON, seconds);
+    printf("%-9s %8s %10s %9s %9s %9s %12s %10s\n", "mode", "threads", "frames", "p50(us)", "p99(us)", "max(us)",
+           "cpu(us)/frame", "unfinished");
+
+    for(bool bExecutor : {false, true}){
+        if(!run(bExecutor, nConsumer, seconds, fps, port ++)){
+            std::cout.clear();
+            std::cout << "Cannot start the server or a client on port " << port - 1 << "\n";
+            return 1;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,157 @@
+// Benchmark of the broadcast path of CMoCapTCPServer (Linux, reactor mode).
+// A frame is serialized once into a shared wire frame and written to each client with gather writes. For a sweep of
+// the number of clients, it reports the time spent in the send callback per frame (which should stay flat) and the
+// CPU of the server per frame and per client. The clients run in a child process which drains all the sockets.
+//
+// Usage: bench_broadcast [frames] [poses per frame]
+
+#include <iostream>
+#include <vector>
+#include <chrono>
+#include <atomic>
+#include <thread>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <sys/epoll.h>
+
+#include "TCPServer.h"
+#include "MoCap_Data.h"
+
+using namespace mocap_netop;
+
+static std::atomic<uint64_t> g_nCallbackNs(0);
+
+// The send callback of the server, timed
+void sendmsg_callback_bench(Data_Buffer* pDataBuffer, Data_Repos<Data_MoCap_Send, Data_MoCap_Recv> &dataRepos)
+{
+    auto t0 = std::chrono::steady_clock::now();
+    sendmsg_callback_mocap_server(pDataBuffer, dataRepos);
+    g_nCallbackNs += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - t0).count();
+}
+
+static double cpu_seconds()
+{
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) * 1e-6;
+}
+
+// The clients: connect and read until all the frames have arrived
+static int run_clients(int port, unsigned nClient, uint64_t nBytePerClient)
+{
+    std::vector<SOCKET> clients;
+    for(unsigned i = 0; i < nClient; i ++){
+        SOCKET fd = socket(AF_INET, SOCK_STREAM, 0);
+
+        struct sockaddr_in serv_addr;
+        memset(&serv_addr, 0, sizeof(serv_addr));
+        serv_addr.sin_family = AF_INET;
+        serv_addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+        serv_addr.sin_port = htons(port);
+
+        while(connect(fd, (struct sockaddr *) &serv_addr, sizeof(serv_addr)) < 0){
+            closesocket(fd);
+            Sleep(10);
+            fd = socket(AF_INET, SOCK_STREAM, 0);
+        }
+        socket_set_nonblocking(fd);
+        clients.push_back(fd);
+    }
+
+    int epollfd = epoll_create1(0);
+    for(unsigned i = 0; i < nClient; i ++){
+        struct epoll_event ev;
+        ev.events = EPOLLIN;
+        ev.data.u32 = i;
+        epoll_ctl(epollfd, EPOLL_CTL_ADD, clients[i], &ev);
+    }
+
+    std::vector<uint64_t> nReceived(nClient, 0);
+    unsigned nDone = 0;
+    static char buffer[1 << 16];
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(60);
+
+    while(nDone < nClient && std::chrono::steady_clock::now() < deadline){
+        struct epoll_event events[64];
+        int nEvent = epoll_wait(epollfd, events, 64, 100);
+
+        for(int i = 0; i < nEvent; i ++){
+            unsigned iClient = events[i].data.u32;
+            ssize_t n;
+            while((n = recv(clients[iClient], buffer, sizeof(buffer), 0)) > 0){
+                bool bWasDone = nReceived[iClient] >= nBytePerClient;
+                nReceived[iClient] += n;
+                if(!bWasDone && nReceived[iClient] >= nBytePerClient) nDone ++;
+            }
+        }
+    }
+
+    return nDone == nClient ? 0 : 1;
+}
+
+int main(int argc, char *argv[])
+{
+    setbuf(stdout, NULL);
+
+    unsigned nFrame = argc > 1 ? atoi(argv[1]) : 2000;
+    unsigned nPose = argc > 2 ? atoi(argv[2]) : 20;
+    int port = 5600;
+
+    // bytes of a frame on the wire: header, poses and an empty action list
+    const unsigned nMaxDataSize = 1 << 16;
+    uint64_t nFrameSize = sizeof(Data_Header) + 4 + nPose * (8 + sizeof(Data_MoCap_Send::Pose::joints)) + 4;
+
+    for(unsigned nClient : {1u, 4u, 16u, 64u, 256u}){
+        pid_t pid = fork();
+        if(pid == 0){
+            _exit(run_clients(port, nClient, nFrameSize * nFrame));
+        }
+
+        CMoCapTCPServer<Data_MoCap_Send, Data_MoCap_Recv> server("127.0.0.1:" + std::to_string(port), nMaxDataSize, nClient);
+        server.SetIOMode(ServerIOMode::Reactor);
+        server.SetOverflowPolicy(Overflow_Policy::DropOldest, nFrame); // nothing is dropped
+        server.Start(sendmsg_callback_bench, 0);
+
+        while(server.GetClientSendStats().size() < nClient){
+            Sleep(10);
+        }
+
+        // the frames are created beforehand
+        std::vector< std::shared_ptr<Data_MoCap_Send> > frames(nFrame);
+        for(unsigned f = 0; f < nFrame; f ++){
+            frames[f] = std::make_shared<Data_MoCap_Send>();
+            frames[f]->timestamp = f;
+            frames[f]->poses.resize(nPose);
+            for(unsigned p = 0; p < nPose; p ++){
+                frames[f]->poses[p].ID = p;
+                for(unsigned k = 0; k < JOINT_NUMBER; k ++){
+                    frames[f]->poses[p].joints[k] = Data_MoCap_Send::Joint{float(f), float(p), float(k)};
+                }
+            }
+        }
+
+        g_nCallbackNs = 0;
+        double cpu0 = cpu_seconds();
+        auto t0 = std::chrono::steady_clock::now();
+
+        for(auto &frame : frames){
+            server.GetSeverDataRepos().PushData_SendQueue(frame);
+        }
+
+        int status = 0;
+        waitpid(pid, &status, 0);
+
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+        double cpu = cpu_seconds() - cpu0;
+
+        server.Stop();
+
+        printf("clients=%4u frame=%6llu B  serialize=%7.2f us/frame  server_cpu=%8.2f us/frame %7.3f us/frame/client  %8.1f MB/s%s\n",
+               nClient, (unsigned long long)nFrameSize, g_nCallbackNs * 1e-3 / nFrame, cpu * 1e6 / nFrame, cpu * 1e6 / nFrame / nClient,
+               nFrameSize * nFrame * nClient / seconds * 1e-6, (WIFEXITED(status) && WEXITSTATUS(status) == 0) ? "" : "  (incomplete)");
+
+        port ++;
+    }
+
+    return 0;
+}
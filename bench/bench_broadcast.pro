@@ -0,0 +1,29 @@
+QT -= gui
+
+CONFIG += c++11 console
+CONFIG -= app_bundle
+
+TARGET = bench_broadcast
+INCLUDEPATH += ..
+
+SOURCES += \
+        bench_broadcast.cpp \
+        ../MoCap_Data.cpp
+
+win32: LIBS += -lws2_32
+unix: LIBS += -lpthread
+linux: LIBS += -lrt # shm_open with an older glibc
+
+HEADERS += \
+    ../ClockSync.h \
+    ../ConnectionTable.h \
+    ../LatencyTrace.h \
+    ../MoCap_Codec.h \
+    ../MoCap_Data.h \
+    ../MulticastChannel.h \
+    ../NetOp.h \
+    ../NetPlatform.h \
+    ../ShmChannel.h \
+    ../Skeleton.h \
+    ../Subscription.h \
+    ../TCPServer.h
@@ -0,0 +1,147 @@
+// Benchmark of the estimation of the clock of the other side of a connection (Clock_Offset_Estimator). First on a
+// simulated remote clock, with an offset and a drift, over a network with jitter and a delay that differs on the two
+// ways: after each exchange it turns a time of the remote clock into the local one by the estimate, as for the send
+// time of a frame, and reports how far off it is (p50 and max) with the drift estimated. Half of the asymmetry of the
+// delay cannot be told from the offset by any exchange, so it is shown as the bias to expect.
+// Then a client pings a server on this host, where the clocks are the same: the offsets should be about 0, within half
+// of the round trip, and the one-way latency of the frames on the client is on its clock by the estimate.
+//
+// Usage: bench_clock [exchanges] [seconds between exchanges] [port]
+
+#include <iostream>
+#include <vector>
+#include <random>
+#include <chrono>
+#include <thread>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "TCPServer.h"
+#include "TCPClient.h"
+#include "MoCap_Data.h"
+#include "ClockSync.h"
+
+using namespace mocap_netop;
+
+typedef CMoCapTCPServer<Data_MoCap_Send, Data_MoCap_Recv> Server;
+typedef CMoCapTCPClient<Data_MoCap_Recv, Data_MoCap_Send> Client;
+
+// A remote clock off the local one by an offset, and running faster by some ppm
+struct Remote_Clock{
+    int64_t offset;
+    double drift;
+
+    uint64_t At(uint64_t tLocal) const { return tLocal + offset + (int64_t)(drift * (double)tLocal); }
+};
+
+// One case of the simulation
+static void simulate(double driftPpm, double asymmetryUs, double jitterUs, unsigned nExchange, double period)
+{
+    std::mt19937_64 random(42);
+    std::exponential_distribution<double> jitter(1.0 / (jitterUs * 1e3));
+
+    // the local clock some hours after the boot; the remote one booted a while earlier
+    const uint64_t tStart = 7200ull * 1000000000ull;
+    Remote_Clock remote{3700ll * 1000000000ll, driftPpm * 1e-6};
+
+    const double baseDelay = 100e3; // each way, in ns
+    Clock_Offset_Estimator estimator;
+    Latency_Histogram error;
+    for(unsigned i = 0; i < nExchange; i ++){
+        uint64_t t0 = tStart + (uint64_t)(i * period * 1e9);
+        uint64_t tArrive = t0 + (uint64_t)(baseDelay + asymmetryUs * 1e3 + jitter(random));
+        uint64_t tReply = tArrive + 20000 + (uint64_t)(jitter(random) / 4); // held by the other side for a while
+        uint64_t t3 = tReply + (uint64_t)(baseDelay + jitter(random));
+        estimator.AddSample(t0, remote.At(tArrive), remote.At(tReply), t3);
+
+        // a time sent from there half way to the next exchange, turned into the local clock
+        uint64_t tCheck = t3 + (uint64_t)(period * 0.5e9);
+        int64_t diff = (int64_t)(estimator.GetEstimate().ToLocal(remote.At(tCheck)) - tCheck);
+        if(i >= 8) error.Record((uint64_t)(diff < 0 ? -diff : diff)); // once the filter is full
+    }
+
+    Clock_Estimate estimate = estimator.GetEstimate();
+    Latency_Summary summary = error.GetSummary();
+    printf("%9.1f %9.1f %9.1f %10.1f %10.1f %10.1f %12.3f\n", driftPpm, asymmetryUs, jitterUs, asymmetryUs / 2,
+           summary.nP50 / 1e3, summary.nMax / 1e3, estimate.drift * 1e6);
+}
+
+// A client and a server on this host. Return false if they cannot start.
+static bool run_loopback(ServerIOMode mode, unsigned port)
+{
+    std::string address = "127.0.0.1:" + std::to_string(port);
+    Server server(address, 65536, 2);
+    server.SetIOMode(mode);
+    if(!server.Start(sendmsg_callback_mocap_server, recvmsg_callback_mocap_server)) return false;
+    Sleep(100);
+
+    Client client(address, 65536);
+    client.EnableClockSync(std::chrono::milliseconds(100));
+    client.EnableLatencyTracing();
+    if(!client.Connect(0, recvmsg_callback_mocap_client_contentRender)) return false;
+
+    // frames at 120 per second for a couple of seconds
+    auto &repos = server.GetSeverDataRepos();
+    std::vector< std::shared_ptr<Data_MoCap_Send> > frames;
+    for(unsigned i = 0; i < 240; i ++){
+        std::shared_ptr<Data_MoCap_Send> frame = repos.AcquireData_SendQueue();
+        frame->poses.resize(4);
+        for(unsigned j = 0; j < 4; j ++) frame->poses[j].ID = j + 1;
+        frame->actions.resize(0);
+        frame->timestamp = latency_now_ns();
+        repos.PushData_SendQueue(frame);
+
+        frames.clear();
+        client.GetClientDataRepos().PopAllData_RecvQueue(frames);
+        std::this_thread::sleep_for(std::chrono::microseconds(8333));
+    }
+
+    Clock_Estimate clock = client.GetServerClock();
+    std::vector<Client_Clock> clocks = server.GetClientClocks();
+    Latency_Summary transport = client.GetLatencyTracer().GetSummary(Latency_Stage::Transport);
+
+    client.Disconnect();
+    server.Stop();
+
+    printf("%-10s %8u %11.1f %10.1f %11.1f %12.1f\n", mode == ServerIOMode::Reactor ? "reactor" : "threads", clock.nSample,
+           (double)clock.offset / 1e3, clock.delay / 1e3, clocks.empty() ? 0. : (double)clocks[0].clock.offset / 1e3,
+           transport.nP50 / 1e3);
+    return true;
+}
+
+int main(int argc, char *argv[])
+{
+    unsigned nExchange = argc > 1 ? (unsigned)atoi(argv[1]) : 600;
+    double period = argc > 2 ? atof(argv[2]) : 1;
+    unsigned port = argc > 3 ? (unsigned)atoi(argv[3]) : 5029; // and the next one
+    if(nExchange == 0 || period <= 0){
+        std::cout << "Usage: bench_clock [exchanges] [seconds between exchanges] [port]\n";
+        return 1;
+    }
+
+    setbuf(stdout, NULL);
+
+    printf("%u exchanges, %.1f s apart, on a simulated clock\n", nExchange, period);
+    printf("%9s %9s %9s %10s %10s %10s %12s\n", "drift", "asym(us)", "jitter", "bias(us)", "p50(us)", "max(us)",
+           "drift(ppm)");
+    const double drifts[] = {0, 20, 100};
+    for(double drift : drifts){
+        simulate(drift, 0, 50, nExchange, period);
+        simulate(drift, 0, 500, nExchange, period);
+        simulate(drift, 200, 50, nExchange, period);
+    }
+
+    // the server and the client tell of each connection on std::cout, which is kept quiet
+    std::cout.setstate(std::ios::failbit);
+
+    printf("\nA client pinging a server on this host every 100 ms\n");
+    printf("%-10s %8s %11s %10s %11s %12s\n", "server", "pongs", "offset(us)", "delay(us)", "server(us)", "one-way(us)");
+    for(ServerIOMode mode : {ServerIOMode::ThreadPerClient, ServerIOMode::Reactor}){
+        if(!run_loopback(mode, port ++)){
+            std::cout.clear();
+            std::cout << "Cannot start the server or the client on port " << port - 1 << "\n";
+            return 1;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,31 @@
+QT -= gui
+
+CONFIG += c++11 console
+CONFIG -= app_bundle
+
+TARGET = bench_clock
+INCLUDEPATH += ..
+
+SOURCES += \
+        bench_clock.cpp \
+        ../MoCap_Data.cpp
+
+win32: LIBS += -lws2_32
+unix: LIBS += -lpthread
+linux: LIBS += -lrt # shm_open with an older glibc
+
+HEADERS += \
+    ../ClockSync.h \
+    ../ConnectionTable.h \
+    ../DecodePipeline.h \
+    ../LatencyTrace.h \
+    ../MoCap_Codec.h \
+    ../MoCap_Data.h \
+    ../MulticastChannel.h \
+    ../NetOp.h \
+    ../NetPlatform.h \
+    ../ShmChannel.h \
+    ../Skeleton.h \
+    ../Subscription.h \
+    ../TCPClient.h \
+    ../TCPServer.h
@@ -0,0 +1,211 @@
+// Benchmark of the compact codec of the mocap data against the raw one.
+// The frames of skeletons.txt are encoded with the send callback of the server and decoded with the recv callback of
+// the client (contentRender), without any socket. It reports the bytes per frame, the compression ratio, the time of
+// encoding/decoding per pose and the largest error of a joint after decoding.
+// Then the same frames on the skeletons of more joints, by the templated callbacks of MoCap_Codec.h in this binary: the
+// joints past the 17 of a pose are copies of its joints (so the compact codec sees the same motion).
+//
+// Usage: bench_codec [skeletons file] [keyframe interval] [rounds]
+
+#include <iostream>
+#include <vector>
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include "NetOp.h"
+#include "MoCap_Data.h"
+#include "MoCap_Codec.h"
+
+using namespace mocap_netop;
+
+template<class Skeleton>
+struct Codec_Callbacks{
+    typedef void (*Send_Callback)(Data_Buffer*, Data_Repos<Data_MoCap_Frame<Skeleton>, Data_MoCap_Recv>&);
+    typedef void (*Recv_Callback)(Data_Buffer*, Data_Repos<Data_MoCap_Recv, Data_MoCap_Frame<Skeleton> >&);
+};
+typedef Codec_Callbacks<Skeleton_Coco17>::Send_Callback Send_Callback;
+typedef Codec_Callbacks<Skeleton_Coco17>::Recv_Callback Recv_Callback;
+
+// Read all the frames of the file, in the same way as the server of the demo
+static std::vector< std::shared_ptr<Data_MoCap_Send> > load_frames(const char *fileName)
+{
+    std::vector< std::shared_ptr<Data_MoCap_Send> > frames;
+
+    FILE *fp = fopen(fileName, "r");
+    if(fp == NULL) return frames;
+
+    unsigned nPose, nJoint;
+    char line[128];
+    while(fscanf(fp, "%u%u", &nPose, &nJoint) == 2){
+        fgets(line, 128, fp); // eat out the line
+
+        std::shared_ptr<Data_MoCap_Send> frame = std::make_shared<Data_MoCap_Send>();
+        frame->timestamp = frames.size();
+        frame->poses.resize(nPose);
+        for(unsigned j = 0; j < nPose; j ++){
+            Data_MoCap_Send::Pose &pose = frame->poses[j];
+            pose.ID = j+1;
+            for(unsigned k = 0; k < JOINT_NUMBER; k ++){
+                Data_MoCap_Send::Joint &joint = pose.joints[k];
+                fscanf(fp, "%f%f%f", &joint.x, &joint.y, &joint.z);
+            }
+            fgets(line, 128, fp);
+        }
+        frame->actions.resize(1);
+        frame->actions[0].poseID = 1;
+        frame->actions[0].action = (int)(frames.size() % 5);
+
+        frames.push_back(frame);
+    }
+
+    fclose(fp);
+    return frames;
+}
+
+// The frames on a skeleton of more joints: joint k of a pose is joint k % 17 of the pose in the file
+template<class Skeleton>
+static std::vector< std::shared_ptr< Data_MoCap_Frame<Skeleton> > > convert_frames(const std::vector< std::shared_ptr<Data_MoCap_Send> > &frames)
+{
+    std::vector< std::shared_ptr< Data_MoCap_Frame<Skeleton> > > converted;
+    for(const auto &frame : frames){
+        std::shared_ptr< Data_MoCap_Frame<Skeleton> > to = std::make_shared< Data_MoCap_Frame<Skeleton> >();
+        to->timestamp = frame->timestamp;
+        to->poses.resize(frame->poses.size());
+        for(size_t j = 0; j < frame->poses.size(); j ++){
+            to->poses[j].ID = frame->poses[j].ID;
+            for(unsigned k = 0; k < Skeleton::JOINT_COUNT; k ++){
+                const Data_MoCap_Send::Joint &joint = frame->poses[j].joints[k % JOINT_NUMBER];
+                to->poses[j].joints[k].x = joint.x;
+                to->poses[j].joints[k].y = joint.y;
+                to->poses[j].joints[k].z = joint.z;
+            }
+        }
+        to->actions.resize(frame->actions.size());
+        for(size_t j = 0; j < frame->actions.size(); j ++){
+            to->actions[j].poseID = frame->actions[j].poseID;
+            to->actions[j].action = frame->actions[j].action;
+        }
+        converted.push_back(to);
+    }
+    return converted;
+}
+
+struct Codec_Result{
+    uint64_t nBytes = 0, nPoses = 0;
+    double encodeNs = 0, decodeNs = 0;
+    float maxError = 0;
+    unsigned nLost = 0;
+};
+
+template<class Skeleton>
+static Codec_Result run_codec(const std::vector< std::shared_ptr< Data_MoCap_Frame<Skeleton> > > &frames, unsigned nRound,
+                              typename Codec_Callbacks<Skeleton>::Send_Callback sendCallback,
+                              typename Codec_Callbacks<Skeleton>::Recv_Callback recvCallback)
+{
+    Codec_Result result;
+
+    // fresh repos for each run, so the codec starts from a keyframe
+    Data_Repos<Data_MoCap_Frame<Skeleton>, Data_MoCap_Recv> reposServer;
+    Data_Repos<Data_MoCap_Recv, Data_MoCap_Frame<Skeleton> > reposClient;
+
+    std::vector<char> storage(1024);
+    Data_Buffer buffer;
+    buffer.pStorage = &storage;
+    buffer.pData = storage.data();
+    buffer.dataHeader.nMaxDataSize = storage.size();
+
+    for(unsigned r = 0; r < nRound; r ++){
+        for(const auto &frame : frames){
+            reposServer.PushData_SendQueue(frame);
+
+            buffer.dataHeader.nDataSize = 0;
+            auto t0 = std::chrono::steady_clock::now();
+            sendCallback(&buffer, reposServer);
+            auto t1 = std::chrono::steady_clock::now();
+            recvCallback(&buffer, reposClient);
+            auto t2 = std::chrono::steady_clock::now();
+
+            result.encodeNs += std::chrono::duration<double, std::nano>(t1 - t0).count();
+            result.decodeNs += std::chrono::duration<double, std::nano>(t2 - t1).count();
+            result.nBytes += buffer.dataHeader.nDataSize;
+            result.nPoses += frame->poses.size();
+
+            std::shared_ptr< Data_MoCap_Frame<Skeleton> > decoded = reposClient.PopData_RecvQueue();
+            if(!decoded || decoded->poses.size() != frame->poses.size() || decoded->actions.size() != frame->actions.size()){
+                result.nLost ++;
+                continue;
+            }
+
+            for(size_t j = 0; j < frame->poses.size(); j ++){
+                for(unsigned k = 0; k < Skeleton::JOINT_COUNT; k ++){
+                    const float *a = &frame->poses[j].joints[k].x, *b = &decoded->poses[j].joints[k].x;
+                    for(unsigned c = 0; c < 3; c ++)
+                        result.maxError = std::max(result.maxError, fabsf(a[c] - b[c]));
+                }
+            }
+        }
+    }
+
+    return result;
+}
+
+// The raw and compact codecs of a skeleton
+template<class Skeleton>
+static void run_skeleton(const std::vector< std::shared_ptr<Data_MoCap_Send> > &frames, unsigned nRound)
+{
+    std::vector< std::shared_ptr< Data_MoCap_Frame<Skeleton> > > converted = convert_frames<Skeleton>(frames);
+    Codec_Result raw = run_codec<Skeleton>(converted, nRound, sendmsg_callback_mocap_server, recvmsg_callback_mocap_client_contentRender);
+    Codec_Result compact = run_codec<Skeleton>(converted, nRound, sendmsg_callback_mocap_server_compact, recvmsg_callback_mocap_client_contentRender_compact);
+
+    printf("%-10s %6u %10.1f %10.1f %10.1f %10.1f %10.1f %10.1f %6u\n", Skeleton::Name(), Skeleton::JOINT_COUNT,
+           (double)raw.nBytes / (frames.size() * nRound), raw.encodeNs / raw.nPoses, raw.decodeNs / raw.nPoses,
+           (double)compact.nBytes / (frames.size() * nRound), compact.encodeNs / compact.nPoses,
+           compact.decodeNs / compact.nPoses, raw.nLost + compact.nLost);
+}
+
+static void print_result(const char *name, const Codec_Result &result, const Codec_Result &raw, unsigned nFrame)
+{
+    printf("%-10s %10.1f %8.2fx %12.1f %12.1f %10.2f %6u\n", name, (double)result.nBytes / nFrame,
+           (double)raw.nBytes / result.nBytes, result.encodeNs / result.nPoses, result.decodeNs / result.nPoses,
+           result.maxError * 1000.f, result.nLost);
+}
+
+int main(int argc, char *argv[])
+{
+    const char *fileName = argc > 1 ? argv[1] : "skeletons.txt";
+    unsigned nKeyframeInterval = argc > 2 ? atoi(argv[2]) : 25;
+    unsigned nRound = argc > 3 ? atoi(argv[3]) : 20;
+
+    std::vector< std::shared_ptr<Data_MoCap_Send> > frames = load_frames(fileName);
+    if(frames.empty()){
+        std::cout << "No frames in " << fileName << "\n";
+        return 1;
+    }
+
+    std::cout.setstate(std::ios::failbit); // mute the messages of the callbacks
+    mocap_codec_set_keyframe_interval(nKeyframeInterval);
+
+    Codec_Result raw = run_codec<Skeleton_Coco17>(frames, nRound, sendmsg_callback_mocap_server, recvmsg_callback_mocap_client_contentRender);
+    Codec_Result compact = run_codec<Skeleton_Coco17>(frames, nRound, sendmsg_callback_mocap_server_compact, recvmsg_callback_mocap_client_contentRender_compact);
+
+    mocap_codec_set_keyframe_interval(1);
+    Codec_Result intra = run_codec<Skeleton_Coco17>(frames, nRound, sendmsg_callback_mocap_server_compact, recvmsg_callback_mocap_client_contentRender_compact);
+
+    unsigned nFrame = frames.size() * nRound;
+    printf("%u frames x %u rounds, keyframe interval %u\n", (unsigned)frames.size(), nRound, nKeyframeInterval);
+    printf("%-10s %10s %9s %12s %12s %10s %6s\n", "codec", "bytes/frm", "ratio", "enc ns/pose", "dec ns/pose", "max err mm", "lost");
+    print_result("raw", raw, raw, nFrame);
+    print_result("compact", compact, raw, nFrame);
+    print_result("keyonly", intra, raw, nFrame);
+
+    mocap_codec_set_keyframe_interval(nKeyframeInterval);
+    printf("\n%-10s %6s %10s %10s %10s %10s %10s %10s %6s\n", "skeleton", "joints", "raw B/frm", "enc ns", "dec ns",
+           "cmp B/frm", "enc ns", "dec ns", "lost");
+    run_skeleton<Skeleton_Coco17>(frames, nRound);
+    run_skeleton<Skeleton_Body25>(frames, nRound);
+    run_skeleton<Skeleton_Kinect32>(frames, nRound);
+
+    return 0;
+}
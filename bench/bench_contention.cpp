@@ -0,0 +1,167 @@
+// Benchmark of the broadcast of CMoCapTCPServer while many clients are uploading actions (thread-per-client mode).
+// The receiving threads of the server read their connection from a snapshot with no lock, so the sending thread
+// should not be held up by them however fast the actions come. For a sweep of the number of uploading clients, each
+// sending actions at a rate, a few observing clients take the frames and report how late they are from the time they
+// are pushed into the server (p50, p99, p99.9 and max), and the rate of the actions the server gets.
+//
+// Usage: bench_contention [seconds per step] [actions per second of an uploader] [frames per second] [first port]
+
+#include <iostream>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "TCPServer.h"
+#include "TCPClient.h"
+#include "MoCap_Data.h"
+
+using namespace mocap_netop;
+
+typedef CMoCapTCPServer<Data_MoCap_Send, Data_MoCap_Recv> Server;
+typedef CMoCapTCPClient<Data_MoCap_Recv, Data_MoCap_Send> Client;
+
+static const unsigned N_OBSERVER = 4;
+static const unsigned N_PERSON = 8;
+
+// Take the frames of an observer and count how late they are
+static void observe(Client &client, Latency_Histogram &latency, std::atomic_bool &bRun)
+{
+    auto &repos = client.GetClientDataRepos();
+    while(bRun){
+        std::shared_ptr<Data_MoCap_Send> frame = repos.PopData_RecvQueue(std::chrono::milliseconds(10));
+        if(!frame) continue;
+
+        uint64_t now = latency_now_ns();
+        latency.Record(now > frame->timestamp ? now - frame->timestamp : 0);
+    }
+}
+
+// Send actions at a rate, and throw away the frames that come
+static void upload(Client &client, double rate, std::atomic_bool &bRun)
+{
+    auto &repos = client.GetClientDataRepos();
+    std::vector< std::shared_ptr<Data_MoCap_Send> > frames;
+    const double periodNs = 1e9 / rate;
+    const uint64_t tStart = latency_now_ns();
+
+    for(uint64_t i = 0; bRun; i ++){
+        uint64_t tAction = tStart + (uint64_t)(i * periodNs), now = latency_now_ns();
+        if(tAction > now) std::this_thread::sleep_for(std::chrono::nanoseconds(tAction - now));
+
+        frames.clear();
+        repos.PopAllData_RecvQueue(frames);
+
+        std::shared_ptr<Data_MoCap_Recv> result = repos.AcquireData_SendQueue();
+        result->actions.resize(N_PERSON);
+        for(unsigned j = 0; j < N_PERSON; j ++){
+            result->actions[j].poseID = j + 1;
+            result->actions[j].action = (int)((i + j) % 8);
+        }
+        repos.PushData_SendQueue(result);
+    }
+}
+
+// One step of the sweep. Return false if the server or a client cannot start.
+static bool run_step(unsigned nUploader, double seconds, double uploadRate, double fps, unsigned port)
+{
+    std::string address = "127.0.0.1:" + std::to_string(port);
+    Server server(address, 65536, nUploader + N_OBSERVER + 1);
+    if(!server.Start(sendmsg_callback_mocap_server, recvmsg_callback_mocap_server)) return false;
+    Sleep(100);
+
+    std::vector< std::unique_ptr<Client> > observers, uploaders;
+    for(unsigned i = 0; i < N_OBSERVER + nUploader; i ++){
+        std::unique_ptr<Client> client(new Client(address, 65536));
+        bool bConnected = i < N_OBSERVER
+                ? client->Connect(0, recvmsg_callback_mocap_client_contentRender)
+                : client->Connect(sendmsg_callback_mocap_client_actionRecog, recvmsg_callback_mocap_client_actionRecog);
+        if(!bConnected) return false;
+
+        (i < N_OBSERVER ? observers : uploaders).push_back(std::move(client));
+    }
+    Sleep(200); // let the server take all of them
+
+    std::atomic_bool bRun(true);
+    Latency_Histogram latency;
+    std::vector<std::thread> threads;
+    for(auto &client : observers) threads.push_back(std::thread(observe, std::ref(*client), std::ref(latency), std::ref(bRun)));
+    for(auto &client : uploaders) threads.push_back(std::thread(upload, std::ref(*client), uploadRate, std::ref(bRun)));
+    Sleep(200); // the uploads are going
+
+    // the frames at the rate, with the actions that came back since the last one
+    auto &repos = server.GetSeverDataRepos();
+    std::vector< std::shared_ptr<Data_MoCap_Recv> > results;
+    const double periodNs = 1e9 / fps;
+    uint64_t nAction = 0;
+
+    latency.Reset();
+    const uint64_t tStart = latency_now_ns(), tEnd = tStart + (uint64_t)(seconds * 1e9);
+    for(uint64_t i = 0; ; i ++){
+        // a frame at its time, or at once if the producer is behind; a host that cannot keep up sends fewer frames
+        uint64_t tFrame = tStart + (uint64_t)(i * periodNs), now = latency_now_ns();
+        if(tFrame >= tEnd || now >= tEnd) break;
+        if(tFrame > now) std::this_thread::sleep_for(std::chrono::nanoseconds(tFrame - now));
+
+        results.clear();
+        nAction += repos.PopAllData_RecvQueue(results);
+
+        std::shared_ptr<Data_MoCap_Send> frame = repos.AcquireData_SendQueue();
+        frame->poses.resize(N_PERSON);
+        for(unsigned j = 0; j < N_PERSON; j ++){
+            frame->poses[j].ID = j + 1;
+            for(unsigned k = 0; k < JOINT_NUMBER; k ++)
+                frame->poses[j].joints[k].x = frame->poses[j].joints[k].y = frame->poses[j].joints[k].z = (float)(i % 100) * 0.01f + k;
+        }
+        frame->actions.resize(0);
+        frame->timestamp = latency_now_ns();
+        repos.PushData_SendQueue(frame);
+    }
+    double elapsed = (latency_now_ns() - tStart) / 1e9;
+    Sleep(200); // the frames on the way
+
+    bRun = false;
+    for(auto &thread : threads) thread.join();
+    for(auto &client : uploaders) client->Disconnect();
+    for(auto &client : observers) client->Disconnect();
+    server.Stop();
+
+    Latency_Summary summary = latency.GetSummary();
+    printf("%9u %12.0f %9llu %9.1f %9.1f %9.1f %9.1f\n", nUploader, nAction / elapsed, (unsigned long long)summary.nCount,
+           summary.nP50 / 1e3, summary.nP99 / 1e3, summary.nP999 / 1e3, summary.nMax / 1e3);
+    return true;
+}
+
+int main(int argc, char *argv[])
+{
+    double seconds = argc > 1 ? atof(argv[1]) : 3;
+    double uploadRate = argc > 2 ? atof(argv[2]) : 500;
+    double fps = argc > 3 ? atof(argv[3]) : 500;
+    unsigned port = argc > 4 ? (unsigned)atoi(argv[4]) : 5023; // a step on each port from here
+    if(seconds <= 0 || uploadRate <= 0 || fps <= 0){
+        std::cout << "Usage: bench_contention [seconds per step] [actions per second of an uploader] [frames per second] [first port]\n";
+        return 1;
+    }
+
+    setbuf(stdout, NULL);
+
+    // the server and the clients tell of each connection on std::cout, which is kept quiet
+    std::cout.setstate(std::ios::failbit);
+
+    printf("%u observers, %.0f frames/s of %u persons for %.1f s a step, %.0f actions/s per uploader\n",
+           N_OBSERVER, fps, N_PERSON, seconds, uploadRate);
+    printf("%9s %12s %9s %9s %9s %9s %9s\n", "uploaders", "actions/s", "frames", "p50(us)", "p99(us)", "p999(us)", "max(us)");
+
+    const unsigned uploaderCounts[] = {0, 8, 16, 32, 64};
+    for(unsigned nUploader : uploaderCounts){
+        if(!run_step(nUploader, seconds, uploadRate, fps, port ++)){
+            std::cout.clear();
+            std::cout << "Cannot start the server or a client on port " << port - 1 << "\n";
+            return 1;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,154 @@
+// Benchmark of the decoding of the frames on worker threads of a client (CMoCapTCPClient::SetDecodeThreads). The
+// server offers the frames at a rate, and the recv callback of the client takes a while on each one (the decoding of
+// the plain callback and some work on the joints, as a heavier codec would). For a sweep of the number of the workers
+// it reports the frames the client gets per second, how late they are (p50 and p99) and the frames out of order,
+// which should be none. Past the rate the callback can keep up with, the server drops the oldest frames of the client.
+//
+// Usage: bench_decode [microseconds of work per frame] [frames per second] [seconds per step] [first port]
+
+#include <iostream>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "TCPServer.h"
+#include "TCPClient.h"
+#include "MoCap_Data.h"
+
+using namespace mocap_netop;
+
+typedef CMoCapTCPServer<Data_MoCap_Send, Data_MoCap_Recv> Server;
+typedef CMoCapTCPClient<Data_MoCap_Recv, Data_MoCap_Send> Client;
+
+static const unsigned N_PERSON = 50;
+static uint64_t g_nWorkStep = 0; // of work for a frame
+
+// An amount of work that takes the same CPU time on any thread, unlike a wait on the clock. It starts from a volatile
+// so that the compiler cannot work it out.
+static volatile float g_workSeed = 0.5f;
+static float work(uint64_t nStep)
+{
+    float x = g_workSeed;
+    for(uint64_t i = 0; i < nStep; i ++) x = x * 0.999f + 0.25f;
+    return x;
+}
+
+// The steps of work() taking a number of microseconds on this host
+static uint64_t calibrate_work(double us)
+{
+    const uint64_t nStep = 10000000;
+    uint64_t t0 = latency_now_ns();
+    volatile float x = work(nStep);
+    (void)x;
+    uint64_t t = latency_now_ns() - t0;
+    return (uint64_t)(us * 1e3 * nStep / (t > 0 ? t : 1));
+}
+
+// The plain callback, and the work on the frame it has pushed into the repos
+static void recvmsg_callback_heavy(Data_Buffer *pDataBuffer, Data_Repos<Data_MoCap_Recv, Data_MoCap_Send> &repos)
+{
+    recvmsg_callback_mocap_client_contentRender(pDataBuffer, repos);
+
+    volatile float x = work(g_nWorkStep);
+    (void)x;
+}
+
+// One step of the sweep. Return false if the server or the client cannot start.
+static bool run_step(unsigned nWorker, double fps, double seconds, unsigned port)
+{
+    std::string address = "127.0.0.1:" + std::to_string(port);
+    Server server(address, 65536, 2);
+    if(!server.Start(sendmsg_callback_mocap_server, recvmsg_callback_mocap_server)) return false;
+    Sleep(100);
+
+    Client client(address, 65536);
+    client.SetDecodeThreads(nWorker);
+    if(!client.Connect(0, recvmsg_callback_heavy)) return false;
+    Sleep(200);
+
+    // take the frames, and check they come in order
+    std::atomic_bool bRun(true);
+    Latency_Histogram latency;
+    uint64_t nFrame = 0, nDisorder = 0;
+    std::thread consumer([&]{
+        uint64_t lastTimestamp = 0;
+        while(bRun){
+            std::shared_ptr<Data_MoCap_Send> frame = client.GetClientDataRepos().PopData_RecvQueue(std::chrono::milliseconds(10));
+            if(!frame) continue;
+
+            uint64_t now = latency_now_ns();
+            latency.Record(now > frame->timestamp ? now - frame->timestamp : 0);
+            if(frame->timestamp < lastTimestamp) nDisorder ++;
+            lastTimestamp = frame->timestamp;
+            nFrame ++;
+        }
+    });
+
+    auto &repos = server.GetSeverDataRepos();
+    const double periodNs = 1e9 / fps;
+    const uint64_t tStart = latency_now_ns(), tEnd = tStart + (uint64_t)(seconds * 1e9);
+    for(uint64_t i = 0; ; i ++){
+        uint64_t tFrame = tStart + (uint64_t)(i * periodNs), now = latency_now_ns();
+        if(tFrame >= tEnd || now >= tEnd) break;
+        if(tFrame > now) std::this_thread::sleep_for(std::chrono::nanoseconds(tFrame - now));
+
+        std::shared_ptr<Data_MoCap_Send> frame = repos.AcquireData_SendQueue();
+        frame->poses.resize(N_PERSON);
+        for(unsigned j = 0; j < N_PERSON; j ++){
+            frame->poses[j].ID = j + 1;
+            for(unsigned k = 0; k < JOINT_NUMBER; k ++)
+                frame->poses[j].joints[k].x = frame->poses[j].joints[k].y = frame->poses[j].joints[k].z = (float)(i % 100) * 0.01f + k;
+        }
+        frame->actions.resize(0);
+        frame->timestamp = latency_now_ns();
+        repos.PushData_SendQueue(frame);
+    }
+    double elapsed = (latency_now_ns() - tStart) / 1e9;
+    Sleep(300); // the frames on the way
+
+    bRun = false;
+    consumer.join();
+    client.Disconnect();
+    server.Stop();
+
+    Latency_Summary summary = latency.GetSummary();
+    printf("%8u %10.0f %10.1f %10.1f %9llu\n", nWorker, nFrame / elapsed, summary.nP50 / 1e3, summary.nP99 / 1e3,
+           (unsigned long long)nDisorder);
+    return true;
+}
+
+int main(int argc, char *argv[])
+{
+    double workUs = argc > 1 ? atof(argv[1]) : 500;
+    double fps = argc > 2 ? atof(argv[2]) : 4000;
+    double seconds = argc > 3 ? atof(argv[3]) : 3;
+    unsigned port = argc > 4 ? (unsigned)atoi(argv[4]) : 5027; // a step on each port from here
+    if(workUs < 0 || fps <= 0 || seconds <= 0){
+        std::cout << "Usage: bench_decode [microseconds of work per frame] [frames per second] [seconds per step] [first port]\n";
+        return 1;
+    }
+    g_nWorkStep = calibrate_work(workUs);
+
+    setbuf(stdout, NULL);
+
+    // the server and the client tell of each connection on std::cout, which is kept quiet
+    std::cout.setstate(std::ios::failbit);
+
+    printf("%.0f frames/s of %u persons offered, %.0f us of work per frame, %u cores\n", fps, N_PERSON, workUs,
+           std::thread::hardware_concurrency());
+    printf("%8s %10s %10s %10s %9s\n", "workers", "frames/s", "p50(us)", "p99(us)", "disorder");
+
+    const unsigned workerCounts[] = {0, 1, 2, 4, 8};
+    for(unsigned nWorker : workerCounts){
+        if(!run_step(nWorker, fps, seconds, port ++)){
+            std::cout.clear();
+            std::cout << "Cannot start the server or the client on port " << port - 1 << "\n";
+            return 1;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,157 @@
+// Benchmark of the UDP multicast fan-out against the TCP unicast to each client, on one host with loopback multicast.
+// A server streams mocap frames to N render clients, which get them either over their TCP connections or from the
+// multicast group through the loopback interface. The server puts the time it pushes a frame into its timestamp, and
+// each client measures how late the frame comes out of its repos. Reported for each mode: the frames delivered and
+// lost, percentiles of the delivery time over all the clients, and the bytes the server writes per frame.
+//
+// Usage: bench_multicast [clients] [frames] [poses per frame]
+
+#include <iostream>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <algorithm>
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "TCPServer.h"
+#include "TCPClient.h"
+#include "MoCap_Data.h"
+
+using namespace mocap_netop;
+
+typedef CMoCapTCPClient<Data_MoCap_Recv, Data_MoCap_Send> Client;
+
+static uint64_t now_ns()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Size of the entity of a frame as the send callback encodes it
+static size_t entity_size(unsigned nPose)
+{
+    Data_Repos<Data_MoCap_Send, Data_MoCap_Recv> repos;
+    std::shared_ptr<Data_MoCap_Send> frame = repos.AcquireData_SendQueue();
+    frame->poses.resize(nPose);
+    repos.PushData_SendQueue(frame);
+
+    std::vector<char> memory(65536);
+    Data_Buffer data;
+    data.dataHeader.nMaxDataSize = (unsigned)memory.size();
+    data.pData = memory.data();
+    data.pStorage = &memory;
+    sendmsg_callback_mocap_server(&data, repos);
+    return data.dataHeader.nDataSize;
+}
+
+static void run(const char *name, bool bMulticast, unsigned nClient, unsigned nFrame, unsigned nPose, int port)
+{
+    const std::string address = "127.0.0.1:" + std::to_string(port);
+    const std::string group = "239.255.0.1:" + std::to_string(port + 1);
+
+    CMoCapTCPServer<Data_MoCap_Send, Data_MoCap_Recv> server(address, 65536, nClient + 1);
+    server.SetIOMode(ServerIOMode::Reactor);
+    server.SetOverflowPolicy(Overflow_Policy::DropOldest, 1024);
+    if(bMulticast) server.EnableMulticast(group, "127.0.0.1");
+    if(!server.Start(sendmsg_callback_mocap_server, recvmsg_callback_mocap_server)){
+        printf("Cannot start the server on port %d\n", port);
+        return;
+    }
+    Sleep(100);
+
+    std::vector< std::unique_ptr<Client> > clients;
+    for(unsigned i = 0; i < nClient; i ++){
+        clients.emplace_back(new Client(address, 65536));
+        if(bMulticast) clients.back()->EnableMulticast(group, "127.0.0.1");
+        if(!clients.back()->Connect(0, recvmsg_callback_mocap_client_contentRender)){
+            printf("Cannot connect to the server on port %d\n", port);
+            return;
+        }
+    }
+    Sleep(200);
+
+    std::mutex mutexLatency;
+    std::vector<uint64_t> latencies;
+    latencies.reserve((size_t)nClient * nFrame);
+    std::atomic_bool bRun(true);
+
+    std::vector<std::thread> consumers;
+    for(unsigned i = 0; i < nClient; i ++){
+        consumers.emplace_back([&, i](){
+            std::vector<uint64_t> mine;
+            auto &repos = clients[i]->GetClientDataRepos();
+            while(bRun){
+                std::shared_ptr<Data_MoCap_Send> frame = repos.PopData_RecvQueue(std::chrono::milliseconds(10));
+                if(frame) mine.push_back(now_ns() - frame->timestamp);
+            }
+            std::unique_lock<std::mutex> lock(mutexLatency);
+            latencies.insert(latencies.end(), mine.begin(), mine.end());
+        });
+    }
+
+    auto &reposServer = server.GetSeverDataRepos();
+    for(unsigned i = 0; i < nFrame; i ++){
+        std::shared_ptr<Data_MoCap_Send> frame = reposServer.AcquireData_SendQueue();
+        frame->poses.resize(nPose);
+        for(unsigned j = 0; j < nPose; j ++){
+            frame->poses[j].ID = j + 1;
+            for(unsigned k = 0; k < JOINT_NUMBER; k ++){
+                frame->poses[j].joints[k].x = i * 0.001f + k;
+                frame->poses[j].joints[k].y = i * 0.002f + j;
+                frame->poses[j].joints[k].z = i * 0.003f;
+            }
+        }
+        frame->actions.resize(0);
+        frame->timestamp = now_ns();
+        reposServer.PushData_SendQueue(frame);
+
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    Sleep(300);
+    bRun = false;
+    for(auto &consumer : consumers) consumer.join();
+
+    // bytes of a frame on the wire: a header and the entity over TCP, or the datagrams of the message
+    size_t nWireSize = sizeof(Data_Header) + entity_size(nPose);
+    const size_t nPayload = MULTICAST_DATAGRAM_SIZE - sizeof(Multicast_Datagram_Header);
+    size_t nEgress = bMulticast ? nWireSize + (nWireSize + nPayload - 1) / nPayload * sizeof(Multicast_Datagram_Header)
+                                : nWireSize * nClient;
+
+    uint64_t nLost = 0;
+    for(auto &client : clients) nLost += client->GetMulticastLostCount();
+
+    std::sort(latencies.begin(), latencies.end());
+    auto percentile = [&](double p){ return latencies.empty() ? 0.0 : latencies[std::min(latencies.size() - 1, (size_t)(p * latencies.size()))] / 1000.0; };
+
+    printf("%-10s: %u clients x %u frames, delivered %u, lost %llu, p50 %.1f us, p99 %.1f us, max %.1f us, egress ~%u bytes/frame\n",
+           name, nClient, nFrame, (unsigned)latencies.size(), (unsigned long long)nLost, percentile(0.5), percentile(0.99),
+           percentile(1.0), (unsigned)nEgress);
+
+    std::cout.setstate(std::ios::failbit); // mute the messages on stopping
+    for(auto &client : clients) client->Disconnect();
+    server.Stop();
+    std::cout.clear();
+}
+
+int main(int argc, char *argv[])
+{
+    unsigned nClient = argc > 1 ? atoi(argv[1]) : 8;
+    unsigned nFrame = argc > 2 ? atoi(argv[2]) : 2000;
+    unsigned nPose = argc > 3 ? atoi(argv[3]) : 8;
+    setbuf(stdout, NULL);
+    srand((unsigned)time(NULL)); // another port for each run, as the last one may still be held
+
+#ifdef __linux__
+    printf("%u poses per frame\n", nPose);
+    run("tcp", false, nClient, nFrame, nPose, 27500 + 2 * (rand() % 500));
+    run("multicast", true, nClient, nFrame, nPose, 28500 + 2 * (rand() % 500));
+#else
+    printf("The benchmark runs the server in the reactor mode, which is only available on Linux\n");
+#endif
+
+    return 0;
+}
@@ -0,0 +1,144 @@
+// Benchmark of the heap allocations on the send and receive paths in steady state.
+// A server and a client run in the same process over the loopback. The server streams mocap frames taken from the
+// pool of its repos, the client decodes them into frames of its own pool and sends an action back for each of them.
+// Every allocation of the process is counted by a replaced operator new; after a warm-up, the count should stay at 0.
+//
+// Usage: bench_pool [frames] [reactor: 0 or 1]
+
+#include <iostream>
+#include <vector>
+#include <atomic>
+#include <thread>
+#include <new>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "TCPServer.h"
+#include "TCPClient.h"
+#include "MoCap_Data.h"
+
+using namespace mocap_netop;
+
+static std::atomic<uint64_t> g_nAllocation(0);
+
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete" // the replaced operators pair malloc with free
+#endif
+
+void* operator new(size_t nSize)
+{
+    g_nAllocation ++;
+    void *p = malloc(nSize ? nSize : 1);
+    if(p == NULL) throw std::bad_alloc();
+    return p;
+}
+void operator delete(void *p) noexcept { free(p); }
+void operator delete(void *p, size_t) noexcept { free(p); }
+
+static void print_stats(const char *name, const Pool_Stats &stats)
+{
+    printf("  %-14s acquired %8llu  created %4llu  blocks %4llu  free %4u\n", name, (unsigned long long)stats.nAcquired,
+           (unsigned long long)stats.nCreated, (unsigned long long)stats.nBlockCreated, stats.nFree);
+}
+
+// The server produces the frames, the client consumes them and answers with an action
+static void run(unsigned nFrame, bool bReactor, int port)
+{
+    const unsigned nWarmUp = 300, nPose = 8;
+
+    CMoCapTCPServer<Data_MoCap_Send, Data_MoCap_Recv> server("127.0.0.1:" + std::to_string(port), 1024, 5);
+    if(bReactor) server.SetIOMode(ServerIOMode::Reactor);
+    if(!server.Start(sendmsg_callback_mocap_server, recvmsg_callback_mocap_server)){
+        printf("Cannot start the server on port %d\n", port);
+        return;
+    }
+    Sleep(100);
+
+    CMoCapTCPClient<Data_MoCap_Recv, Data_MoCap_Send> client("127.0.0.1:" + std::to_string(port), 1024);
+    if(!client.Connect(sendmsg_callback_mocap_client_actionRecog, recvmsg_callback_mocap_client_contentRender)){
+        printf("Cannot connect to the server on port %d\n", port);
+        return;
+    }
+    Sleep(100);
+
+    auto &reposServer = server.GetSeverDataRepos();
+    auto &reposClient = client.GetClientDataRepos();
+
+    std::atomic<unsigned> nReceived(0), nAction(0);
+    std::atomic_bool bRun(true);
+
+    // the client: take out the frames and send an action for each
+    std::thread consumer([&](){
+        while(bRun){
+            std::shared_ptr<Data_MoCap_Send> frame = reposClient.PopData_RecvQueue(std::chrono::milliseconds(10));
+            if(!frame) continue;
+            nReceived ++;
+
+            std::shared_ptr<Data_MoCap_Recv> action = reposClient.AcquireData_SendQueue();
+            action->actions.resize(1);
+            action->actions[0].poseID = frame->poses.empty() ? 0 : frame->poses[0].ID;
+            action->actions[0].action = (int)frame->timestamp;
+            reposClient.PushData_SendQueue(action);
+        }
+    });
+
+    uint64_t nAllocationStart = 0;
+    for(unsigned i = 0; i < nWarmUp + nFrame; i ++){
+        if(i == nWarmUp) nAllocationStart = g_nAllocation;
+
+        std::shared_ptr<Data_MoCap_Send> frame = reposServer.AcquireData_SendQueue();
+        frame->timestamp = i;
+        frame->poses.resize(nPose);
+        for(unsigned j = 0; j < nPose; j ++){
+            frame->poses[j].ID = j + 1;
+            for(unsigned k = 0; k < JOINT_NUMBER; k ++)
+                frame->poses[j].joints[k].x = frame->poses[j].joints[k].y = frame->poses[j].joints[k].z = i * 0.001f;
+        }
+        frame->actions.resize(0);
+        while(std::shared_ptr<Data_MoCap_Recv> action = reposServer.PopData_RecvQueue()){ // merge the actions of the client
+            frame->actions.resize(action->actions.size());
+            for(size_t j = 0; j < action->actions.size(); j ++){
+                frame->actions[j].poseID = action->actions[j].poseID;
+                frame->actions[j].action = action->actions[j].action;
+            }
+            nAction ++;
+        }
+        reposServer.PushData_SendQueue(frame);
+
+        Sleep(2);
+    }
+    uint64_t nAllocation = g_nAllocation - nAllocationStart;
+
+    Sleep(100);
+    bRun = false;
+    consumer.join();
+
+    printf("%s: %u frames after %u of warm-up, received %u, actions %u\n", bReactor ? "reactor" : "thread-per-client",
+           nFrame, nWarmUp, (unsigned)nReceived, (unsigned)nAction);
+    printf("  heap allocations in steady state: %llu (%.3f per frame)\n", (unsigned long long)nAllocation, (double)nAllocation / nFrame);
+    print_stats("server send", reposServer.GetPoolStats_SendQueue());
+    print_stats("server recv", reposServer.GetPoolStats_RecvQueue());
+    print_stats("client send", reposClient.GetPoolStats_SendQueue());
+    print_stats("client recv", reposClient.GetPoolStats_RecvQueue());
+
+    std::cout.setstate(std::ios::failbit); // mute the messages on stopping
+    client.Disconnect();
+    server.Stop();
+    std::cout.clear();
+}
+
+int main(int argc, char *argv[])
+{
+    unsigned nFrame = argc > 1 ? atoi(argv[1]) : 2000;
+    int reactor = argc > 2 ? atoi(argv[2]) : -1;
+    setbuf(stdout, NULL);
+    srand((unsigned)time(NULL)); // another port for each run, as the last one may still be held
+
+    if(reactor != 1) run(nFrame, false, 23500 + rand() % 1000);
+#ifdef __linux__
+    if(reactor != 0) run(nFrame, true, 24500 + rand() % 1000);
+#endif
+
+    return 0;
+}
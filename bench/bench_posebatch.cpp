@@ -0,0 +1,169 @@
+// Benchmark of the kernels of Pose_Batch for each instruction set.
+// A batch of poses (the frames of skeletons.txt repeated) is unpacked from the wire format, scaled, bounded and packed
+// back again. The array-of-structures loop of the recv callback (a memcpy per pose) is the reference for unpacking.
+// It reports ns per pose and the bandwidth over the bytes of the poses on the wire. The kernels of each level are
+// checked against the scalar ones first: the poses unpacked, packed back, scaled and their boxes should be the same
+// bits, and it exits with 2 if they are not.
+//
+// Usage: bench_posebatch [skeletons file] [poses] [rounds]
+
+#include <iostream>
+#include <vector>
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "PoseBatch.h"
+
+static std::vector<Data_MoCap_Send::Pose> load_poses(const char *fileName, size_t nPose)
+{
+    std::vector<Data_MoCap_Send::Pose> poses;
+
+    FILE *fp = fopen(fileName, "r");
+    if(fp == NULL) return poses;
+
+    unsigned nPoseFrame, nJoint;
+    char line[128];
+    while(poses.size() < nPose){
+        if(fscanf(fp, "%u%u", &nPoseFrame, &nJoint) != 2){
+            if(poses.empty()) break;
+            rewind(fp); // repeat the file
+            continue;
+        }
+        fgets(line, 128, fp); // eat out the line
+
+        for(unsigned j = 0; j < nPoseFrame; j ++){
+            Data_MoCap_Send::Pose pose;
+            pose.ID = poses.size() + 1;
+            for(unsigned k = 0; k < JOINT_NUMBER; k ++)
+                fscanf(fp, "%f%f%f", &pose.joints[k].x, &pose.joints[k].y, &pose.joints[k].z);
+            fgets(line, 128, fp);
+            poses.push_back(pose);
+        }
+    }
+
+    fclose(fp);
+    if(poses.size() > nPose) poses.resize(nPose);
+    return poses;
+}
+
+template<class Func>
+static double time_ns(unsigned nRound, Func func)
+{
+    auto t0 = std::chrono::steady_clock::now();
+    for(unsigned r = 0; r < nRound; r ++) func();
+    return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - t0).count() / nRound;
+}
+
+// The results of the kernels on the poses of the wire
+struct Kernel_Output{
+    std::vector<unsigned long long> ids;
+    std::vector<float> x, y, z; // unpacked
+    std::vector<Pose_Box> boxes;
+    std::vector<char> wire; // packed back, which should be the wire itself
+    std::vector<char> scaled; // packed after scaling
+};
+
+static Kernel_Output run_kernels(const std::vector<char> &wire)
+{
+    Kernel_Output output;
+    Pose_Batch batch;
+    batch.Unpack(wire.data(), wire.size());
+    output.ids = batch.ids;
+    output.x = batch.x;
+    output.y = batch.y;
+    output.z = batch.z;
+    batch.ComputeBoxes(output.boxes);
+    output.wire.resize(batch.WireSize());
+    batch.Pack(output.wire.data());
+    batch.Scale(1.5f);
+    output.scaled.resize(batch.WireSize());
+    batch.Pack(output.scaled.data());
+    return output;
+}
+
+template<class T>
+static bool same_bits(const std::vector<T> &a, const std::vector<T> &b)
+{
+    return a.size() == b.size() && (a.empty() || memcmp(a.data(), b.data(), a.size() * sizeof(T)) == 0);
+}
+
+// Description:
+// The first result of a level that differs from the reference, or 0 if all are the same
+static const char* compare_output(const Kernel_Output &output, const Kernel_Output &reference, const std::vector<char> &wire)
+{
+    if(!same_bits(output.ids, reference.ids) || !same_bits(output.x, reference.x) || !same_bits(output.y, reference.y) ||
+       !same_bits(output.z, reference.z)) return "unpack";
+    if(!same_bits(output.wire, wire)) return "round trip";
+    if(!same_bits(output.scaled, reference.scaled)) return "scale";
+    if(!same_bits(output.boxes, reference.boxes)) return "boxes";
+    return 0;
+}
+
+static float g_sink = 0; // keep the results alive
+
+int main(int argc, char *argv[])
+{
+    const char *fileName = argc > 1 ? argv[1] : "skeletons.txt";
+    size_t nPose = argc > 2 ? atoi(argv[2]) : 4096;
+    unsigned nRound = argc > 3 ? atoi(argv[3]) : 2000;
+
+    std::vector<Data_MoCap_Send::Pose> poses = load_poses(fileName, nPose);
+    if(poses.empty()){
+        std::cout << "No poses in " << fileName << "\n";
+        return 1;
+    }
+    nPose = poses.size();
+
+    Pose_Batch batch;
+    batch.FromPoses(poses);
+    std::vector<char> wire(batch.WireSize());
+    batch.Pack(wire.data());
+    double nWireByte = wire.size();
+
+    printf("%u poses (%.0f KB on the wire) x %u rounds, best level %d\n", (unsigned)nPose, nWireByte / 1024, nRound, (int)posebatch_simd_level());
+    printf("%-8s %14s %14s %14s %14s\n", "level", "unpack", "pack", "scale", "boxes");
+
+    // reference: unpack into the array of structures, as recvmsg_callback_mocap_client_contentRender does
+    std::vector<Data_MoCap_Send::Pose> aos(nPose);
+    double nsAoS = time_ns(nRound, [&](){
+        unsigned n;
+        memcpy(&n, wire.data(), 4);
+        const char *p = wire.data() + 4;
+        for(auto &pose : aos){
+            memcpy(&pose.ID, p, 8);
+            memcpy(pose.joints, p + 8, sizeof(pose.joints));
+            p += 8 + sizeof(pose.joints);
+        }
+        g_sink += aos[n - 1].joints[0].x;
+    });
+    printf("%-8s %7.1f ns/pose %5.1f GB/s\n", "aos", nsAoS / nPose, nWireByte / nsAoS);
+
+    const char *names[] = {"scalar", "sse", "avx2"};
+    std::vector<Pose_Box> boxes;
+    int bestLevel = (int)posebatch_simd_level();
+    posebatch_set_simd_level(Simd_Level::Scalar);
+    const Kernel_Output reference = run_kernels(wire);
+    for(int level = 0; level <= bestLevel; level ++){
+        posebatch_set_simd_level((Simd_Level)level);
+
+        const char *pMismatch = compare_output(run_kernels(wire), reference, wire);
+        if(pMismatch != 0){
+            printf("%-8s %s differs from the scalar kernels\n", names[level], pMismatch);
+            return 2;
+        }
+
+        double nsUnpack = time_ns(nRound, [&](){ batch.Unpack(wire.data(), wire.size()); g_sink += batch.x[0]; });
+        double nsPack = time_ns(nRound, [&](){ batch.Pack(wire.data()); g_sink += wire[5]; });
+        double nsScale = time_ns(nRound, [&](){ batch.Scale(1.0001f); g_sink += batch.x[0]; });
+        double nsBox = time_ns(nRound, [&](){ batch.ComputeBoxes(boxes); g_sink += boxes[0].minX; });
+
+        printf("%-8s %7.1f ns/pose %7.1f ns/pose %7.1f ns/pose %7.1f ns/pose\n", names[level],
+               nsUnpack / nPose, nsPack / nPose, nsScale / nPose, nsBox / nPose);
+        printf("%-8s %9.1f GB/s %9.1f GB/s %9.1f GB/s %9.1f GB/s\n", "", nWireByte / nsUnpack, nWireByte / nsPack,
+               2 * nWireByte / nsScale, nWireByte / nsBox);
+    }
+
+    return g_sink == 12345.f;
+}
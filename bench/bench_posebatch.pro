@@ -0,0 +1,23 @@
+QT -= gui
+
+CONFIG += c++11 console
+CONFIG -= app_bundle
+
+TARGET = bench_posebatch
+INCLUDEPATH += ..
+
+SOURCES += \
+        bench_posebatch.cpp \
+        ../MoCap_Data.cpp \
+        ../PoseBatch.cpp
+
+unix: LIBS += -lpthread
+
+HEADERS += \
+    ../LatencyTrace.h \
+    ../MoCap_Codec.h \
+    ../MoCap_Data.h \
+    ../NetOp.h \
+    ../PoseBatch.h \
+    ../Skeleton.h \
+    ../Subscription.h
@@ -0,0 +1,146 @@
+// Benchmark of the IO modes of CMoCapTCPServer (Linux).
+// For 1, 10 and 200 connected clients, it reports the CPU used by an idle server and the latency from a client's
+// send() to the server's receive callback.
+//
+// Usage: bench_reactor [port]
+
+#include <iostream>
+#include <vector>
+#include <algorithm>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <sys/resource.h>
+
+#include "TCPServer.h"
+
+using namespace mocap_netop;
+
+// The message uploaded by the clients: the time when it is sent
+struct Bench_Msg{
+    uint64_t sendTime;
+};
+
+static uint64_t now_ns()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static double cpu_seconds()
+{
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) * 1e-6;
+}
+
+static std::mutex g_mutexLatency;
+static std::vector<uint64_t> g_latency;
+
+void recvmsg_callback_bench(Data_Buffer* pDataBuffer, Data_Repos<Bench_Msg, Bench_Msg> &)
+{
+    Bench_Msg msg;
+    memcpy(&msg, pDataBuffer->pData, sizeof(msg));
+
+    uint64_t t = now_ns();
+
+    std::unique_lock<std::mutex> lock(g_mutexLatency);
+    g_latency.push_back(t - msg.sendTime);
+}
+
+static SOCKET connect_client(int port)
+{
+    SOCKET fd = socket(AF_INET, SOCK_STREAM, 0);
+
+    struct sockaddr_in serv_addr;
+    memset(&serv_addr, 0, sizeof(serv_addr));
+    serv_addr.sin_family = AF_INET;
+    serv_addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+    serv_addr.sin_port = htons(port);
+
+    if(connect(fd, (struct sockaddr *) &serv_addr, sizeof(serv_addr)) < 0){
+        closesocket(fd);
+        return INVALID_SOCKET;
+    }
+
+    return fd;
+}
+
+static void run(ServerIOMode mode, unsigned nClient, int port)
+{
+    CMoCapTCPServer<Bench_Msg, Bench_Msg> server("127.0.0.1:" + std::to_string(port), 1024, nClient);
+    server.SetIOMode(mode);
+    if(!server.Start(0, recvmsg_callback_bench)){
+        std::cout << "Fail to start the server on port " << port << "\n";
+        return;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(100)); // the listening thread calls listen() itself
+
+    std::vector<SOCKET> clients;
+    for(unsigned i = 0; i < nClient; i ++){
+        SOCKET fd = connect_client(port);
+        if(fd != INVALID_SOCKET) clients.push_back(fd);
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(200)); // let the server accept all of them
+    if(clients.empty()){
+        std::cout << "No client is connected to the server on port " << port << "\n";
+        return;
+    }
+
+    // 1. CPU of the idle server
+    double cpu0 = cpu_seconds();
+    auto t0 = std::chrono::steady_clock::now();
+    std::this_thread::sleep_for(std::chrono::seconds(1));
+    double idleCPU = (cpu_seconds() - cpu0) / std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+
+    // 2. Receive latency: the clients upload messages in turn
+    g_latency.clear();
+    const unsigned nMsg = 500;
+    for(unsigned i = 0; i < nMsg; i ++){
+        char packet[sizeof(Data_Header) + sizeof(Bench_Msg)];
+        Data_Header header = Data_Header();
+        strcpy(header.data_name, "mocap");
+        header.nDataSize = sizeof(Bench_Msg);
+
+        Bench_Msg msg;
+        msg.sendTime = now_ns();
+
+        memcpy(packet, &header, sizeof(header));
+        memcpy(packet + sizeof(header), &msg, sizeof(msg));
+        send(clients[i % clients.size()], packet, sizeof(packet), MSG_NOSIGNAL);
+
+        std::this_thread::sleep_for(std::chrono::microseconds(500));
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+    server.Stop();
+    for(SOCKET fd : clients) closesocket(fd);
+
+    std::vector<uint64_t> latency;
+    {
+        std::unique_lock<std::mutex> lock(g_mutexLatency);
+        latency.swap(g_latency);
+    }
+    std::sort(latency.begin(), latency.end());
+
+    auto percentile = [&](double p) -> double {
+        if(latency.empty()) return 0;
+        return latency[std::min(latency.size() - 1, (size_t)(p * latency.size()))] * 1e-3;
+    };
+
+    printf("%-16s clients=%4u connected=%4zu idle_cpu=%6.1f%%  recv_latency_us p50=%8.1f p99=%8.1f max=%8.1f  (%zu/%u msgs)\n",
+           mode == ServerIOMode::Reactor ? "reactor" : "thread-per-client", nClient, clients.size(), idleCPU * 100,
+           percentile(0.5), percentile(0.99), percentile(1.0), latency.size(), nMsg);
+}
+
+int main(int argc, char *argv[])
+{
+    setbuf(stdout, NULL);
+    int port = argc > 1 ? atoi(argv[1]) : 5100;
+
+    for(unsigned nClient : {1u, 10u, 200u}){
+        run(ServerIOMode::ThreadPerClient, nClient, port++);
+        run(ServerIOMode::Reactor, nClient, port++);
+    }
+
+    return 0;
+}
@@ -0,0 +1,125 @@
+// Microbenchmark of the data repos: the mutex-based Data_Repos against Data_Repos_LockFree.
+// 1, 2 and 4 producer threads push into the send queue while a consumer pops from it. It reports the throughput
+// and the latency from a push to the pop of the same data. Both queues hold QUEUE_CAPACITY data at most: a producer
+// waits while that many are in the queue, as it does at a full lock-free queue. Otherwise the producers of the
+// unbounded Data_Repos run ahead of the consumer, and the latency is how deep the backlog grows rather than what the
+// queue costs.
+//
+// Usage: bench_repos [number of data per producer]
+
+#include <iostream>
+#include <vector>
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include <atomic>
+#include <memory>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "NetOp.h"
+#include "LockFreeRepos.h"
+
+using namespace mocap_netop;
+
+static const unsigned QUEUE_CAPACITY = 4096;
+
+struct Bench_Item{
+    uint64_t pushTime;
+};
+
+static uint64_t now_ns()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Push into the repos until it accepts the data
+static void push_send(Data_Repos<Bench_Item, Bench_Item> &repos, const std::shared_ptr<Bench_Item> &item)
+{
+    repos.PushData_SendQueue(item);
+}
+static void push_send(Data_Repos_LockFree<Bench_Item, Bench_Item> &repos, const std::shared_ptr<Bench_Item> &item)
+{
+    while(repos.PushData_SendQueue(item) == Queue_Result::Full){
+        std::this_thread::yield();
+    }
+}
+
+template<class Repos>
+static void run(const char *name, Repos &repos, unsigned nProducer, unsigned nItemPerProducer)
+{
+    // the data are created beforehand, so only the queue operations are measured
+    std::vector< std::vector< std::shared_ptr<Bench_Item> > > items(nProducer);
+    for(auto &producerItems : items){
+        for(unsigned i = 0; i < nItemPerProducer; i ++){
+            producerItems.push_back(std::make_shared<Bench_Item>());
+        }
+    }
+
+    unsigned nTotal = nProducer * nItemPerProducer;
+    std::vector<uint64_t> latency;
+    latency.reserve(nTotal);
+
+    std::atomic_bool bGo(false);
+    std::atomic<unsigned> nInQueue(0); // the same bound for both queues
+    std::vector<std::thread> producers;
+    for(unsigned p = 0; p < nProducer; p ++){
+        producers.push_back(std::thread([&, p]{
+            while(!bGo) std::this_thread::yield();
+
+            for(auto &item : items[p]){
+                while(nInQueue.fetch_add(1) >= QUEUE_CAPACITY){
+                    nInQueue.fetch_sub(1);
+                    std::this_thread::yield();
+                }
+                item->pushTime = now_ns();
+                push_send(repos, item);
+            }
+        }));
+    }
+
+    auto t0 = std::chrono::steady_clock::now();
+    bGo = true;
+
+    unsigned nPop = 0;
+    while(nPop < nTotal){
+        auto item = repos.PopData_SendQueue();
+        if(item){
+            latency.push_back(now_ns() - item->pushTime);
+            nInQueue.fetch_sub(1);
+            nPop ++;
+        }
+        else{
+            std::this_thread::yield();
+        }
+    }
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    for(auto &t : producers) t.join();
+
+    std::sort(latency.begin(), latency.end());
+    auto percentile = [&](double p) -> double {
+        return latency[std::min(latency.size() - 1, (size_t)(p * latency.size()))] * 1e-3;
+    };
+
+    printf("%-10s producers=%u  %8.2f Mops/s  latency_us p50=%8.2f p99=%8.2f p999=%9.2f max=%9.2f\n",
+           name, nProducer, nTotal / seconds * 1e-6, percentile(0.5), percentile(0.99), percentile(0.999), percentile(1.0));
+}
+
+int main(int argc, char *argv[])
+{
+    unsigned nItemPerProducer = argc > 1 ? atoi(argv[1]) : 200000;
+
+    for(unsigned nProducer : {1u, 2u, 4u}){
+        {
+            Data_Repos<Bench_Item, Bench_Item> repos;
+            run("mutex", repos, nProducer, nItemPerProducer);
+        }
+        {
+            Data_Repos_LockFree<Bench_Item, Bench_Item> repos(QUEUE_CAPACITY, 16);
+            run("lock-free", repos, nProducer, nItemPerProducer);
+        }
+    }
+
+    return 0;
+}
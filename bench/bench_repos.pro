@@ -0,0 +1,17 @@
+QT -= gui
+
+CONFIG += c++11 console
+CONFIG -= app_bundle
+
+TARGET = bench_repos
+INCLUDEPATH += ..
+
+SOURCES += \
+        bench_repos.cpp
+
+unix: LIBS += -lpthread
+
+HEADERS += \
+    ../LatencyTrace.h \
+    ../LockFreeRepos.h \
+    ../NetOp.h
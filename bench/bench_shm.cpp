@@ -0,0 +1,148 @@
+// Benchmark of the shared-memory ring against the TCP loopback for a client on the same host.
+// A server streams mocap frames to one client, which connects either with "ip:port" or with "shm://name". The server
+// puts the time it pushes a frame into its timestamp, and the client measures how late the frame comes out of its repos:
+//   - latency   : one frame every 1 ms, percentiles of the delivery time
+//   - throughput: frames pushed as fast as possible, frames per second delivered and the frames lost on the way
+//
+// Usage: bench_shm [frames] [poses per frame]
+
+#include <iostream>
+#include <vector>
+#include <atomic>
+#include <thread>
+#include <algorithm>
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "TCPServer.h"
+#include "TCPClient.h"
+#include "MoCap_Data.h"
+
+using namespace mocap_netop;
+
+static uint64_t now_ns()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static void fill_frame(Data_MoCap_Send &frame, unsigned i, unsigned nPose)
+{
+    frame.poses.resize(nPose);
+    for(unsigned j = 0; j < nPose; j ++){
+        frame.poses[j].ID = j + 1;
+        for(unsigned k = 0; k < JOINT_NUMBER; k ++){
+            frame.poses[j].joints[k].x = i * 0.001f + k;
+            frame.poses[j].joints[k].y = i * 0.002f + j;
+            frame.poses[j].joints[k].z = i * 0.003f;
+        }
+    }
+    frame.actions.resize(0);
+}
+
+static void run(const char *name, bool bShm, unsigned nFrame, unsigned nPose, int port)
+{
+    const std::string address = "127.0.0.1:" + std::to_string(port);
+    const std::string shmName = "mocap_bench_" + std::to_string(port);
+
+    CMoCapTCPServer<Data_MoCap_Send, Data_MoCap_Recv> server(address, 65536, 5);
+    server.SetOverflowPolicy(Overflow_Policy::DropOldest, 1024);
+    if(bShm) server.EnableSharedMemory(shmName, 1024);
+    if(!server.Start(sendmsg_callback_mocap_server, recvmsg_callback_mocap_server)){
+        printf("Cannot start the server on port %d\n", port);
+        return;
+    }
+    Sleep(100);
+
+    CMoCapTCPClient<Data_MoCap_Recv, Data_MoCap_Send> client(bShm ? "shm://" + shmName : address, 65536);
+    if(!client.Connect(0, recvmsg_callback_mocap_client_contentRender)){
+        printf("Cannot connect to the server on port %d\n", port);
+        return;
+    }
+    Sleep(100);
+
+    auto &reposServer = server.GetSeverDataRepos();
+    auto &reposClient = client.GetClientDataRepos();
+
+    std::vector<uint64_t> latencies;
+    latencies.reserve(nFrame);
+    std::atomic<unsigned> nReceived(0);
+    std::atomic<uint64_t> lastArrival(0);
+    std::atomic_bool bRun(true), bRecord(false);
+
+    std::thread consumer([&](){
+        while(bRun){
+            std::shared_ptr<Data_MoCap_Send> frame = reposClient.PopData_RecvQueue(std::chrono::milliseconds(10));
+            if(!frame) continue;
+
+            uint64_t t = now_ns();
+            if(bRecord) latencies.push_back(t - frame->timestamp);
+            nReceived ++;
+            lastArrival = t;
+        }
+    });
+
+    auto push = [&](unsigned i){
+        std::shared_ptr<Data_MoCap_Send> frame = reposServer.AcquireData_SendQueue();
+        fill_frame(*frame, i, nPose);
+        frame->timestamp = now_ns();
+        reposServer.PushData_SendQueue(frame);
+    };
+
+    // 1. latency: paced frames
+    bRecord = true;
+    for(unsigned i = 0; i < nFrame; i ++){
+        push(i);
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    Sleep(200);
+    bRecord = false;
+
+    std::vector<uint64_t> sorted = latencies;
+    std::sort(sorted.begin(), sorted.end());
+    auto percentile = [&](double p){ return sorted.empty() ? 0.0 : sorted[std::min(sorted.size() - 1, (size_t)(p * sorted.size()))] / 1000.0; };
+
+    printf("%-12s latency    : %u frames, received %u, p50 %.1f us, p99 %.1f us, p99.9 %.1f us, max %.1f us\n", name,
+           nFrame, (unsigned)sorted.size(), percentile(0.5), percentile(0.99), percentile(0.999), percentile(1.0));
+
+    // 2. throughput: frames as fast as the server can take them
+    const unsigned nBurst = nFrame * 20;
+    unsigned nStart = nReceived;
+    uint64_t tStart = now_ns();
+    for(unsigned i = 0; i < nBurst; i ++){
+        push(i);
+        if((i & 63) == 63) std::this_thread::yield(); // let the sending thread keep up with the repos
+    }
+    Sleep(500);
+    unsigned nDelivered = nReceived - nStart;
+    double seconds = (lastArrival - tStart) / 1e9;
+
+    printf("%-12s throughput : %u frames pushed, delivered %u (%.0f frames/s)", name, nBurst, nDelivered, nDelivered / seconds);
+    if(bShm) printf(", chunks lost by the reader %llu", (unsigned long long)client.GetSharedMemoryLostCount());
+    printf("\n");
+
+    bRun = false;
+    consumer.join();
+
+    std::cout.setstate(std::ios::failbit); // mute the messages on stopping
+    client.Disconnect();
+    server.Stop();
+    std::cout.clear();
+}
+
+int main(int argc, char *argv[])
+{
+    unsigned nFrame = argc > 1 ? atoi(argv[1]) : 2000;
+    unsigned nPose = argc > 2 ? atoi(argv[2]) : 8;
+    setbuf(stdout, NULL);
+    srand((unsigned)time(NULL)); // another port for each run, as the last one may still be held
+
+    printf("%u poses per frame\n", nPose);
+    run("tcp loopback", false, nFrame, nPose, 25500 + rand() % 1000);
+#ifdef __linux__
+    run("shm ring", true, nFrame, nPose, 26500 + rand() % 1000);
+#endif
+
+    return 0;
+}
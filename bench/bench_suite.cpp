@@ -0,0 +1,480 @@
+// Microbenchmark suite of the hot paths without the sockets: the serialization callbacks of the mocap data and the
+// projection of a frame for a subscription, the push and pop of Data_Repos under contention, and the framing of the messages (sealing a Wire_Frame and reassembling it
+// with a Frame_Assembler). The callbacks are run with 1 to 100 poses per frame and with and without actions.
+// For each case it reports the nanoseconds per frame (the median of several samples, and the interquartile range of
+// the samples relative to it), the bytes per second of the encoded data and the heap allocations per frame, counted by a replaced
+// operator new. The frames are generated from a fixed seed and each sample runs for a fixed time, so the numbers of
+// two builds on the same machine can be compared, e.g., by keeping the --csv output of each build.
+//
+// Usage: bench_suite [--csv] [--samples N] [--ms milliseconds per sample] [filter: only the cases whose name has it]
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include <atomic>
+#include <memory>
+#include <new>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "NetOp.h"
+#include "MoCap_Data.h"
+
+using namespace mocap_netop;
+
+static std::atomic<uint64_t> g_nAllocation(0);
+
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete" // the replaced operators pair malloc with free
+#endif
+
+void* operator new(size_t nSize)
+{
+    g_nAllocation.fetch_add(1, std::memory_order_relaxed);
+    void *p = malloc(nSize ? nSize : 1);
+    if(p == NULL) throw std::bad_alloc();
+    return p;
+}
+void operator delete(void *p) noexcept { free(p); }
+void operator delete(void *p, size_t) noexcept { free(p); }
+
+static uint64_t now_ns()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+struct Suite_Options{
+    bool bCsv = false;
+    unsigned nSample = 9;
+    unsigned nSampleMs = 20;
+    std::string filter;
+};
+static Suite_Options g_options;
+
+struct Case_Result{
+    double ns = 0; // median of the samples, per frame
+    double spread = 0; // interquartile range of the samples, relative to the median
+    double bytesPerFrame = 0;
+    double allocPerFrame = 0;
+};
+
+static void print_header()
+{
+    if(g_options.bCsv)
+        printf("case,poses,actions,ns_per_frame,spread_pct,mb_per_s,allocs_per_frame\n");
+    else
+        printf("%-26s %6s %7s %12s %8s %10s %12s\n", "case", "poses", "actions", "ns/frame", "spread", "MB/s", "allocs/frame");
+}
+
+static void print_result(const char *name, unsigned nPose, unsigned nAction, const Case_Result &result)
+{
+    double mbPerSecond = result.ns > 0 ? result.bytesPerFrame / result.ns * 1e3 : 0; // bytes per ns = GB/s
+
+    if(g_options.bCsv){
+        printf("%s,%u,%u,%.1f,%.2f,%.1f,%.3f\n", name, nPose, nAction, result.ns, result.spread * 100, mbPerSecond, result.allocPerFrame);
+        return;
+    }
+
+    char bandwidth[32] = "-";
+    if(result.bytesPerFrame > 0) snprintf(bandwidth, sizeof(bandwidth), "%.1f", mbPerSecond);
+    printf("%-26s %6u %7u %12.1f %7.1f%% %10s %12.3f\n", name, nPose, nAction, result.ns, result.spread * 100, bandwidth, result.allocPerFrame);
+}
+
+static bool selected(const std::string &name)
+{
+    return g_options.filter.empty() || name.find(g_options.filter) != std::string::npos;
+}
+
+// Median and spread of the samples, which are sorted
+static void summarize(const std::vector<double> &samples, Case_Result &result)
+{
+    result.ns = samples[samples.size() / 2];
+    result.spread = (samples[samples.size() * 3 / 4] - samples[samples.size() / 4]) / result.ns;
+}
+
+// Time op(i) for i = 0, 1, ...: a warm-up, a calibration of the number of calls that takes a sample of the given
+// time, and then the samples. op(i) handles one frame.
+template<typename Op>
+static Case_Result measure(Op op, double bytesPerFrame)
+{
+    uint64_t i = 0;
+
+    // warm up the caches and the pools, and find how many calls make a sample
+    uint64_t nCall = 1;
+    for(;;){
+        uint64_t t0 = now_ns();
+        for(uint64_t n = 0; n < nCall; n ++) op(i++);
+        uint64_t t = now_ns() - t0;
+        if(t >= g_options.nSampleMs * 1000000ull / 4) {
+            nCall = std::max<uint64_t>(1, nCall * g_options.nSampleMs * 1000000ull / std::max<uint64_t>(t, 1));
+            break;
+        }
+        nCall *= 2;
+    }
+
+    std::vector<double> samples;
+    samples.reserve(g_options.nSample);
+    uint64_t nAllocation = g_nAllocation.load();
+    for(unsigned s = 0; s < g_options.nSample; s ++){
+        uint64_t t0 = now_ns();
+        for(uint64_t n = 0; n < nCall; n ++) op(i++);
+        samples.push_back((double)(now_ns() - t0) / nCall);
+    }
+    nAllocation = g_nAllocation.load() - nAllocation;
+    std::sort(samples.begin(), samples.end());
+
+    Case_Result result;
+    summarize(samples, result);
+    result.bytesPerFrame = bytesPerFrame;
+    result.allocPerFrame = (double)nAllocation / ((double)nCall * g_options.nSample);
+    return result;
+}
+
+////////////////////////////////////////////////////////////////
+/// Input data
+///
+
+// Frame i of nPose skeletons walking on a plane, the first nAction of which have an action. The skeletons are laid
+// out from a fixed seed and move a little from a frame to the next, as the compact codec expects.
+static std::shared_ptr<Data_MoCap_Send> make_frame(unsigned i, unsigned nPose, unsigned nAction)
+{
+    uint32_t state = 2463534242u;
+    auto random = [&state](){ // xorshift, in [0, 1)
+        state ^= state << 13; state ^= state >> 17; state ^= state << 5;
+        return (state >> 8) / 16777216.f;
+    };
+
+    std::shared_ptr<Data_MoCap_Send> frame = std::make_shared<Data_MoCap_Send>();
+    frame->timestamp = 1000000 + i * 33333;
+    frame->poses.resize(nPose);
+    for(unsigned j = 0; j < nPose; j ++){
+        frame->poses[j].ID = 1000 + j;
+        float x = random() * 10 + i * 0.01f, z = random() * 10 + i * 0.005f;
+        for(unsigned k = 0; k < JOINT_NUMBER; k ++){
+            float sway = 0.02f * (float)((i * 7 + j * 3 + k) % 11) / 11;
+            frame->poses[j].joints[k].x = x + (random() - 0.5f) * 0.6f + sway;
+            frame->poses[j].joints[k].y = 0.9f + (random() - 0.5f) * 1.6f;
+            frame->poses[j].joints[k].z = z + (random() - 0.5f) * 0.6f - sway;
+        }
+    }
+
+    frame->actions.resize(std::min(nAction, nPose));
+    for(unsigned j = 0; j < frame->actions.size(); j ++){
+        frame->actions[j].poseID = 1000 + j;
+        frame->actions[j].action = (int)((i / 30 + j) % 8);
+    }
+    return frame;
+}
+
+// An encoded message: its header and entity
+struct Encoded_Message{
+    Data_Header header;
+    std::vector<char> entity;
+};
+
+template<typename Send, typename Recv>
+static Encoded_Message encode(void (*sendCallback)(Data_Buffer*, Data_Repos<Send, Recv>&), Data_Repos<Send, Recv> &repos,
+                              const std::shared_ptr<Send> &data)
+{
+    std::vector<char> storage(1024);
+    Data_Buffer buffer;
+    buffer.pStorage = &storage;
+    buffer.pData = storage.data();
+    buffer.dataHeader.nMaxDataSize = storage.size();
+
+    repos.PushData_SendQueue(data);
+    sendCallback(&buffer, repos);
+
+    Encoded_Message message;
+    message.header = buffer.dataHeader;
+    message.entity.assign(storage.begin(), storage.begin() + buffer.dataHeader.nDataSize);
+    return message;
+}
+
+typedef void (*Server_Send_Callback)(Data_Buffer*, Data_Repos<Data_MoCap_Send, Data_MoCap_Recv>&);
+typedef void (*Client_Recv_Callback)(Data_Buffer*, Data_Repos<Data_MoCap_Recv, Data_MoCap_Send>&);
+
+// Frames cycled through in a case, so the branches do not learn one of them. The compact codec needs a stream whose
+// length is a multiple of the keyframe interval, so that the decoder can go on from the last frame to the first.
+static const unsigned N_FRAME_VARIANT = 16;
+static const unsigned N_COMPACT_STREAM = 250, N_COMPACT_KEYFRAME_INTERVAL = 25;
+
+// A server send callback: a frame is pushed to the repos and the callback pops and encodes it
+static void bench_server_send(const char *name, Server_Send_Callback sendCallback, unsigned nFrame, unsigned nPose, unsigned nAction)
+{
+    std::vector< std::shared_ptr<Data_MoCap_Send> > frames;
+    for(unsigned i = 0; i < nFrame; i ++) frames.push_back(make_frame(i, nPose, nAction));
+
+    // bytes of the encoded frames on average
+    double nBytes = 0;
+    {
+        Data_Repos<Data_MoCap_Send, Data_MoCap_Recv> repos;
+        for(const auto &frame : frames) nBytes += encode(sendCallback, repos, frame).entity.size();
+        nBytes /= nFrame;
+    }
+
+    Data_Repos<Data_MoCap_Send, Data_MoCap_Recv> repos;
+    std::vector<char> storage(1024);
+    Data_Buffer buffer;
+    buffer.pStorage = &storage;
+    buffer.pData = storage.data();
+    buffer.dataHeader.nMaxDataSize = storage.size();
+
+    Case_Result result = measure([&](uint64_t i){
+        repos.PushData_SendQueue(frames[i % nFrame]);
+        buffer.dataHeader.nDataSize = 0;
+        sendCallback(&buffer, repos);
+    }, nBytes);
+    print_result(name, nPose, nAction, result);
+}
+
+// A client receive callback: a frame encoded by the server send callback is decoded into the repos and popped by the consumer
+static void bench_client_recv(const char *name, Server_Send_Callback sendCallback, Client_Recv_Callback recvCallback,
+                              unsigned nFrame, unsigned nPose, unsigned nAction)
+{
+    Data_Repos<Data_MoCap_Send, Data_MoCap_Recv> reposServer;
+    std::vector<Encoded_Message> messages;
+    double nBytes = 0;
+    for(unsigned i = 0; i < nFrame; i ++){
+        messages.push_back(encode(sendCallback, reposServer, make_frame(i, nPose, nAction)));
+        nBytes += messages.back().entity.size();
+    }
+    nBytes /= nFrame;
+
+    Data_Repos<Data_MoCap_Recv, Data_MoCap_Send> repos;
+    Case_Result result = measure([&](uint64_t i){
+        Encoded_Message &message = messages[i % nFrame];
+        Data_Buffer buffer;
+        buffer.dataHeader = message.header;
+        buffer.pData = message.entity.data();
+        recvCallback(&buffer, repos);
+        if(!repos.PopData_RecvQueue()){
+            printf("%s lost a frame\n", name);
+            exit(1);
+        }
+    }, nBytes);
+    print_result(name, nPose, nAction, result);
+}
+
+// The projection of a frame for a subscribed client (project_callback_mocap_server): a quarter of the poses, the
+// joints of the upper body and no actions
+static void bench_project(unsigned nPose, unsigned nAction)
+{
+    Data_Repos<Data_MoCap_Send, Data_MoCap_Recv> reposServer;
+    std::vector<Encoded_Message> messages;
+    for(unsigned i = 0; i < N_FRAME_VARIANT; i ++)
+        messages.push_back(encode(sendmsg_callback_mocap_server, reposServer, make_frame(i, nPose, nAction)));
+
+    Stream_Subscription subscription;
+    for(unsigned j = 0; j < nPose; j += 4) subscription.poseIDs.push_back(1000 + j);
+    subscription.jointMask = 0x7FF; // the head, the shoulders, the elbows and the wrists
+    subscription.bActions = false;
+
+    std::vector<char> storage(1024);
+    Data_Buffer projected;
+    projected.pStorage = &storage;
+    projected.pData = storage.data();
+    projected.dataHeader.nMaxDataSize = storage.size();
+
+    auto project = [&](uint64_t i){
+        Encoded_Message &message = messages[i % N_FRAME_VARIANT];
+        Data_Buffer frame;
+        frame.dataHeader = message.header;
+        frame.pData = message.entity.data();
+        projected.dataHeader.nDataSize = 0;
+        project_callback_mocap_server(frame, subscription, &projected);
+    };
+    project(0);
+
+    Case_Result result = measure(project, (double)projected.dataHeader.nDataSize);
+    print_result("project", nPose, nAction, result);
+}
+
+// The actions of a client: sendmsg_callback_mocap_client_actionRecog and recvmsg_callback_mocap_server
+static void bench_actions(unsigned nAction)
+{
+    std::vector< std::shared_ptr<Data_MoCap_Recv> > actions;
+    for(unsigned i = 0; i < N_FRAME_VARIANT; i ++){
+        std::shared_ptr<Data_MoCap_Send> frame = make_frame(i, nAction, nAction);
+        actions.push_back(std::make_shared<Data_MoCap_Recv>());
+        for(const auto &action : frame->actions) actions.back()->actions.push_back({action.poseID, action.action});
+    }
+
+    Data_Repos<Data_MoCap_Recv, Data_MoCap_Send> reposClient;
+    std::vector<Encoded_Message> messages;
+    for(const auto &action : actions)
+        messages.push_back(encode(sendmsg_callback_mocap_client_actionRecog, reposClient, action));
+    double nBytes = messages[0].entity.size();
+
+    if(selected("client_send_actionRecog")){
+        std::vector<char> storage(1024);
+        Data_Buffer buffer;
+        buffer.pStorage = &storage;
+        buffer.pData = storage.data();
+        buffer.dataHeader.nMaxDataSize = storage.size();
+
+        Case_Result result = measure([&](uint64_t i){
+            reposClient.PushData_SendQueue(actions[i % N_FRAME_VARIANT]);
+            buffer.dataHeader.nDataSize = 0;
+            sendmsg_callback_mocap_client_actionRecog(&buffer, reposClient);
+        }, nBytes);
+        print_result("client_send_actionRecog", 0, nAction, result);
+    }
+
+    if(selected("server_recv")){
+        Data_Repos<Data_MoCap_Send, Data_MoCap_Recv> reposServer;
+        Case_Result result = measure([&](uint64_t i){
+            Encoded_Message &message = messages[i % N_FRAME_VARIANT];
+            Data_Buffer buffer;
+            buffer.dataHeader = message.header;
+            buffer.pData = message.entity.data();
+            recvmsg_callback_mocap_server(&buffer, reposServer);
+            reposServer.PopData_RecvQueue();
+        }, nBytes);
+        print_result("server_recv", 0, nAction, result);
+    }
+}
+
+// The framing of an encoded frame: Wire_Frame::Seal() and GetSegments() on the sending side, and Frame_Assembler
+// Feed() and Next() on the receiving side. A frame larger than the chunk size goes in several chunks.
+static void bench_framing(unsigned nPose, unsigned nAction)
+{
+    const unsigned nMaxChunkSize = 16384;
+
+    Data_Repos<Data_MoCap_Send, Data_MoCap_Recv> repos;
+    Encoded_Message message = encode(sendmsg_callback_mocap_server, repos, make_frame(0, nPose, nAction));
+
+    Wire_Frame frame;
+    frame.entity = message.entity;
+    Frame_Assembler assembler(nMaxChunkSize);
+    std::vector<Wire_Segment> segments;
+
+    frame.Seal(message.header, nMaxChunkSize);
+    double nWireSize = frame.nWireSize;
+
+    Case_Result result = measure([&](uint64_t){
+        frame.Seal(message.header, nMaxChunkSize);
+        segments.resize(2 * frame.headers.size());
+        unsigned nSegment = frame.GetSegments(0, segments.data(), segments.size());
+        for(unsigned i = 0; i < nSegment; i ++) assembler.Feed(segments[i].pData, segments[i].nSize);
+
+        Data_Buffer msg;
+        if(assembler.Next(msg) != 1 || msg.dataHeader.nDataSize != message.header.nDataSize){
+            printf("The framing lost the message\n");
+            exit(1);
+        }
+    }, nWireSize);
+    print_result(frame.headers.size() > 1 ? "framing_chunked" : "framing", nPose, nAction, result);
+}
+
+// Data_Repos under contention: nProducer threads acquire data from the pool and push them to the send queue, while
+// a consumer pops them. The time per frame is the wall time over all the frames. The producers are not throttled,
+// so the queue backs up beyond what the pool keeps and the allocations of the extra data show up.
+struct Bench_Item{
+    uint64_t value;
+};
+
+static void bench_repos(unsigned nProducer)
+{
+    const unsigned nPerProducer = 100000;
+    Data_Repos<Bench_Item, Bench_Item> repos;
+
+    auto run = [&](){
+        std::atomic<unsigned> nReady(0);
+        std::atomic_bool bGo(false);
+        std::vector<std::thread> producers;
+        for(unsigned p = 0; p < nProducer; p ++){
+            producers.emplace_back([&, p](){
+                nReady ++;
+                while(!bGo) std::this_thread::yield();
+                for(unsigned i = 0; i < nPerProducer; i ++){
+                    std::shared_ptr<Bench_Item> item = repos.AcquireData_SendQueue();
+                    item->value = p;
+                    repos.PushData_SendQueue(item);
+                }
+            });
+        }
+        while(nReady < nProducer) std::this_thread::yield();
+
+        uint64_t nAllocation = g_nAllocation.load();
+        uint64_t t0 = now_ns();
+        bGo = true;
+        for(unsigned n = 0; n < nProducer * nPerProducer; ){
+            if(repos.PopData_SendQueue()) n ++;
+            else std::this_thread::yield();
+        }
+        uint64_t t = now_ns() - t0;
+        nAllocation = g_nAllocation.load() - nAllocation;
+
+        for(auto &producer : producers) producer.join();
+        return std::make_pair((double)t / (nProducer * nPerProducer), (double)nAllocation / (nProducer * nPerProducer));
+    };
+
+    run(); // warm up the pool
+
+    std::vector<double> samples;
+    double allocPerFrame = 0;
+    for(unsigned s = 0; s < std::max(3u, g_options.nSample / 2); s ++){
+        auto sample = run();
+        samples.push_back(sample.first);
+        allocPerFrame += sample.second;
+    }
+    std::sort(samples.begin(), samples.end());
+
+    Case_Result result;
+    summarize(samples, result);
+    result.allocPerFrame = allocPerFrame / samples.size();
+
+    std::string name = "repos_" + std::to_string(nProducer) + "_producer";
+    print_result(name.c_str(), 0, 0, result);
+}
+
+int main(int argc, char *argv[])
+{
+    for(int i = 1; i < argc; i ++){
+        if(strcmp(argv[i], "--csv") == 0) g_options.bCsv = true;
+        else if(strcmp(argv[i], "--samples") == 0 && i + 1 < argc) g_options.nSample = std::max(1, atoi(argv[++i]));
+        else if(strcmp(argv[i], "--ms") == 0 && i + 1 < argc) g_options.nSampleMs = std::max(1, atoi(argv[++i]));
+        else g_options.filter = argv[i];
+    }
+    setbuf(stdout, NULL);
+    std::cout.setstate(std::ios::failbit); // mute the messages of the callbacks
+    mocap_codec_set_keyframe_interval(N_COMPACT_KEYFRAME_INTERVAL);
+
+    const unsigned poseCounts[] = {1, 5, 10, 25, 50, 100};
+    const unsigned actionCounts[] = {1, 10, 100};
+
+    print_header();
+
+    for(unsigned nPose : poseCounts){
+        for(unsigned nAction : {0u, nPose}){
+            if(selected("server_send"))
+                bench_server_send("server_send", sendmsg_callback_mocap_server, N_FRAME_VARIANT, nPose, nAction);
+            if(selected("client_recv_actionRecog"))
+                bench_client_recv("client_recv_actionRecog", sendmsg_callback_mocap_server, recvmsg_callback_mocap_client_actionRecog,
+                                  N_FRAME_VARIANT, nPose, nAction);
+            if(selected("client_recv_contentRender"))
+                bench_client_recv("client_recv_contentRender", sendmsg_callback_mocap_server, recvmsg_callback_mocap_client_contentRender,
+                                  N_FRAME_VARIANT, nPose, nAction);
+            if(selected("server_send_compact"))
+                bench_server_send("server_send_compact", sendmsg_callback_mocap_server_compact, N_COMPACT_STREAM, nPose, nAction);
+            if(selected("client_recv_compact"))
+                bench_client_recv("client_recv_compact", sendmsg_callback_mocap_server_compact, recvmsg_callback_mocap_client_contentRender_compact,
+                                  N_COMPACT_STREAM, nPose, nAction);
+            if(selected("project")) bench_project(nPose, nAction);
+            if(selected("framing")) bench_framing(nPose, nAction);
+        }
+    }
+
+    for(unsigned nAction : actionCounts) bench_actions(nAction);
+
+    if(selected("repos")){
+        for(unsigned nProducer : {1u, 2u, 4u}) bench_repos(nProducer);
+    }
+
+    return 0;
+}
@@ -0,0 +1,21 @@
+QT -= gui
+
+CONFIG += c++11 console
+CONFIG -= app_bundle
+
+TARGET = bench_suite
+INCLUDEPATH += ..
+
+SOURCES += \
+        bench_suite.cpp \
+        ../MoCap_Data.cpp
+
+unix: LIBS += -lpthread
+
+HEADERS += \
+    ../LatencyTrace.h \
+    ../MoCap_Codec.h \
+    ../MoCap_Data.h \
+    ../NetOp.h \
+    ../Skeleton.h \
+    ../Subscription.h
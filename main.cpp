@@ -4,16 +4,29 @@
 #include "TCPServer.h"
 #include "TCPClient.h"
 #include "MoCap_Data.h"
+#include "MoCapTake.h"
+#include "ActionJoin.h"
 
 //// Here is where the server works
 void Server_Work(mocap_netop::CMoCapTCPServer<Data_MoCap_Send,Data_MoCap_Recv> &server)
 {
-    while(true){
     // Simulate the running of the server
-    // We read 100 frames of poses (each frame has several poses) from a file and send them one by one to the clients
-    FILE *fp = fopen("skeletons.txt", "r");
+    // We play the frames of poses (each frame has several poses) of a recorded take and send them one by one to the clients.
+    // The take is converted from the text file once, so no parsing is done while streaming.
+    MoCap_Take_Reader take;
+    if(!take.Open("skeletons.take")){
+        if(mocap_take_convert_text("skeletons.txt", "skeletons.take") < 0 || !take.Open("skeletons.take")){
+            std::cout << "No take to play!\n";
+            return;
+        }
+    }
     
-    for(unsigned i = 0; i < 100; i ++){ // for each frame
+    // The latest action of each pose sent back by the clients, joined into the frames by pose ID
+    Action_Join_Table actionTable(std::chrono::milliseconds(500));
+    uint64_t nFrame = 0; // the timestamp of the frames goes on as the take is played again, so the actions stay in order
+    
+    while(true){
+    for(unsigned i = 0; i < take.GetFrameCount(); i ++){ // for each frame
         Sleep(20);
         std::cout<<"i:"<<i<<"\n";
 
@@ -22,53 +35,21 @@ void Server_Work(mocap_netop::CMoCapTCPServer<Data_MoCap_Send,Data_MoCap_Recv> &
             break;
         }
         
-        std::shared_ptr<Data_MoCap_Send> dataEntity = std::make_shared< Data_MoCap_Send >(); // memory for the data to be sent
+        std::shared_ptr<Data_MoCap_Send> dataEntity = server.GetSeverDataRepos().AcquireData_SendQueue(); // memory for the data to be sent, recycled
         
-        // To fill the data
+        // To fill the data: the poses are copied straight from the mapped take
         Data_MoCap_Send &dataFrame = *dataEntity;
-        unsigned nPose, nJoint;
-        char line[128];
-        
-        dataFrame.timestamp = i;
-        
-        // number of poses and joints
-        fscanf(fp, "%d%d", &nPose, &nJoint);
-        fgets(line, 128, fp); // eat out the line
-        
-        // each pose
-        dataFrame.poses.resize(nPose);
-        for(unsigned j = 0; j < nPose; j ++){
-            Data_MoCap_Send::Pose &pose = dataFrame.poses[j];
-            pose.ID = j+1; //fixed value for easy testing
-            for(unsigned k = 0; k < JOINT_NUMBER; k ++){
-                Data_MoCap_Send::Joint &joint = pose.joints[k];
-                fscanf(fp, "%f%f%f", &joint.x, &joint.y, &joint.z);
-            }
-            
-            // eat out the line: one pose one line
-            fgets(line, 128, fp);
-        }
+        take.CopyFrame(i, dataFrame);
+        dataFrame.timestamp = nFrame ++;
 
-        //get the action data from the RecvQueue and merge into the dataFrame
-        std::shared_ptr<Data_MoCap_Recv> dataEntityRecv = server.GetSeverDataRepos().PopData_RecvQueue();
-        Data_MoCap_Recv &dataFrameRecv = *dataEntityRecv;
-        if(dataEntityRecv==nullptr){
-            dataFrame.actions.resize(0);
-        }
-        else{
-            dataFrame.actions.resize(dataFrameRecv.actions.size());
-            for(unsigned j=0; j<dataFrameRecv.actions.size(); j++){
-                dataFrame.actions[j].poseID = dataFrameRecv.actions[j].poseID;
-                dataFrame.actions[j].action = dataFrameRecv.actions[j].action;
-            }
-        }
+        // take all the action data from the RecvQueue, and merge the latest action of each pose into the dataFrame
+        actionTable.Absorb(server.GetSeverDataRepos());
+        actionTable.Join(dataFrame);
         
         // Push the frame into the server's repo and
         // it will be automatically sent by the server to all the clients
         server.GetSeverDataRepos().PushData_SendQueue( dataEntity );
     }
-    
-    fclose(fp);
     }
 }
 
@@ -84,8 +65,8 @@ void Client_Work(mocap_netop::CMoCapTCPClient<Data_MoCap_Recv, Data_MoCap_Send>
     int nIterate = 0;
     
     while(client.IsWorking()){
-        // Obtain a pose from its recv repo
-        auto dataFrame = client.GetClientDataRepos().PopData_RecvQueue();
+        // Obtain a pose from its recv repo: sleep until one arrives
+        auto dataFrame = client.GetClientDataRepos().PopData_RecvQueue(std::chrono::milliseconds(100));
     
         if(dataFrame){
             nRecvPose ++;
@@ -114,10 +95,13 @@ void Client_Work(mocap_netop::CMoCapTCPClient<Data_MoCap_Recv, Data_MoCap_Send>
             
             if(nIterate%2==0){
                 // Send an action to server
-                std::shared_ptr<Data_MoCap_Recv> dataEntity = std::make_shared< Data_MoCap_Recv >(); // memory for the data to be sent
+                std::shared_ptr<Data_MoCap_Recv> dataEntity = client.GetClientDataRepos().AcquireData_SendQueue(); // memory for the data to be sent, recycled
                         
+                dataEntity->timestamp = dataFrame->timestamp; // the frame the actions are recognized from
+                
                 // To fill the data
                 Data_MoCap_Recv &dataFrame = *dataEntity;
+                dataFrame.actions.clear(); // it may keep the actions of its last use
                 Data_MoCap_Recv::PoseAction poseAction;
                 poseAction.poseID = 1;
                 poseAction.action = rand()%100;
@@ -171,6 +155,8 @@ int main(int argc, char *argv[])
 //    maxPacketSize = nPoseSize * nMaxPose;
     
 //    // Simulation of server
+    // The recorder of the stream is declared before the server, so it outlives the server that writes to it
+    mocap_netop::Stream_Recorder recorder;
     mocap_netop::CMoCapTCPServer<Data_MoCap_Send, Data_MoCap_Recv> server("127.0.0.1:5003", 10000, 5); // max 5 client connections
     auto waitfor = std::chrono::milliseconds(2000) + std::chrono::high_resolution_clock::now(); // wait for 20s
     std::cout << "waiting to start the server.....\n";
@@ -182,6 +168,11 @@ int main(int argc, char *argv[])
         }
 //        sleep(2);
     }
+    // Record the stream if a log is given, e.g. "records/session1", to be replayed by tools/stream_replay
+    if(argc > 1 && recorder.Start(argv[1])){
+        server.SetRecorder(&recorder);
+    }
+    
     // Simulation of client
     mocap_netop::CMoCapTCPClient<Data_MoCap_Recv, Data_MoCap_Send> client("127.0.0.1:5003", 10000);
     client.Connect(sendmsg_callback_mocap_client_actionRecog, recvmsg_callback_mocap_client_actionRecog);
@@ -204,6 +195,10 @@ int main(int argc, char *argv[])
 
     client.Disconnect();
     
+    // Detach the recorder before it is destroyed, and close the log
+    server.SetRecorder(0);
+    recorder.Stop();
+    
     std::cout << "Finish......!\n";
     
     return 0;
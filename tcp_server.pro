@@ -15,10 +15,16 @@ DEFINES += QT_DEPRECATED_WARNINGS
 #DEFINES += QT_DISABLE_DEPRECATED_BEFORE=0x060000    # disables all the APIs deprecated before Qt 6.0.0
 
 SOURCES += \
+        ActionJoin.cpp \
+        MoCapTake.cpp \
         MoCap_Data.cpp \
+        PoseBatch.cpp \
+        StreamRecorder.cpp \
         main.cpp
 
-LIBS += -lws2_32
+win32: LIBS += -lws2_32
+unix: LIBS += -lpthread
+linux: LIBS += -lrt # shm_open with an older glibc
 
 # Default rules for deployment.
 qnx: target.path = /tmp/$${TARGET}/bin
@@ -26,7 +32,23 @@ else: unix:!android: target.path = /opt/$${TARGET}/bin
 !isEmpty(target.path): INSTALLS += target
 
 HEADERS += \
+    ActionJoin.h \
+    AsyncExecutor.h \
+    ClockSync.h \
+    ConnectionTable.h \
+    DecodePipeline.h \
+    LatencyTrace.h \
+    LockFreeRepos.h \
+    MoCapTake.h \
+    MoCap_Codec.h \
     MoCap_Data.h \
+    MulticastChannel.h \
     NetOp.h \
+    NetPlatform.h \
+    PoseBatch.h \
+    ShmChannel.h \
+    Skeleton.h \
+    StreamRecorder.h \
+    Subscription.h \
     TCPClient.h \
     TCPServer.h
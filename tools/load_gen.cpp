@@ -0,0 +1,346 @@
+// Load generator and soak test of a server with many clients, all on the loopback.
+// A producer streams synthetic skeletons (persons walking around) at a frame rate with a random jitter, and the
+// actions sent back by the clients are joined into the next frames by pose ID as Server_Work does (Action_Join_Table). The clients are of three kinds:
+//   - render : take the frames with poses and actions (recvmsg_callback_mocap_client_contentRender)
+//   - action : take the poses and send back an action for each of them (the actionRecog callbacks)
+//   - slow   : render clients which spend --slow-ms on each frame, so they cannot keep up with a fast stream
+// Each frame carries the monotonic time it is pushed into the server as its timestamp, so a client finds how late it is
+// (end-to-end: through the server, the sockets and its repos up to its consumer), and whether it comes out of order.
+// At the end it reports for each kind the frames delivered, dropped, reordered and left in the repos, and the latency
+// percentiles; and for the server the frames dropped by its outbound queues, the actions received, and how old the
+// actions joined into the frames are (from the frame they are recognized from).
+//
+// Usage: load_gen [options]
+//   --render N         render clients (16)          --action N       action clients (4)
+//   --slow N           slow clients (0)             --slow-ms MS     time a slow client spends on a frame (50)
+//   --persons N        persons per frame (8)        --fps N          frames per second (60)
+//   --jitter MS        jitter of a frame time (0)   --seconds N      time to run (10)
+//   --reactor          reactor mode of the server   --queue N        outbound queue of a client (8)
+//   --policy P         overflow policy: oldest, latest or disconnect
+//   --address A        server address (127.0.0.1:5013)
+//   --seed N           seed of the jitter (1)       --trace          report the latency of the stages as well
+//   --heartbeat MS     heartbeats of the server and the clients every MS, and an idle timeout of 4 of them (off)
+//   --min-delivery P   exit with 2 if the render or action clients get less than P percent of the frames
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <memory>
+#include <atomic>
+#include <thread>
+#include <random>
+#include <chrono>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "TCPServer.h"
+#include "TCPClient.h"
+#include "MoCap_Data.h"
+#include "ActionJoin.h"
+
+using namespace mocap_netop;
+
+typedef CMoCapTCPServer<Data_MoCap_Send, Data_MoCap_Recv> Server;
+typedef CMoCapTCPClient<Data_MoCap_Recv, Data_MoCap_Send> Client;
+
+struct Load_Options{
+    unsigned nRender = 16, nAction = 4, nSlow = 0, nSlowMs = 50;
+    unsigned nPerson = 8;
+    double fps = 60, jitterMs = 0;
+    unsigned nSecond = 10;
+    bool bReactor = false;
+    unsigned nQueue = 8;
+    Overflow_Policy policy = Overflow_Policy::DropOldest;
+    std::string address = "127.0.0.1:5013";
+    unsigned nSeed = 1;
+    bool bTrace = false;
+    double minDelivery = 0;
+    unsigned nHeartbeatMs = 0;
+};
+
+enum Client_Kind { KIND_RENDER, KIND_ACTION, KIND_SLOW, N_KIND };
+static const char *g_kindNames[N_KIND] = {"render", "action", "slow"};
+
+// Counters of all the clients of a kind
+struct Kind_Stats{
+    unsigned nClient = 0;
+    std::atomic<uint64_t> nDelivered{0}, nReordered{0}, nBacklog{0};
+    Latency_Histogram latency;
+};
+
+// A simulated client and the thread consuming its repos
+struct Load_Client{
+    Client_Kind kind;
+    std::unique_ptr<Client> client;
+    std::thread consumer;
+    std::atomic<uint64_t> nDelivered{0}; // read by the producer for the progress
+};
+
+static bool parse_options(int argc, char *argv[], Load_Options &options)
+{
+    for(int i = 1; i < argc; i ++){
+        std::string name = argv[i];
+        if(name == "--reactor") { options.bReactor = true; continue; }
+        if(name == "--trace") { options.bTrace = true; continue; }
+        if(i + 1 >= argc) return false;
+
+        const char *value = argv[++i];
+        if(name == "--render") options.nRender = atoi(value);
+        else if(name == "--action") options.nAction = atoi(value);
+        else if(name == "--slow") options.nSlow = atoi(value);
+        else if(name == "--slow-ms") options.nSlowMs = atoi(value);
+        else if(name == "--persons") options.nPerson = atoi(value);
+        else if(name == "--fps") options.fps = atof(value);
+        else if(name == "--jitter") options.jitterMs = atof(value);
+        else if(name == "--seconds") options.nSecond = atoi(value);
+        else if(name == "--queue") options.nQueue = atoi(value);
+        else if(name == "--address") options.address = value;
+        else if(name == "--seed") options.nSeed = atoi(value);
+        else if(name == "--min-delivery") options.minDelivery = atof(value);
+        else if(name == "--heartbeat") options.nHeartbeatMs = atoi(value);
+        else if(name == "--policy"){
+            if(strcmp(value, "oldest") == 0) options.policy = Overflow_Policy::DropOldest;
+            else if(strcmp(value, "latest") == 0) options.policy = Overflow_Policy::KeepLatest;
+            else if(strcmp(value, "disconnect") == 0) options.policy = Overflow_Policy::Disconnect;
+            else return false;
+        }
+        else return false;
+    }
+    return options.fps > 0 && options.nRender + options.nAction + options.nSlow > 0;
+}
+
+// Offsets of the joints from the root of a standing person, in metres (the order of Human3.6M)
+static const float g_skeleton[JOINT_NUMBER][3] = {
+    {0, 0.95f, 0}, {-0.12f, 0.95f, 0}, {-0.12f, 0.5f, 0}, {-0.12f, 0.08f, 0}, {0.12f, 0.95f, 0}, {0.12f, 0.5f, 0},
+    {0.12f, 0.08f, 0}, {0, 1.2f, 0}, {0, 1.45f, 0}, {0, 1.55f, 0.02f}, {0, 1.7f, 0}, {0.18f, 1.42f, 0},
+    {0.2f, 1.15f, 0}, {0.22f, 0.9f, 0}, {-0.18f, 1.42f, 0}, {-0.2f, 1.15f, 0}, {-0.22f, 0.9f, 0}
+};
+
+// Frame i of persons walking on circles, with their legs and arms swinging
+static void fill_frame(Data_MoCap_Send &frame, uint64_t i, unsigned nPerson, double fps)
+{
+    double t = i / fps;
+    frame.poses.resize(nPerson);
+    for(unsigned j = 0; j < nPerson; j ++){
+        Data_MoCap_Send::Pose &pose = frame.poses[j];
+        pose.ID = j + 1;
+
+        double radius = 1 + 0.5 * (j % 7), angle = t * 0.5 / radius + j * 2.399; // 0.5 m/s
+        float x = (float)(radius * cos(angle)), z = (float)(radius * sin(angle));
+        float swing = (float)(0.15 * sin(t * 6 + j));
+        for(unsigned k = 0; k < JOINT_NUMBER; k ++){
+            bool bLeft = (k >= 4 && k <= 6) || k >= 14, bLimb = (k >= 2 && k <= 6 && k != 4) || k == 12 || k == 13 || k == 15 || k == 16;
+            float dz = bLimb ? (bLeft ? swing : -swing) : 0;
+            pose.joints[k].x = x + g_skeleton[k][0];
+            pose.joints[k].y = g_skeleton[k][1];
+            pose.joints[k].z = z + g_skeleton[k][2] + dz;
+        }
+    }
+}
+
+// Take the frames out of the repos of a client as fast as it can, or slowly
+static void consume(Load_Client &loadClient, Kind_Stats &stats, unsigned nSlowMs, std::atomic_bool &bRun)
+{
+    auto &repos = loadClient.client->GetClientDataRepos();
+    uint64_t lastTimestamp = 0;
+
+    while(bRun){
+        std::shared_ptr<Data_MoCap_Send> frame = repos.PopData_RecvQueue(std::chrono::milliseconds(10));
+        if(!frame) continue;
+
+        uint64_t now = latency_now_ns();
+        stats.latency.Record(now > frame->timestamp ? now - frame->timestamp : 0);
+        if(frame->timestamp < lastTimestamp) stats.nReordered ++;
+        lastTimestamp = std::max(lastTimestamp, frame->timestamp);
+        loadClient.nDelivered ++;
+
+        if(loadClient.kind == KIND_ACTION){
+            // recognize an action of each person
+            std::shared_ptr<Data_MoCap_Recv> result = repos.AcquireData_SendQueue();
+            result->timestamp = frame->timestamp;
+            result->actions.resize(frame->poses.size());
+            for(size_t j = 0; j < frame->poses.size(); j ++){
+                result->actions[j].poseID = frame->poses[j].ID;
+                result->actions[j].action = (int)((loadClient.nDelivered.load() / 30 + j) % 8);
+            }
+            repos.PushData_SendQueue(result);
+        }
+        else if(loadClient.kind == KIND_SLOW){
+            std::this_thread::sleep_for(std::chrono::milliseconds(nSlowMs));
+        }
+    }
+
+    std::vector< std::shared_ptr<Data_MoCap_Send> > rest;
+    stats.nBacklog += repos.PopAllData_RecvQueue(rest);
+    stats.nDelivered += loadClient.nDelivered;
+}
+
+static void print_latency(const char *name, const Latency_Histogram &histogram)
+{
+    Latency_Summary summary = histogram.GetSummary();
+    printf("  %-8s latency (ms): p50 %8.2f  p99 %8.2f  p99.9 %8.2f  max %8.2f\n", name, summary.nP50 / 1e6,
+           summary.nP99 / 1e6, summary.nP999 / 1e6, summary.nMax / 1e6);
+}
+
+int main(int argc, char *argv[])
+{
+    Load_Options options;
+    if(!parse_options(argc, argv, options)){
+        std::cout << "Usage: load_gen [--render N] [--action N] [--slow N] [--slow-ms MS] [--persons N] [--fps N] [--jitter MS]"
+                     " [--seconds N] [--reactor] [--queue N] [--policy oldest|latest|disconnect] [--address A] [--seed N]"
+                     " [--trace] [--min-delivery PERCENT] [--heartbeat MS]\n";
+        return 1;
+    }
+    setbuf(stdout, NULL);
+
+    unsigned nClient = options.nRender + options.nAction + options.nSlow;
+
+    Server server(options.address, 65536, nClient + 1);
+    if(options.bReactor && !server.SetIOMode(ServerIOMode::Reactor)){
+        std::cout << "The reactor mode is not available here\n";
+        return 1;
+    }
+    server.SetOverflowPolicy(options.policy, options.nQueue);
+    server.EnableLatencyTracing(options.bTrace);
+    const std::chrono::milliseconds heartbeat(options.nHeartbeatMs);
+    server.SetHeartbeat(heartbeat, 4 * heartbeat);
+    if(!server.Start(sendmsg_callback_mocap_server, recvmsg_callback_mocap_server)){
+        std::cout << "Cannot start the server on " << options.address << "\n";
+        return 1;
+    }
+    Sleep(100);
+
+    // 1. the clients
+    Kind_Stats stats[N_KIND];
+    std::vector< std::unique_ptr<Load_Client> > clients;
+    for(unsigned i = 0; i < nClient; i ++){
+        std::unique_ptr<Load_Client> loadClient(new Load_Client);
+        loadClient->kind = i < options.nRender ? KIND_RENDER : i < options.nRender + options.nAction ? KIND_ACTION : KIND_SLOW;
+        loadClient->client.reset(new Client(options.address, 65536));
+        loadClient->client->EnableLatencyTracing(options.bTrace);
+        loadClient->client->SetHeartbeat(heartbeat, 4 * heartbeat);
+
+        bool bConnected = loadClient->kind == KIND_ACTION
+                ? loadClient->client->Connect(sendmsg_callback_mocap_client_actionRecog, recvmsg_callback_mocap_client_actionRecog)
+                : loadClient->client->Connect(0, recvmsg_callback_mocap_client_contentRender);
+        if(!bConnected){
+            std::cout << "Cannot connect the client " << i << " to " << options.address << "\n";
+            return 1;
+        }
+
+        stats[loadClient->kind].nClient ++;
+        clients.push_back(std::move(loadClient));
+    }
+    Sleep(200); // let the server take all of them
+
+    std::atomic_bool bRun(true);
+    for(auto &loadClient : clients)
+        loadClient->consumer = std::thread(consume, std::ref(*loadClient), std::ref(stats[loadClient->kind]), options.nSlowMs, std::ref(bRun));
+
+    // 2. the producer: frames at the rate, each pushed at its time give or take the jitter
+    printf("%u render, %u action and %u slow clients; %u persons per frame at %.0f fps (jitter %.1f ms) for %u s, %s mode\n",
+           options.nRender, options.nAction, options.nSlow, options.nPerson, options.fps, options.jitterMs, options.nSecond,
+           options.bReactor ? "reactor" : "thread-per-client");
+
+    std::mt19937 random(options.nSeed);
+    std::uniform_real_distribution<double> jitter(-options.jitterMs, options.jitterMs);
+    auto &reposServer = server.GetSeverDataRepos();
+    const uint64_t nFrame = (uint64_t)(options.fps * options.nSecond);
+    const double periodNs = 1e9 / options.fps;
+
+    uint64_t nSent = 0, nActionReceived = 0, nLate = 0;
+    const uint64_t tStart = latency_now_ns();
+    uint64_t tReport = tStart + 1000000000ull;
+    Action_Join_Table actionTable;
+    Latency_Histogram actionAge; // from the frame an action is recognized from to the frame it is joined into
+
+    for(uint64_t i = 0; i < nFrame && server.IsWorking(); i ++){
+        double tFrame = tStart + i * periodNs + jitter(random) * 1e6;
+        uint64_t now = latency_now_ns();
+        if(tFrame > now) std::this_thread::sleep_for(std::chrono::nanoseconds((uint64_t)tFrame - now));
+        else if(now - tFrame > periodNs) nLate ++; // the producer itself is behind
+
+        std::shared_ptr<Data_MoCap_Send> frame = reposServer.AcquireData_SendQueue();
+        fill_frame(*frame, i, options.nPerson, options.fps);
+
+        // the latest action of each person, from those that came back so far
+        nActionReceived += actionTable.Absorb(reposServer);
+        actionTable.Join(*frame);
+
+        frame->timestamp = latency_now_ns();
+        for(const auto &poseAction : frame->actions){
+            int action;
+            uint64_t tSource;
+            if(actionTable.Find(poseAction.poseID, action, &tSource) && frame->timestamp > tSource)
+                actionAge.Record(frame->timestamp - tSource);
+        }
+        reposServer.PushData_SendQueue(frame);
+        nSent ++;
+
+        if(frame->timestamp >= tReport){
+            uint64_t nDelivered = 0;
+            for(auto &loadClient : clients) nDelivered += loadClient->nDelivered;
+            printf("  %3llu s: %llu frames sent, %llu delivered to the clients\n", (unsigned long long)((frame->timestamp - tStart) / 1000000000ull),
+                   (unsigned long long)nSent, (unsigned long long)nDelivered);
+            tReport += 1000000000ull;
+        }
+    }
+    double seconds = (latency_now_ns() - tStart) / 1e9;
+
+    // 3. let the frames on the way arrive, then stop the consumers
+    Sleep(500);
+    std::vector<Client_SendStats> sendStats = server.GetClientSendStats();
+    bRun = false;
+    for(auto &loadClient : clients) loadClient->consumer.join();
+
+    uint64_t nServerDropped = 0;
+    for(const auto &item : sendStats) nServerDropped += item.nDroppedMessage;
+
+    // 4. report
+    printf("\nproducer: %llu frames in %.2f s (%.1f fps), %llu behind their time; server: %u clients connected, %llu frames "
+           "dropped by the outbound queues, %llu action results received\n", (unsigned long long)nSent, seconds, nSent / seconds,
+           (unsigned long long)nLate, (unsigned)sendStats.size(), (unsigned long long)nServerDropped, (unsigned long long)nActionReceived);
+    printf("%-8s %7s %12s %10s %9s %9s %9s %9s\n", "clients", "number", "delivered", "rate", "dropped", "reordered", "backlog", "fps/client");
+
+    bool bPass = true;
+    for(int k = 0; k < N_KIND; k ++){
+        const Kind_Stats &kindStats = stats[k];
+        if(kindStats.nClient == 0) continue;
+
+        uint64_t nExpected = nSent * kindStats.nClient;
+        uint64_t nArrived = kindStats.nDelivered + kindStats.nBacklog;
+        uint64_t nDropped = nExpected > nArrived ? nExpected - nArrived : 0;
+        double rate = nExpected ? 100.0 * kindStats.nDelivered / nExpected : 0;
+
+        printf("%-8s %7u %12llu %9.2f%% %9llu %9llu %9llu %9.1f\n", g_kindNames[k], kindStats.nClient,
+               (unsigned long long)kindStats.nDelivered, rate, (unsigned long long)nDropped, (unsigned long long)kindStats.nReordered,
+               (unsigned long long)kindStats.nBacklog, kindStats.nDelivered / seconds / kindStats.nClient);
+
+        if(k != KIND_SLOW && rate < options.minDelivery) bPass = false;
+    }
+    for(int k = 0; k < N_KIND; k ++)
+        if(stats[k].nClient > 0) print_latency(g_kindNames[k], stats[k].latency);
+    if(nActionReceived > 0){
+        Latency_Summary summary = actionAge.GetSummary();
+        printf("  actions joined: %llu, age (ms): p50 %8.2f  p99 %8.2f  max %8.2f; %llu older than those kept\n", (unsigned long long)summary.nCount,
+               summary.nP50 / 1e6, summary.nP99 / 1e6, summary.nMax / 1e6, (unsigned long long)actionTable.GetStaleCount());
+    }
+
+    if(options.bTrace){
+        printf("\nserver stages:\n%s", server.GetLatencyTracer().Report().c_str());
+        printf("first client stages:\n%s", clients.front()->client->GetLatencyTracer().Report().c_str());
+    }
+
+    std::cout.setstate(std::ios::failbit); // mute the messages on stopping
+    for(auto &loadClient : clients) loadClient->client->Disconnect();
+    server.Stop();
+    std::cout.clear();
+
+    if(!bPass){
+        printf("The delivery is below %.1f%%\n", options.minDelivery);
+        return 2;
+    }
+    return 0;
+}
@@ -0,0 +1,52 @@
+// Replay a log recorded from a server (see Stream_Recorder) to the clients of a new server.
+//
+// Usage: stream_replay <log base path> [speed: 1 real time, N times, 0 max] [start in ms] [address, 127.0.0.1:5003 by default]
+
+#include <iostream>
+#include <stdlib.h>
+
+#include "TCPServer.h"
+#include "MoCap_Data.h"
+#include "StreamRecorder.h"
+
+int main(int argc, char *argv[])
+{
+    if(argc < 2){
+        std::cout << "Usage: stream_replay <log base path> [speed] [start in ms] [address]\n";
+        return 1;
+    }
+
+    double speed = argc > 2 ? atof(argv[2]) : 1;
+    uint64_t startMs = argc > 3 ? atoll(argv[3]) : 0;
+    std::string address = argc > 4 ? argv[4] : "127.0.0.1:5003";
+
+    mocap_netop::CMoCapTCPServer<Data_MoCap_Send, Data_MoCap_Recv> server(address, 10000, 5);
+    if(!server.Start(sendmsg_callback_mocap_server, recvmsg_callback_mocap_server)){
+        std::cout << "Fail to open the server!\n";
+        return 1;
+    }
+
+    // the frames are decoded as a client does, and pushed into the server to be sent again
+    mocap_netop::Stream_Replayer<Data_MoCap_Send, Data_MoCap_Recv> replayer(server.GetSeverDataRepos(), recvmsg_callback_mocap_client_contentRender);
+    if(!replayer.Open(argv[1])){
+        std::cout << "Cannot open the log " << argv[1] << "\n";
+        return 1;
+    }
+    replayer.SetSpeed(speed);
+    if(startMs > 0 && !replayer.Seek(startMs)){
+        std::cout << "The log ends before " << startMs << " ms\n";
+        return 1;
+    }
+
+    replayer.Start();
+    while(!replayer.IsFinished() && server.IsWorking())
+        Sleep(100);
+    Sleep(100); // let the last frames go out
+
+    std::cout << "Replayed " << replayer.GetPlayedCount() << " frames\n";
+
+    replayer.Stop();
+    server.Stop();
+
+    return 0;
+}
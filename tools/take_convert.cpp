@@ -0,0 +1,41 @@
+// Convert a text file of poses (such as skeletons.txt) into a binary take file for playback.
+//
+// Usage: take_convert <text file> <take file> [frame interval in ms, 20 by default]
+
+#include <iostream>
+#include <stdlib.h>
+
+#include "MoCapTake.h"
+
+int main(int argc, char *argv[])
+{
+    if(argc < 3){
+        std::cout << "Usage: take_convert <text file> <take file> [frame interval in ms]\n";
+        return 1;
+    }
+
+    unsigned nFrameIntervalMs = argc > 3 ? atoi(argv[3]) : 20;
+
+    long long nFrame = mocap_take_convert_text(argv[1], argv[2], nFrameIntervalMs);
+    if(nFrame < 0){
+        std::cout << "Failed to convert " << argv[1] << "\n";
+        return 1;
+    }
+
+    // read it back to check it
+    MoCap_Take_Reader reader;
+    if(!reader.Open(argv[2]) || reader.GetFrameCount() != (uint64_t)nFrame){
+        std::cout << "Failed to read back " << argv[2] << "\n";
+        return 1;
+    }
+
+    uint64_t nPose = 0;
+    for(uint64_t i = 0; i < reader.GetFrameCount(); i ++){
+        Take_Frame_View view;
+        reader.GetFrame(i, view);
+        nPose += view.nPose;
+    }
+
+    std::cout << "Converted " << nFrame << " frames (" << nPose << " poses) into " << argv[2] << "\n";
+    return 0;
+}
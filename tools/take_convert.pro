@@ -0,0 +1,20 @@
+QT -= gui
+
+CONFIG += c++11 console
+CONFIG -= app_bundle
+
+TARGET = take_convert
+INCLUDEPATH += ..
+
+SOURCES += \
+        take_convert.cpp \
+        ../MoCapTake.cpp
+
+HEADERS += \
+    ../LatencyTrace.h \
+    ../MoCap_Codec.h \
+    ../MoCap_Data.h \
+    ../MoCapTake.h \
+    ../NetOp.h \
+    ../Skeleton.h \
+    ../Subscription.h